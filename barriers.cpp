@@ -0,0 +1,79 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "barriers.h"
+
+#define MAX_BATCH_BARRIERS 32   // more are rare enough to split across calls
+
+static_assert(STATE_COMMON == D3D12_RESOURCE_STATE_COMMON, "");
+static_assert(STATE_PRESENT == D3D12_RESOURCE_STATE_PRESENT, "");
+static_assert(STATE_RENDER_TARGET == D3D12_RESOURCE_STATE_RENDER_TARGET, "");
+static_assert(STATE_UNORDERED_ACCESS == D3D12_RESOURCE_STATE_UNORDERED_ACCESS, "");
+static_assert(STATE_NON_PIXEL_SHADER_RESOURCE == D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, "");
+static_assert(STATE_COPY_DEST == D3D12_RESOURCE_STATE_COPY_DEST, "");
+static_assert(STATE_COPY_SOURCE == D3D12_RESOURCE_STATE_COPY_SOURCE, "");
+static_assert(STATE_READ_MASK == (D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER |
+   D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+   D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+   D3D12_RESOURCE_STATE_COPY_SOURCE | D3D12_RESOURCE_STATE_RESOLVE_SOURCE), "");
+static_assert(STATE_ALL_SUBRESOURCES == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, "");
+static_assert(STATE_BEGIN_ONLY == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY, "");
+static_assert(STATE_END_ONLY == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY, "");
+
+void CmdFlushBarriers(ID3D12GraphicsCommandList *commandList, StateList *list)
+{
+   const StateBarrier *barriers;
+   uint32_t count = StateListFlush(list, &barriers);
+   CmdStateBarriers(commandList, list->tracker, barriers, count);
+}
+
+void CmdStateBarriers(ID3D12GraphicsCommandList *commandList, const StateTracker *tracker,
+   const StateBarrier *barriers, uint32_t count)
+{
+   D3D12_RESOURCE_BARRIER batch[MAX_BATCH_BARRIERS];
+   while (count) {
+      uint32_t batchCount = count < MAX_BATCH_BARRIERS ? count : MAX_BATCH_BARRIERS;
+      for (uint32_t i = 0; i < batchCount; ++i) {
+         const StateBarrier *barrier = &barriers[i];
+         ASSERT(tracker->resources[barrier->resource].user);
+         if (barrier->flags == STATE_ALIASING) {
+            batch[i].Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+            batch[i].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            batch[i].Aliasing.pResourceBefore = barrier->before == STATE_INVALID ? nullptr :
+               (ID3D12Resource *)tracker->resources[barrier->before].user;
+            batch[i].Aliasing.pResourceAfter = (ID3D12Resource *)tracker->resources[barrier->resource].user;
+            continue;
+         }
+         batch[i].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+         batch[i].Flags = (D3D12_RESOURCE_BARRIER_FLAGS)barrier->flags;
+         batch[i].Transition.pResource = (ID3D12Resource *)tracker->resources[barrier->resource].user;
+         batch[i].Transition.Subresource = barrier->subresource;
+         batch[i].Transition.StateBefore = (D3D12_RESOURCE_STATES)barrier->before;
+         batch[i].Transition.StateAfter = (D3D12_RESOURCE_STATES)barrier->after;
+      }
+      commandList->ResourceBarrier(batchCount, batch);
+      barriers += batchCount;
+      count -= batchCount;
+   }
+}
@@ -0,0 +1,38 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "dx12demo.h"
+#include "statetrack.h"
+
+// ResourceBarrier calls for the transitions statetrack.h works out. Tracker
+// ids map to their ID3D12Resource through StateResource::user.
+
+// Issues whatever list has queued since its last flush, in one call.
+void CmdFlushBarriers(ID3D12GraphicsCommandList *commandList, StateList *list);
+
+// Issues barriers, e.g. StateTrackerResolve's fixups, in one call.
+void CmdStateBarriers(ID3D12GraphicsCommandList *commandList, const StateTracker *tracker,
+   const StateBarrier *barriers, uint32_t count);
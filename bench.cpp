@@ -0,0 +1,293 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "bench.h"
+#include "common.h"
+#include "mapfile.h"
+#include "render.h"
+
+#define DEFAULT_INSTANCES        1
+#define DEFAULT_SPINNING_PERCENT 100
+#define DEFAULT_WIDTH            1280
+#define DEFAULT_HEIGHT           720
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define DEFAULT_WARMUP_FRAMES    60
+
+const char *const BENCH_USAGE =
+   "  --instances N          cubes to draw\n"
+   "  --spinning PERCENT     how many of them move; the rest stand still\n"
+   "  --size WxH             render target size\n"
+   "  --frames-in-flight N   1-4\n"
+   "  --vsync on|off\n"
+   "  --cull none|gpu|cpu    how instances are culled and drawn\n"
+   "  --post N               copies through transient targets after the scene, 0-8\n"
+   "  --bindless on|off      one descriptor table indexed by shaders, where the GPU allows\n"
+   "  --warmup N             frames to draw before measuring\n"
+   "  --frames N             frames to measure\n"
+   "  --seconds S            time to measure; with --frames, whichever ends first\n"
+   "  --report path          where to write the results, - for stdout\n"
+   "  --format json|csv\n";
+
+// By FrameCulling.
+static const char *const s_cullingNames[] = {
+   "none",
+   "gpu",
+   "cpu",
+};
+
+static_assert(ARRAY_COUNT(s_cullingNames) == FRAME_CULL_CPU + 1, "s_cullingNames doesn't match FrameCulling");
+
+void BenchConfigInit(BenchConfig *config)
+{
+   config->instances = DEFAULT_INSTANCES;
+   config->spinningPercent = DEFAULT_SPINNING_PERCENT;
+   config->width = DEFAULT_WIDTH;
+   config->height = DEFAULT_HEIGHT;
+   config->framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+   config->vsync = true;
+   config->culling = FRAME_CULL_NONE;
+   config->postPasses = 0;
+   config->bindless = true;
+   config->warmupFrames = DEFAULT_WARMUP_FRAMES;
+   config->frames = 0;
+   config->seconds = 0.0;
+   config->reportPath = nullptr;
+   config->format = BENCH_FORMAT_JSON;
+}
+
+static bool parseU32(const char *value, uint32_t *result)
+{
+   char *end;
+   unsigned long parsed = strtoul(value, &end, 10);
+   if (end == value || *end || parsed > 0xffffffffu) {
+      return false;
+   }
+   *result = (uint32_t)parsed;
+   return true;
+}
+
+int ParseBenchOption(BenchConfig *config, const char *arg, const char *value)
+{
+   bool ok;
+   if (strcmp(arg, "--instances") == 0) {
+      ok = parseU32(value, &config->instances);
+   } else if (strcmp(arg, "--spinning") == 0) {
+      ok = parseU32(value, &config->spinningPercent) && config->spinningPercent <= 100;
+   } else if (strcmp(arg, "--size") == 0) {
+      ok = sscanf(value, "%ux%u", &config->width, &config->height) == 2 && config->width > 0 && config->height > 0;
+   } else if (strcmp(arg, "--frames-in-flight") == 0) {
+      ok = parseU32(value, &config->framesInFlight) &&
+         config->framesInFlight >= 1 && config->framesInFlight <= RENDER_MAX_FRAMES;
+   } else if (strcmp(arg, "--vsync") == 0) {
+      config->vsync = strcmp(value, "on") == 0;
+      ok = config->vsync || strcmp(value, "off") == 0;
+   } else if (strcmp(arg, "--cull") == 0) {
+      ok = false;
+      for (uint32_t i = 0; i < ARRAY_COUNT(s_cullingNames); ++i) {
+         if (strcmp(value, s_cullingNames[i]) == 0) {
+            config->culling = (FrameCulling)i;
+            ok = true;
+         }
+      }
+   } else if (strcmp(arg, "--post") == 0) {
+      ok = parseU32(value, &config->postPasses) && config->postPasses <= RENDER_MAX_TARGETS;
+   } else if (strcmp(arg, "--bindless") == 0) {
+      config->bindless = strcmp(value, "on") == 0;
+      ok = config->bindless || strcmp(value, "off") == 0;
+   } else if (strcmp(arg, "--warmup") == 0) {
+      ok = parseU32(value, &config->warmupFrames);
+   } else if (strcmp(arg, "--frames") == 0) {
+      ok = parseU32(value, &config->frames);
+   } else if (strcmp(arg, "--seconds") == 0) {
+      char *end;
+      config->seconds = strtod(value, &end);
+      ok = end != value && !*end && config->seconds >= 0.0;
+   } else if (strcmp(arg, "--report") == 0) {
+      config->reportPath = value;
+      ok = true;
+   } else if (strcmp(arg, "--format") == 0) {
+      if (strcmp(value, "json") == 0) {
+         config->format = BENCH_FORMAT_JSON;
+         ok = true;
+      } else {
+         config->format = BENCH_FORMAT_CSV;
+         ok = strcmp(value, "csv") == 0;
+      }
+   } else {
+      return 0;
+   }
+   return ok ? 1 : -1;
+}
+
+void BenchRunInit(BenchRun *run, const BenchConfig *config)
+{
+   run->config = config;
+   run->warmupLeft = config->warmupFrames;
+   run->frameTimes.clear();
+   run->frameTimes.reserve(config->frames ? config->frames : 4096);
+   memset(&run->stageTotals, 0, sizeof(run->stageTotals));
+   run->instances = 0;
+   run->measuredSeconds = 0.0;
+}
+
+bool BenchRunAddFrame(BenchRun *run, double frameSeconds, const FrameStats *stats)
+{
+   if (run->warmupLeft > 0) {
+      --run->warmupLeft;
+      return true;
+   }
+
+   run->frameTimes.push_back(frameSeconds);
+   run->measuredSeconds += frameSeconds;
+   run->stageTotals.wait += stats->wait;
+   run->stageTotals.prepare += stats->prepare;
+   run->stageTotals.record += stats->record;
+   run->stageTotals.submit += stats->submit;
+   run->stageTotals.present += stats->present;
+   run->instances += stats->instances;
+
+   const BenchConfig *config = run->config;
+   if (config->frames > 0 && run->frameTimes.size() >= config->frames) {
+      return false;
+   }
+   return !(config->seconds > 0.0 && run->measuredSeconds >= config->seconds);
+}
+
+double BenchPercentile(std::vector<double> *samples, double percentile)
+{
+   if (samples->empty()) {
+      return 0.0;
+   }
+
+   std::sort(samples->begin(), samples->end());
+   size_t count = samples->size();
+   // The epsilon keeps e.g. 99.9% of 1000 from rounding up past 999.
+   size_t rank = (size_t)ceil(percentile / 100.0 * count - 1e-9);
+   return (*samples)[rank > 0 ? (rank <= count ? rank - 1 : count - 1) : 0];
+}
+
+void BenchSummarize(const BenchRun *run, BenchSummary *summary)
+{
+   memset(summary, 0, sizeof(*summary));
+
+   uint32_t frames = (uint32_t)run->frameTimes.size();
+   summary->frames = frames;
+   summary->seconds = run->measuredSeconds;
+   if (frames == 0) {
+      return;
+   }
+
+   std::vector<double> sorted = run->frameTimes;
+   summary->p50 = BenchPercentile(&sorted, 50.0) * 1000.0;
+   summary->p95 = BenchPercentile(&sorted, 95.0) * 1000.0;
+   summary->p99 = BenchPercentile(&sorted, 99.0) * 1000.0;
+   summary->p999 = BenchPercentile(&sorted, 99.9) * 1000.0;
+   summary->min = sorted.front() * 1000.0;
+   summary->max = sorted.back() * 1000.0;
+   summary->mean = run->measuredSeconds * 1000.0 / frames;
+
+   if (run->measuredSeconds > 0.0) {
+      summary->framesPerSecond = frames / run->measuredSeconds;
+      summary->instancesPerSecond = run->instances / run->measuredSeconds;
+   }
+
+   double scale = 1000.0 / frames;
+   summary->stageMeans.wait = run->stageTotals.wait * scale;
+   summary->stageMeans.prepare = run->stageTotals.prepare * scale;
+   summary->stageMeans.record = run->stageTotals.record * scale;
+   summary->stageMeans.submit = run->stageTotals.submit * scale;
+   summary->stageMeans.present = run->stageTotals.present * scale;
+   summary->stageMeans.instances = (uint32_t)(run->instances / frames);
+}
+
+static void appendf(std::string *out, const char *format, ...)
+{
+   char buffer[512];
+   va_list args;
+   va_start(args, format);
+   int length = vsnprintf(buffer, sizeof(buffer), format, args);
+   va_end(args);
+   if (length > 0) {
+      out->append(buffer, length < (int)sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+   }
+}
+
+void FormatBenchReport(std::string *out, BenchFormat format, const BenchConfig *config,
+   const char *backend, const BenchSummary *summary)
+{
+   const FrameStats *stages = &summary->stageMeans;
+
+   // backend is one of ours, so it never needs escaping.
+   out->clear();
+   if (format == BENCH_FORMAT_CSV) {
+      out->append("backend,instances,spinning_percent,width,height,frames_in_flight,vsync,culling,post_passes,bindless,warmup_frames,frames,seconds,"
+         "mean_ms,min_ms,max_ms,p50_ms,p95_ms,p99_ms,p999_ms,fps,instances_per_second,"
+         "wait_ms,prepare_ms,record_ms,submit_ms,present_ms\n");
+      appendf(out, "%s,%u,%u,%u,%u,%u,%d,%s,%u,%d,%u,%u,%.6f,", backend, config->instances, config->spinningPercent,
+         config->width, config->height, config->framesInFlight, config->vsync ? 1 : 0, s_cullingNames[config->culling],
+         config->postPasses, config->bindless ? 1 : 0, config->warmupFrames, summary->frames, summary->seconds);
+      appendf(out, "%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.0f,", summary->mean, summary->min, summary->max,
+         summary->p50, summary->p95, summary->p99, summary->p999, summary->framesPerSecond, summary->instancesPerSecond);
+      appendf(out, "%.6f,%.6f,%.6f,%.6f,%.6f\n", stages->wait, stages->prepare, stages->record, stages->submit, stages->present);
+      return;
+   }
+
+   out->append("{\n");
+   appendf(out, "  \"backend\": \"%s\",\n", backend);
+   appendf(out, "  \"config\": {\"instances\": %u, \"spinningPercent\": %u, \"width\": %u, \"height\": %u, "
+      "\"framesInFlight\": %u, \"vsync\": %s, \"culling\": \"%s\", \"postPasses\": %u, \"bindless\": %s, "
+      "\"warmupFrames\": %u},\n",
+      config->instances, config->spinningPercent, config->width, config->height,
+      config->framesInFlight, config->vsync ? "true" : "false", s_cullingNames[config->culling], config->postPasses,
+      config->bindless ? "true" : "false", config->warmupFrames);
+   appendf(out, "  \"frames\": %u,\n  \"seconds\": %.6f,\n", summary->frames, summary->seconds);
+   appendf(out, "  \"frameTimeMs\": {\"mean\": %.6f, \"min\": %.6f, \"max\": %.6f, "
+      "\"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"p999\": %.6f},\n", summary->mean, summary->min, summary->max,
+      summary->p50, summary->p95, summary->p99, summary->p999);
+   appendf(out, "  \"stageCpuMs\": {\"wait\": %.6f, \"prepare\": %.6f, \"record\": %.6f, \"submit\": %.6f, "
+      "\"present\": %.6f},\n", stages->wait, stages->prepare, stages->record, stages->submit, stages->present);
+   appendf(out, "  \"framesPerSecond\": %.3f,\n  \"instancesPerSecond\": %.0f\n", summary->framesPerSecond,
+      summary->instancesPerSecond);
+   out->append("}\n");
+}
+
+bool WriteBenchReport(const BenchConfig *config, const char *backend, const BenchSummary *summary)
+{
+   std::string report;
+   FormatBenchReport(&report, config->format, config, backend, summary);
+
+   if (!config->reportPath || strcmp(config->reportPath, "-") == 0) {
+      return fwrite(report.data(), 1, report.size(), stdout) == report.size() && fflush(stdout) == 0;
+   }
+   return WriteFileAtomic(config->reportPath, report.data(), report.size());
+}
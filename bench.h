@@ -0,0 +1,113 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "frame.h"
+
+// Repeatable measurements: shared command-line options, per-frame sample
+// collection after a warm-up, and a summary written as JSON or CSV so runs
+// can be compared across builds. Platform independent; both the windowed
+// demo and the headless runner use it.
+
+enum BenchFormat {
+   BENCH_FORMAT_JSON,
+   BENCH_FORMAT_CSV,
+};
+
+struct BenchConfig {
+   uint32_t instances;
+   uint32_t spinningPercent;
+   uint32_t width;
+   uint32_t height;
+   uint32_t framesInFlight;
+   bool vsync;
+   FrameCulling culling;
+   uint32_t postPasses;
+   bool bindless;             // asked for; the D3D12 backend falls back without tier 2
+   uint32_t warmupFrames;     // drawn but not measured
+   uint32_t frames;           // measured frames; 0 for no limit
+   double seconds;            // measured time; 0 for no limit
+   const char *reportPath;    // "-" for stdout
+   BenchFormat format;
+};
+
+// Defaults for everything; frames and seconds are both 0, i.e. not a
+// benchmark run.
+void BenchConfigInit(BenchConfig *config);
+
+// Handles one "--name value" pair. Returns 1 if it was consumed, 0 if arg
+// isn't a benchmark option and -1 if value is malformed.
+int ParseBenchOption(BenchConfig *config, const char *arg, const char *value);
+
+// The usage lines for the options above.
+extern const char *const BENCH_USAGE;
+
+static inline bool BenchEnabled(const BenchConfig *config)
+{
+   return config->frames > 0 || config->seconds > 0.0;
+}
+
+struct BenchRun {
+   const BenchConfig *config;
+   uint32_t warmupLeft;
+   std::vector<double> frameTimes;  // start to start, in seconds
+   FrameStats stageTotals;
+   uint64_t instances;              // drawn across measured frames
+   double measuredSeconds;
+};
+
+void BenchRunInit(BenchRun *run, const BenchConfig *config);
+
+// Adds a frame that started frameSeconds after the previous one. Returns
+// false once the run is complete.
+bool BenchRunAddFrame(BenchRun *run, double frameSeconds, const FrameStats *stats);
+
+struct BenchSummary {
+   uint32_t frames;
+   double seconds;
+   double mean, min, max;           // frame times, in milliseconds
+   double p50, p95, p99, p999;
+   double framesPerSecond;
+   double instancesPerSecond;
+   FrameStats stageMeans;           // in milliseconds
+};
+
+// Nearest-rank percentile of samples, which are sorted in place. Returns 0
+// for an empty set.
+double BenchPercentile(std::vector<double> *samples, double percentile);
+
+void BenchSummarize(const BenchRun *run, BenchSummary *summary);
+
+// The whole report, config and results, in the requested format. backend
+// names what ran it, e.g. "d3d12" or "soft".
+void FormatBenchReport(std::string *out, BenchFormat format, const BenchConfig *config,
+   const char *backend, const BenchSummary *summary);
+
+bool WriteBenchReport(const BenchConfig *config, const char *backend, const BenchSummary *summary);
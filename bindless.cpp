@@ -0,0 +1,90 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+
+#include "common.h"
+#include "bindless.h"
+
+void BindlessTableInit(BindlessTable *table, DescriptorAllocator *descriptors)
+{
+   table->descriptors = descriptors;
+   table->ranges.clear();
+}
+
+uint32_t BindlessAddRange(BindlessTable *table, uint64_t gpu, uint64_t size)
+{
+   ASSERT(table->descriptors);
+   ASSERT(size > 0 && size <= UINT32_MAX + 1ull);
+
+   std::vector<BindlessRange>::iterator next = std::upper_bound(table->ranges.begin(), table->ranges.end(), gpu,
+      [](uint64_t address, const BindlessRange &range) { return address < range.gpu; });
+   ASSERT(next == table->ranges.end() || gpu + size <= next->gpu);
+   ASSERT(next == table->ranges.begin() || (next - 1)->gpu + (next - 1)->size <= gpu);
+
+   uint32_t index = DescriptorAllocPersistent(table->descriptors);
+   if (index == DESCRIPTOR_INVALID) {
+      return DESCRIPTOR_INVALID;
+   }
+
+   BindlessRange range;
+   range.gpu = gpu;
+   range.size = size;
+   range.index = index;
+   table->ranges.insert(next, range);
+   return index;
+}
+
+void BindlessRemoveRange(BindlessTable *table, uint32_t index, uint64_t fenceValue)
+{
+   // Only a handful of buffers are ever registered, and they come and go
+   // with resizes, so a scan will do.
+   for (size_t i = 0; i < table->ranges.size(); ++i) {
+      if (table->ranges[i].index == index) {
+         table->ranges.erase(table->ranges.begin() + i);
+         DescriptorFreePersistent(table->descriptors, index, fenceValue);
+         return;
+      }
+   }
+   ASSERT(!"BindlessRemoveRange: no such range");
+}
+
+bool BindlessResolve(const BindlessTable *table, uint64_t gpu, BindlessRef *ref)
+{
+   std::vector<BindlessRange>::const_iterator next = std::upper_bound(table->ranges.begin(), table->ranges.end(), gpu,
+      [](uint64_t address, const BindlessRange &range) { return address < range.gpu; });
+   if (next == table->ranges.begin()) {
+      return false;
+   }
+
+   const BindlessRange *range = &*(next - 1);
+   if (gpu - range->gpu >= range->size) {
+      return false;
+   }
+
+   ref->offset = (uint32_t)(gpu - range->gpu);
+   ref->index = range->index;
+   return true;
+}
@@ -0,0 +1,77 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "descalloc.h"
+
+// Bindless access: one shader-visible CBV/SRV/UAV table, bound once per
+// command list, that shaders index into rather than having each resource
+// bound. Every buffer shaders read from gets a raw view at a persistent slot,
+// and the table remembers which GPU addresses each view covers, so any
+// address in one of them turns into the slot and a byte offset. That pair is
+// all a draw passes, as two root constants. Textures and materials take slots
+// from the same DescriptorAllocator and are referred to by index likewise.
+// Holds no device objects, like the allocator under it.
+
+// A resolved address, laid out as the draw's root constants. The offset is
+// in the low word, so a packed one can stand in for an address and have
+// byte offsets added to it.
+struct BindlessRef {
+   uint32_t offset;
+   uint32_t index;            // into the table
+};
+
+struct BindlessRange {
+   uint64_t gpu;
+   uint64_t size;
+   uint32_t index;
+};
+
+struct BindlessTable {
+   DescriptorAllocator *descriptors;   // null if bindless is off
+   std::vector<BindlessRange> ranges;  // sorted by address, never overlapping
+};
+
+void BindlessTableInit(BindlessTable *table, DescriptorAllocator *descriptors);
+
+// Takes a persistent slot for a view of [gpu, gpu + size), which must not
+// overlap any other range and is at most 4 GB. Returns the slot, or
+// DESCRIPTOR_INVALID if there are none left. The caller writes the view.
+uint32_t BindlessAddRange(BindlessTable *table, uint64_t gpu, uint64_t size);
+
+// Forgets the range at once; its slot is reused once fenceValue has completed.
+void BindlessRemoveRange(BindlessTable *table, uint32_t index, uint64_t fenceValue);
+
+// The view and offset gpu falls in. False if no range covers it.
+bool BindlessResolve(const BindlessTable *table, uint64_t gpu, BindlessRef *ref);
+
+static inline uint64_t BindlessPack(BindlessRef ref)
+{
+   return (uint64_t)ref.index << 32 | ref.offset;
+}
@@ -0,0 +1,260 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks the bindless table (bindless.h) and the persistent slots under it:
+//
+//    bindlesstest [--frames N]
+//
+// Fixed cases first: slots handed out and resolved, a full table refusing
+// more, and a removed range's slot held back until its fence completes. Then
+// a run of frames adding and removing ranges at random, with a few frames in
+// flight, checked against a model of which slot is live, waiting on a fence
+// or free. Prints nothing and returns 0 if everything holds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "common.h"
+#include "bindless.h"
+
+#define SLOTS              8
+#define FRAMES_IN_FLIGHT   3
+
+static uint32_t s_failures;
+
+#define CHECK(x) \
+   do { \
+      if (!(x)) { \
+         fprintf(stderr, "%s(%d): %s\n", __FILE__, __LINE__, #x); \
+         ++s_failures; \
+      } \
+   } while (0)
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--frames N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static uint32_t random32(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return *state >> 8;
+}
+
+static bool resolvesTo(const BindlessTable *table, uint64_t gpu, uint32_t index, uint32_t offset)
+{
+   BindlessRef ref;
+   return BindlessResolve(table, gpu, &ref) && ref.index == index && ref.offset == offset;
+}
+
+static bool resolves(const BindlessTable *table, uint64_t gpu)
+{
+   BindlessRef ref;
+   return BindlessResolve(table, gpu, &ref);
+}
+
+static void testSlots()
+{
+   DescriptorAllocator descriptors;
+   DescriptorAllocatorInit(&descriptors, SLOTS, 4);
+   BindlessTable table;
+   BindlessTableInit(&table, &descriptors);
+
+   // Added out of address order, with gaps between some and not others.
+   static const uint64_t gpu[SLOTS] = { 0x50000, 0x10000, 0x30000, 0x20000, 0x80000, 0x70000, 0x40000, 0x100000 };
+   static const uint64_t size[SLOTS] = { 0x100, 0x10000, 0x8000, 0x10000, 4, 0x10000, 0x10000, 1ull << 32 };
+   uint32_t index[SLOTS];
+   for (uint32_t i = 0; i < SLOTS; ++i) {
+      index[i] = BindlessAddRange(&table, gpu[i], size[i]);
+      CHECK(index[i] == i);   // the free list hands slots out in order
+   }
+   CHECK(descriptors.persistentInUse == SLOTS);
+
+   for (uint32_t i = 0; i < SLOTS; ++i) {
+      CHECK(resolvesTo(&table, gpu[i], index[i], 0));
+      CHECK(resolvesTo(&table, gpu[i] + size[i] / 2, index[i], (uint32_t)(size[i] / 2)));
+      CHECK(resolvesTo(&table, gpu[i] + size[i] - 1, index[i], (uint32_t)(size[i] - 1)));
+   }
+   CHECK(!resolves(&table, 0));
+   CHECK(!resolves(&table, 0xffff));
+   CHECK(!resolves(&table, 0x38000));           // between two ranges
+   CHECK(!resolves(&table, 0x50100));
+   CHECK(!resolves(&table, 0x80004));
+   CHECK(!resolves(&table, 0x100000 + (1ull << 32)));
+   CHECK(resolvesTo(&table, 0x20000, index[3], 0));   // right after the end of another
+
+   // Packed, the offset can be added to like an address.
+   BindlessRef ref = { 0x40, 7 };
+   CHECK(BindlessPack(ref) + 0x40 == ((7ull << 32) | 0x80));
+
+   // Transient tables come from above the persistent slots.
+   uint32_t transient = DescriptorAllocTransient(&descriptors, 4);
+   CHECK(transient == SLOTS);
+   CHECK(DescriptorAllocTransient(&descriptors, 1) == DESCRIPTOR_INVALID);
+}
+
+static void testExhaustionAndReuse()
+{
+   DescriptorAllocator descriptors;
+   DescriptorAllocatorInit(&descriptors, SLOTS, 0);
+   BindlessTable table;
+   BindlessTableInit(&table, &descriptors);
+
+   for (uint32_t i = 0; i < SLOTS; ++i) {
+      CHECK(BindlessAddRange(&table, 0x10000 * (i + 1), 0x1000) == i);
+   }
+
+   // A full table refuses the range and doesn't remember it.
+   CHECK(BindlessAddRange(&table, 0x100000, 0x1000) == DESCRIPTOR_INVALID);
+   CHECK(!resolves(&table, 0x100000));
+   CHECK(table.ranges.size() == SLOTS);
+   CHECK(descriptors.persistentInUse == SLOTS);
+
+   // Removed ranges stop resolving at once, but frames in flight may still
+   // read their views, so the slots stay taken until the fence says not.
+   BindlessRemoveRange(&table, 3, 10);
+   BindlessRemoveRange(&table, 5, 12);
+   CHECK(!resolves(&table, 0x40000));
+   CHECK(!resolves(&table, 0x60000));
+   CHECK(resolvesTo(&table, 0x50000, 4, 0));
+   CHECK(BindlessAddRange(&table, 0x100000, 0x1000) == DESCRIPTOR_INVALID);
+
+   DescriptorBeginFrame(&descriptors, 9);
+   CHECK(BindlessAddRange(&table, 0x100000, 0x1000) == DESCRIPTOR_INVALID);
+
+   DescriptorBeginFrame(&descriptors, 10);
+   CHECK(BindlessAddRange(&table, 0x40000, 0x800) == 3);   // back where it was
+   CHECK(resolvesTo(&table, 0x407ff, 3, 0x7ff));
+   CHECK(!resolves(&table, 0x40800));
+   CHECK(BindlessAddRange(&table, 0x100000, 0x1000) == DESCRIPTOR_INVALID);
+
+   // Several frames retiring at once free everything up to the value.
+   BindlessRemoveRange(&table, 0, 13);
+   DescriptorBeginFrame(&descriptors, 13);
+   uint32_t a = BindlessAddRange(&table, 0x100000, 0x1000);
+   uint32_t b = BindlessAddRange(&table, 0x200000, 0x1000);
+   CHECK((a == 5 && b == 0) || (a == 0 && b == 5));
+   CHECK(BindlessAddRange(&table, 0x300000, 0x1000) == DESCRIPTOR_INVALID);
+   CHECK(descriptors.persistentInUse == SLOTS);
+   CHECK(descriptors.persistentHighWater == SLOTS);
+}
+
+// Every frame removes and adds a few ranges at random. A slot must never be
+// handed out while it's live or its fence is still pending.
+static void testChurn(uint32_t frames)
+{
+   enum { FREE, LIVE, PENDING };
+   struct Slot {
+      uint32_t state;
+      uint64_t fenceValue;    // while pending
+      uint64_t gpu;           // while live
+   };
+
+   DescriptorAllocator descriptors;
+   DescriptorAllocatorInit(&descriptors, SLOTS, 0);
+   BindlessTable table;
+   BindlessTableInit(&table, &descriptors);
+
+   Slot slots[SLOTS];
+   memset(slots, 0, sizeof(slots));
+   uint32_t seed = 1;
+   uint64_t nextGpu = 0x10000;
+   for (uint64_t frame = 1; frame <= frames; ++frame) {
+      uint64_t completed = frame > FRAMES_IN_FLIGHT ? frame - FRAMES_IN_FLIGHT : 0;
+      DescriptorBeginFrame(&descriptors, completed);
+      uint32_t free = 0;
+      for (uint32_t i = 0; i < SLOTS; ++i) {
+         if (slots[i].state == PENDING && slots[i].fenceValue <= completed) {
+            slots[i].state = FREE;
+         }
+         free += slots[i].state == FREE;
+      }
+
+      uint32_t removes = random32(&seed) % 3;
+      for (uint32_t j = 0; j < removes; ++j) {
+         uint32_t i = random32(&seed) % SLOTS;
+         if (slots[i].state == LIVE) {
+            BindlessRemoveRange(&table, i, frame);
+            slots[i].state = PENDING;
+            slots[i].fenceValue = frame;
+            CHECK(!resolves(&table, slots[i].gpu));
+         }
+      }
+
+      uint32_t adds = random32(&seed) % 3;
+      for (uint32_t j = 0; j < adds; ++j) {
+         uint64_t size = 1 + random32(&seed) % 0x10000;
+         uint32_t index = BindlessAddRange(&table, nextGpu, size);
+         if (free == 0) {
+            CHECK(index == DESCRIPTOR_INVALID);
+            continue;
+         }
+         CHECK(index < SLOTS && slots[index].state == FREE);
+         if (index >= SLOTS) {
+            return;
+         }
+         slots[index].state = LIVE;
+         slots[index].gpu = nextGpu;
+         --free;
+         nextGpu += 0x10000;
+      }
+
+      for (uint32_t i = 0; i < SLOTS; ++i) {
+         if (slots[i].state == LIVE) {
+            CHECK(resolvesTo(&table, slots[i].gpu, i, 0));
+         }
+      }
+      if (s_failures > 0) {
+         fprintf(stderr, "churn: failed at frame %llu\n", (unsigned long long)frame);
+         return;
+      }
+   }
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t frames = 100000;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--frames") == 0) {
+         frames = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   testSlots();
+   testExhaustionAndReuse();
+   testChurn(frames);
+   return s_failures > 0 ? 1 : 0;
+}
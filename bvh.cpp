@@ -0,0 +1,402 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "bvh.h"
+#include "common.h"
+#include "jobs.h"
+#include "profiler.h"
+
+#define BVH_MAX_JOBS          (JOB_MAX_THREADS * 4)
+#define BVH_JOBS_PER_THREAD   4     // subtrees per thread, so stealing evens out the rest
+#define BVH_MIN_JOB_OBJECTS   4096  // fewer than this per subtree isn't worth a job
+
+static float surfaceArea(const BvhNode *node)
+{
+   float dx = node->max[0] - node->min[0];
+   float dy = node->max[1] - node->min[1];
+   float dz = node->max[2] - node->min[2];
+   return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+// Most nodes a tree over count objects can have. Splits are never more
+// uneven than one object, so leaves hold at least half of BVH_LEAF_SIZE.
+static uint32_t maxNodes(uint32_t count)
+{
+   return 2 * (2 * count / BVH_LEAF_SIZE + 1);
+}
+
+static void fitLeaf(Bvh *bvh, BvhNode *node)
+{
+   float mn[3] = { INFINITY, INFINITY, INFINITY };
+   float mx[3] = { -INFINITY, -INFINITY, -INFINITY };
+   for (uint32_t slot = node->first; slot < node->first + node->count; ++slot) {
+      float center[3] = { bvh->centerX[slot], bvh->centerY[slot], bvh->centerZ[slot] };
+      float r = bvh->radius[slot];
+      for (int axis = 0; axis < 3; ++axis) {
+         mn[axis] = std::min(mn[axis], center[axis] - r);
+         mx[axis] = std::max(mx[axis], center[axis] + r);
+      }
+   }
+   memcpy(node->min, mn, sizeof(mn));
+   memcpy(node->max, mx, sizeof(mx));
+}
+
+static void fitInterior(Bvh *bvh, BvhNode *node)
+{
+   const BvhNode *left = node + 1;
+   const BvhNode *right = &bvh->nodes[node->right];
+   for (int axis = 0; axis < 3; ++axis) {
+      node->min[axis] = std::min(left->min[axis], right->min[axis]);
+      node->max[axis] = std::max(left->max[axis], right->max[axis]);
+   }
+}
+
+static void fitNode(Bvh *bvh, uint32_t index)
+{
+   BvhNode *node = &bvh->nodes[index];
+   if (node->right) {
+      fitInterior(bvh, node);
+   } else {
+      fitLeaf(bvh, node);
+   }
+}
+
+// An object as the build sorts it: contiguous, so partitioning a range
+// doesn't chase ids into four arrays.
+struct BvhBuildItem {
+   float center[3];
+   float radius;
+   uint32_t id;
+};
+
+// Builds the subtree at node over slots [first, first + count), whose objects
+// are items[0, count), and stores them in slot order. Returns the node after
+// the subtree.
+static uint32_t buildNode(Bvh *bvh, BvhBuildItem *items, uint32_t index, uint32_t parent, uint32_t first, uint32_t count)
+{
+   BvhNode *node = &bvh->nodes[index];
+   node->first = first;
+   node->count = count;
+   node->parent = parent;
+   node->right = 0;
+   node->dirty = 0;
+
+   uint32_t next = index + 1;
+   if (count > BVH_LEAF_SIZE) {
+      float mn[3] = { INFINITY, INFINITY, INFINITY };
+      float mx[3] = { -INFINITY, -INFINITY, -INFINITY };
+      for (uint32_t i = 0; i < count; ++i) {
+         for (int axis = 0; axis < 3; ++axis) {
+            mn[axis] = std::min(mn[axis], items[i].center[axis]);
+            mx[axis] = std::max(mx[axis], items[i].center[axis]);
+         }
+      }
+
+      int axis = 0;
+      for (int i = 1; i < 3; ++i) {
+         if (mx[i] - mn[i] > mx[axis] - mn[axis]) {
+            axis = i;
+         }
+      }
+
+      // Ties go by id, so the same input always builds the same tree.
+      uint32_t half = count / 2;
+      std::nth_element(items, items + half, items + count, [axis](const BvhBuildItem &a, const BvhBuildItem &b) {
+         return a.center[axis] < b.center[axis] || (a.center[axis] == b.center[axis] && a.id < b.id);
+      });
+
+      next = buildNode(bvh, items, next, index, first, half);
+      bvh->nodes[index].right = next;
+      next = buildNode(bvh, items + half, next, index, first + half, count - half);
+   } else {
+      for (uint32_t i = 0; i < count; ++i) {
+         uint32_t slot = first + i;
+         bvh->objects[slot] = items[i].id;
+         bvh->slots[items[i].id] = slot;
+         bvh->centerX[slot] = items[i].center[0];
+         bvh->centerY[slot] = items[i].center[1];
+         bvh->centerZ[slot] = items[i].center[2];
+         bvh->radius[slot] = items[i].radius;
+      }
+   }
+
+   node = &bvh->nodes[index];
+   fitNode(bvh, index);
+   node->builtArea = surfaceArea(node);
+   return next;
+}
+
+void BvhBuild(Bvh *bvh, const BoundingSpheres *spheres)
+{
+   PROFILE_ZONE("BvhBuild");
+
+   uint32_t count = spheres->count;
+   bvh->objects.resize(count);
+   bvh->slots.resize(count);
+   bvh->centerX.resize(count);
+   bvh->centerY.resize(count);
+   bvh->centerZ.resize(count);
+   bvh->radius.resize(count);
+
+   std::vector<BvhBuildItem> items(count);
+   for (uint32_t i = 0; i < count; ++i) {
+      items[i].center[0] = spheres->centerX[i];
+      items[i].center[1] = spheres->centerY[i];
+      items[i].center[2] = spheres->centerZ[i];
+      items[i].radius = spheres->radius[i];
+      items[i].id = i;
+   }
+
+   bvh->nodes.resize(count ? maxNodes(count) : 0);
+   if (count) {
+      bvh->nodes.resize(buildNode(bvh, items.data(), 0, BVH_NONE, 0, count));
+   }
+
+   bvh->spheres.centerX = bvh->centerX.data();
+   bvh->spheres.centerY = bvh->centerY.data();
+   bvh->spheres.centerZ = bvh->centerZ.data();
+   bvh->spheres.radius = bvh->radius.data();
+   bvh->spheres.count = count;
+   bvh->refit.clear();
+   bvh->rebuilds = 0;
+}
+
+// The leaf holding slot; every node's children split its range at half its
+// count.
+static uint32_t findLeaf(const Bvh *bvh, uint32_t slot)
+{
+   uint32_t index = 0;
+   for (;;) {
+      const BvhNode *node = &bvh->nodes[index];
+      if (!node->right) {
+         return index;
+      }
+      index = slot < node->first + node->count / 2 ? index + 1 : node->right;
+   }
+}
+
+void BvhUpdate(Bvh *bvh, const BoundingSpheres *spheres, const uint32_t *ids, uint32_t count)
+{
+   PROFILE_ZONE("BvhUpdate");
+   ASSERT(spheres->count == bvh->spheres.count);
+
+   // Collect every node above a moved object once. Paths stop at the first
+   // node another object already marked, since the rest of it is too.
+   std::vector<uint32_t> *refit = &bvh->refit;
+   refit->clear();
+   for (uint32_t i = 0; i < count; ++i) {
+      uint32_t id = ids[i];
+      uint32_t slot = bvh->slots[id];
+      bvh->centerX[slot] = spheres->centerX[id];
+      bvh->centerY[slot] = spheres->centerY[id];
+      bvh->centerZ[slot] = spheres->centerZ[id];
+      bvh->radius[slot] = spheres->radius[id];
+
+      for (uint32_t index = findLeaf(bvh, slot); index != BVH_NONE && !bvh->nodes[index].dirty;
+         index = bvh->nodes[index].parent) {
+         bvh->nodes[index].dirty = 1;
+         refit->push_back(index);
+      }
+   }
+
+   // Children come after their parents, so going backwards fits every node
+   // after its children.
+   std::sort(refit->begin(), refit->end());
+   for (size_t i = refit->size(); i-- > 0; ) {
+      uint32_t index = (*refit)[i];
+      fitNode(bvh, index);
+      bvh->nodes[index].dirty = 0;
+   }
+
+   // Then rebuild each outermost subtree that has grown too much. A rebuild
+   // covers the same objects, so it doesn't change the subtree's bounds or
+   // need anything above it refit; the nodes under it that have grown too
+   // are skipped as part of it.
+   std::vector<BvhBuildItem> items;
+   uint32_t rebuiltEnd = 0;
+   for (size_t i = 0; i < refit->size(); ++i) {
+      uint32_t index = (*refit)[i];
+      const BvhNode *node = &bvh->nodes[index];
+      if (index < rebuiltEnd || surfaceArea(node) <= node->builtArea * BVH_REBUILD_GROWTH) {
+         continue;
+      }
+
+      items.resize(node->count);
+      for (uint32_t j = 0; j < node->count; ++j) {
+         uint32_t slot = node->first + j;
+         items[j].center[0] = bvh->centerX[slot];
+         items[j].center[1] = bvh->centerY[slot];
+         items[j].center[2] = bvh->centerZ[slot];
+         items[j].radius = bvh->radius[slot];
+         items[j].id = bvh->objects[slot];
+      }
+
+      // Same count, so the same shape over the same nodes.
+      rebuiltEnd = buildNode(bvh, items.data(), index, node->parent, node->first, node->count);
+      ++bvh->rebuilds;
+   }
+}
+
+// Whether any of the node is inside the planes in mask, clearing the bits of
+// planes it's entirely inside.
+static bool classifyNode(const BvhNode *node, const Vec4 planes[6], uint32_t *mask)
+{
+   for (uint32_t p = 0; p < 6; ++p) {
+      if (!(*mask & (1u << p))) {
+         continue;
+      }
+
+      const Vec4 *plane = &planes[p];
+      float nearX = plane->x >= 0.0f ? node->max[0] : node->min[0];
+      float nearY = plane->y >= 0.0f ? node->max[1] : node->min[1];
+      float nearZ = plane->z >= 0.0f ? node->max[2] : node->min[2];
+      if (plane->x * nearX + plane->y * nearY + plane->z * nearZ + plane->w < 0.0f) {
+         return false;
+      }
+
+      float farX = plane->x >= 0.0f ? node->min[0] : node->max[0];
+      float farY = plane->y >= 0.0f ? node->min[1] : node->max[1];
+      float farZ = plane->z >= 0.0f ? node->min[2] : node->max[2];
+      if (plane->x * farX + plane->y * farY + plane->z * farZ + plane->w >= 0.0f) {
+         *mask &= ~(1u << p);
+      }
+   }
+   return true;
+}
+
+// The node isn't outside; mask holds the planes it crosses.
+static uint32_t cullInside(const Bvh *bvh, const Vec4 planes[6], uint32_t index, uint32_t mask, uint32_t *visible)
+{
+   const BvhNode *node = &bvh->nodes[index];
+   if (!mask) {
+      memcpy(visible, &bvh->objects[node->first], node->count * sizeof(uint32_t));
+      return node->count;
+   } else if (!node->right) {
+      return FrustumCullSpheres(planes, &bvh->spheres, node->first, node->count, bvh->objects.data(), visible);
+   }
+
+   uint32_t written = 0;
+   uint32_t children[2] = { index + 1, node->right };
+   for (uint32_t i = 0; i < 2; ++i) {
+      uint32_t childMask = mask;
+      if (classifyNode(&bvh->nodes[children[i]], planes, &childMask)) {
+         written += cullInside(bvh, planes, children[i], childMask, visible + written);
+      }
+   }
+   return written;
+}
+
+uint32_t BvhCull(const Bvh *bvh, const Vec4 planes[6], uint32_t *visible)
+{
+   uint32_t mask = 0x3f;
+   if (bvh->nodes.empty() || !classifyNode(&bvh->nodes[0], planes, &mask)) {
+      return 0;
+   }
+   return cullInside(bvh, planes, 0, mask, visible);
+}
+
+// Subtrees that survived the descent in BvhCullParallel, in slot order. Each
+// job culls one into the part of visible its slots map to, which nothing
+// else writes.
+struct BvhCullJobs {
+   const Bvh *bvh;
+   const Vec4 *planes;
+   uint32_t *visible;
+   uint32_t count;
+   uint32_t nodes[BVH_MAX_JOBS];
+   uint32_t masks[BVH_MAX_JOBS];
+   uint32_t written[BVH_MAX_JOBS];
+};
+
+static void cullJob(void *data, uint32_t index)
+{
+   PROFILE_ZONE("cull subtree");
+
+   BvhCullJobs *jobs = (BvhCullJobs *)data;
+   uint32_t node = jobs->nodes[index];
+   jobs->written[index] = cullInside(jobs->bvh, jobs->planes, node, jobs->masks[index],
+      jobs->visible + jobs->bvh->nodes[node].first);
+}
+
+static void collectJobs(BvhCullJobs *jobs, uint32_t index, uint32_t mask, uint32_t jobObjects)
+{
+   const BvhNode *node = &jobs->bvh->nodes[index];
+   if (!mask || !node->right || node->count <= jobObjects || jobs->count + 2 > BVH_MAX_JOBS) {
+      jobs->nodes[jobs->count] = index;
+      jobs->masks[jobs->count] = mask;
+      ++jobs->count;
+      return;
+   }
+
+   uint32_t children[2] = { index + 1, node->right };
+   for (uint32_t i = 0; i < 2; ++i) {
+      uint32_t childMask = mask;
+      if (classifyNode(&jobs->bvh->nodes[children[i]], jobs->planes, &childMask)) {
+         collectJobs(jobs, children[i], childMask, jobObjects);
+      }
+   }
+}
+
+uint32_t BvhCullParallel(const Bvh *bvh, const Vec4 planes[6], uint32_t *visible)
+{
+   uint32_t mask = 0x3f;
+   if (bvh->nodes.empty() || !classifyNode(&bvh->nodes[0], planes, &mask)) {
+      return 0;
+   }
+
+   uint32_t threads = JobThreadCount();
+   uint32_t objects = bvh->nodes[0].count;
+   uint32_t jobObjects = objects / (threads * BVH_JOBS_PER_THREAD);
+   if (threads == 1 || objects <= BVH_MIN_JOB_OBJECTS) {
+      return cullInside(bvh, planes, 0, mask, visible);
+   } else if (jobObjects < BVH_MIN_JOB_OBJECTS) {
+      jobObjects = BVH_MIN_JOB_OBJECTS;
+   }
+
+   BvhCullJobs jobs;
+   jobs.bvh = bvh;
+   jobs.planes = planes;
+   jobs.visible = visible;
+   jobs.count = 0;
+   collectJobs(&jobs, 0, mask, jobObjects);
+   JobParallelFor(cullJob, &jobs, jobs.count);
+
+   // Close the gaps between the subtrees' output. Every move is towards the
+   // front, and the subtrees are in order, so nothing is overwritten before
+   // it has moved.
+   uint32_t written = 0;
+   for (uint32_t i = 0; i < jobs.count; ++i) {
+      const uint32_t *src = visible + bvh->nodes[jobs.nodes[i]].first;
+      if (src != visible + written) {
+         memmove(visible + written, src, jobs.written[i] * sizeof(uint32_t));
+      }
+      written += jobs.written[i];
+   }
+   return written;
+}
@@ -0,0 +1,90 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "frustum.h"
+
+#define BVH_LEAF_SIZE         16       // most objects in a leaf
+#define BVH_REBUILD_GROWTH    2.0f     // refit over built surface area that rebuilds a subtree
+#define BVH_NONE              UINT32_MAX
+
+// Nodes are stored depth first: a node's left child follows it and its
+// subtree is one contiguous run of nodes.
+struct BvhNode {
+   float min[3];
+   uint32_t first;            // first slot of the node's objects
+   float max[3];
+   uint32_t count;            // objects under the node; at most BVH_LEAF_SIZE in a leaf
+   uint32_t right;            // the right child, or 0 for a leaf
+   uint32_t parent;           // BVH_NONE for the root
+   float builtArea;           // surface area as of the last build of this subtree
+   uint32_t dirty;            // BvhUpdate's scratch
+};
+
+// A bounding volume hierarchy over spheres, for culling content that mostly
+// stays put. Built top down, splitting each node's objects in half along the
+// widest axis of their centers, so every node covers a contiguous range of
+// slots and the tree's shape depends only on the object count. The spheres
+// are kept in slot order, so leaves are tested straight out of contiguous
+// memory, many at a time.
+//
+// Moving objects refits the nodes above them. A subtree whose bounds grow
+// too far past what it was built with is rebuilt in place, which the fixed
+// shape allows, so the tree stays tight without ever being rebuilt whole.
+struct Bvh {
+   std::vector<BvhNode> nodes;         // nodes[0] is the root
+   std::vector<uint32_t> objects;      // object id in each slot
+   std::vector<uint32_t> slots;        // slot of each object id
+   std::vector<float> centerX;         // the spheres, by slot
+   std::vector<float> centerY;
+   std::vector<float> centerZ;
+   std::vector<float> radius;
+   BoundingSpheres spheres;            // views of the four above
+   std::vector<uint32_t> refit;        // BvhUpdate's scratch
+   uint32_t rebuilds;                  // subtrees BvhUpdate has rebuilt
+};
+
+// Builds the tree over every sphere, with ids in index order.
+void BvhBuild(Bvh *bvh, const BoundingSpheres *spheres);
+
+// Objects ids[0, count) have moved; spheres holds every object's current
+// bounds, indexed by id, and the same count as the build. Costs in
+// proportion to the moved objects and the nodes above them, plus any
+// subtrees that get rebuilt.
+void BvhUpdate(Bvh *bvh, const BoundingSpheres *spheres, const uint32_t *ids, uint32_t count);
+
+// Writes the ids of the visible objects to visible, in slot order, and
+// returns how many there are. Subtrees entirely inside the frustum are
+// copied out without testing their objects. visible needs room for every
+// object.
+uint32_t BvhCull(const Bvh *bvh, const Vec4 planes[6], uint32_t *visible);
+
+// Same as above with subtrees spread across the job system's threads. The
+// output is the same.
+uint32_t BvhCullParallel(const Bvh *bvh, const Vec4 planes[6], uint32_t *visible);
@@ -23,49 +23,28 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
 */
 
-static const float4 boxVerts[8] = {
-   { -1.0, -1.0, -1.0,  1.0 },
-   {  1.0, -1.0, -1.0,  1.0 },
-   { -1.0,  1.0, -1.0,  1.0 },
-   {  1.0,  1.0, -1.0,  1.0 },
-   { -1.0, -1.0,  1.0,  1.0 },
-   {  1.0, -1.0,  1.0,  1.0 },
-   { -1.0,  1.0,  1.0,  1.0 },
-   {  1.0,  1.0,  1.0,  1.0 },
+struct Instance {
+   column_major float4x4 clipFromLocal;
 };
 
-static const float4 boxColors[8] = {
-   { 0.0, 0.0, 0.0, 1.0 },
-   { 1.0, 0.0, 0.0, 1.0 },
-   { 0.0, 1.0, 0.0, 1.0 },
-   { 1.0, 1.0, 0.0, 1.0 },
-   { 0.0, 0.0, 1.0, 1.0 },
-   { 1.0, 0.0, 1.0, 1.0 },
-   { 0.0, 1.0, 1.0, 1.0 },
-   { 1.0, 1.0, 1.0, 1.0 },
+#ifdef BINDLESS
+// Where the draw's instances start: a buffer in the table and a byte offset
+// into it. See BindlessRef.
+cbuffer DrawConstants : register(b0) {
+   uint instanceOffset;
+   uint instanceBuffer;
 };
 
-static const uint boxIndices[36] = {
-   1, 0, 2,
-   1, 2, 3,
-   5, 1, 3,
-   5, 3, 7,
-   4, 5, 7,
-   4, 7, 6,
-   0, 4, 6,
-   0, 6, 2,
-   6, 7, 3,
-   6, 3, 2,
-   1, 4, 0,
-   1, 5, 4,
-};
-
-cbuffer cb0 : register(b0)  {
-   float4x4 clipFromLocal;
-};
+ByteAddressBuffer buffers[] : register(t0, space1);
+#else
+StructuredBuffer<Instance> instances : register(t0);
+#endif
 
+// Streams of cube.mesh, one input slot each.
 struct VsInput {
-   uint vertexIndex : SV_VERTEXID;
+   float3 position : POSITION;
+   float4 color : COLOR;
+   uint instanceIndex : SV_INSTANCEID;
 };
 
 struct VsOutput {
@@ -77,10 +56,18 @@ VsOutput main(VsInput input)
 {
    VsOutput output;
 
-   uint index = boxIndices[input.vertexIndex];
-   float4 localPos = boxVerts[index];
-   output.color = boxColors[index];
-   output.position = mul(clipFromLocal, localPos);
+   output.color = input.color;
+#ifdef BINDLESS
+   // An Instance, column by column.
+   uint address = instanceOffset + input.instanceIndex * 64;
+   float4 x = asfloat(buffers[instanceBuffer].Load4(address));
+   float4 y = asfloat(buffers[instanceBuffer].Load4(address + 16));
+   float4 z = asfloat(buffers[instanceBuffer].Load4(address + 32));
+   float4 w = asfloat(buffers[instanceBuffer].Load4(address + 48));
+   output.position = x * input.position.x + y * input.position.y + z * input.position.z + w;
+#else
+   output.position = mul(instances[input.instanceIndex].clipFromLocal, float4(input.position, 1.0));
+#endif
 
    return output;
 }
@@ -0,0 +1,180 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <math.h>
+
+#include "common.h"
+#include "cull.h"
+#include "jobs.h"
+#include "transform.h"
+
+#define TWO_PI 6.28318530f
+
+void CullFrustumPlanes(const Mat4 *clipFromWorld, Vec4 planes[6])
+{
+   // Row i of the matrix; clip = (dot(row0, p), dot(row1, p), ...).
+   Vec4 rows[4];
+   const float *m = &clipFromWorld->m[0].x;
+   for (int i = 0; i < 4; ++i) {
+      rows[i].x = m[i];
+      rows[i].y = m[4 + i];
+      rows[i].z = m[8 + i];
+      rows[i].w = m[12 + i];
+   }
+
+   // -w <= x <= w, -w <= y <= w, 0 <= z <= w.
+   for (int i = 0; i < 2; ++i) {
+      planes[2 * i].x = rows[3].x + rows[i].x;
+      planes[2 * i].y = rows[3].y + rows[i].y;
+      planes[2 * i].z = rows[3].z + rows[i].z;
+      planes[2 * i].w = rows[3].w + rows[i].w;
+      planes[2 * i + 1].x = rows[3].x - rows[i].x;
+      planes[2 * i + 1].y = rows[3].y - rows[i].y;
+      planes[2 * i + 1].z = rows[3].z - rows[i].z;
+      planes[2 * i + 1].w = rows[3].w - rows[i].w;
+   }
+   planes[4] = rows[2];
+   planes[5].x = rows[3].x - rows[2].x;
+   planes[5].y = rows[3].y - rows[2].y;
+   planes[5].z = rows[3].z - rows[2].z;
+   planes[5].w = rows[3].w - rows[2].w;
+
+   // Normalized, so the distance to a plane can be compared with a radius.
+   for (int i = 0; i < 6; ++i) {
+      float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+      float scale = length > 0.0f ? 1.0f / length : 0.0f;
+      planes[i].x *= scale;
+      planes[i].y *= scale;
+      planes[i].z *= scale;
+      planes[i].w *= scale;
+   }
+}
+
+Vec4 CullBoundingSphere(const float boundsMin[3], const float boundsMax[3])
+{
+   Vec4 sphere;
+   sphere.x = (boundsMin[0] + boundsMax[0]) * 0.5f;
+   sphere.y = (boundsMin[1] + boundsMax[1]) * 0.5f;
+   sphere.z = (boundsMin[2] + boundsMax[2]) * 0.5f;
+   float dx = boundsMax[0] - sphere.x, dy = boundsMax[1] - sphere.y, dz = boundsMax[2] - sphere.z;
+   sphere.w = sqrtf(dx * dx + dy * dy + dz * dz);
+   return sphere;
+}
+
+void CullGroups(const CullConstants *constants, const CullInstance *instances, Mat4 *output,
+   uint32_t *groupCounts, uint32_t firstGroup, uint32_t groupCount)
+{
+   const Vec4 *bounds = &constants->bounds;
+
+   for (uint32_t group = firstGroup; group < firstGroup + groupCount; ++group) {
+      uint32_t first = group * CULL_GROUP_SIZE;
+      uint32_t end = first + CULL_GROUP_SIZE < constants->instanceCount ? first + CULL_GROUP_SIZE : constants->instanceCount;
+
+      // Visible instances' transforms, gathered so they go through the same
+      // kernel the CPU path draws with.
+      float rotY[CULL_GROUP_SIZE], posX[CULL_GROUP_SIZE], posY[CULL_GROUP_SIZE], posZ[CULL_GROUP_SIZE];
+      uint32_t visible = 0;
+      for (uint32_t i = first; i < end; ++i) {
+         const CullInstance *instance = &instances[i];
+         float angle = (constants->rotation * instance->spin + instance->phase) * TWO_PI;
+         float sn = sinf(angle), cs = cosf(angle);
+
+         // The sphere's center rotated about Y, then moved into place.
+         float x = cs * bounds->x - sn * bounds->z + instance->posX;
+         float y = bounds->y + instance->posY;
+         float z = sn * bounds->x + cs * bounds->z + instance->posZ;
+         if (CullSphereVisible(constants->planes, x, y, z, bounds->w)) {
+            rotY[visible] = angle;
+            posX[visible] = instance->posX;
+            posY[visible] = instance->posY;
+            posZ[visible] = instance->posZ;
+            ++visible;
+         }
+      }
+
+      if (visible > 0) {
+         TransformBatch batch = {};
+         batch.rotY = rotY;
+         batch.posX = posX;
+         batch.posY = posY;
+         batch.posZ = posZ;
+         batch.count = visible;
+         TransformBatchToClip(output + first, &constants->clipFromWorld, &batch, 0, visible);
+      }
+      groupCounts[group] = visible;
+   }
+}
+
+uint32_t CullBuildCommands(const CullConstants *constants, const uint32_t *groupCounts,
+   CullDrawCommand *commands)
+{
+   uint32_t groupCount = CullGroupCount(constants->instanceCount);
+   uint32_t count = 0;
+   for (uint32_t group = 0; group < groupCount; ++group) {
+      if (groupCounts[group] == 0) {
+         continue;
+      }
+
+      CullDrawCommand *command = &commands[count++];
+      command->instances = constants->outputBase + (uint64_t)group * CULL_GROUP_SIZE * sizeof(Mat4);
+      command->indexCount = constants->indexCount;
+      command->instanceCount = groupCounts[group];
+      command->startIndex = 0;
+      command->baseVertex = 0;
+      command->startInstance = 0;
+      command->pad = 0;
+   }
+   return count;
+}
+
+struct CullJob {
+   const CullConstants *constants;
+   const CullInstance *instances;
+   Mat4 *output;
+   uint32_t *groupCounts;
+   uint32_t groupCount;
+};
+
+static void cullJob(void *data, uint32_t index)
+{
+   const CullJob *job = (const CullJob *)data;
+   uint32_t first = index * CULL_JOB_GROUPS;
+   uint32_t count = job->groupCount - first < CULL_JOB_GROUPS ? job->groupCount - first : CULL_JOB_GROUPS;
+   CullGroups(job->constants, job->instances, job->output, job->groupCounts, first, count);
+}
+
+uint32_t CullScene(const CullConstants *constants, const CullInstance *instances, Mat4 *output,
+   uint32_t *groupCounts, CullDrawCommand *commands)
+{
+   uint32_t groupCount = CullGroupCount(constants->instanceCount);
+   uint32_t jobCount = (groupCount + CULL_JOB_GROUPS - 1) / CULL_JOB_GROUPS;
+   if (jobCount <= 1 || JobThreadCount() == 1) {
+      CullGroups(constants, instances, output, groupCounts, 0, groupCount);
+   } else {
+      // Groups own whole slices of output, so jobs never share a line.
+      CullJob job = { constants, instances, output, groupCounts, groupCount };
+      JobParallelFor(cullJob, &job, jobCount);
+   }
+   return CullBuildCommands(constants, groupCounts, commands);
+}
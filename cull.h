@@ -0,0 +1,126 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "vecmath.h"
+
+// GPU-driven culling: the scene's instances live in a GPU buffer and a
+// compute shader (cull.comp) tests each one's bounding sphere against the
+// frustum. Every thread group of CULL_GROUP_SIZE instances writes the clip
+// matrices of its visible instances to its own slice of an output buffer,
+// and how many there are. A second dispatch then writes one indirect draw
+// per group with any to a compacted command buffer, and their number to a
+// count buffer, which ExecuteIndirect consumes. The CPU records the same
+// handful of commands however big the scene is.
+//
+// The functions here do exactly what the shader does, so backends without a
+// GPU can run it and results can be checked without one. Both keep instances
+// and commands in index order, so a frame draws the same way every time,
+// whichever path culled it.
+
+#define CULL_GROUP_SIZE          64    // instances per thread group, and at most per draw
+#define CULL_JOB_GROUPS          64    // thread groups per job on the CPU
+
+// Matches SceneInstance in cull.comp.
+struct CullInstance {
+   float posX, posY, posZ;
+   float phase;               // rotation about Y, in turns...
+   float spin;                // ...plus this much of CullConstants::rotation
+   float pad[3];
+};
+
+static_assert(sizeof(CullInstance) == 32, "CullInstance doesn't match SceneInstance in cull.comp");
+
+// Matches the CullConstants cbuffer in cull.comp, padding included.
+struct CullConstants {
+   Mat4 clipFromWorld;
+   Vec4 planes[6];            // world space, normalized, pointing inwards
+   Vec4 bounds;               // the mesh's bounding sphere: local center and radius
+   float rotation;            // in turns
+   uint32_t instanceCount;
+   uint32_t indexCount;       // for every draw
+   uint32_t pad;
+   uint64_t outputBase;       // GPU address of the output matrices, or a packed BindlessRef
+   uint64_t pad2;
+};
+
+static_assert(sizeof(CullConstants) == 208, "CullConstants doesn't match the cbuffer in cull.comp");
+
+// One indirect command: where its instance matrices are, then
+// DrawIndexedInstanced's arguments.
+struct CullDrawCommand {
+   uint64_t instances;        // outputBase plus the group's offset
+   uint32_t indexCount;
+   uint32_t instanceCount;
+   uint32_t startIndex;
+   int32_t baseVertex;
+   uint32_t startInstance;
+   uint32_t pad;
+};
+
+static_assert(sizeof(CullDrawCommand) == 32, "CullDrawCommand is written by cull.comp as two uint4s");
+
+static inline uint32_t CullGroupCount(uint32_t instanceCount)
+{
+   return (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+}
+
+// The six planes bounding what clipFromWorld maps into D3D's clip volume
+// (0 <= z <= w), as left, right, bottom, top, near, far.
+void CullFrustumPlanes(const Mat4 *clipFromWorld, Vec4 planes[6]);
+
+// A sphere around the box from boundsMin to boundsMax.
+Vec4 CullBoundingSphere(const float boundsMin[3], const float boundsMax[3]);
+
+// Whether any of the sphere at center with radius is inside all six planes.
+static inline bool CullSphereVisible(const Vec4 planes[6], float x, float y, float z, float radius)
+{
+   for (int i = 0; i < 6; ++i) {
+      if (planes[i].x * x + planes[i].y * y + planes[i].z * z + planes[i].w < -radius) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// What thread groups [firstGroup, firstGroup + groupCount) of cull.comp
+// write: the visible instances' clip matrices to output, starting at
+// group * CULL_GROUP_SIZE for each group, and how many there are to
+// groupCounts[group].
+void CullGroups(const CullConstants *constants, const CullInstance *instances, Mat4 *output,
+   uint32_t *groupCounts, uint32_t firstGroup, uint32_t groupCount);
+
+// The compacted commands for groupCounts, in group order. Returns how many
+// there are, i.e. what the shader leaves in the count buffer.
+uint32_t CullBuildCommands(const CullConstants *constants, const uint32_t *groupCounts,
+   CullDrawCommand *commands);
+
+// Both of the above for the whole scene, with the groups spread across the
+// job system. output, groupCounts and commands must have room for every
+// group of constants->instanceCount.
+uint32_t CullScene(const CullConstants *constants, const CullInstance *instances, Mat4 *output,
+   uint32_t *groupCounts, CullDrawCommand *commands);
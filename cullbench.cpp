@@ -0,0 +1,191 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Times CPU frustum culling (frustum.h, bvh.h) over scenes of 10K to 10M
+// objects:
+//
+//    cullbench [--workers N] [--max N] [--views N]
+//
+// Objects are spheres scattered over a square field, at the same density as
+// the demo's grid, and the camera stands in the middle looking along it, so
+// about a fifth of them are visible. Each scene is culled from --views
+// directions by brute force and through the BVH, on one thread and on all of
+// them, and then 1% of the objects move and the tree is updated.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "bvh.h"
+#include "cull.h"
+#include "jobs.h"
+#include "profiler.h"
+
+#define PI              3.14159265f
+#define OBJECT_SPACING  3.0f     // average distance between neighbours
+#define MOVED_FRACTION  100      // one in this many objects moves per update
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--workers N] [--max N] [--views N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static float random01(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+struct Scene {
+   float size;
+   std::vector<float> x, y, z, radius;
+   BoundingSpheres spheres;
+};
+
+static void makeScene(Scene *scene, uint32_t count, uint32_t *seed)
+{
+   scene->size = sqrtf((float)count) * OBJECT_SPACING;
+   scene->x.resize(count);
+   scene->y.resize(count);
+   scene->z.resize(count);
+   scene->radius.resize(count);
+   for (uint32_t i = 0; i < count; ++i) {
+      scene->x[i] = (random01(seed) - 0.5f) * scene->size;
+      scene->y[i] = (random01(seed) - 0.5f) * 4.0f;
+      scene->z[i] = (random01(seed) - 0.5f) * scene->size;
+      scene->radius[i] = 0.5f + random01(seed) * 1.5f;
+   }
+   scene->spheres.centerX = scene->x.data();
+   scene->spheres.centerY = scene->y.data();
+   scene->spheres.centerZ = scene->z.data();
+   scene->spheres.radius = scene->radius.data();
+   scene->spheres.count = count;
+}
+
+// From the middle of the field, looking along it at yaw, out to its edge.
+static void viewPlanes(const Scene *scene, float yaw, Vec4 planes[6])
+{
+   Mat4 viewFromWorld, clipFromView, clipFromWorld;
+   Vec3 eye = { 0.0f, 2.0f, 0.0f };
+   Vec3 target = { sinf(yaw), 2.0f, cosf(yaw) };
+   Vec3 up = { 0.0f, 1.0f, 0.0f };
+   mat4LookAt(&viewFromWorld, eye, target, up);
+   mat4PerspectiveFov(&clipFromView, PI / 2.0f, 16.0f / 9.0f, 0.5f, scene->size * 0.5f);
+   mat4Mul(&clipFromWorld, &clipFromView, &viewFromWorld);
+   CullFrustumPlanes(&clipFromWorld, planes);
+}
+
+static double millisecondsSince(int64_t start)
+{
+   return (ProfilerNow() - start) * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t workers = 0, maxObjects = 10000000, views = 16;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--workers") == 0) {
+         workers = value;
+      } else if (strcmp(argv[i], "--max") == 0) {
+         maxObjects = value;
+      } else if (strcmp(argv[i], "--views") == 0 && value > 0) {
+         views = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   JobSystemInit(workers);
+   printf("%u threads, mean ms per view over %u views\n", JobThreadCount(), views);
+   printf("%10s %10s %10s %10s %10s %10s %10s %10s\n",
+      "objects", "visible", "build", "brute", "bvh", "bvh par", "update", "rebuilds");
+
+   uint32_t seed = 1;
+   for (uint32_t count = 10000; count <= maxObjects; count *= 10) {
+      Scene scene;
+      makeScene(&scene, count, &seed);
+      std::vector<uint32_t> visible(count), check(count);
+
+      Bvh bvh;
+      int64_t start = ProfilerNow();
+      BvhBuild(&bvh, &scene.spheres);
+      double buildMs = millisecondsSince(start);
+
+      double bruteMs = 0.0, bvhMs = 0.0, parallelMs = 0.0;
+      uint64_t visibleTotal = 0;
+      for (uint32_t view = 0; view < views; ++view) {
+         Vec4 planes[6];
+         viewPlanes(&scene, view * 2.0f * PI / views, planes);
+
+         start = ProfilerNow();
+         uint32_t bruteCount = FrustumCullSpheres(planes, &scene.spheres, 0, count, nullptr, check.data());
+         bruteMs += millisecondsSince(start);
+
+         start = ProfilerNow();
+         uint32_t bvhCount = BvhCull(&bvh, planes, visible.data());
+         bvhMs += millisecondsSince(start);
+
+         start = ProfilerNow();
+         uint32_t parallelCount = BvhCullParallel(&bvh, planes, visible.data());
+         parallelMs += millisecondsSince(start);
+
+         // Same objects, in slot order rather than by id.
+         if (bvhCount != bruteCount || parallelCount != bruteCount) {
+            fprintf(stderr, "%u objects: brute force kept %u, the BVH %u and %u\n", count, bruteCount, bvhCount, parallelCount);
+            JobSystemShutdown();
+            return 1;
+         }
+         visibleTotal += bruteCount;
+      }
+
+      // Random moves within a few spacings, as for things wandering about.
+      uint32_t moved = count / MOVED_FRACTION;
+      std::vector<uint32_t> ids(moved);
+      for (uint32_t i = 0; i < moved; ++i) {
+         uint32_t id = (uint32_t)(random01(&seed) * count) % count;
+         ids[i] = id;
+         scene.x[id] += (random01(&seed) - 0.5f) * 4.0f * OBJECT_SPACING;
+         scene.z[id] += (random01(&seed) - 0.5f) * 4.0f * OBJECT_SPACING;
+      }
+      start = ProfilerNow();
+      BvhUpdate(&bvh, &scene.spheres, ids.data(), moved);
+      double updateMs = millisecondsSince(start);
+
+      printf("%10u %10.0f %10.3f %10.3f %10.3f %10.3f %10.3f %10u\n", count, (double)visibleTotal / views,
+         buildMs, bruteMs / views, bvhMs / views, parallelMs / views, updateMs, bvh.rebuilds);
+   }
+
+   JobSystemShutdown();
+   return 0;
+}
@@ -0,0 +1,384 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <string.h>
+
+#include "culling.h"
+#include "descriptors.h"
+#include "gpumemory.h"
+#include "shaders.h"
+#include "transfers.h"
+#include "upload.h"
+#include "D3DCompiler.h"
+
+#define CULL_SHADER_PATH   "cull.comp"
+#define CULL_MIN_GROUPS    16    // smallest per-frame capacity, grown in powers of two
+
+// Root parameters of the culling root signature, in register order.
+enum CullRootParam {
+   CULL_PARAM_CONSTANTS,      // b0
+   CULL_PARAM_SCENE,          // t0
+   CULL_PARAM_INSTANCES,      // u0
+   CULL_PARAM_COMMANDS,       // u1
+   CULL_PARAM_COUNT,          // u2
+   CULL_PARAM_GROUP_COUNTS,   // u3
+   CULL_PARAM_TOTAL,
+};
+
+static bool createBuffer(Dx12Device *device, UINT64 size, D3D12_RESOURCE_FLAGS flags, Dx12Allocation *buffer)
+{
+   D3D12_RESOURCE_DESC desc = {};
+   desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+   desc.Width = size;
+   desc.Height = 1;
+   desc.DepthOrArraySize = 1;
+   desc.MipLevels = 1;
+   desc.Format = DXGI_FORMAT_UNKNOWN;
+   desc.SampleDesc.Count = 1;
+   desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+   desc.Flags = flags;
+
+   // COMMON, so any queue can promote it to what it needs.
+   return AllocResource(device, D3D12_HEAP_TYPE_DEFAULT, &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, buffer);
+}
+
+// The slot's buffers last had their final use in a frame that has retired,
+// so the old ones only need to outlive frames still in flight on other slots.
+static bool growFrame(Dx12CullFrame *frame, Dx12Device *device, uint32_t groups)
+{
+   uint32_t capacity = frame->capacity ? frame->capacity : CULL_MIN_GROUPS;
+   while (capacity < groups) {
+      capacity *= 2;
+   }
+
+   Dx12Allocation instances, commands, count, groupCounts;
+   uint32_t view = DESCRIPTOR_INVALID;
+   const D3D12_RESOURCE_FLAGS uav = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+   if (!createBuffer(device, (UINT64)capacity * CULL_GROUP_SIZE * sizeof(Mat4), uav, &instances) ||
+      !createBuffer(device, (UINT64)capacity * sizeof(CullDrawCommand), uav, &commands) ||
+      !createBuffer(device, sizeof(uint32_t), uav, &count) ||
+      !createBuffer(device, (UINT64)capacity * sizeof(uint32_t), uav, &groupCounts) ||
+      !AddBindlessBuffer(device, instances.resource.Get(), &view)) {
+      FreeResource(device, &instances);
+      FreeResource(device, &commands);
+      FreeResource(device, &count);
+      FreeResource(device, &groupCounts);
+      return false;
+   }
+
+   RemoveBindlessBuffer(device, &frame->view);
+   FreeResource(device, &frame->instances);
+   FreeResource(device, &frame->commands);
+   FreeResource(device, &frame->count);
+   FreeResource(device, &frame->groupCounts);
+   frame->instances = std::move(instances);
+   frame->commands = std::move(commands);
+   frame->count = std::move(count);
+   frame->groupCounts = std::move(groupCounts);
+   frame->capacity = capacity;
+   frame->view = view;
+   return true;
+}
+
+bool CreateCulling(Dx12Culling *culling, Dx12Device *device, const Dx12Pipelines *pipelines)
+{
+   ID3D12Device *d3dDevice = device->device.Get();
+
+   UINT compileFlags = 0;
+#ifndef NDEBUG
+   compileFlags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+   D3D12_SHADER_BYTECODE computeCode, compactCode;
+   if (!CompileShader(&device->shaderCache, CULL_SHADER_PATH, nullptr, "main", "cs_5_0", compileFlags, &computeCode) ||
+      !CompileShader(&device->shaderCache, CULL_SHADER_PATH, nullptr, "compact", "cs_5_0", compileFlags, &compactCode)) {
+      return false;
+   }
+
+   // Everything is a root descriptor, so the dispatch needs no descriptor heap.
+   D3D12_ROOT_PARAMETER params[CULL_PARAM_TOTAL];
+   static const D3D12_ROOT_PARAMETER_TYPE paramTypes[CULL_PARAM_TOTAL] = {
+      D3D12_ROOT_PARAMETER_TYPE_CBV,
+      D3D12_ROOT_PARAMETER_TYPE_SRV,
+      D3D12_ROOT_PARAMETER_TYPE_UAV,
+      D3D12_ROOT_PARAMETER_TYPE_UAV,
+      D3D12_ROOT_PARAMETER_TYPE_UAV,
+      D3D12_ROOT_PARAMETER_TYPE_UAV,
+   };
+   static const UINT paramRegisters[CULL_PARAM_TOTAL] = { 0, 0, 0, 1, 2, 3 };
+   for (UINT i = 0; i < CULL_PARAM_TOTAL; ++i) {
+      params[i].ParameterType = paramTypes[i];
+      params[i].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+      params[i].Descriptor.ShaderRegister = paramRegisters[i];
+      params[i].Descriptor.RegisterSpace = 0;
+   }
+
+   D3D12_ROOT_SIGNATURE_DESC rsDesc;
+   rsDesc.NumParameters = CULL_PARAM_TOTAL;
+   rsDesc.pParameters = params;
+   rsDesc.NumStaticSamplers = 0;
+   rsDesc.pStaticSamplers = nullptr;
+   rsDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+
+   D3D12_SHADER_BYTECODE rootSignatureCode;
+   ComPtr<ID3D12RootSignature> rootSignature;
+   if (!SerializeRootSignature(&device->shaderCache, &rsDesc, &rootSignatureCode) ||
+      FAILED(d3dDevice->CreateRootSignature(0, rootSignatureCode.pShaderBytecode, rootSignatureCode.BytecodeLength,
+         IID_PPV_ARGS(&rootSignature)))) {
+      return false;
+   }
+
+   D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+   psoDesc.pRootSignature = rootSignature.Get();
+   psoDesc.CS = computeCode;
+
+   ComPtr<ID3D12PipelineState> pipeline, compactPipeline;
+   if (!CreateComputePipeline(&device->shaderCache, d3dDevice, &psoDesc, &rootSignatureCode, &pipeline)) {
+      return false;
+   }
+   psoDesc.CS = compactCode;
+   if (!CreateComputePipeline(&device->shaderCache, d3dDevice, &psoDesc, &rootSignatureCode, &compactPipeline)) {
+      return false;
+   }
+
+   // Laid out as CullDrawCommand: the instance buffer's root SRV, or the root
+   // constants of a packed BindlessRef, then the draw.
+   D3D12_INDIRECT_ARGUMENT_DESC args[2] = {};
+   if (pipelines->bindless) {
+      args[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+      args[0].Constant.RootParameterIndex = DRAW_PARAM_INSTANCES;
+      args[0].Constant.DestOffsetIn32BitValues = 0;
+      args[0].Constant.Num32BitValuesToSet = sizeof(BindlessRef) / 4;
+   } else {
+      args[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+      args[0].ShaderResourceView.RootParameterIndex = DRAW_PARAM_INSTANCES;
+   }
+   args[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+   D3D12_COMMAND_SIGNATURE_DESC sigDesc = {};
+   sigDesc.ByteStride = sizeof(CullDrawCommand);
+   sigDesc.NumArgumentDescs = ARRAY_COUNT(args);
+   sigDesc.pArgumentDescs = args;
+
+   ComPtr<ID3D12CommandSignature> commandSignature;
+   if (FAILED(d3dDevice->CreateCommandSignature(&sigDesc, pipelines->rootSignature.Get(), IID_PPV_ARGS(&commandSignature)))) {
+      return false;
+   }
+
+   D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+   queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+   queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+
+   ComPtr<ID3D12CommandQueue> commandQueue;
+   ComPtr<ID3D12Fence> fence;
+   if (FAILED(d3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue))) ||
+      FAILED(d3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)))) {
+      return false;
+   }
+
+   for (size_t i = 0; i < ARRAY_COUNT(culling->frames); ++i) {
+      if (FAILED(d3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&culling->frames[i].allocator)))) {
+         return false;
+      }
+      culling->frames[i].capacity = 0;
+      culling->frames[i].view = DESCRIPTOR_INVALID;
+   }
+
+   ComPtr<ID3D12GraphicsCommandList> commandList;
+   if (FAILED(d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, culling->frames[0].allocator.Get(),
+      nullptr, IID_PPV_ARGS(&commandList)))) {
+      return false;
+   }
+   commandList->Close();
+
+   culling->fence.event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+   culling->fence.fence = std::move(fence);
+   culling->commandQueue = std::move(commandQueue);
+   culling->rootSignature = std::move(rootSignature);
+   culling->pipeline = std::move(pipeline);
+   culling->compactPipeline = std::move(compactPipeline);
+   culling->commandSignature = std::move(commandSignature);
+   culling->commandList = std::move(commandList);
+   culling->sceneTransfer = 0;
+   culling->sceneCount = 0;
+   culling->signaled = 0;
+   culling->frameGroups = 0;
+   culling->frameCulled = false;
+   return true;
+}
+
+void DestroyCulling(Dx12Culling *culling, Dx12Device *device)
+{
+   if (culling->commandQueue && culling->fence.CompletedValue() < culling->signaled) {
+      culling->fence.Block(culling->signaled);
+   }
+
+   if (culling->scene.resource) {
+      // Stages what's left of the upload, so sceneData can go.
+      TransferFlush(&device->transfers.queue, culling->sceneTransfer);
+   }
+   FreeResource(device, &culling->scene);
+   culling->sceneData.clear();
+   culling->sceneCount = 0;
+
+   for (size_t i = 0; i < ARRAY_COUNT(culling->frames); ++i) {
+      Dx12CullFrame *frame = &culling->frames[i];
+      RemoveBindlessBuffer(device, &frame->view);
+      FreeResource(device, &frame->instances);
+      FreeResource(device, &frame->commands);
+      FreeResource(device, &frame->count);
+      FreeResource(device, &frame->groupCounts);
+      frame->allocator = nullptr;
+      frame->capacity = 0;
+   }
+
+   culling->commandList = nullptr;
+   culling->commandSignature = nullptr;
+   culling->pipeline = nullptr;
+   culling->compactPipeline = nullptr;
+   culling->rootSignature = nullptr;
+   CloseHandle(culling->fence.event);
+   culling->fence.event = NULL;
+   culling->fence.fence = nullptr;
+   culling->commandQueue = nullptr;
+}
+
+bool SetCullingScene(Dx12Culling *culling, Dx12Device *device, const CullInstance *instances, uint32_t count)
+{
+   ASSERT(!culling->frameCulled);
+
+   // The old upload has to be staged before its source is overwritten.
+   if (culling->scene.resource) {
+      TransferFlush(&device->transfers.queue, culling->sceneTransfer);
+   }
+
+   Dx12Allocation scene;
+   if (count && !createBuffer(device, (UINT64)count * sizeof(CullInstance), D3D12_RESOURCE_FLAG_NONE, &scene)) {
+      return false;
+   }
+
+   FreeResource(device, &culling->scene);
+   culling->sceneData.assign(instances, instances + count);
+   culling->sceneCount = count;
+   culling->sceneTransfer = 0;
+   if (count) {
+      culling->sceneTransfer = UploadBuffer(&device->transfers, scene.resource.Get(), 0, culling->sceneData.data(),
+         (UINT64)count * sizeof(CullInstance), nullptr, nullptr);
+   }
+   culling->scene = std::move(scene);
+   return true;
+}
+
+void DispatchCulling(Dx12Culling *culling, Dx12Device *device, UINT frameIdx, uint64_t fenceValue,
+   const CullConstants *constants)
+{
+   ASSERT(!culling->frameCulled);
+   culling->frameCulled = true;
+   culling->frameGroups = 0;
+
+   uint32_t groups = CullGroupCount(culling->sceneCount);
+   Dx12CullFrame *frame = &culling->frames[frameIdx];
+   if (!groups || (frame->capacity < groups && !growFrame(frame, device, groups))) {
+      return;
+   }
+
+   Dx12UploadAlloc constantsAlloc;
+   if (!UploadRingAlloc(&device->uploadRing, sizeof(CullConstants), UPLOAD_ALIGNMENT, &constantsAlloc)) {
+      return;
+   }
+
+   CullConstants *frameConstants = (CullConstants *)constantsAlloc.cpu;
+   memcpy(frameConstants, constants, sizeof(*frameConstants));
+   frameConstants->instanceCount = culling->sceneCount;
+   frameConstants->outputBase = frame->instances.resource->GetGPUVirtualAddress();
+   if (frame->view != DESCRIPTOR_INVALID) {
+      // The shader adds byte offsets to this and writes it into the
+      // commands, which is just as right for a packed BindlessRef.
+      BindlessRef ref = { 0, frame->view };
+      frameConstants->outputBase = BindlessPack(ref);
+   }
+
+   // The slot's last frame has retired, so its allocator is free.
+   ID3D12GraphicsCommandList *commandList = culling->commandList.Get();
+   DX_VERIFY(frame->allocator->Reset());
+   DX_VERIFY(commandList->Reset(frame->allocator.Get(), culling->pipeline.Get()));
+
+   commandList->SetComputeRootSignature(culling->rootSignature.Get());
+   commandList->SetComputeRootConstantBufferView(CULL_PARAM_CONSTANTS, constantsAlloc.gpu);
+   commandList->SetComputeRootShaderResourceView(CULL_PARAM_SCENE, culling->scene.resource->GetGPUVirtualAddress());
+   commandList->SetComputeRootUnorderedAccessView(CULL_PARAM_INSTANCES, frame->instances.resource->GetGPUVirtualAddress());
+   commandList->SetComputeRootUnorderedAccessView(CULL_PARAM_COMMANDS, frame->commands.resource->GetGPUVirtualAddress());
+   commandList->SetComputeRootUnorderedAccessView(CULL_PARAM_COUNT, frame->count.resource->GetGPUVirtualAddress());
+   commandList->SetComputeRootUnorderedAccessView(CULL_PARAM_GROUP_COUNTS, frame->groupCounts.resource->GetGPUVirtualAddress());
+
+   // Every buffer is promoted straight to a UAV. The compaction writes the
+   // commands and their count in group order once every group has its count.
+   commandList->Dispatch(groups, 1, 1);
+   D3D12_RESOURCE_BARRIER barrier = {};
+   barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+   barrier.UAV.pResource = frame->groupCounts.resource.Get();
+   commandList->ResourceBarrier(1, &barrier);
+   commandList->SetPipelineState(culling->compactPipeline.Get());
+   commandList->Dispatch(1, 1, 1);
+   DX_VERIFY(commandList->Close());
+
+   // Only the first frames after a new scene find its upload unfinished.
+   ID3D12CommandQueue *commandQueue = culling->commandQueue.Get();
+   uint64_t sceneWait = TransferFlush(&device->transfers.queue, culling->sceneTransfer);
+   if (sceneWait) {
+      DX_VERIFY(commandQueue->Wait(device->transfers.fence.fence.Get(), sceneWait));
+   }
+
+   ID3D12CommandList *lists[] = { commandList };
+   commandQueue->ExecuteCommandLists(1, lists);
+   DX_VERIFY(commandQueue->Signal(culling->fence.fence.Get(), fenceValue));
+   culling->signaled = fenceValue;
+   culling->frameGroups = groups;
+}
+
+void CullingBeforeSubmit(Dx12Culling *culling, ID3D12CommandQueue *commandQueue)
+{
+   if (culling->frameGroups) {
+      DX_VERIFY(commandQueue->Wait(culling->fence.fence.Get(), culling->signaled));
+   }
+}
+
+void CmdDrawCulled(ID3D12GraphicsCommandList *commandList, const Dx12Culling *culling, UINT frameIdx)
+{
+   ASSERT(culling->frameCulled);
+   if (!culling->frameGroups) {
+      return;
+   }
+
+   // At most one command per group; the count buffer says how many there are.
+   const Dx12CullFrame *frame = &culling->frames[frameIdx];
+   commandList->ExecuteIndirect(culling->commandSignature.Get(), culling->frameGroups,
+      frame->commands.resource.Get(), 0, frame->count.resource.Get(), 0);
+}
+
+void CullingEndFrame(Dx12Culling *culling)
+{
+   culling->frameCulled = false;
+   culling->frameGroups = 0;
+}
@@ -0,0 +1,58 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "dx12demo.h"
+
+// Compiles cull.comp and creates the compute queue and the command signature
+// CmdDrawCulled executes. Commands set the instance buffer through the
+// pipelines' root signature, so they're tied to it.
+bool CreateCulling(Dx12Culling *culling, Dx12Device *device, const Dx12Pipelines *pipelines);
+
+// Waits for the compute queue to go idle. Buffers go to the deferred-release
+// queue.
+void DestroyCulling(Dx12Culling *culling, Dx12Device *device);
+
+// Copies the instances and queues them for upload into a new scene buffer,
+// releasing the old one once the frames using it are done. Not between
+// DispatchCulling and the end of that frame.
+bool SetCullingScene(Dx12Culling *culling, Dx12Device *device, const CullInstance *instances, uint32_t count);
+
+// Records and submits the culling dispatch for the frame with fence value
+// fenceValue, in slot frameIdx. constants' instance count and output address
+// are filled in here. The compute queue waits for the scene's upload, if
+// need be, and signals the culling fence with fenceValue once done.
+void DispatchCulling(Dx12Culling *culling, Dx12Device *device, UINT frameIdx, uint64_t fenceValue,
+   const CullConstants *constants);
+
+// Makes commandQueue wait for this frame's dispatch, if there was one, before
+// running what's submitted to it next.
+void CullingBeforeSubmit(Dx12Culling *culling, ID3D12CommandQueue *commandQueue);
+
+// Draws what this frame's dispatch left: as many commands as it wrote to the
+// count buffer, each setting root parameter 0 and drawing the bound mesh.
+void CmdDrawCulled(ID3D12GraphicsCommandList *commandList, const Dx12Culling *culling, UINT frameIdx);
+
+void CullingEndFrame(Dx12Culling *culling);
@@ -0,0 +1,106 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "common.h"
+#include "descalloc.h"
+
+void DescriptorAllocatorInit(DescriptorAllocator *alloc, uint32_t persistentCount, uint32_t transientCount)
+{
+   alloc->persistentCount = persistentCount;
+   alloc->transientCount = transientCount;
+
+   // Reversed so slots come out in increasing order.
+   alloc->freeList.resize(persistentCount);
+   for (uint32_t i = 0; i < persistentCount; ++i) {
+      alloc->freeList[i] = persistentCount - 1 - i;
+   }
+
+   alloc->pendingFrees.clear();
+   alloc->pendingFirst = 0;
+   RingInit(&alloc->transient, transientCount);
+   alloc->persistentInUse = 0;
+   alloc->persistentHighWater = 0;
+}
+
+uint32_t DescriptorAllocPersistent(DescriptorAllocator *alloc)
+{
+   if (alloc->freeList.empty()) {
+      return DESCRIPTOR_INVALID;
+   }
+
+   uint32_t index = alloc->freeList.back();
+   alloc->freeList.pop_back();
+
+   if (++alloc->persistentInUse > alloc->persistentHighWater) {
+      alloc->persistentHighWater = alloc->persistentInUse;
+   }
+   return index;
+}
+
+void DescriptorFreePersistent(DescriptorAllocator *alloc, uint32_t index, uint64_t fenceValue)
+{
+   ASSERT(index < alloc->persistentCount);
+   ASSERT(alloc->pendingFrees.size() == alloc->pendingFirst || alloc->pendingFrees.back().fenceValue <= fenceValue);
+
+   DescriptorAllocator::PendingFree pending;
+   pending.fenceValue = fenceValue;
+   pending.index = index;
+   alloc->pendingFrees.push_back(pending);
+}
+
+void DescriptorBeginFrame(DescriptorAllocator *alloc, uint64_t completedValue)
+{
+   size_t first = alloc->pendingFirst;
+   while (first < alloc->pendingFrees.size() && alloc->pendingFrees[first].fenceValue <= completedValue) {
+      alloc->freeList.push_back(alloc->pendingFrees[first].index);
+      --alloc->persistentInUse;
+      ++first;
+   }
+
+   if (first == alloc->pendingFrees.size()) {
+      alloc->pendingFrees.clear();
+      first = 0;
+   } else if (first > alloc->pendingFrees.size() / 2) {
+      alloc->pendingFrees.erase(alloc->pendingFrees.begin(), alloc->pendingFrees.begin() + first);
+      first = 0;
+   }
+   alloc->pendingFirst = first;
+
+   RingBeginFrame(&alloc->transient, completedValue);
+}
+
+uint32_t DescriptorAllocTransient(DescriptorAllocator *alloc, uint32_t count)
+{
+   uint64_t offset = RingAlloc(&alloc->transient, count, 1);
+   if (offset == RING_INVALID) {
+      return DESCRIPTOR_INVALID;
+   }
+   return alloc->persistentCount + (uint32_t)offset;
+}
+
+void DescriptorEndFrame(DescriptorAllocator *alloc, uint64_t fenceValue)
+{
+   RingEndFrame(&alloc->transient, fenceValue);
+}
@@ -0,0 +1,76 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "ring.h"
+
+#define DESCRIPTOR_INVALID UINT32_MAX
+
+// Index bookkeeping for a shader-visible descriptor heap. The bottom
+// persistentCount slots are handed out one at a time from a free list; the
+// rest form a ring that transient tables are bump-allocated from each frame.
+// Both halves are fenced: a freed persistent slot and a frame's transient
+// tables only become reusable once the fence value they were retired with has
+// completed. Holds no device objects.
+struct DescriptorAllocator {
+   uint32_t persistentCount;
+   uint32_t transientCount;
+
+   std::vector<uint32_t> freeList;
+
+   struct PendingFree {
+      uint64_t fenceValue;
+      uint32_t index;
+   };
+   std::vector<PendingFree> pendingFrees;  // in fence order
+   size_t pendingFirst;
+
+   RingAllocator transient;
+
+   uint32_t persistentInUse;
+   uint32_t persistentHighWater;
+};
+
+void DescriptorAllocatorInit(DescriptorAllocator *alloc, uint32_t persistentCount, uint32_t transientCount);
+
+// Returns a persistent slot, or DESCRIPTOR_INVALID if they're all taken.
+uint32_t DescriptorAllocPersistent(DescriptorAllocator *alloc);
+
+// The slot goes back on the free list once fenceValue has completed.
+void DescriptorFreePersistent(DescriptorAllocator *alloc, uint32_t index, uint64_t fenceValue);
+
+// Reclaims persistent slots and transient tables retired at or before completedValue.
+void DescriptorBeginFrame(DescriptorAllocator *alloc, uint64_t completedValue);
+
+// Returns the first slot of count contiguous transient slots that stay valid
+// until the current frame retires, or DESCRIPTOR_INVALID if the ring is full.
+uint32_t DescriptorAllocTransient(DescriptorAllocator *alloc, uint32_t count);
+
+void DescriptorEndFrame(DescriptorAllocator *alloc, uint64_t fenceValue);
@@ -0,0 +1,310 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks the descriptor allocator (descalloc.h) without a GPU:
+//
+//    descalloctest [--frames N] [--frames-in-flight N]
+//
+// Fixed cases first: the persistent free list, frees held until their fence
+// value completes, and transient tables wrapping around the ring. Then a run
+// of frames paced by a null fence and a timeline, as the backends pace
+// theirs, taking and freeing slots and tables at random and checking them
+// against a model of what's still in use. Prints nothing and returns 0 if
+// everything holds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "common.h"
+#include "descalloc.h"
+#include "nullrender.h"
+#include "timeline.h"
+
+static uint32_t s_failures;
+
+#define CHECK(x) \
+   do { \
+      if (!(x)) { \
+         fprintf(stderr, "%s(%d): %s\n", __FILE__, __LINE__, #x); \
+         ++s_failures; \
+      } \
+   } while (0)
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--frames N] [--frames-in-flight N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static uint32_t random32(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return *state >> 8;
+}
+
+static void testFreeList()
+{
+   DescriptorAllocator alloc;
+   DescriptorAllocatorInit(&alloc, 4, 0);
+
+   for (uint32_t i = 0; i < 4; ++i) {
+      CHECK(DescriptorAllocPersistent(&alloc) == i);
+   }
+   CHECK(DescriptorAllocPersistent(&alloc) == DESCRIPTOR_INVALID);
+   CHECK(alloc.persistentInUse == 4 && alloc.persistentHighWater == 4);
+
+   // Freed slots are reused, most recently freed first.
+   DescriptorFreePersistent(&alloc, 2, 1);
+   DescriptorFreePersistent(&alloc, 0, 1);
+   DescriptorBeginFrame(&alloc, 1);
+   CHECK(alloc.persistentInUse == 2);
+   CHECK(DescriptorAllocPersistent(&alloc) == 0);
+   CHECK(DescriptorAllocPersistent(&alloc) == 2);
+   CHECK(DescriptorAllocPersistent(&alloc) == DESCRIPTOR_INVALID);
+   CHECK(alloc.persistentHighWater == 4);
+
+   // Going round many times doesn't leave the pending list growing.
+   for (uint64_t fence = 2; fence < 1000; ++fence) {
+      DescriptorFreePersistent(&alloc, 3, fence);
+      DescriptorBeginFrame(&alloc, fence);
+      CHECK(DescriptorAllocPersistent(&alloc) == 3);
+   }
+   CHECK(alloc.pendingFrees.size() - alloc.pendingFirst == 0);
+   CHECK(alloc.pendingFrees.capacity() < 16);
+}
+
+static void testFencedFrees()
+{
+   DescriptorAllocator alloc;
+   DescriptorAllocatorInit(&alloc, 3, 0);
+   for (uint32_t i = 0; i < 3; ++i) {
+      DescriptorAllocPersistent(&alloc);
+   }
+
+   NullFence fence;
+   Timeline timeline;
+   TimelineInit(&timeline, &fence);
+
+   DescriptorFreePersistent(&alloc, 1, 5);
+   DescriptorFreePersistent(&alloc, 0, 7);
+   DescriptorFreePersistent(&alloc, 2, 7);
+
+   // Nothing comes back until the GPU has got past the frame that freed it.
+   fence.value = 4;
+   DescriptorBeginFrame(&alloc, TimelinePoll(&timeline));
+   CHECK(DescriptorAllocPersistent(&alloc) == DESCRIPTOR_INVALID);
+
+   TimelineWait(&timeline, 5);
+   DescriptorBeginFrame(&alloc, timeline.completed);
+   CHECK(DescriptorAllocPersistent(&alloc) == 1);
+   CHECK(DescriptorAllocPersistent(&alloc) == DESCRIPTOR_INVALID);
+
+   fence.value = 6;
+   DescriptorBeginFrame(&alloc, TimelinePoll(&timeline));
+   CHECK(DescriptorAllocPersistent(&alloc) == DESCRIPTOR_INVALID);
+
+   // Past both at once.
+   fence.value = 9;
+   DescriptorBeginFrame(&alloc, TimelinePoll(&timeline));
+   uint32_t a = DescriptorAllocPersistent(&alloc);
+   uint32_t b = DescriptorAllocPersistent(&alloc);
+   CHECK((a == 0 && b == 2) || (a == 2 && b == 0));
+   CHECK(DescriptorAllocPersistent(&alloc) == DESCRIPTOR_INVALID);
+}
+
+static void testRingWrap()
+{
+   DescriptorAllocator alloc;
+   DescriptorAllocatorInit(&alloc, 2, 8);
+
+   // Frame 1 takes six of the eight slots.
+   DescriptorBeginFrame(&alloc, 0);
+   CHECK(DescriptorAllocTransient(&alloc, 3) == 2);
+   CHECK(DescriptorAllocTransient(&alloc, 3) == 5);
+   DescriptorEndFrame(&alloc, 1);
+
+   // Frame 2 can't wrap while frame 1 holds the start, so three don't fit;
+   // two do, at the end.
+   DescriptorBeginFrame(&alloc, 0);
+   CHECK(DescriptorAllocTransient(&alloc, 3) == DESCRIPTOR_INVALID);
+   CHECK(DescriptorAllocTransient(&alloc, 2) == 8);
+   DescriptorEndFrame(&alloc, 2);
+
+   // Once frame 1 retires, frame 3 wraps to the start. A table never
+   // straddles the end, and frame 2's slots stay out of reach.
+   DescriptorBeginFrame(&alloc, 1);
+   CHECK(DescriptorAllocTransient(&alloc, 3) == 2);
+   CHECK(DescriptorAllocTransient(&alloc, 4) == DESCRIPTOR_INVALID);
+   CHECK(DescriptorAllocTransient(&alloc, 3) == 5);
+   CHECK(DescriptorAllocTransient(&alloc, 1) == DESCRIPTOR_INVALID);
+   DescriptorEndFrame(&alloc, 3);
+
+   // With everything retired, the whole ring is free again, in two pieces
+   // either side of the wrap. A table bigger than the ring never fits, and
+   // neither does an empty one.
+   DescriptorBeginFrame(&alloc, 3);
+   CHECK(DescriptorAllocTransient(&alloc, 9) == DESCRIPTOR_INVALID);
+   CHECK(DescriptorAllocTransient(&alloc, 0) == DESCRIPTOR_INVALID);
+   CHECK(DescriptorAllocTransient(&alloc, 2) == 8);
+   CHECK(DescriptorAllocTransient(&alloc, 6) == 2);
+   CHECK(DescriptorAllocTransient(&alloc, 1) == DESCRIPTOR_INVALID);
+   DescriptorEndFrame(&alloc, 4);
+}
+
+// Frames paced like the backends': before starting frame N, wait for frame
+// N - framesInFlight, reclaim what it freed, and tag the frame's tables with N
+// at the end. The fence sometimes runs ahead of the wait, as a GPU would.
+static void testFrames(uint32_t frames, uint32_t framesInFlight)
+{
+   const uint32_t persistentCount = 16, transientCount = 64;
+
+   struct Pending {
+      uint64_t fenceValue;
+      uint32_t index;
+   };
+   struct Table {
+      uint64_t fenceValue;
+      uint32_t first;
+      uint32_t count;
+   };
+
+   DescriptorAllocator alloc;
+   DescriptorAllocatorInit(&alloc, persistentCount, transientCount);
+   NullFence fence;
+   Timeline timeline;
+   TimelineInit(&timeline, &fence);
+
+   std::vector<uint32_t> live;
+   std::vector<Pending> pending;
+   std::vector<Table> tables;
+   uint32_t seed = 1;
+   uint64_t transientFailures = 0;
+   for (uint64_t frameNum = 1; frameNum <= frames; ++frameNum) {
+      if (random32(&seed) % 4 == 0 && fence.value + 1 < frameNum) {
+         fence.value += 1 + random32(&seed) % (frameNum - 1 - fence.value);
+      }
+      if (frameNum > framesInFlight) {
+         TimelineWait(&timeline, frameNum - framesInFlight);
+      }
+      uint64_t completed = timeline.completed;
+      DescriptorBeginFrame(&alloc, completed);
+
+      size_t kept = 0;
+      for (size_t i = 0; i < pending.size(); ++i) {
+         if (pending[i].fenceValue > completed) {
+            pending[kept++] = pending[i];
+         }
+      }
+      pending.resize(kept);
+      kept = 0;
+      for (size_t i = 0; i < tables.size(); ++i) {
+         if (tables[i].fenceValue > completed) {
+            tables[kept++] = tables[i];
+         }
+      }
+      tables.resize(kept);
+
+      // Persistent slots: never one that's in use or waiting on its fence.
+      uint32_t allocs = random32(&seed) % 3;
+      for (uint32_t j = 0; j < allocs; ++j) {
+         uint32_t index = DescriptorAllocPersistent(&alloc);
+         if (live.size() + pending.size() == persistentCount) {
+            CHECK(index == DESCRIPTOR_INVALID);
+            continue;
+         }
+         CHECK(index < persistentCount);
+         for (uint32_t other : live) {
+            CHECK(index != other);
+         }
+         for (const Pending &other : pending) {
+            CHECK(index != other.index);
+         }
+         live.push_back(index);
+      }
+      uint32_t frees = random32(&seed) % 3;
+      for (uint32_t j = 0; j < frees && !live.empty(); ++j) {
+         uint32_t k = random32(&seed) % live.size();
+         Pending freed = { frameNum, live[k] };
+         DescriptorFreePersistent(&alloc, freed.index, freed.fenceValue);
+         pending.push_back(freed);
+         live[k] = live.back();
+         live.pop_back();
+      }
+      CHECK(alloc.persistentInUse == live.size() + pending.size());
+
+      // Transient tables: contiguous, inside the ring, and clear of every
+      // table a frame in flight may still be reading.
+      uint32_t count = 1 + random32(&seed) % 16;
+      uint32_t first;
+      while ((first = DescriptorAllocTransient(&alloc, count)) != DESCRIPTOR_INVALID) {
+         CHECK(first >= persistentCount && first + count <= persistentCount + transientCount);
+         for (const Table &other : tables) {
+            CHECK(first + count <= other.first || other.first + other.count <= first);
+         }
+         Table table = { frameNum, first, count };
+         tables.push_back(table);
+         count = 1 + random32(&seed) % 16;
+      }
+      ++transientFailures;
+      DescriptorEndFrame(&alloc, frameNum);
+
+      if (s_failures > 0) {
+         fprintf(stderr, "frames: failed at frame %llu\n", (unsigned long long)frameNum);
+         return;
+      }
+   }
+
+   // Every frame filled the ring, so it must have wrapped many times.
+   CHECK(transientFailures == frames);
+   CHECK(timeline.stats.blockedWaits > 0 && timeline.stats.polledWaits + timeline.stats.cachedWaits > 0);
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t frames = 100000, framesInFlight = 3;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--frames") == 0) {
+         frames = value;
+      } else if (strcmp(argv[i], "--frames-in-flight") == 0 && value > 0 && value < RING_MAX_FRAMES) {
+         framesInFlight = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   testFreeList();
+   testFencedFrees();
+   testRingWrap();
+   testFrames(frames, framesInFlight);
+   return s_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "descriptors.h"
+
+bool CreateDescriptorHeap(Dx12DescriptorHeap *heap, ID3D12Device *device,
+   D3D12_DESCRIPTOR_HEAP_TYPE type, UINT descriptorCount, bool shaderVisible)
+{
+   ASSERT(heap);
+   ASSERT(device);
+   ASSERT(!shaderVisible || type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV || type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+
+   D3D12_DESCRIPTOR_HEAP_DESC heapDesc;
+   heapDesc.NumDescriptors = descriptorCount;
+   heapDesc.Type = type;
+   heapDesc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+   heapDesc.NodeMask = 0;
+   if (FAILED(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&heap->heap)))) {
+      return false;
+   }
+
+   heap->type = type;
+   heap->descriptorCount = descriptorCount;
+   heap->cpuStart = heap->heap->GetCPUDescriptorHandleForHeapStart();
+   if (shaderVisible) {
+      heap->gpuStart = heap->heap->GetGPUDescriptorHandleForHeapStart();
+   } else {
+      heap->gpuStart.ptr = 0;
+   }
+   heap->increment = device->GetDescriptorHandleIncrementSize(type);
+   return true;
+}
+
+bool CreateDescriptorAllocator(Dx12DescriptorAllocator *descriptors, ID3D12Device *device,
+   D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t persistentCount, uint32_t transientCount)
+{
+   if (!CreateDescriptorHeap(&descriptors->heap, device, type, persistentCount + transientCount, true)) {
+      return false;
+   }
+
+   DescriptorAllocatorInit(&descriptors->alloc, persistentCount, transientCount);
+   return true;
+}
+
+void DestroyDescriptorAllocator(Dx12DescriptorAllocator *descriptors)
+{
+   descriptors->heap.heap = nullptr;
+   DescriptorAllocatorInit(&descriptors->alloc, 0, 0);
+}
+
+bool AddBindlessBuffer(Dx12Device *device, ID3D12Resource *buffer, uint32_t *index)
+{
+   *index = DESCRIPTOR_INVALID;
+   if (!device->bindless.descriptors) {
+      return true;
+   }
+
+   D3D12_RESOURCE_DESC desc = buffer->GetDesc();
+   ASSERT(desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER && desc.Width % 4 == 0);
+   uint32_t slot = BindlessAddRange(&device->bindless, buffer->GetGPUVirtualAddress(), desc.Width);
+   if (slot == DESCRIPTOR_INVALID) {
+      return false;
+   }
+
+   // Raw, so one view serves every stride and offset.
+   D3D12_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+   viewDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+   viewDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+   viewDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+   viewDesc.Buffer.FirstElement = 0;
+   viewDesc.Buffer.NumElements = (UINT)(desc.Width / 4);
+   viewDesc.Buffer.StructureByteStride = 0;
+   viewDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+   device->device->CreateShaderResourceView(buffer, &viewDesc, DescriptorCpuHandle(&device->viewHeap.heap, slot));
+
+   *index = slot;
+   return true;
+}
+
+void RemoveBindlessBuffer(Dx12Device *device, uint32_t *index)
+{
+   if (*index == DESCRIPTOR_INVALID) {
+      return;
+   }
+
+   BindlessRemoveRange(&device->bindless, *index, device->frameNum - 1);
+   *index = DESCRIPTOR_INVALID;
+}
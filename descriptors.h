@@ -0,0 +1,62 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "dx12demo.h"
+
+bool CreateDescriptorHeap(Dx12DescriptorHeap *heap, ID3D12Device *device,
+   D3D12_DESCRIPTOR_HEAP_TYPE type, UINT descriptorCount, bool shaderVisible);
+
+// Creates a shader-visible heap of persistentCount + transientCount descriptors
+// and the bookkeeping that splits it between the free list and the ring.
+bool CreateDescriptorAllocator(Dx12DescriptorAllocator *descriptors, ID3D12Device *device,
+   D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t persistentCount, uint32_t transientCount);
+void DestroyDescriptorAllocator(Dx12DescriptorAllocator *descriptors);
+
+static inline D3D12_CPU_DESCRIPTOR_HANDLE DescriptorCpuHandle(const Dx12DescriptorHeap *heap, uint32_t index)
+{
+   ASSERT(index < heap->descriptorCount);
+   D3D12_CPU_DESCRIPTOR_HANDLE handle;
+   handle.ptr = heap->cpuStart.ptr + (SIZE_T)index * heap->increment;
+   return handle;
+}
+
+static inline D3D12_GPU_DESCRIPTOR_HANDLE DescriptorGpuHandle(const Dx12DescriptorHeap *heap, uint32_t index)
+{
+   ASSERT(index < heap->descriptorCount && heap->gpuStart.ptr);
+   D3D12_GPU_DESCRIPTOR_HANDLE handle;
+   handle.ptr = heap->gpuStart.ptr + (UINT64)index * heap->increment;
+   return handle;
+}
+
+// Writes a raw view of the whole of buffer into the bindless table, so
+// shaders can read any address in it. Does nothing and succeeds if bindless
+// is off, leaving *index DESCRIPTOR_INVALID; fails if the table is full.
+bool AddBindlessBuffer(Dx12Device *device, ID3D12Resource *buffer, uint32_t *index);
+
+// The view goes once the frames that could use it have retired. Nothing
+// happens for DESCRIPTOR_INVALID, which *index is left as.
+void RemoveBindlessBuffer(Dx12Device *device, uint32_t *index);
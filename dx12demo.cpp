@@ -23,473 +23,930 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
 */
 
-#include <math.h>
-#include <string.h>
+#include <stdio.h>
 
 #include "dx12demo.h"
-#include "D3DCompiler.h"
-
-#define PI 3.14159265f
-#define CUBE_SPIN_SPEED    0.5f // turns per second
+#include "barriers.h"
+#include "culling.h"
+#include "deferred.h"
+#include "descriptors.h"
+#include "gpumemory.h"
+#include "gpuprofile.h"
+#include "instancestore.h"
+#include "meshes.h"
+#include "pipelines.h"
+#include "shaders.h"
+#include "transfers.h"
+#include "transienttargets.h"
+#include "upload.h"
+
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define UPLOAD_RING_SIZE      (64ull << 20)
+#define TRANSFER_STAGING_SIZE (16ull << 20)
+#define VIEW_DESCRIPTORS      16384 // each of persistent and transient
+#define SAMPLER_DESCRIPTORS   1024  // ...likewise; 2048 is the shader-visible limit
+#define CUBE_MESH_PATH        "cube.mesh"  // relative to the working directory, like the shaders
+
+// Every pipeline the demo draws with, declared up front so they're all
+// created in the background at startup. Add variants here.
+static constexpr PipelineKey CUBE_PIPELINE = PipelineKey().withProgram(PROGRAM_CUBE)
+   .withDepth(PIPELINE_DEPTH_TEST_WRITE, PIPELINE_COMPARE_GREATER_EQUAL).withDepthFormat(PIPELINE_DEPTH_FORMAT_D32);
+static constexpr PipelineKey DEMO_PIPELINES[] = {
+   CUBE_PIPELINE,
+};
 
 struct DemoResources {
-   ComPtr<ID3D12RootSignature> rootSignature;
-   ComPtr<ID3D12PipelineState> pipelineState;
-   ComPtr<ID3D12GraphicsCommandList> commandLists[ARRAY_COUNT(Dx12Device::frames)];
+   Dx12Pipelines pipelines;
+   Dx12Mesh cube;
+   Dx12Culling culling;
+   Dx12InstanceStore instanceStore;
+   Dx12TransientTargets transientTargets;
+   ComPtr<ID3D12GraphicsCommandList> commandLists[ARRAY_COUNT(Dx12Device::frames)][MAX_RECORD_CHUNKS];
+
+   // Transitions, tracked per chunk as it's recorded. Any a list needs before
+   // it starts go in the fixup list submitted ahead of it.
+   StateList stateLists[MAX_RECORD_CHUNKS];
+   ComPtr<ID3D12GraphicsCommandList> fixupLists[ARRAY_COUNT(Dx12Device::frames)][MAX_RECORD_CHUNKS];
+   std::vector<StateBarrier> fixups;
 };
 
-typedef struct Vec3 {
-   float x, y, z;
-} Vec3;
-
-typedef struct Vec4 {
-   float x, y, z, w;
-} Vec4;
-
-typedef struct Mat4 {
-   Vec4 m[4];
-} Mat4;
+class Dx12Backend : public RenderBackend {
+public:
+   Dx12 dx12;
+   Dx12Device device;
+   HWND hwnd;
+   bool minimized;   // the swap chain is kept, but there's nothing to draw into
+   bool vsync;
+
+   // Current frame, set by BeginFrame.
+   uint64_t curFrame;
+   UINT frameIdx;
+   UINT backBufferIdx;
+   D3D12_VIEWPORT viewport;
+   D3D12_RECT scissor;
 
-typedef struct ShaderMatrices {
-   Mat4 clipFromLocal;
-} ShaderMatrices;
+   Dx12Backend() : dx12(), device(), hwnd(NULL), minimized(false), vsync(true), curFrame(0), frameIdx(0), backBufferIdx(0), viewport(), scissor() {}
+   ~Dx12Backend() override;
+
+   void Resize(uint32_t width, uint32_t height) override;
+   void SetFramesInFlight(uint32_t framesInFlight) override;
+   void GetStats(RenderStats *stats) const override;
+   void SetVsync(bool enable) override;
+
+   bool BeginFrame(RenderFrame *frame) override;
+   bool AllocUpload(uint64_t size, uint64_t alignment, RenderUpload *upload) override;
+   bool SetInstanceStore(uint64_t size, uint64_t *gpu) override;
+   void CmdUpdateInstanceStore(RenderCommandList *list, uint64_t src, const RenderStoreCopy *copies,
+      uint32_t count) override;
+
+   void GetTargetAllocation(const RenderTargetDesc *desc, uint64_t *size, uint64_t *alignment) override;
+   bool SetTransientTargets(const RenderTargetPlacement *placements, uint32_t count, uint64_t heapSize) override;
+
+   RenderCommandList *BeginCommandList(uint32_t chunk) override;
+   void CmdBarriers(RenderCommandList *list, const RenderBarrier *barriers, uint32_t count) override;
+   void CmdBeginPass(RenderCommandList *list, uint32_t target, const float *clearColor, const float *clearDepth) override;
+   void CmdSetInstanceBuffer(RenderCommandList *list, uint64_t gpu, uint32_t stride) override;
+   void CmdDraw(RenderCommandList *list, uint32_t indexCount, uint32_t instanceCount) override;
+
+   bool SetCullScene(const CullInstance *instances, uint32_t count) override;
+   void CullScene(const CullConstants *constants) override;
+   void CmdDrawCulled(RenderCommandList *list) override;
+   void CmdEndPass(RenderCommandList *list) override;
+   void CmdCopyTarget(RenderCommandList *list, uint32_t src, uint32_t dst) override;
+   void EndCommandList(RenderCommandList *list) override;
+
+   void Submit(RenderCommandList *const *lists, uint32_t count) override;
+   void EndFrame() override;
+};
 
 static DemoResources s_resources;
-static uint64_t s_frameNum = ARRAY_COUNT(Dx12Device::frames);
-static float s_cubeRot;       // in turns
 
-static inline Vec3 vec3Add(Vec3 a, Vec3 b)
+// None of this depends on the swap chain, so it's made once per device.
+// Everything goes through the shader cache, so after the first run this
+// compiles nothing and pipelines come out of the pipeline library. Pipelines
+// are created in the background while the rest is set up.
+static bool createResources(Dx12Device *device, bool bindless)
 {
-   Vec3 r;
+#ifndef NDEBUG
+   LARGE_INTEGER startTime;
+   QueryPerformanceCounter(&startTime);
+#endif
 
-   r.x = a.x + b.x;
-   r.y = a.y + b.y;
-   r.z = a.z + b.z;
+   if (!CreatePipelines(&s_resources.pipelines, device, bindless)) {
+      return false;
+   }
+   PrecompilePipelines(&s_resources.pipelines, DEMO_PIPELINES, ARRAY_COUNT(DEMO_PIPELINES));
 
-   return r;
-}
+   // Draws take their instances from the upload ring as well as the store.
+   if (s_resources.pipelines.bindless) {
+      BindlessTableInit(&device->bindless, &device->viewHeap.alloc);
+      if (!AddBindlessBuffer(device, device->uploadRing.buffer.Get(), &device->uploadRing.view)) {
+         return false;
+      }
+   }
 
-static inline Vec3 vec3Sub(Vec3 a, Vec3 b)
-{
-   Vec3 r;
+   if (!LoadMesh(&s_resources.cube, device, CUBE_MESH_PATH) ||
+      !CreateCulling(&s_resources.culling, device, &s_resources.pipelines)) {
+      return false;
+   }
 
-   r.x = a.x - b.x;
-   r.y = a.y - b.y;
-   r.z = a.z - b.z;
+   ComPtr<ID3D12GraphicsCommandList> commandLists[ARRAY_COUNT(device->frames)][MAX_RECORD_CHUNKS];
+   ComPtr<ID3D12GraphicsCommandList> fixupLists[ARRAY_COUNT(device->frames)][MAX_RECORD_CHUNKS];
+   for (size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
+      for (size_t j = 0; j < MAX_RECORD_CHUNKS; ++j) {
+         if (FAILED(device->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+               device->frames[i].commandAllocators[j].Get(), nullptr, IID_PPV_ARGS(&commandLists[i][j]))) ||
+            FAILED(device->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+               device->frames[i].fixupAllocator.Get(), nullptr, IID_PPV_ARGS(&fixupLists[i][j])))) {
+            return false;
+         }
+         commandLists[i][j]->Close();
+         fixupLists[i][j]->Close();
+      }
+   }
 
-   return r;
-}
+   for (size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
+      for (size_t j = 0; j < MAX_RECORD_CHUNKS; ++j) {
+         s_resources.commandLists[i][j] = std::move(commandLists[i][j]);
+         s_resources.fixupLists[i][j] = std::move(fixupLists[i][j]);
+      }
+   }
 
-static inline Vec3 vec3Scale(Vec3 a, float b)
-{
-   Vec3 r;
+   // The first frame needs this one anyway, so wait for it here, where
+   // failing is still an option. Any other variants keep compiling.
+   if (!GetPipeline(&s_resources.pipelines, CUBE_PIPELINE)) {
+      return false;
+   }
 
-   r.x = a.x * b;
-   r.y = a.y * b;
-   r.z = a.z * b;
+#ifndef NDEBUG
+   LARGE_INTEGER endTime, frequency;
+   QueryPerformanceCounter(&endTime);
+   QueryPerformanceFrequency(&frequency);
+   char message[64];
+   sprintf_s(message, "createResources: %.3f ms\n", (endTime.QuadPart - startTime.QuadPart) * 1000.0 / frequency.QuadPart);
+   OutputDebugStringA(message);
+#endif
 
-   return r;
+   return true;
 }
 
-static inline float vec3Dot(Vec3 a, Vec3 b)
+// Doesn't wait for the GPU; anything it may still be using is handed to the
+// deferred-release queue.
+static void destroyResources(Dx12Device *device)
 {
-   return a.x * b.x + a.y * b.y + a.z * b.z;
+   DestroyPipelines(&s_resources.pipelines);
+   DestroyCulling(&s_resources.culling, device);
+   DestroyInstanceStore(&s_resources.instanceStore, device);
+   DestroyTransientTargets(&s_resources.transientTargets, device);
+   DestroyMesh(&s_resources.cube, device);
+   RemoveBindlessBuffer(device, &device->uploadRing.view);
+   BindlessTableInit(&device->bindless, nullptr);
+   for (size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
+      for (size_t j = 0; j < MAX_RECORD_CHUNKS; ++j) {
+         DeferRelease(device, s_resources.commandLists[i][j].Get());
+         DeferRelease(device, s_resources.fixupLists[i][j].Get());
+         s_resources.commandLists[i][j] = nullptr;
+         s_resources.fixupLists[i][j] = nullptr;
+      }
+   }
 }
 
-static inline Vec3 vec3Normalize(Vec3 v)
+uint64_t Dx12Fence::CompletedValue()
 {
-   float lensq = vec3Dot(v, v);
-   return vec3Scale(v, 1.0f / sqrtf(lensq));
+   return fence->GetCompletedValue();
 }
 
-static inline Vec3 vec3Cross(Vec3 a, Vec3 b)
+void Dx12Fence::Block(uint64_t value)
 {
-   Vec3 r;
+   DX_VERIFY(fence->SetEventOnCompletion(value, event));
+   WaitForSingleObject(event, INFINITE);
+}
 
-   r.x = a.y * b.z - a.z * b.y;
-   r.y = a.z * b.x - a.x * b.z;
-   r.z = a.x * b.y - a.y * b.x;
+static void waitForGpu(Dx12Device *device)
+{
+   TimelineWait(&device->timeline, device->frameNum - 1);
+}
 
-   return r;
+static UINT backBufferCount(const Dx12Device *device)
+{
+   // Flip model needs at least two buffers whatever the frame latency.
+   return device->framesInFlight > 2 ? device->framesInFlight : 2;
 }
 
-static void mat4RotY(Mat4 *m, float angle)
+static bool createBackBuffers(Dx12Device *device)
 {
-   float c = cosf(angle);
-   float s = sinf(angle);
+   DXGI_SWAP_CHAIN_DESC swapChainDesc;
+   if (FAILED(device->swapChain->GetDesc(&swapChainDesc))) {
+      return false;
+   }
+   ASSERT(swapChainDesc.BufferCount <= MAX_BACK_BUFFERS);
 
-   m->m[0].x = c;
-   m->m[0].y = 0.0f;
-   m->m[0].z = s;
-   m->m[0].w = 0.0f;
+   D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = device->rtvHeap.cpuStart;
+   D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
+   rtvDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+   rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+   rtvDesc.Texture2D.MipSlice = 0;
+   rtvDesc.Texture2D.PlaneSlice = 0;
 
-   m->m[1].x = 0.0f;
-   m->m[1].y = 1.0f;
-   m->m[1].z = 0.0f;
-   m->m[1].w = 0.0f;
+   for (UINT i = 0; i < swapChainDesc.BufferCount; ++i) {
+      if (FAILED(device->swapChain->GetBuffer(i, IID_PPV_ARGS(&device->backBuffers[i].renderTarget)))) {
+         return false;
+      }
 
-   m->m[2].x = -s;
-   m->m[2].y = 0.0f;
-   m->m[2].z = c;
-   m->m[2].w = 0.0f;
+      device->device->CreateRenderTargetView(device->backBuffers[i].renderTarget.Get(), &rtvDesc, rtvHandle);
+      device->backBuffers[i].rtv = rtvHandle;
+      device->backBuffers[i].state = StateTrackerAdd(&device->states, 1, STATE_PRESENT, 0,
+         device->backBuffers[i].renderTarget.Get());
+      rtvHandle.ptr += device->rtvHeap.increment;
+   }
+   device->backBufferCount = swapChainDesc.BufferCount;
+   device->surfaceWidth = swapChainDesc.BufferDesc.Width;
+   device->surfaceHeight = swapChainDesc.BufferDesc.Height;
+
+   D3D12_RESOURCE_DESC depthDesc = {};
+   depthDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+   depthDesc.Width = swapChainDesc.BufferDesc.Width;
+   depthDesc.Height = swapChainDesc.BufferDesc.Height;
+   depthDesc.DepthOrArraySize = 1;
+   depthDesc.MipLevels = 1;
+   depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+   depthDesc.SampleDesc.Count = 1;
+   depthDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+   depthDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE;
+
+   D3D12_CLEAR_VALUE depthClear = {};
+   depthClear.Format = DXGI_FORMAT_D32_FLOAT;
+   depthClear.DepthStencil.Depth = RENDER_DEPTH_CLEAR;
+   if (!AllocResource(device, D3D12_HEAP_TYPE_DEFAULT, &depthDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthClear,
+         &device->depthBuffer)) {
+      return false;
+   }
 
-   m->m[3].x = 0.0f;
-   m->m[3].y = 0.0f;
-   m->m[3].z = 0.0f;
-   m->m[3].w = 1.0f;
+   D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+   dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+   dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+   device->dsv = device->dsvHeap.cpuStart;
+   device->device->CreateDepthStencilView(device->depthBuffer.resource.Get(), &dsvDesc, device->dsv);
+   return true;
 }
 
-static void mat4Mul(Mat4 *r, const Mat4 *a, const Mat4 *b)
+static void releaseBackBuffers(Dx12Device *device)
 {
-   Mat4 tmp;
-
-   tmp.m[0].x = a->m[0].x * b->m[0].x + a->m[1].x * b->m[0].y + a->m[2].x * b->m[0].z + a->m[3].x * b->m[0].w;
-   tmp.m[0].y = a->m[0].y * b->m[0].x + a->m[1].y * b->m[0].y + a->m[2].y * b->m[0].z + a->m[3].y * b->m[0].w;
-   tmp.m[0].z = a->m[0].z * b->m[0].x + a->m[1].z * b->m[0].y + a->m[2].z * b->m[0].z + a->m[3].z * b->m[0].w;
-   tmp.m[0].w = a->m[0].w * b->m[0].x + a->m[1].w * b->m[0].y + a->m[2].w * b->m[0].z + a->m[3].w * b->m[0].w;
+   for (std::size_t i = 0; i < ARRAY_COUNT(device->backBuffers); ++i) {
+      if (device->backBuffers[i].renderTarget) {
+         StateTrackerRemove(&device->states, device->backBuffers[i].state);
+      }
+      device->backBuffers[i].renderTarget = nullptr;
+      device->backBuffers[i].rtv.ptr = 0;
+   }
+   device->backBufferCount = 0;
+   FreeResource(device, &device->depthBuffer);
+   device->dsv.ptr = 0;
+}
 
-   tmp.m[1].x = a->m[0].x * b->m[1].x + a->m[1].x * b->m[1].y + a->m[2].x * b->m[1].z + a->m[3].x * b->m[1].w;
-   tmp.m[1].y = a->m[0].y * b->m[1].x + a->m[1].y * b->m[1].y + a->m[2].y * b->m[1].z + a->m[3].y * b->m[1].w;
-   tmp.m[1].z = a->m[0].z * b->m[1].x + a->m[1].z * b->m[1].y + a->m[2].z * b->m[1].z + a->m[3].z * b->m[1].w;
-   tmp.m[1].w = a->m[0].w * b->m[1].x + a->m[1].w * b->m[1].y + a->m[2].w * b->m[1].z + a->m[3].w * b->m[1].w;
+static bool createSwapChain(Dx12Device *device, HWND hwnd, uint32_t width, uint32_t height)
+{
+   ASSERT(device && device->dx12 && device->device);
+   const Dx12 *dx12 = device->dx12;
+
+   DXGI_SWAP_CHAIN_DESC swapChainDesc = { 0 };
+   swapChainDesc.BufferDesc.Width = width;
+   swapChainDesc.BufferDesc.Height = height;
+   swapChainDesc.BufferCount = backBufferCount(device);
+   swapChainDesc.BufferDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+   swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+   swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+   swapChainDesc.OutputWindow = hwnd;
+   swapChainDesc.SampleDesc.Count = 1;
+   swapChainDesc.Windowed = TRUE;
+
+   ComPtr<IDXGISwapChain> swapChain;
+   if (FAILED(dx12->factory->CreateSwapChain(device->commandQueue.Get(), &swapChainDesc, &swapChain))) {
+      return false;
+   }
 
-   tmp.m[2].x = a->m[0].x * b->m[2].x + a->m[1].x * b->m[2].y + a->m[2].x * b->m[2].z + a->m[3].x * b->m[2].w;
-   tmp.m[2].y = a->m[0].y * b->m[2].x + a->m[1].y * b->m[2].y + a->m[2].y * b->m[2].z + a->m[3].y * b->m[2].w;
-   tmp.m[2].z = a->m[0].z * b->m[2].x + a->m[1].z * b->m[2].y + a->m[2].z * b->m[2].z + a->m[3].z * b->m[2].w;
-   tmp.m[2].w = a->m[0].w * b->m[2].x + a->m[1].w * b->m[2].y + a->m[2].w * b->m[2].z + a->m[3].w * b->m[2].w;
+   if (FAILED(dx12->factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER))) {
+      return false;
+   }
 
-   tmp.m[3].x = a->m[0].x * b->m[3].x + a->m[1].x * b->m[3].y + a->m[2].x * b->m[3].z + a->m[3].x * b->m[3].w;
-   tmp.m[3].y = a->m[0].y * b->m[3].x + a->m[1].y * b->m[3].y + a->m[2].y * b->m[3].z + a->m[3].y * b->m[3].w;
-   tmp.m[3].z = a->m[0].z * b->m[3].x + a->m[1].z * b->m[3].y + a->m[2].z * b->m[3].z + a->m[3].z * b->m[3].w;
-   tmp.m[3].w = a->m[0].w * b->m[3].x + a->m[1].w * b->m[3].y + a->m[2].w * b->m[3].z + a->m[3].w * b->m[3].w;
+   if (!swapChain.As(&device->swapChain)) {
+      return false;
+   }
 
-   memcpy(r, &tmp, sizeof(tmp));
+   return createBackBuffers(device);
 }
 
-static inline void mat4PerspectiveFov(Mat4 *r, float fovY, float aspect, float nearDist, float farDist)
+// Only the back buffers depend on the window size and frames in flight, so
+// this keeps the swap chain and everything else and swaps out just those.
+static bool resizeSwapChain(Dx12Device *device, uint32_t width, uint32_t height)
 {
-   float y = tanf(fovY * 0.5f);
-   float x = aspect * y;
+   ASSERT(device && device->swapChain);
 
-   float hw = x * nearDist;
-   float hh = y * nearDist;
-   float c, d;
+#ifndef NDEBUG
+   LARGE_INTEGER startTime;
+   QueryPerformanceCounter(&startTime);
+#endif
 
-   if (nearDist < farDist) {
-      c = nearDist / (nearDist - farDist);
-      d = -farDist * nearDist / (nearDist - farDist);
-   } else {
-      c = 0.0f;
-      d = nearDist;
+   // ResizeBuffers fails while anything, the GPU included, still references
+   // the old buffers.
+   waitForGpu(device);
+   releaseBackBuffers(device);
+   if (FAILED(device->swapChain->ResizeBuffers(backBufferCount(device), width, height, DXGI_FORMAT_UNKNOWN, 0)) ||
+      !createBackBuffers(device)) {
+      return false;
    }
 
-   r->m[0].x = 1.0f / x;
-   r->m[0].y = 0.0f;
-   r->m[0].z = 0.0f;
-   r->m[0].w = 0.0f;
+#ifndef NDEBUG
+   LARGE_INTEGER endTime, frequency;
+   QueryPerformanceCounter(&endTime);
+   QueryPerformanceFrequency(&frequency);
+   char message[64];
+   sprintf_s(message, "resizeSwapChain: %.3f ms\n", (endTime.QuadPart - startTime.QuadPart) * 1000.0 / frequency.QuadPart);
+   OutputDebugStringA(message);
+#endif
 
-   r->m[1].x = 0.0f;
-   r->m[1].y = -1.0f / y;
-   r->m[1].z = 0.0f;
-   r->m[1].w = 0.0f;
+   return true;
+}
 
-   r->m[2].x = 0.0f;
-   r->m[2].y = 0.0f;
-   r->m[2].z = c;
-   r->m[2].w = 1.0f;
+static void destroySwapChain(Dx12Device *device)
+{
+   ASSERT(device && device->device);
 
-   r->m[3].x = 0.0f;
-   r->m[3].y = 0.0f;
-   r->m[3].z = d;
-   r->m[3].w = 0.0f;
+   // The GPU may still be drawing into the back buffers.
+   waitForGpu(device);
+   releaseBackBuffers(device);
+   device->swapChain = nullptr;
 }
 
-static inline void mat4LookAt(Mat4 *r, Vec3 eye, Vec3 target, Vec3 up)
+static bool initD3d(Dx12 *dx12)
 {
-   Vec3 mf = vec3Normalize(vec3Sub(target, eye));
-   Vec3 mr = vec3Normalize(vec3Cross(up, mf));
-   Vec3 mu = vec3Cross(mr, mf);
+   UINT dxgiFactoryFlags = 0;
+
+#ifndef NDEBUG
+   ComPtr<ID3D12Debug> debugController;
+   if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController)))) {
+      debugController->EnableDebugLayer();
+      dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+   }
+#endif
 
-   r->m[0].x = mr.x;
-   r->m[0].y = mr.y;
-   r->m[0].z = mr.z;
-   r->m[0].w = 0.0f;
+   ComPtr<IDXGIFactory4> factory;
+   if (FAILED(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)))) {
+      return false;
+   }
 
-   r->m[1].x = mu.x;
-   r->m[1].y = mu.y;
-   r->m[1].z = mu.z;
-   r->m[1].w = 0.0f;
+   ComPtr<IDXGIAdapter1> adapter;
+   dx12->adapters.reserve(8);
+   dx12->adapterDescs.reserve(8);
+   while (SUCCEEDED(factory->EnumAdapters1((UINT)dx12->adapters.size(), &adapter))) {
+      dx12->adapterDescs.resize(dx12->adapterDescs.size() + 1);
+      adapter->GetDesc1(&dx12->adapterDescs.back());
 
-   r->m[2].x = mf.x;
-   r->m[2].y = mf.y;
-   r->m[2].z = mf.z;
-   r->m[2].w = 0.0f;
+      dx12->adapters.emplace_back(std::move(adapter));
+   }
 
-   r->m[3].x = -eye.x * mr.x - eye.y * mu.x - eye.z * mf.x;
-   r->m[3].y = -eye.x * mr.y - eye.y * mu.y - eye.z * mf.y;
-   r->m[3].z = -eye.x * mr.z - eye.y * mu.z - eye.z * mf.z;
-   r->m[3].w = 1.0f;
+   dx12->factory = std::move(factory);
+   return true;
 }
 
-bool CreateResources(const Dx12Device *device)
+static void uninitD3d(Dx12 *dx12)
 {
-   ComPtr<ID3DBlob> vertexCode, pixelCode;
-   ComPtr<ID3D12RootSignature> rootSignature;
-   {
-      UINT compileFlags = 0;
-
-#ifndef NDEBUG
-      compileFlags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
+   if (dx12) {
+      dx12->adapters.clear();
+      dx12->adapterDescs.clear();
+      dx12->factory = nullptr;
+   }
+}
 
-      ComPtr<ID3DBlob> vertexErrors;
-      if (FAILED(D3DCompileFromFile(L"cube.vert", nullptr, nullptr, "main", "vs_5_0", compileFlags, 0, &vertexCode, &vertexErrors))) {
-#ifndef NDEBUG
-         if (vertexErrors) {
-            OutputDebugStringA((const char *)vertexErrors->GetBufferPointer());
-         }
-#endif
-         return false;
+static bool createDevice(const Dx12 *dx12, Dx12Device *device)
+{
+   // look for a hardware adapter
+   std::size_t deviceIdx = dx12->adapterDescs.size();
+   for (std::size_t i = 0; i < deviceIdx; ++i) {
+      if ((dx12->adapterDescs[i].Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == 0) {
+         deviceIdx = i;
       }
+   }
 
-      ComPtr<ID3DBlob> pixelErrors;
-      if (FAILED(D3DCompileFromFile(L"cube.frag", nullptr, nullptr, "main", "ps_5_0", compileFlags, 0, &pixelCode, &pixelErrors))) {
-#ifndef NDEBUG
-         if (pixelErrors) {
-            OutputDebugStringA((const char *)pixelErrors->GetBufferPointer());
+   if (deviceIdx == dx12->adapters.size()) {
+      return false;
+   }
+
+   ComPtr<ID3D12Device> d3dDevice;
+   if (FAILED(D3D12CreateDevice(dx12->adapters[deviceIdx].Get(), D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&d3dDevice)))) {
+      return false;
+   }
+
+   D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+   queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+   queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+
+   ComPtr<ID3D12CommandQueue> commandQueue;
+   if (FAILED(d3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)))) {
+      return false;
+   }
+
+   ComPtr<ID3D12Fence> fence;
+   // Start far enough ahead that waiting on any of the first frames' predecessors returns immediately.
+   if (FAILED(d3dDevice->CreateFence(MAX_FRAMES_IN_FLIGHT - 1, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)))) {
+      return false;
+   }
+
+   for (std::size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
+      for (std::size_t j = 0; j < ARRAY_COUNT(device->frames[i].commandAllocators); ++j) {
+         if (FAILED(d3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&device->frames[i].commandAllocators[j])))) {
+            return false;
          }
-#endif
+      }
+      if (FAILED(d3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&device->frames[i].fixupAllocator)))) {
          return false;
       }
+   }
+   StateTrackerInit(&device->states);
+   if (!CreateGpuMemory(&device->memory, d3dDevice.Get())) {
+      return false;
+   }
 
-      D3D12_ROOT_PARAMETER constantParam;
-      constantParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
-      constantParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-      constantParam.Constants.ShaderRegister = 0;
-      constantParam.Constants.RegisterSpace = 0;
-      constantParam.Constants.Num32BitValues = sizeof(ShaderMatrices) / sizeof(UINT);
-
-      D3D12_ROOT_SIGNATURE_DESC rsDesc;
-      rsDesc.NumParameters = 1;
-      rsDesc.pParameters = &constantParam;
-      rsDesc.NumStaticSamplers = 0;
-      rsDesc.pStaticSamplers = nullptr;
-      rsDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
-
-      ComPtr<ID3DBlob> rootCode, rootErrors;
-      if (FAILED(D3D12SerializeRootSignature(&rsDesc, D3D_ROOT_SIGNATURE_VERSION_1_0, &rootCode, &rootErrors))) {
-#ifndef NDEBUG
-         if (rootErrors) {
-            OutputDebugStringA((const char *)rootErrors->GetBufferPointer());
+   if (!CreateUploadRing(&device->uploadRing, d3dDevice.Get(), UPLOAD_RING_SIZE) ||
+      !CreateTransfers(&device->transfers, d3dDevice.Get(), TRANSFER_STAGING_SIZE)) {
+      return false;
+   }
+
+   if (!CreateDescriptorAllocator(&device->viewHeap, d3dDevice.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, VIEW_DESCRIPTORS, VIEW_DESCRIPTORS) ||
+      !CreateDescriptorAllocator(&device->samplerHeap, d3dDevice.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, SAMPLER_DESCRIPTORS, SAMPLER_DESCRIPTORS)) {
+      return false;
+   }
+
+   CreateGpuProfiler(&device->gpuProfiler, d3dDevice.Get(), commandQueue.Get());
+
+   // Sized for the most back buffers any frames in flight setting needs, so
+   // it survives swap chain resizes, then the transient targets.
+   if (!CreateDescriptorHeap(&device->rtvHeap, d3dDevice.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+         MAX_BACK_BUFFERS + RENDER_MAX_TARGETS, false) ||
+      !CreateDescriptorHeap(&device->dsvHeap, d3dDevice.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_DSV, 1, false)) {
+      return false;
+   }
+
+   device->fence.event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+   device->fence.fence = std::move(fence);
+   TimelineInit(&device->timeline, &device->fence);
+   device->commandQueue = std::move(commandQueue);
+   device->frameNum = MAX_FRAMES_IN_FLIGHT;
+   if (device->framesInFlight < 1 || device->framesInFlight > MAX_FRAMES_IN_FLIGHT) {
+      device->framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+   }
+   device->device = std::move(d3dDevice);
+   device->deviceIdx = (uint32_t) deviceIdx;
+   device->dx12 = dx12;
+   OpenShaderCache(&device->shaderCache, device->device.Get(), &dx12->adapterDescs[deviceIdx], SHADER_CACHE_PATH);
+   return true;
+}
+
+static void destroyDevice(Dx12Device *device)
+{
+   if (device) {
+      destroyResources(device);
+      destroySwapChain(device);
+      DestroyTransfers(&device->transfers);
+      ReleaseAll(device);
+      DestroyGpuMemory(&device->memory);
+      CloseShaderCache(&device->shaderCache);
+      device->rtvHeap.heap = nullptr;
+      device->dsvHeap.heap = nullptr;
+      for (std::size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
+         for (std::size_t j = 0; j < ARRAY_COUNT(device->frames[i].commandAllocators); ++j) {
+            device->frames[i].commandAllocators[j] = nullptr;
          }
-#endif
-         return false;
+         device->frames[i].fixupAllocator = nullptr;
       }
+      DestroyUploadRing(&device->uploadRing);
+      DestroyGpuProfiler(&device->gpuProfiler);
+      DestroyDescriptorAllocator(&device->viewHeap);
+      DestroyDescriptorAllocator(&device->samplerHeap);
+      CloseHandle(device->fence.event);
+      device->fence.event = NULL;
+      device->fence.fence = nullptr;
+      device->commandQueue = nullptr;
+      device->device = nullptr;
+   }
+}
 
-      if (FAILED(device->device->CreateRootSignature(0, rootCode->GetBufferPointer(), rootCode->GetBufferSize(), IID_PPV_ARGS(&rootSignature)))) {
-         return false;
+static inline ID3D12GraphicsCommandList *dx12List(RenderCommandList *list)
+{
+   return (ID3D12GraphicsCommandList *)list;
+}
+
+// Which chunk of frame frameIdx a command list belongs to.
+static uint32_t listChunk(ID3D12GraphicsCommandList *commandList, UINT frameIdx)
+{
+   for (uint32_t chunk = 0; chunk < MAX_RECORD_CHUNKS; ++chunk) {
+      if (s_resources.commandLists[frameIdx][chunk].Get() == commandList) {
+         return chunk;
       }
    }
+   ASSERT(!"command list not from this frame");
+   return 0;
+}
 
-   ComPtr<ID3D12PipelineState> pipelineState;
-   {
-      D3D12_GRAPHICS_PIPELINE_STATE_DESC psDesc;
-      psDesc.pRootSignature = rootSignature.Get();
-
-      psDesc.VS.BytecodeLength = vertexCode->GetBufferSize();
-      psDesc.VS.pShaderBytecode = vertexCode->GetBufferPointer();
-      psDesc.PS.BytecodeLength = pixelCode->GetBufferSize();
-      psDesc.PS.pShaderBytecode = pixelCode->GetBufferPointer();
-      psDesc.DS.BytecodeLength = 0;
-      psDesc.DS.pShaderBytecode = nullptr;
-      psDesc.HS.BytecodeLength = 0;
-      psDesc.HS.pShaderBytecode = nullptr;
-      psDesc.GS.BytecodeLength = 0;
-      psDesc.GS.pShaderBytecode = nullptr;
-
-      psDesc.StreamOutput.pSODeclaration = nullptr;
-      psDesc.StreamOutput.NumEntries = 0;
-      psDesc.StreamOutput.pBufferStrides = nullptr;
-      psDesc.StreamOutput.NumStrides = 0;
-      psDesc.StreamOutput.RasterizedStream = 0;
-
-      psDesc.BlendState.AlphaToCoverageEnable = FALSE;
-      psDesc.BlendState.IndependentBlendEnable = FALSE;
-      psDesc.BlendState.RenderTarget[0].BlendEnable = FALSE;
-      psDesc.BlendState.RenderTarget[0].LogicOpEnable = FALSE;
-      psDesc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_ONE;
-      psDesc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
-      psDesc.BlendState.RenderTarget[0].BlendOp = D3D12_BLEND_OP_ADD;
-      psDesc.BlendState.RenderTarget[0].SrcBlendAlpha = D3D12_BLEND_ONE;
-      psDesc.BlendState.RenderTarget[0].DestBlendAlpha = D3D12_BLEND_INV_SRC_ALPHA;
-      psDesc.BlendState.RenderTarget[0].BlendOpAlpha = D3D12_BLEND_OP_ADD;
-      psDesc.BlendState.RenderTarget[0].LogicOp = D3D12_LOGIC_OP_CLEAR;
-      psDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-
-      psDesc.SampleMask = UINT_MAX;
-
-      psDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-      psDesc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
-      psDesc.RasterizerState.FrontCounterClockwise = FALSE;
-      psDesc.RasterizerState.DepthBias = 0;
-      psDesc.RasterizerState.DepthBiasClamp = 0;
-      psDesc.RasterizerState.SlopeScaledDepthBias = 0.0;
-      psDesc.RasterizerState.DepthClipEnable = FALSE;
-      psDesc.RasterizerState.MultisampleEnable = FALSE;
-      psDesc.RasterizerState.AntialiasedLineEnable = FALSE;
-      psDesc.RasterizerState.ForcedSampleCount = 0;
-      psDesc.RasterizerState.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
-
-      psDesc.DepthStencilState.DepthEnable = FALSE;
-      psDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
-      psDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
-      psDesc.DepthStencilState.StencilEnable = FALSE;
-      psDesc.DepthStencilState.StencilReadMask = 0xff;
-      psDesc.DepthStencilState.StencilWriteMask = 0xff;
-      psDesc.DepthStencilState.FrontFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
-      psDesc.DepthStencilState.FrontFace.StencilDepthFailOp = D3D12_STENCIL_OP_KEEP;
-      psDesc.DepthStencilState.FrontFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
-      psDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
-      psDesc.DepthStencilState.BackFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
-      psDesc.DepthStencilState.BackFace.StencilDepthFailOp = D3D12_STENCIL_OP_KEEP;
-      psDesc.DepthStencilState.BackFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
-      psDesc.DepthStencilState.BackFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
-
-      psDesc.InputLayout.pInputElementDescs = nullptr;
-      psDesc.InputLayout.NumElements = 0;
-      psDesc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
-      psDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-
-      psDesc.NumRenderTargets = 1;
-      psDesc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
-      psDesc.RTVFormats[1] = DXGI_FORMAT_UNKNOWN;
-      psDesc.RTVFormats[2] = DXGI_FORMAT_UNKNOWN;
-      psDesc.RTVFormats[3] = DXGI_FORMAT_UNKNOWN;
-      psDesc.RTVFormats[4] = DXGI_FORMAT_UNKNOWN;
-      psDesc.RTVFormats[5] = DXGI_FORMAT_UNKNOWN;
-      psDesc.RTVFormats[6] = DXGI_FORMAT_UNKNOWN;
-      psDesc.RTVFormats[7] = DXGI_FORMAT_UNKNOWN;
-      psDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
-
-      psDesc.NodeMask = 0;
-      psDesc.SampleDesc.Count = 1;
-      psDesc.SampleDesc.Quality = 0;
-      psDesc.CachedPSO.pCachedBlob = nullptr;
-      psDesc.CachedPSO.CachedBlobSizeInBytes = 0;
-
-      psDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-
-      if (FAILED(device->device->CreateGraphicsPipelineState(&psDesc, IID_PPV_ARGS(&pipelineState)))) {
-         return false;
-      }
+static StateList *listStates(ID3D12GraphicsCommandList *commandList, UINT frameIdx)
+{
+   return &s_resources.stateLists[listChunk(commandList, frameIdx)];
+}
+
+// A render target's resource, RTV and tracker id.
+static void getTarget(const Dx12Device *device, UINT backBufferIdx, uint32_t target, ID3D12Resource **resource,
+   D3D12_CPU_DESCRIPTOR_HANDLE *rtv, uint32_t *state)
+{
+   if (target == RENDER_BACK_BUFFER) {
+      const Dx12BackBuffer *backBuffer = &device->backBuffers[backBufferIdx];
+      *resource = backBuffer->renderTarget.Get();
+      *rtv = backBuffer->rtv;
+      *state = backBuffer->state;
+   } else {
+      const Dx12TransientTargets *targets = &s_resources.transientTargets;
+      ASSERT(target - 1 < targets->count);
+      *resource = targets->targets[target - 1].Get();
+      *rtv = targets->rtvs[target - 1];
+      *state = targets->states[target - 1];
    }
+}
 
-   std::array<ComPtr<ID3D12GraphicsCommandList>, ARRAY_COUNT(device->frames)> commandLists;
-   for (size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
-      if (FAILED(device->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
-         device->frames[i].commandAllocator.Get(), pipelineState.Get(), IID_PPV_ARGS(&commandLists[i])))) {
-         return false;
-      }
-      commandLists[i]->Close();
+RenderBackend *CreateDx12Backend(HWND hwnd, bool bindless)
+{
+   Dx12Backend *backend = new Dx12Backend();
+   backend->hwnd = hwnd;
+   if (!initD3d(&backend->dx12) || !createDevice(&backend->dx12, &backend->device) ||
+      !createResources(&backend->device, bindless)) {
+      delete backend;
+      return nullptr;
    }
+   return backend;
+}
 
-   s_resources.rootSignature = std::move(rootSignature);
-   s_resources.pipelineState = std::move(pipelineState);
-   for (size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
-      s_resources.commandLists[i] = std::move(commandLists[i]);
+Dx12Backend::~Dx12Backend()
+{
+   if (device.device) {
+      destroyDevice(&device);
    }
-   
-   return true;
+   uninitD3d(&dx12);
 }
 
-void DestroyResources(const Dx12Device *device)
+void Dx12Backend::Resize(uint32_t width, uint32_t height)
 {
-   DX_VERIFY(device->fence->SetEventOnCompletion((UINT64)s_frameNum - 1, device->fenceEvent));
-   WaitForSingleObject(device->fenceEvent, INFINITE);
+   // BeginFrame returns false until the next resize.
+   minimized = width == 0 || height == 0;
+   if (minimized) {
+      return;
+   }
 
-   s_resources.pipelineState = nullptr;
-   s_resources.rootSignature = nullptr;
-   for (size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
-      s_resources.commandLists[i] = nullptr;
+   bool ok;
+   if (!device.swapChain) {
+      ok = createSwapChain(&device, hwnd, width, height);
+   } else if (width != device.surfaceWidth || height != device.surfaceHeight) {
+      ok = resizeSwapChain(&device, width, height);
+   } else {
+      return;
+   }
+
+   // Start over with a new swap chain next time.
+   if (!ok) {
+      destroySwapChain(&device);
+   }
+}
+
+void Dx12Backend::SetFramesInFlight(uint32_t framesInFlight)
+{
+   ASSERT(framesInFlight >= 1 && framesInFlight <= MAX_FRAMES_IN_FLIGHT);
+   if (framesInFlight == device.framesInFlight) {
+      return;
+   }
+
+   // The swap chain's buffer count follows the frame count. Resizing also
+   // drains the GPU, which has to happen anyway since per-frame state is
+   // indexed modulo the frame count.
+   device.framesInFlight = framesInFlight;
+   if (device.swapChain && !resizeSwapChain(&device, device.surfaceWidth, device.surfaceHeight)) {
+      destroySwapChain(&device);
    }
 }
 
-void DrawFrame(const Dx12Device *device, float dt)
+void Dx12Backend::GetStats(RenderStats *stats) const
 {
-   uint64_t curFrame = s_frameNum++;
-   DX_VERIFY(device->fence->SetEventOnCompletion(curFrame - ARRAY_COUNT(device->frames), device->fenceEvent));
-   WaitForSingleObject(device->fenceEvent, INFINITE);
+   stats->framesInFlight = device.framesInFlight;
+   stats->uploadSize = device.uploadRing.ring.size;
+   stats->uploadHighWater = device.uploadRing.ring.highWater;
+   stats->gpuWaits = device.timeline.stats.waits;
+   stats->gpuBlockedWaits = device.timeline.stats.blockedWaits;
+   stats->gpuBlockedSeconds = device.timeline.stats.blockedSeconds;
+   stats->gpuPollSeconds = device.timeline.stats.pollSeconds;
+   stats->barriers = device.states.stats;
+   GetGpuMemoryStats(&device.memory, &stats->memory);
+}
 
-   UINT imageIdx = device->swapChain->GetCurrentBackBufferIndex();
-   ASSERT(imageIdx < ARRAY_COUNT(s_resources.commandLists));
+// Without a tearing-capable swap chain, an interval of 0 still never tears:
+// the flip model just replaces the queued frame with the newest one.
+void Dx12Backend::SetVsync(bool enable)
+{
+   vsync = enable;
+}
 
-   DX_VERIFY(device->frames[imageIdx].commandAllocator->Reset());
-   ID3D12GraphicsCommandList *commandList = s_resources.commandLists[imageIdx].Get();
-   DX_VERIFY(commandList->Reset(device->frames[imageIdx].commandAllocator.Get(), s_resources.pipelineState.Get()));
+bool Dx12Backend::BeginFrame(RenderFrame *frame)
+{
+   if (!device.swapChain || minimized) {
+      return false;
+   }
 
-   commandList->SetGraphicsRootSignature(s_resources.rootSignature.Get());
+   // Usually the slot's last frame finished long ago and this doesn't even
+   // read the fence. Deferred releases run from here too.
+   curFrame = device.frameNum++;
+   TimelineWait(&device.timeline, curFrame - device.framesInFlight);
+   UINT64 completedValue = device.timeline.completed;
+   UploadRingBeginFrame(&device.uploadRing, completedValue);
+   DescriptorBeginFrame(&device.viewHeap.alloc, completedValue);
+   DescriptorBeginFrame(&device.samplerHeap.alloc, completedValue);
+   GpuMemoryBeginFrame(&device, completedValue);
+   TransfersBeginFrame(&device.transfers);
+   UseTransfer(&device.transfers, s_resources.cube.transfer);
+
+   // A little at a time, and only what's recorded from here on sees the moves.
+   frameIdx = (UINT)(curFrame % device.framesInFlight);
+   MeshBeginFrame(&s_resources.cube, &device);
+   DefragmentGpuMemory(&device, frameIdx, GPU_DEFRAG_BUDGET);
+   GpuProfilerBeginFrame(&device, frameIdx, curFrame);
+   backBufferIdx = device.swapChain->GetCurrentBackBufferIndex();
+   ASSERT(backBufferIdx < device.backBufferCount);
 
-   D3D12_VIEWPORT viewport;
    viewport.TopLeftX = 0.0f;
    viewport.TopLeftY = 0.0f;
-   viewport.Width = (float) device->surfaceWidth;
-   viewport.Height = (float) device->surfaceHeight;
+   viewport.Width = (float) device.surfaceWidth;
+   viewport.Height = (float) device.surfaceHeight;
    viewport.MinDepth = D3D12_MIN_DEPTH;
    viewport.MaxDepth = D3D12_MAX_DEPTH;
 
-   D3D12_RECT scissor;
    scissor.left = 0;
    scissor.top = 0;
-   scissor.right = device->surfaceWidth;
-   scissor.bottom = device->surfaceHeight;
+   scissor.right = device.surfaceWidth;
+   scissor.bottom = device.surfaceHeight;
+
+   frame->frameNum = curFrame;
+   frame->width = device.surfaceWidth;
+   frame->height = device.surfaceHeight;
+   frame->maxChunks = MAX_RECORD_CHUNKS;
+   return true;
+}
+
+bool Dx12Backend::AllocUpload(uint64_t size, uint64_t alignment, RenderUpload *upload)
+{
+   Dx12UploadAlloc alloc;
+   if (!UploadRingAlloc(&device.uploadRing, size, alignment, &alloc)) {
+      return false;
+   }
+
+   upload->cpu = alloc.cpu;
+   upload->gpu = alloc.gpu;
+   return true;
+}
+
+bool Dx12Backend::SetInstanceStore(uint64_t size, uint64_t *gpu)
+{
+   if (!ResizeInstanceStore(&s_resources.instanceStore, &device, size)) {
+      return false;
+   }
+
+   *gpu = s_resources.instanceStore.buffer.resource->GetGPUVirtualAddress();
+   return true;
+}
+
+void Dx12Backend::CmdUpdateInstanceStore(RenderCommandList *list, uint64_t src, const RenderStoreCopy *copies,
+   uint32_t count)
+{
+   // Uploads all come out of the one ring buffer.
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   ::CmdUpdateInstanceStore(commandList, listStates(commandList, frameIdx), &s_resources.instanceStore,
+      device.uploadRing.buffer.Get(), src - device.uploadRing.gpuBase, copies, count);
+}
+
+void Dx12Backend::GetTargetAllocation(const RenderTargetDesc *desc, uint64_t *size, uint64_t *alignment)
+{
+   GetTransientTargetAllocation(&device, desc, size, alignment);
+}
+
+bool Dx12Backend::SetTransientTargets(const RenderTargetPlacement *placements, uint32_t count, uint64_t heapSize)
+{
+   return ::SetTransientTargets(&s_resources.transientTargets, &device, placements, count, heapSize);
+}
 
+RenderCommandList *Dx12Backend::BeginCommandList(uint32_t chunk)
+{
+   ASSERT(chunk < MAX_RECORD_CHUNKS);
+
+   ID3D12CommandAllocator *allocator = device.frames[frameIdx].commandAllocators[chunk].Get();
+   ID3D12GraphicsCommandList *commandList = s_resources.commandLists[frameIdx][chunk].Get();
+   DX_VERIFY(allocator->Reset());
+   DX_VERIFY(commandList->Reset(allocator, GetPipeline(&s_resources.pipelines, CUBE_PIPELINE)));
+
+   ID3D12DescriptorHeap *descriptorHeaps[] = { device.viewHeap.heap.heap.Get(), device.samplerHeap.heap.heap.Get() };
+   commandList->SetDescriptorHeaps(ARRAY_COUNT(descriptorHeaps), descriptorHeaps);
+   commandList->SetGraphicsRootSignature(s_resources.pipelines.rootSignature.Get());
+   if (s_resources.pipelines.bindless) {
+      commandList->SetGraphicsRootDescriptorTable(DRAW_PARAM_TABLE, DescriptorGpuHandle(&device.viewHeap.heap, 0));
+   }
+   commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+   CmdBindMesh(commandList, &s_resources.cube);
+   StateListBegin(&s_resources.stateLists[chunk], &device.states);
+   return (RenderCommandList *)commandList;
+}
+
+void Dx12Backend::CmdBarriers(RenderCommandList *list, const RenderBarrier *barriers, uint32_t count)
+{
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   StateList *states = listStates(commandList, frameIdx);
+   for (uint32_t i = 0; i < count; ++i) {
+      const RenderBarrier *barrier = &barriers[i];
+      ID3D12Resource *resource;
+      D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+      uint32_t id;
+      getTarget(&device, backBufferIdx, barrier->target, &resource, &rtv, &id);
+
+      if (barrier->flags & RENDER_BARRIER_ALIAS) {
+         uint32_t before = STATE_INVALID;
+         if (barrier->aliasBefore != RENDER_NO_TARGET) {
+            getTarget(&device, backBufferIdx, barrier->aliasBefore, &resource, &rtv, &before);
+         }
+         StateListAlias(states, before, id);
+         continue;
+      }
+
+      // A list that hasn't used the target yet learns from the barrier what
+      // state it's in, so the transition goes in the list rather than ahead
+      // of it at submit.
+      uint32_t expected = barrier->flags & RENDER_BARRIER_END ? barrier->after : barrier->before;
+      if (StateListState(states, id, STATE_ALL_SUBRESOURCES) == STATE_INVALID && expected != STATE_INVALID) {
+         StateListTransition(states, id, STATE_ALL_SUBRESOURCES, expected);
+      }
+      if (barrier->flags & RENDER_BARRIER_BEGIN) {
+         StateListBeginSplit(states, id, STATE_ALL_SUBRESOURCES, barrier->after);
+      } else {
+         StateListTransition(states, id, STATE_ALL_SUBRESOURCES, barrier->after);
+      }
+   }
+   CmdFlushBarriers(commandList, states);
+}
+
+void Dx12Backend::CmdBeginPass(RenderCommandList *list, uint32_t target, const float *clearColor,
+   const float *clearDepth)
+{
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   ID3D12Resource *resource;
+   D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+   uint32_t id;
+   getTarget(&device, backBufferIdx, target, &resource, &rtv, &id);
+
+   GpuProfilerBeginPass(&device.gpuProfiler, commandList, frameIdx, listChunk(commandList, frameIdx));
+
+   // Already there if this list's barriers put it there; if not, an earlier
+   // list's did.
+   StateList *states = listStates(commandList, frameIdx);
+   StateListTransition(states, id, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   CmdFlushBarriers(commandList, states);
+
+   // Transient targets are the size of the surface, and so of the depth buffer.
+   commandList->OMSetRenderTargets(1, &rtv, FALSE, &device.dsv);
    commandList->RSSetViewports(1, &viewport);
    commandList->RSSetScissorRects(1, &scissor);
 
-   D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = device->frames[imageIdx].rtv;
-   D3D12_RESOURCE_BARRIER resourceBarrier;
-   resourceBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-   resourceBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-   resourceBarrier.Transition.pResource = device->frames[imageIdx].renderTarget.Get();
-   resourceBarrier.Transition.Subresource = 0;
-   resourceBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-   resourceBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-   commandList->ResourceBarrier(1, &resourceBarrier);
+   if (clearColor) {
+      commandList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
+   }
+   if (clearDepth) {
+      commandList->ClearDepthStencilView(device.dsv, D3D12_CLEAR_FLAG_DEPTH, *clearDepth, 0, 0, nullptr);
+   }
+}
+
+void Dx12Backend::CmdSetInstanceBuffer(RenderCommandList *list, uint64_t gpu, uint32_t /*stride*/)
+{
+   // Uploads need no transitions; the store finishes whatever its update began.
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   const Dx12InstanceStore *store = &s_resources.instanceStore;
+   if (store->buffer.resource) {
+      D3D12_GPU_VIRTUAL_ADDRESS storeGpu = store->buffer.resource->GetGPUVirtualAddress();
+      if (gpu >= storeGpu && gpu < storeGpu + store->size) {
+         StateList *states = listStates(commandList, frameIdx);
+         StateListTransition(states, store->state, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+         CmdFlushBarriers(commandList, states);
+      }
+   }
 
-   commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+   if (s_resources.pipelines.bindless) {
+      // The shader knows the stride; only where the instances start changes.
+      BindlessRef ref;
+      bool found = BindlessResolve(&device.bindless, gpu, &ref);
+      ASSERT(found);
+      commandList->SetGraphicsRoot32BitConstants(DRAW_PARAM_INSTANCES, sizeof(ref) / 4, &ref, 0);
+      return;
+   }
 
-   const float clearColor[] = { 0.086f, 0.086f, 0.1137f, 1.0f, };
-   commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
+   // Root SRVs take their stride from the shader's StructuredBuffer type.
+   commandList->SetGraphicsRootShaderResourceView(DRAW_PARAM_INSTANCES, gpu);
+}
 
-   s_cubeRot += dt * CUBE_SPIN_SPEED;
-   s_cubeRot -= floorf(s_cubeRot);
+void Dx12Backend::CmdDraw(RenderCommandList *list, uint32_t indexCount, uint32_t instanceCount)
+{
+   ASSERT(indexCount <= s_resources.cube.indexCount);
+   dx12List(list)->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, 0);
+}
 
-   ShaderMatrices matrices;
-   Mat4 worldFromLocal, viewFromWorld, viewFromLocal, clipFromView;
-   mat4RotY(&worldFromLocal, s_cubeRot * (2.0f * PI));
+bool Dx12Backend::SetCullScene(const CullInstance *instances, uint32_t count)
+{
+   return SetCullingScene(&s_resources.culling, &device, instances, count);
+}
 
-   Vec3 eye = { 0.0f, 1.5f, -3.0f };
-   Vec3 target = { 0.0f, 0.0f, 0.0f };
-   Vec3 up = { 0.0f, 1.0f, 0.0f };
-   mat4LookAt(&viewFromWorld, eye, target, up);
-   mat4Mul(&viewFromLocal, &viewFromWorld, &worldFromLocal);
+void Dx12Backend::CullScene(const CullConstants *constants)
+{
+   DispatchCulling(&s_resources.culling, &device, frameIdx, curFrame, constants);
+}
 
-   mat4PerspectiveFov(&clipFromView, PI / 2.0f, device->surfaceWidth / (float)device->surfaceHeight, 1.0f, 100.0f);
-   mat4Mul(&matrices.clipFromLocal, &clipFromView, &viewFromLocal);
+void Dx12Backend::CmdDrawCulled(RenderCommandList *list)
+{
+   ::CmdDrawCulled(dx12List(list), &s_resources.culling, frameIdx);
+}
 
-   commandList->SetGraphicsRoot32BitConstants(0, sizeof(matrices) / sizeof(UINT), &matrices, 0);
-   commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-   commandList->DrawInstanced(36, 1, 0, 0);
+void Dx12Backend::CmdEndPass(RenderCommandList *list)
+{
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   GpuProfilerEndPass(&device.gpuProfiler, commandList, frameIdx, listChunk(commandList, frameIdx));
+}
 
-   resourceBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-   resourceBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-   commandList->ResourceBarrier(1, &resourceBarrier);
+void Dx12Backend::CmdCopyTarget(RenderCommandList *list, uint32_t src, uint32_t dst)
+{
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   ID3D12Resource *srcResource, *dstResource;
+   D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+   uint32_t srcId, dstId;
+   getTarget(&device, backBufferIdx, src, &srcResource, &rtv, &srcId);
+   getTarget(&device, backBufferIdx, dst, &dstResource, &rtv, &dstId);
+
+   StateList *states = listStates(commandList, frameIdx);
+   StateListTransition(states, srcId, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   StateListTransition(states, dstId, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   CmdFlushBarriers(commandList, states);
+
+   // The typeless transient targets copy to and from the UNORM back buffers.
+   commandList->CopyResource(dstResource, srcResource);
+}
 
+void Dx12Backend::EndCommandList(RenderCommandList *list)
+{
+   ID3D12GraphicsCommandList *commandList = dx12List(list);
+   StateList *states = listStates(commandList, frameIdx);
+   StateListEnd(states);
+   CmdFlushBarriers(commandList, states);
    DX_VERIFY(commandList->Close());
+}
 
-   ID3D12CommandList* commandLists[] = { commandList };
-   device->commandQueue->ExecuteCommandLists(1, commandLists);
+void Dx12Backend::Submit(RenderCommandList *const *lists, uint32_t count)
+{
+   ASSERT(count <= MAX_RECORD_CHUNKS);
+
+   // Only now, in submission order, is it known what state each list finds
+   // its resources in. Whatever a list needs changed goes in a fixup list
+   // just ahead of it, in the same ExecuteCommandLists.
+   ID3D12CommandList *commandLists[2 * MAX_RECORD_CHUNKS];
+   uint32_t listCount = 0;
+   bool fixupsReset = false;
+   for (uint32_t i = 0; i < count; ++i) {
+      ID3D12GraphicsCommandList *commandList = dx12List(lists[i]);
+      std::vector<StateBarrier> *fixups = &s_resources.fixups;
+      fixups->clear();
+      StateTrackerResolve(&device.states, listStates(commandList, frameIdx), fixups);
+
+      if (!fixups->empty()) {
+         ID3D12CommandAllocator *allocator = device.frames[frameIdx].fixupAllocator.Get();
+         if (!fixupsReset) {
+            DX_VERIFY(allocator->Reset());
+            fixupsReset = true;
+         }
+         ID3D12GraphicsCommandList *fixupList = s_resources.fixupLists[frameIdx][i].Get();
+         DX_VERIFY(fixupList->Reset(allocator, nullptr));
+         CmdStateBarriers(fixupList, &device.states, fixups->data(), (uint32_t)fixups->size());
+         DX_VERIFY(fixupList->Close());
+         commandLists[listCount++] = fixupList;
+      }
+      commandLists[listCount++] = commandList;
+   }
+   StateTrackerEndSubmit(&device.states);
 
-   DX_VERIFY(device->swapChain->Present(1, 0));
-   DX_VERIFY(device->commandQueue->Signal(device->fence.Get(), curFrame));
+   TransfersBeforeSubmit(&device.transfers, device.commandQueue.Get());
+   CullingBeforeSubmit(&s_resources.culling, device.commandQueue.Get());
+   device.commandQueue->ExecuteCommandLists(listCount, commandLists);
+}
+
+void Dx12Backend::EndFrame()
+{
+   DX_VERIFY(device.swapChain->Present(vsync ? 1 : 0, 0));
+   DX_VERIFY(device.commandQueue->Signal(device.fence.fence.Get(), curFrame));
+   UploadRingEndFrame(&device.uploadRing, curFrame);
+   CullingEndFrame(&s_resources.culling);
+   DescriptorEndFrame(&device.viewHeap.alloc, curFrame);
+   DescriptorEndFrame(&device.samplerHeap.alloc, curFrame);
 }
@@ -30,18 +30,24 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include <atlbase.h>
 
 #include <array>
+#include <atomic>
 #include <stdint.h>
 #include <vector>
 
-#ifdef NDEBUG
-#  define ASSERT(x) __assume(x)
-#else
-#  include <assert.h>
-#  define ASSERT(x) assert(x)
-#endif
+#include "common.h"
+#include "bindless.h"
+#include "descalloc.h"
+#include "heapalloc.h"
+#include "mesh.h"
+#include "pipelinecache.h"
+#include "render.h"
+#include "ring.h"
+#include "shadercache.h"
+#include "statetrack.h"
+#include "timeline.h"
+#include "transfer.h"
 
 #define DX_VERIFY(x) do { HRESULT res = (x); ASSERT(SUCCEEDED(res)); } while(0)
-#define ARRAY_COUNT(a)  (uint32_t)(sizeof(a)/sizeof((a)[0]))
 
 // Like ATL's CComPtr but with just the stuff we need.
 //
@@ -139,10 +145,34 @@ struct Dx12 {
    std::vector<DXGI_ADAPTER_DESC1> adapterDescs;
 };
 
+// Most command lists a frame is recorded into; each needs its own allocator.
+#define MAX_RECORD_CHUNKS     RENDER_MAX_CHUNKS
+#define MAX_FRAMES_IN_FLIGHT  RENDER_MAX_FRAMES
+#define MAX_BACK_BUFFERS      MAX_FRAMES_IN_FLIGHT
+
+// Per frame in flight. Indexed by fence value modulo Dx12Device::framesInFlight.
 struct Dx12Frame {
-   ComPtr<ID3D12CommandAllocator> commandAllocator;
+   ComPtr<ID3D12CommandAllocator> commandAllocators[MAX_RECORD_CHUNKS];
+   ComPtr<ID3D12CommandAllocator> fixupAllocator;   // for the transitions Submit puts between lists
+};
+
+// Per swap chain buffer. Indexed by GetCurrentBackBufferIndex.
+struct Dx12BackBuffer {
    ComPtr<ID3D12Resource> renderTarget;
    D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+   uint32_t state;            // id in Dx12Device::states
+};
+
+// A fence and the event used to block on it, as the GPU side of a Timeline.
+class Dx12Fence : public TimelineFence {
+public:
+   ComPtr<ID3D12Fence> fence;
+   HANDLE event;
+
+   Dx12Fence() : event(NULL) {}
+
+   uint64_t CompletedValue() override;
+   void Block(uint64_t value) override;
 };
 
 struct Dx12DescriptorHeap {
@@ -155,20 +185,254 @@ struct Dx12DescriptorHeap {
    UINT increment;
 };
 
+// A shader-visible heap split into persistent and per-frame transient
+// descriptors. See descriptors.h.
+struct Dx12DescriptorAllocator {
+   Dx12DescriptorHeap heap;
+   DescriptorAllocator alloc;
+};
+
+// A persistently mapped upload heap carved up by a RingAllocator. Frames bump
+// allocate constants, instance data and staging memory out of it and never
+// map, unmap or create anything on the hot path. See upload.h.
+struct Dx12UploadRing {
+   RingAllocator ring;
+   ComPtr<ID3D12Resource> buffer;
+   uint8_t *cpuBase;
+   D3D12_GPU_VIRTUAL_ADDRESS gpuBase;
+   uint32_t view;             // in the bindless table, if it's on
+};
+
+// Heaps on tier 1 hardware only take one kind of resource: buffers,
+// textures, or render and depth targets. Each heap type gets a pool for each
+// kind there, and on tier 2 one pool takes all three.
+enum Dx12ResourceKind {
+   RESOURCE_BUFFER,
+   RESOURCE_TEXTURE,
+   RESOURCE_TARGET,
+   RESOURCE_KIND_COUNT,
+};
+
+#define GPU_HEAP_TYPE_COUNT  3      // D3D12_HEAP_TYPE_DEFAULT, UPLOAD and READBACK
+#define GPU_POOL_COUNT       (GPU_HEAP_TYPE_COUNT * RESOURCE_KIND_COUNT)
+
+struct Dx12MemoryPool {
+   HeapAllocator alloc;
+   std::vector<ComPtr<ID3D12Heap>> heaps;   // by block
+};
+
+// Told when defragmentation has moved a resource; old is the resource that
+// was there before, still alive until the frame retires.
+typedef void Dx12MovedFn(void *user, ID3D12Resource *old);
+
+// A placed resource and the heap range under it. See gpumemory.h.
+struct Dx12Allocation {
+   ComPtr<ID3D12Resource> resource;
+   uint32_t pool;
+   uint32_t handle;           // in the pool's HeapAllocator
+   Dx12MovedFn *moved;        // if defragmentation may move it
+   void *user;
+};
+
+// Placed resources, suballocated from big heaps. Moves made by
+// defragmentation are copied on the direct queue, through a command list of
+// their own, ahead of the frame that first uses their new place.
+struct Dx12GpuMemory {
+   bool tier2;                // any resource in any heap
+   Dx12MemoryPool pools[GPU_POOL_COUNT];
+   ComPtr<ID3D12CommandAllocator> allocators[MAX_FRAMES_IN_FLIGHT];
+   ComPtr<ID3D12GraphicsCommandList> commandList;
+   std::vector<HeapMove> moves;                      // one defragment's moves,
+   std::vector<ComPtr<ID3D12Resource>> placed;       // their new resources
+   std::vector<D3D12_RESOURCE_BARRIER> aliasing;     // and aliasing barriers
+};
+
+// Uploads through a copy queue of their own, so streaming data in never
+// queues up behind rendering. Frames wait on the copy fence, on the GPU, only
+// for what they use. See transfers.h.
+struct Dx12Transfers {
+   ComPtr<ID3D12CommandQueue> commandQueue;        // D3D12_COMMAND_LIST_TYPE_COPY
+   Dx12Fence fence;                                // signaled by each batch...
+   Timeline timeline;                              // ...and tracked through this
+   TransferQueue queue;
+   ComPtr<ID3D12Resource> staging;
+   ComPtr<ID3D12CommandAllocator> allocators[TRANSFER_MAX_BATCHES];   // by fence value
+   ComPtr<ID3D12GraphicsCommandList> commandList;
+   uint64_t frameWait;        // copy fence value the frame being recorded needs
+   uint64_t queueWait;        // last value the direct queue was made to wait for
+};
+
+// One frame in flight's culling output. Grown, never shrunk, to fit the
+// scene.
+struct Dx12CullFrame {
+   ComPtr<ID3D12CommandAllocator> allocator;
+   Dx12Allocation instances;           // CULL_GROUP_SIZE clip matrices per group
+   Dx12Allocation commands;            // a CullDrawCommand per group
+   Dx12Allocation count;               // how many commands there are
+   Dx12Allocation groupCounts;         // visible instances per group, for the compaction
+   uint32_t capacity;                  // in groups
+   uint32_t view;                      // of instances in the bindless table, if it's on
+};
+
+// Frustum culling on a compute queue, feeding ExecuteIndirect on the direct
+// one. The scene arrives through the copy queue. Every buffer here stays in
+// COMMON between command lists and is promoted to whatever each queue uses
+// it as. See culling.h.
+struct Dx12Culling {
+   ComPtr<ID3D12CommandQueue> commandQueue;        // D3D12_COMMAND_LIST_TYPE_COMPUTE
+   Dx12Fence fence;                                // signaled with the frame's fence value
+   ComPtr<ID3D12RootSignature> rootSignature;
+   ComPtr<ID3D12PipelineState> pipeline;
+   ComPtr<ID3D12PipelineState> compactPipeline;   // cull.comp's second dispatch
+   ComPtr<ID3D12CommandSignature> commandSignature;
+   ComPtr<ID3D12GraphicsCommandList> commandList;
+   Dx12CullFrame frames[MAX_FRAMES_IN_FLIGHT];
+
+   Dx12Allocation scene;                           // CullInstances
+   std::vector<CullInstance> sceneData;            // its source until staged
+   TransferId sceneTransfer;
+   uint32_t sceneCount;
+
+   uint64_t signaled;         // last value the compute queue was told to signal
+   uint32_t frameGroups;      // dispatched this frame, or 0 if there's nothing to draw
+   bool frameCulled;          // CullScene has run this frame
+};
+
+// Instance matrices that persist across frames, updated in place by copies
+// recorded ahead of the frame's draws. Rests in COMMON between submissions,
+// like every buffer. See instancestore.h.
+struct Dx12InstanceStore {
+   Dx12Allocation buffer;
+   UINT64 size;
+   uint32_t state;            // id in Dx12Device::states, if there's a buffer
+   uint32_t view;             // in the bindless table, if it's on and there's a buffer
+};
+
+// The frame graph's transient render targets, placed in one heap where it
+// says and overlapping where it says they may. Numbered from 1 as render
+// targets, from 0 here. See transienttargets.h.
+struct Dx12TransientTargets {
+   ComPtr<ID3D12Heap> heap;
+   uint32_t count;
+   ComPtr<ID3D12Resource> targets[RENDER_MAX_TARGETS];
+   D3D12_CPU_DESCRIPTOR_HANDLE rtvs[RENDER_MAX_TARGETS];
+   uint32_t states[RENDER_MAX_TARGETS];   // ids in Dx12Device::states
+};
+
+// A mesh file's payload in one default-heap buffer, laid out as in the file,
+// with views of its streams bound to the slots of their semantics. See
+// meshes.h.
+struct Dx12Mesh {
+   Dx12Allocation buffer;     // movable once uploaded
+   Mesh source;               // mapped until its payload is staged
+   TransferId transfer;
+   D3D12_VERTEX_BUFFER_VIEW vertexViews[MESH_MAX_STREAMS];   // zeroed for missing streams
+   D3D12_INDEX_BUFFER_VIEW indexView;
+   uint32_t indexCount;
+   float boundsMin[3];
+   float boundsMax[3];
+};
+
+// Compiled shaders and serialized root signatures in a ShaderCache, plus a
+// pipeline library whose serialized form lives in the same file. See shaders.h.
+// Pipelines may be created from several threads; everything else belongs to
+// one.
+struct Dx12ShaderCache {
+   ShaderCache blobs;
+   ComPtr<ID3D12PipelineLibrary> library;   // null if the driver has no support
+   uint64_t libraryKey;
+   std::atomic<bool> libraryDirty;
+
+   std::atomic<uint32_t> pipelineHits;
+   std::atomic<uint32_t> pipelineMisses;
+};
+
+// Parameters of the shared root signature. Bindless, draws pass their
+// instances as a BindlessRef in two root constants and shaders read them
+// through a table covering all of Dx12Device::viewHeap, set once per command
+// list. Otherwise the instances are a root SRV and there is no table.
+enum Dx12DrawParam {
+   DRAW_PARAM_INSTANCES,      // b0 if bindless, t0 if not
+   DRAW_PARAM_TABLE,          // bindless only
+};
+
+// Shader programs by the index PipelineKey::program() refers to. See
+// pipelines.cpp for their sources.
+enum Dx12Program {
+   PROGRAM_CUBE,
+   PROGRAM_COUNT,
+};
+
+struct Dx12Device;
+
+// Every pipeline state the renderer draws with, made on demand from a
+// PipelineKey and shared by all of them: one root signature and the compiled
+// programs. See pipelines.h.
+struct Dx12Pipelines {
+   Dx12Device *device;
+   PipelineCache cache;
+   ComPtr<ID3D12RootSignature> rootSignature;
+   D3D12_SHADER_BYTECODE rootSignatureCode;     // serialized, owned by the shader cache
+   bool bindless;             // see Dx12DrawParam
+   D3D12_SHADER_BYTECODE vertexCode[PROGRAM_COUNT];
+   D3D12_SHADER_BYTECODE pixelCode[PROGRAM_COUNT];
+};
+
+// Timestamps around every pass of every frame in flight, read back once the
+// frame retires and recorded as GPU zones. See gpuprofile.h.
+struct Dx12GpuProfiler {
+   ComPtr<ID3D12QueryHeap> queryHeap;    // null if timestamps aren't available
+   ComPtr<ID3D12Resource> readback;
+   uint32_t track;
+   uint64_t frequency;        // timestamp ticks per second
+   uint64_t gpuBase;          // a timestamp...
+   int64_t cpuBase;           // ...and the same moment on the ProfilerNow() clock
+   bool capturing;            // as of the last BeginFrame
+   bool passTimed[MAX_FRAMES_IN_FLIGHT][MAX_RECORD_CHUNKS];
+};
+
 struct Dx12Device {
    const Dx12 *dx12;
 
    uint32_t deviceIdx; // index into dx12->adapters/adapterDescs
    ComPtr<ID3D12Device> device;
    ComPtr<ID3D12CommandQueue> commandQueue;
-   ComPtr<ID3D12Fence> fence;
-   HANDLE fenceEvent;
+   Dx12Fence fence;           // signaled by commandQueue at the end of each frame
+   Timeline timeline;         // ...and tracked through this
+   uint64_t frameNum;         // fence value the next frame will signal
 
    Dx12DescriptorHeap rtvHeap;
-
-   Dx12Frame frames[2];
+   Dx12DescriptorHeap dsvHeap;            // just depthBuffer's
+   Dx12DescriptorAllocator viewHeap;      // CBV/SRV/UAV
+   Dx12DescriptorAllocator samplerHeap;
+   BindlessTable bindless;                // over viewHeap; see bindless.h
+   Dx12UploadRing uploadRing;
+   Dx12Transfers transfers;
+   Dx12ShaderCache shaderCache;
+   Dx12GpuProfiler gpuProfiler;
+   Dx12GpuMemory memory;
+
+   // States of the resources the direct queue transitions: the back buffers,
+   // the transient targets and the instance store. See statetrack.h.
+   StateTracker states;
+
+   // Between 1 and MAX_FRAMES_IN_FLIGHT. Changing it takes a new swap chain.
+   uint32_t framesInFlight;
+   Dx12Frame frames[MAX_FRAMES_IN_FLIGHT];
+
+   uint32_t backBufferCount;
+   Dx12BackBuffer backBuffers[MAX_BACK_BUFFERS];
    ComPtr<IDXGISwapChain3> swapChain;
 
+   // D32, the size of the back buffers and recreated with them. Only ever
+   // in DEPTH_WRITE, so not in states.
+   Dx12Allocation depthBuffer;
+   D3D12_CPU_DESCRIPTOR_HANDLE dsv;
+
    uint32_t surfaceWidth;
    uint32_t surfaceHeight;
-};
\ No newline at end of file
+};
+
+// Returns null if there's no usable D3D12 device. The swap chain is created
+// by the first Resize.
+RenderBackend *CreateDx12Backend(HWND hwnd, bool bindless);
@@ -0,0 +1,888 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+#include <vector>
+
+#include "bvh.h"
+#include "common.h"
+#include "cull.h"
+#include "frame.h"
+#include "framegraph.h"
+#include "hierarchy.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "render.h"
+#include "sim.h"
+#include "transform.h"
+#include "vecmath.h"
+
+#define PI 3.14159265f
+#define CUBE_SPACING       3.0f // distance between neighbouring cubes in the grid
+#define CUBE_PHASE_STEP    0.05f // rotation offset between neighbours, in turns
+#define CUBE_INDEX_COUNT   36   // all of cube.mesh
+#define CUBE_BOUNDS_RADIUS 1.73205081f // cube.mesh spans -1 to 1 on every axis
+#define MAX_INSTANCES      (1u << 20)
+#define MIN_CHUNK_INSTANCES 4096 // fewer than this per command list isn't worth another list
+#define MAX_STORE_COPIES   256  // more separate runs of changes than this and the store isn't worth it
+
+// Matches Instance in cube.vert.
+typedef struct ShaderInstance {
+   Mat4 clipFromLocal;
+} ShaderInstance;
+
+static_assert(sizeof(ShaderInstance) == sizeof(Mat4), "instance data is written as a Mat4 array");
+
+// What each pass of the frame graph is, as its user value.
+enum FramePass {
+   FRAME_PASS_CULL,           // CullScene; on the backend's compute queue, ahead of the command lists
+   FRAME_PASS_STORE,          // copies the changes into the instance store
+   FRAME_PASS_SCENE,          // the cubes
+   FRAME_PASS_POST,           // copies its input over its output
+};
+
+// Everything a recording job needs. Chunk i draws its slice of the instances
+// into its own command list. Chunk 0 also records the graph's steps ahead of
+// the scene and the scene's barriers, and the last chunk the steps after it,
+// down to presenting.
+struct RecordContext {
+   RenderBackend *backend;
+   const FrameGraphCompiled *graph;
+   uint32_t sceneStep;
+   uint32_t sceneTarget;
+   bool gpuCulled;               // the scene is whatever CullScene left, in one chunk
+   uint32_t chunkCount;
+   uint32_t chunkInstances;
+   uint32_t instanceCount;
+   const Mat4 *clipFromWorld;
+   const Mat4 *worldFromLocal;   // by scene instance
+   const uint32_t *visible;      // scene instance of each one drawn, or null for all of them
+
+   // Set if the instances go straight from the layout to clip space rather
+   // than through worldFromLocal. Each chunk fills in its slice of the
+   // batch's arrays first.
+   const TransformBatch *batch;
+   float cubeRot;
+
+   // Either the instances are transformed into this frame's upload, or they
+   // were already and are drawn from the store.
+   RenderUpload instanceAlloc;   // null cpu if drawing from the store
+   uint64_t instanceGpu;
+   uint64_t storeSource;
+   const RenderStoreCopy *storeCopies;
+   uint32_t storeCopyCount;
+
+   RenderCommandList *lists[RENDER_MAX_CHUNKS];
+};
+
+// Cubes are laid out on a square grid in the xz plane with a small phase
+// offset between neighbours. Some of them spin about Y and the rest stand
+// still; the still ones come first in instance order, so the ones that change
+// from frame to frame are all in one run.
+struct DemoScene {
+   uint32_t instanceCount;
+   uint32_t spinningPercent;
+   uint32_t spinningFirst;    // instances from here on spin
+   float extent;              // distance from the origin to the farthest cube
+   std::vector<float> posX;
+   std::vector<float> posY;   // all zero
+   std::vector<float> posZ;
+   std::vector<float> radius;
+   std::vector<float> phase;  // in turns
+
+   // Node 0 is the grid and instance i is node i + 1, one of its children.
+   // Only the spinning cubes are set each frame, so only they are updated.
+   Hierarchy hierarchy;
+   float spinRot;             // the rotation the spinning cubes were last set to
+   bool spinSet;
+
+   // Clip matrices that persist on the backend. Valid only while the
+   // backend and the camera stay the same and every frame goes through it.
+   const RenderBackend *storeBackend;
+   uint64_t storeGpu;
+   Mat4 storeClipFromWorld;
+   std::vector<RenderStoreCopy> storeCopies;
+
+   // The direct path, for frames that transform every cube they draw. The
+   // grid is the identity, so a cube's local transform is its world
+   // transform, and the recording jobs go from these to clip space in one
+   // pass. rotY is rebuilt every frame; the visible cubes' positions are
+   // gathered into drawX and drawZ when culling.
+   std::vector<float> rotY;   // in radians
+   std::vector<float> drawX;
+   std::vector<float> drawZ;
+
+   // CPU culling. The cubes only spin, which doesn't move their bounding
+   // spheres, so the tree is built once per layout. The visible cubes are
+   // left in visible, in index order, for the recording jobs to gather.
+   Bvh bvh;
+   bool bvhBuilt;
+   std::vector<uint32_t> visible;
+   std::vector<uint64_t> visibleBits;  // a bit per cube, for putting visible in order
+
+   const RenderBackend *cullBackend;   // holds this layout as its cull scene
+   bool cullFailed;                    // ...or couldn't
+};
+
+// The frame as a graph of passes, declared every frame and compiled when it
+// changes. The transient targets are only replaced when the compiled graph
+// places them differently.
+struct FramePasses {
+   FrameGraph graph;
+   bool graphInit;
+
+   const RenderBackend *allocBackend;  // allocSize and allocAlignment are its, for allocDesc
+   RenderTargetDesc allocDesc;
+   uint64_t allocSize;
+   uint64_t allocAlignment;
+
+   const RenderBackend *targetBackend; // has these transient targets
+   RenderTargetPlacement placements[RENDER_MAX_TARGETS];
+   uint32_t placementCount;
+   uint64_t heapSize;
+};
+
+static DemoScene s_scene;
+static FramePasses s_passes;
+static std::atomic<uint32_t> s_instanceCount(1);   // set from the window thread
+static std::atomic<uint32_t> s_spinningPercent(100);
+static std::atomic<uint32_t> s_culling(FRAME_CULL_NONE);
+static std::atomic<uint32_t> s_postPasses(0);
+
+// Spreads the spinning cubes evenly over the grid: 61 is coprime with 100,
+// so every hundred cells in a row have exactly percent of them.
+static inline bool cellSpins(uint32_t cell, uint32_t percent)
+{
+   return (cell * 61u) % 100u < percent;
+}
+
+static void layoutScene(DemoScene *scene, uint32_t instanceCount, uint32_t spinningPercent)
+{
+   uint32_t side = (uint32_t)ceilf(sqrtf((float)instanceCount));
+   float offset = (side - 1) * CUBE_SPACING * 0.5f;
+
+   scene->posX.resize(instanceCount);
+   scene->posY.assign(instanceCount, 0.0f);
+   scene->posZ.resize(instanceCount);
+   scene->radius.assign(instanceCount, CUBE_BOUNDS_RADIUS);
+   scene->phase.resize(instanceCount);
+   scene->visible.resize(instanceCount);
+   scene->visibleBits.resize((instanceCount + 63) / 64);
+   scene->rotY.resize(instanceCount);
+   scene->drawX.resize(instanceCount);
+   scene->drawZ.resize(instanceCount);
+
+   // Still cubes from the front, spinning ones from the back.
+   uint32_t still = 0;
+   for (uint32_t cell = 0; cell < instanceCount; ++cell) {
+      still += !cellSpins(cell, spinningPercent);
+   }
+   uint32_t nextStill = 0, nextSpinning = still;
+   for (uint32_t cell = 0; cell < instanceCount; ++cell) {
+      uint32_t row = cell / side;
+      uint32_t col = cell % side;
+      uint32_t i = cellSpins(cell, spinningPercent) ? nextSpinning++ : nextStill++;
+      scene->posX[i] = col * CUBE_SPACING - offset;
+      scene->posZ[i] = row * CUBE_SPACING - offset;
+      scene->phase[i] = (row + col) * CUBE_PHASE_STEP;
+   }
+
+   Hierarchy *hierarchy = &scene->hierarchy;
+   HierarchyClear(hierarchy);
+   HierarchyTransform local = { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+   uint32_t grid = HierarchyAddNode(hierarchy, HIERARCHY_NONE, &local);
+   for (uint32_t i = 0; i < instanceCount; ++i) {
+      local.posX = scene->posX[i];
+      local.posZ = scene->posZ[i];
+      local.rotY = scene->phase[i] * (2.0f * PI);
+      HierarchyAddNode(hierarchy, grid, &local);
+   }
+
+   scene->extent = offset * 1.41421356f;
+   scene->instanceCount = instanceCount;
+   scene->spinningPercent = spinningPercent;
+   scene->spinningFirst = still;
+   scene->spinSet = false;
+   scene->storeBackend = nullptr;
+   scene->cullBackend = nullptr;
+   scene->cullFailed = false;
+   scene->bvhBuilt = false;
+}
+
+// Whether the grid, which every cube hangs off, is where it started.
+static bool gridIsIdentity(const DemoScene *scene)
+{
+   const HierarchyTransform *grid = &scene->hierarchy.local[0];
+   return grid->posX == 0.0f && grid->posY == 0.0f && grid->posZ == 0.0f && grid->rotY == 0.0f && grid->scale == 1.0f;
+}
+
+// Turns the spinning cubes to cubeRot and brings the world matrices up to
+// date. Returns how many instances changed.
+static uint32_t animateScene(DemoScene *scene, float cubeRot)
+{
+   PROFILE_ZONE("animate");
+
+   Hierarchy *hierarchy = &scene->hierarchy;
+   if (!scene->spinSet || cubeRot != scene->spinRot) {
+      HierarchyTransform local = { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+      for (uint32_t i = scene->spinningFirst; i < scene->instanceCount; ++i) {
+         local.posX = scene->posX[i];
+         local.posZ = scene->posZ[i];
+         local.rotY = (cubeRot + scene->phase[i]) * (2.0f * PI);
+         HierarchySetLocal(hierarchy, i + 1, &local);
+      }
+      scene->spinRot = cubeRot;
+      scene->spinSet = true;
+   }
+
+   // The grid itself never moves once placed, so after the first update
+   // every changed node is an instance.
+   uint32_t changed = HierarchyUpdate(hierarchy);
+   return changed > scene->instanceCount ? scene->instanceCount : changed;
+}
+
+// Brings the backend's instance store up to date for this frame, uploading
+// just the instances that changed if it was already current and all of them
+// if not. Returns false if the store can't be used, in which case the frame
+// has to draw from an upload of its own.
+static bool updateStore(RenderBackend *backend, DemoScene *scene, const Mat4 *clipFromWorld, RecordContext *ctx)
+{
+   PROFILE_ZONE("update store");
+
+   const Hierarchy *hierarchy = &scene->hierarchy;
+   const Mat4 *worldFromLocal = hierarchy->world.data() + 1;
+   uint32_t instanceCount = scene->instanceCount;
+   std::vector<RenderStoreCopy> *copies = &scene->storeCopies;
+   copies->clear();
+
+   bool current = scene->storeBackend == backend &&
+      memcmp(&scene->storeClipFromWorld, clipFromWorld, sizeof(Mat4)) == 0;
+   scene->storeBackend = nullptr;
+
+   RenderUpload upload;
+   if (current) {
+      uint32_t count = hierarchy->changedNodes < instanceCount ? hierarchy->changedNodes : instanceCount;
+      if (count > 0 && !backend->AllocUpload((uint64_t)count * sizeof(ShaderInstance), RENDER_UPLOAD_ALIGNMENT, &upload)) {
+         return false;
+      }
+
+      uint32_t uploaded = 0;
+      for (size_t i = 0; i < hierarchy->changed.size(); ++i) {
+         uint32_t first = hierarchy->changed[i].first > 0 ? hierarchy->changed[i].first - 1 : 0;
+         uint32_t end = hierarchy->changed[i].end - 1;
+         if (first >= end) {
+            continue;
+         }
+
+         ShaderInstance *instances = (ShaderInstance *)upload.cpu + uploaded;
+         TransformMatricesToClip(&instances->clipFromLocal, clipFromWorld, worldFromLocal + first, end - first);
+
+         RenderStoreCopy copy;
+         copy.srcOffset = (uint64_t)uploaded * sizeof(ShaderInstance);
+         copy.dstOffset = (uint64_t)first * sizeof(ShaderInstance);
+         copy.size = (uint64_t)(end - first) * sizeof(ShaderInstance);
+         copies->push_back(copy);
+         uploaded += end - first;
+      }
+   } else {
+      uint64_t size = (uint64_t)instanceCount * sizeof(ShaderInstance);
+      if (!backend->SetInstanceStore(size, &scene->storeGpu) ||
+         !backend->AllocUpload(size, RENDER_UPLOAD_ALIGNMENT, &upload)) {
+         return false;
+      }
+
+      TransformMatricesToClip(&((ShaderInstance *)upload.cpu)->clipFromLocal, clipFromWorld, worldFromLocal, instanceCount);
+      RenderStoreCopy copy = { 0, 0, size };
+      copies->push_back(copy);
+   }
+
+   scene->storeBackend = backend;
+   scene->storeClipFromWorld = *clipFromWorld;
+   ctx->instanceAlloc.cpu = nullptr;
+   ctx->instanceAlloc.gpu = 0;
+   ctx->instanceGpu = scene->storeGpu;
+   ctx->storeSource = copies->empty() ? 0 : upload.gpu;
+   ctx->storeCopies = copies->data();
+   ctx->storeCopyCount = (uint32_t)copies->size();
+   return true;
+}
+
+static inline uint32_t lowestBit(uint64_t bits)
+{
+   ASSERT(bits != 0);
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward64(&index, bits);
+   return index;
+#else
+   return __builtin_ctzll(bits);
+#endif
+}
+
+// The tree hands back its leaves' order. Every other path draws cubes in
+// index order, and overlapping cubes at equal depth go to whichever is drawn
+// last, so put them back in it: a bit per cube costs far less than a sort.
+static void orderVisible(DemoScene *scene, uint32_t count)
+{
+   uint64_t *bits = scene->visibleBits.data();
+   uint32_t *visible = scene->visible.data();
+   uint32_t words = (uint32_t)scene->visibleBits.size();
+   memset(bits, 0, words * sizeof(uint64_t));
+   for (uint32_t i = 0; i < count; ++i) {
+      bits[visible[i] / 64] |= 1ull << (visible[i] % 64);
+   }
+
+   uint32_t out = 0;
+   for (uint32_t word = 0; word < words; ++word) {
+      for (uint64_t set = bits[word]; set; set &= set - 1) {
+         visible[out++] = word * 64 + lowestBit(set);
+      }
+   }
+   ASSERT(out == count);
+}
+
+// Leaves the visible cubes' indices in scene->visible, in index order, and
+// returns how many there are.
+static uint32_t cullScene(DemoScene *scene, const Mat4 *clipFromWorld)
+{
+   PROFILE_ZONE("cull");
+
+   if (!scene->bvhBuilt) {
+      BoundingSpheres spheres;
+      spheres.centerX = scene->posX.data();
+      spheres.centerY = scene->posY.data();
+      spheres.centerZ = scene->posZ.data();
+      spheres.radius = scene->radius.data();
+      spheres.count = scene->instanceCount;
+      BvhBuild(&scene->bvh, &spheres);
+      scene->bvhBuilt = true;
+   }
+
+   Vec4 planes[6];
+   CullFrustumPlanes(clipFromWorld, planes);
+   uint32_t count = BvhCullParallel(&scene->bvh, planes, scene->visible.data());
+   orderVisible(scene, count);
+   return count;
+}
+
+// Hands the layout to the backend as the scene it culls, the first time it's
+// culled. The spinning cubes all turn together bar the phase, so nothing per
+// instance needs to go to the GPU after that.
+static bool setCullScene(RenderBackend *backend, DemoScene *scene)
+{
+   if (scene->cullBackend == backend) {
+      return true;
+   } else if (scene->cullFailed) {
+      return false;
+   }
+
+   std::vector<CullInstance> instances(scene->instanceCount);
+   for (uint32_t i = 0; i < scene->instanceCount; ++i) {
+      instances[i].posX = scene->posX[i];
+      instances[i].posY = 0.0f;
+      instances[i].posZ = scene->posZ[i];
+      instances[i].phase = scene->phase[i];
+      instances[i].spin = i >= scene->spinningFirst ? 1.0f : 0.0f;
+   }
+
+   if (!backend->SetCullScene(instances.data(), scene->instanceCount)) {
+      scene->cullFailed = true;
+      return false;
+   }
+   scene->cullBackend = backend;
+   return true;
+}
+
+void SetInstanceCount(uint32_t instanceCount)
+{
+   if (instanceCount < 1) {
+      instanceCount = 1;
+   } else if (instanceCount > MAX_INSTANCES) {
+      instanceCount = MAX_INSTANCES;
+   }
+   s_instanceCount = instanceCount;
+}
+
+uint32_t GetInstanceCount()
+{
+   return s_instanceCount;
+}
+
+void SetSpinningPercent(uint32_t percent)
+{
+   s_spinningPercent = percent < 100 ? percent : 100;
+}
+
+uint32_t GetSpinningPercent()
+{
+   return s_spinningPercent;
+}
+
+void SetCulling(FrameCulling culling)
+{
+   s_culling = culling;
+}
+
+FrameCulling GetCulling()
+{
+   return (FrameCulling)s_culling.load();
+}
+
+void SetPostPasses(uint32_t count)
+{
+   s_postPasses = count < RENDER_MAX_TARGETS ? count : RENDER_MAX_TARGETS;
+}
+
+uint32_t GetPostPasses()
+{
+   return s_postPasses;
+}
+
+const FrameGraphStats *GetFrameGraphStats()
+{
+   return &s_passes.graph.stats;
+}
+
+// Declares this frame's passes and compiles them. Every pass after the scene
+// copies the picture into the next target, the last of them into the back
+// buffer. The instances the scene draws are a resource too, written by the
+// culling dispatch or the store update if there is one; the backend makes
+// their transitions itself, but they order the passes.
+static const FrameGraphCompiled *declareFrame(RenderBackend *backend, const RenderFrame *frame, bool gpuCulling,
+   bool storeUpdate, uint32_t postPasses)
+{
+   FramePasses *passes = &s_passes;
+   if (!passes->graphInit) {
+      FrameGraphInit(&passes->graph);
+      passes->graphInit = true;
+   }
+
+   RenderTargetDesc desc = { frame->width, frame->height };
+   if (postPasses > 0 && (passes->allocBackend != backend || passes->allocDesc.width != desc.width ||
+      passes->allocDesc.height != desc.height)) {
+      backend->GetTargetAllocation(&desc, &passes->allocSize, &passes->allocAlignment);
+      passes->allocBackend = backend;
+      passes->allocDesc = desc;
+   }
+
+   FrameGraph *graph = &passes->graph;
+   FrameGraphBegin(graph, 1u << FRAMEGRAPH_QUEUE_COMPUTE);
+   uint32_t backBuffer = FrameGraphImport(graph, RENDER_BACK_BUFFER, STATE_PRESENT, STATE_PRESENT, true);
+   uint32_t instances = FrameGraphImport(graph, RENDER_NO_TARGET, STATE_INVALID, STATE_INVALID, false);
+
+   if (gpuCulling) {
+      uint32_t cull = FrameGraphAddPass(graph, "cull", FRAMEGRAPH_QUEUE_COMPUTE, FRAMEGRAPH_ASYNC, FRAME_PASS_CULL);
+      FrameGraphWrite(graph, cull, instances, STATE_UNORDERED_ACCESS);
+   } else if (storeUpdate) {
+      uint32_t update = FrameGraphAddPass(graph, "update store", FRAMEGRAPH_QUEUE_GRAPHICS, 0, FRAME_PASS_STORE);
+      FrameGraphWrite(graph, update, instances, STATE_COPY_DEST);
+   }
+
+   uint32_t color = postPasses > 0 ? FrameGraphCreate(graph, 0, passes->allocSize, passes->allocAlignment) : backBuffer;
+   uint32_t scene = FrameGraphAddPass(graph, "scene", FRAMEGRAPH_QUEUE_GRAPHICS, 0, FRAME_PASS_SCENE);
+   FrameGraphRead(graph, scene, instances, STATE_NON_PIXEL_SHADER_RESOURCE);
+   FrameGraphWrite(graph, scene, color, STATE_RENDER_TARGET);
+
+   for (uint32_t i = 1; i <= postPasses; ++i) {
+      uint32_t output = i < postPasses ? FrameGraphCreate(graph, i, passes->allocSize, passes->allocAlignment) : backBuffer;
+      uint32_t post = FrameGraphAddPass(graph, "post", FRAMEGRAPH_QUEUE_GRAPHICS, 0, FRAME_PASS_POST);
+      FrameGraphRead(graph, post, color, STATE_COPY_SOURCE);
+      FrameGraphWrite(graph, post, output, STATE_COPY_DEST);
+      color = output;
+   }
+
+   return FrameGraphCompile(graph);
+}
+
+// Hands the compiled graph's placements to the backend, unless it has them
+// already. Returns false if it has no memory for them.
+static bool placeTargets(RenderBackend *backend, const FrameGraphCompiled *compiled)
+{
+   FramePasses *passes = &s_passes;
+   RenderTargetPlacement placements[RENDER_MAX_TARGETS];
+   uint32_t count = compiled->transientCount;
+   ASSERT(count <= RENDER_MAX_TARGETS);
+   for (uint32_t r = 0; r < compiled->decl.resourceCount; ++r) {
+      uint32_t index = compiled->transientIndex[r];
+      if (index != FRAMEGRAPH_NONE) {
+         placements[index].desc = passes->allocDesc;
+         placements[index].offset = compiled->offsets[r];
+         placements[index].state = compiled->restStates[r];
+      }
+   }
+
+   bool same = passes->targetBackend == backend && passes->placementCount == count &&
+      passes->heapSize == compiled->transientBytes;
+   for (uint32_t i = 0; i < count && same; ++i) {
+      const RenderTargetPlacement *a = &placements[i];
+      const RenderTargetPlacement *b = &passes->placements[i];
+      same = a->desc.width == b->desc.width && a->desc.height == b->desc.height && a->offset == b->offset &&
+         a->state == b->state;
+   }
+   if (same) {
+      return true;
+   }
+
+   passes->targetBackend = nullptr;
+   if (!backend->SetTransientTargets(placements, count, compiled->transientBytes)) {
+      return false;
+   }
+   memcpy(passes->placements, placements, count * sizeof(RenderTargetPlacement));
+   passes->placementCount = count;
+   passes->heapSize = compiled->transientBytes;
+   passes->targetBackend = backend;
+   return true;
+}
+
+// The render target a graph resource is: imported ones say, and transient
+// ones are numbered in order.
+static uint32_t resourceTarget(const FrameGraphCompiled *compiled, uint32_t resource)
+{
+   uint32_t index = compiled->transientIndex[resource];
+   return index != FRAMEGRAPH_NONE ? index + 1 : compiled->decl.resources[resource].user;
+}
+
+// The first resource a pass reads or writes.
+static uint32_t passUse(const FrameGraphPass *pass, bool write)
+{
+   for (uint32_t i = 0; i < pass->useCount; ++i) {
+      if ((pass->uses[i].write != 0) == write) {
+         return pass->uses[i].resource;
+      }
+   }
+   return FRAMEGRAPH_NONE;
+}
+
+// Issues the graph's barriers for render targets; the rest are the
+// backend's business.
+static void cmdGraphBarriers(RenderBackend *backend, RenderCommandList *list, const FrameGraphCompiled *compiled,
+   uint32_t first, uint32_t count)
+{
+   RenderBarrier barriers[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t used = 0;
+   for (uint32_t i = first; i < first + count; ++i) {
+      const FrameGraphBarrier *from = &compiled->barriers[i];
+      uint32_t target = resourceTarget(compiled, from->resource);
+      if (target == RENDER_NO_TARGET) {
+         continue;
+      }
+
+      RenderBarrier *barrier = &barriers[used++];
+      barrier->target = target;
+      barrier->before = from->before;
+      barrier->after = from->state;
+      barrier->flags = (from->flags & FRAMEGRAPH_BARRIER_ALIAS ? RENDER_BARRIER_ALIAS : 0) |
+         (from->flags & FRAMEGRAPH_BARRIER_BEGIN ? RENDER_BARRIER_BEGIN : 0) |
+         (from->flags & FRAMEGRAPH_BARRIER_END ? RENDER_BARRIER_END : 0);
+      barrier->aliasBefore = from->aliasBefore == FRAMEGRAPH_NONE ? RENDER_NO_TARGET :
+         resourceTarget(compiled, from->aliasBefore);
+      if (used == ARRAY_COUNT(barriers)) {
+         backend->CmdBarriers(list, barriers, used);
+         used = 0;
+      }
+   }
+   if (used) {
+      backend->CmdBarriers(list, barriers, used);
+   }
+}
+
+// Records steps [first, end) but the scene, each between its barriers. The
+// culling dispatch has gone already.
+static void recordSteps(const RecordContext *ctx, RenderCommandList *list, uint32_t first, uint32_t end)
+{
+   RenderBackend *backend = ctx->backend;
+   const FrameGraphCompiled *graph = ctx->graph;
+   for (uint32_t s = first; s < end; ++s) {
+      const FrameGraphStep *step = &graph->steps[s];
+      const FrameGraphPass *pass = &graph->decl.passes[step->pass];
+      cmdGraphBarriers(backend, list, graph, step->firstBarrier, step->barrierCount);
+
+      switch (pass->user) {
+      case FRAME_PASS_STORE:
+         backend->CmdUpdateInstanceStore(list, ctx->storeSource, ctx->storeCopies, ctx->storeCopyCount);
+         break;
+      case FRAME_PASS_POST:
+         backend->CmdCopyTarget(list, resourceTarget(graph, passUse(pass, false)), resourceTarget(graph, passUse(pass, true)));
+         break;
+      default:
+         break;
+      }
+
+      cmdGraphBarriers(backend, list, graph, step->firstAfter, step->afterCount);
+   }
+}
+
+// Job entry point: fills in the chunk's instance matrices, unless they're
+// in the store already, and records its command list.
+static void recordChunk(void *data, uint32_t chunk)
+{
+   PROFILE_ZONE("record chunk");
+
+   RecordContext *ctx = (RecordContext *)data;
+   RenderBackend *backend = ctx->backend;
+   const FrameGraphCompiled *graph = ctx->graph;
+   const FrameGraphStep *scene = &graph->steps[ctx->sceneStep];
+
+   RenderCommandList *list = backend->BeginCommandList(chunk);
+   if (chunk == 0) {
+      recordSteps(ctx, list, 0, ctx->sceneStep);
+      cmdGraphBarriers(backend, list, graph, scene->firstBarrier, scene->barrierCount);
+   }
+
+   const float clearColor[] = { 0.086f, 0.086f, 0.1137f, 1.0f, };
+   const float clearDepth = RENDER_DEPTH_CLEAR;
+   backend->CmdBeginPass(list, ctx->sceneTarget, chunk == 0 ? clearColor : nullptr, chunk == 0 ? &clearDepth : nullptr);
+
+   uint32_t first = chunk * ctx->chunkInstances;
+   uint32_t count = 0;
+   if (first < ctx->instanceCount) {
+      count = ctx->instanceCount - first < ctx->chunkInstances ? ctx->instanceCount - first : ctx->chunkInstances;
+   }
+
+   if (ctx->gpuCulled) {
+      backend->CmdDrawCulled(list);
+   } else if (count > 0) {
+      if (ctx->batch) {
+         for (uint32_t i = first; i < first + count; ++i) {
+            uint32_t index = ctx->visible ? ctx->visible[i] : i;
+            float turns = s_scene.phase[index] + (index >= s_scene.spinningFirst ? ctx->cubeRot : 0.0f);
+            s_scene.rotY[i] = turns * (2.0f * PI);
+            if (ctx->visible) {
+               s_scene.drawX[i] = s_scene.posX[index];
+               s_scene.drawZ[i] = s_scene.posZ[index];
+            }
+         }
+
+         ShaderInstance *instances = (ShaderInstance *)ctx->instanceAlloc.cpu + first;
+         TransformBatchToClip(&instances->clipFromLocal, ctx->clipFromWorld, ctx->batch, first, count);
+      } else if (ctx->instanceAlloc.cpu) {
+         ShaderInstance *instances = (ShaderInstance *)ctx->instanceAlloc.cpu + first;
+         if (ctx->visible) {
+            TransformIndexedToClip(&instances->clipFromLocal, ctx->clipFromWorld, ctx->worldFromLocal,
+               ctx->visible + first, count);
+         } else {
+            TransformMatricesToClip(&instances->clipFromLocal, ctx->clipFromWorld, ctx->worldFromLocal + first, count);
+         }
+      }
+
+      // SV_InstanceID restarts at zero for every draw, so offset the buffer
+      // rather than the instance.
+      backend->CmdSetInstanceBuffer(list, ctx->instanceGpu + (uint64_t)first * sizeof(ShaderInstance), sizeof(ShaderInstance));
+      backend->CmdDraw(list, CUBE_INDEX_COUNT, count);
+   }
+
+   backend->CmdEndPass(list);
+   if (chunk == ctx->chunkCount - 1) {
+      cmdGraphBarriers(backend, list, graph, scene->firstAfter, scene->afterCount);
+      recordSteps(ctx, list, ctx->sceneStep + 1, graph->stepCount);
+      cmdGraphBarriers(backend, list, graph, graph->firstEndBarrier, graph->endBarrierCount);
+   }
+   backend->EndCommandList(list);
+   ctx->lists[chunk] = list;
+}
+
+// Starts the GPU-culled frame's culling dispatch, which leaves whatever
+// survives it for one CmdDrawCulled, however many instances there are.
+static void dispatchCulling(RenderBackend *backend, const FramePacket *packet, const Mat4 *clipFromWorld)
+{
+   PROFILE_ZONE("dispatch culling");
+
+   CullConstants constants = {};
+   constants.clipFromWorld = *clipFromWorld;
+   CullFrustumPlanes(clipFromWorld, constants.planes);
+   constants.bounds.x = 0.0f;
+   constants.bounds.y = 0.0f;
+   constants.bounds.z = 0.0f;
+   constants.bounds.w = CUBE_BOUNDS_RADIUS;
+   constants.rotation = packet->cubeRot;
+   constants.indexCount = CUBE_INDEX_COUNT;
+   backend->CullScene(&constants);
+}
+
+bool DrawFrame(RenderBackend *backend, const FramePacket *packet, FrameStats *stats)
+{
+   PROFILE_ZONE("DrawFrame");
+
+   int64_t stageTimes[6];
+   stageTimes[0] = ProfilerNow();
+
+   // Includes waiting for the frame slot, which TimelineWait profiles on its own.
+   RenderFrame frame;
+   {
+      PROFILE_ZONE("BeginFrame");
+      if (!backend->BeginFrame(&frame)) {
+         return false;
+      }
+   }
+   stageTimes[1] = ProfilerNow();
+
+   uint32_t requestedCount = s_instanceCount.load();
+   uint32_t spinningPercent = s_spinningPercent.load();
+   if (s_scene.instanceCount != requestedCount || s_scene.spinningPercent != spinningPercent) {
+      layoutScene(&s_scene, requestedCount, spinningPercent);
+   }
+
+   FrameCulling culling = GetCulling();
+   bool gpuCulling = culling == FRAME_CULL_GPU && setCullScene(backend, &s_scene);
+
+   // Only a whole scene that mostly stands still goes through the instance
+   // store; past about a third of it spinning, updating the hierarchy and
+   // then the store costs more than transforming everything. Any other frame
+   // transforms every cube it draws, so it skips the hierarchy and takes the
+   // direct path, which the default of everything spinning needs to be fast.
+   // The hierarchy's spinning cubes fall behind meanwhile and are brought up
+   // to date the next time it's used.
+   uint32_t spinning = s_scene.instanceCount - s_scene.spinningFirst;
+   bool direct = !gpuCulling && (culling != FRAME_CULL_NONE || spinning * 3 > s_scene.instanceCount) &&
+      gridIsIdentity(&s_scene);
+   uint32_t updated = 0;
+   if (direct) {
+      s_scene.spinSet = false;
+      updated = spinning;
+   } else if (!gpuCulling) {
+      updated = animateScene(&s_scene, packet->cubeRot);
+   }
+
+   // Pull the camera back far enough to keep the whole grid in view.
+   float cameraScale = 1.0f + s_scene.extent / 3.0f;
+   Mat4 viewFromWorld, clipFromView, clipFromWorld;
+   Vec3 eye = { 0.0f, 1.5f * cameraScale, -3.0f * cameraScale };
+   Vec3 target = { 0.0f, 0.0f, 0.0f };
+   Vec3 up = { 0.0f, 1.0f, 0.0f };
+   mat4LookAt(&viewFromWorld, eye, target, up);
+   mat4PerspectiveFov(&clipFromView, PI / 2.0f, frame.width / (float)frame.height, 1.0f, 100.0f * cameraScale);
+   mat4Mul(&clipFromWorld, &clipFromView, &viewFromWorld);
+
+   RecordContext ctx = {};
+   ctx.backend = backend;
+   TransformBatch batch = {};
+   uint32_t instanceCount = s_scene.instanceCount;
+   uint32_t chunkCount = 1;
+   uint32_t culled = 0;
+
+   if (culling == FRAME_CULL_CPU) {
+      instanceCount = cullScene(&s_scene, &clipFromWorld);
+      culled = s_scene.instanceCount - instanceCount;
+      ctx.visible = s_scene.visible.data();
+   }
+
+   if (!gpuCulling) {
+      // The store pays off when most of the scene stands still. Whatever
+      // doesn't go through it leaves it stale.
+      const Hierarchy *hierarchy = &s_scene.hierarchy;
+      bool stored = !direct && culling == FRAME_CULL_NONE && updated * 2 <= instanceCount &&
+         hierarchy->changed.size() <= MAX_STORE_COPIES && updateStore(backend, &s_scene, &clipFromWorld, &ctx);
+      if (!stored) {
+         s_scene.storeBackend = nullptr;
+
+         // If the ring can't fit the whole scene, draw as much of it as does fit.
+         while (instanceCount > 0 && !backend->AllocUpload((uint64_t)instanceCount * sizeof(ShaderInstance),
+            RENDER_UPLOAD_ALIGNMENT, &ctx.instanceAlloc)) {
+            instanceCount /= 2;
+         }
+         ctx.instanceGpu = ctx.instanceAlloc.gpu;
+      }
+
+      chunkCount = (instanceCount + MIN_CHUNK_INSTANCES - 1) / MIN_CHUNK_INSTANCES;
+      uint32_t maxChunks = JobThreadCount() < frame.maxChunks ? JobThreadCount() : frame.maxChunks;
+      if (chunkCount > maxChunks) {
+         chunkCount = maxChunks;
+      } else if (chunkCount < 1) {
+         chunkCount = 1;
+      }
+
+      ctx.chunkInstances = (instanceCount + chunkCount - 1) / chunkCount;
+      ctx.instanceCount = instanceCount;
+      ctx.clipFromWorld = &clipFromWorld;
+      ctx.worldFromLocal = hierarchy->world.data() + 1;
+      if (direct) {
+         batch.rotY = s_scene.rotY.data();
+         batch.posX = ctx.visible ? s_scene.drawX.data() : s_scene.posX.data();
+         batch.posZ = ctx.visible ? s_scene.drawZ.data() : s_scene.posZ.data();
+         batch.count = instanceCount;
+         ctx.batch = &batch;
+         ctx.cubeRot = packet->cubeRot;
+      }
+   }
+
+   // Post passes go if there's no memory for their targets.
+   uint32_t postPasses = s_postPasses.load();
+   const FrameGraphCompiled *graph = declareFrame(backend, &frame, gpuCulling, ctx.storeCopyCount > 0, postPasses);
+   if (!placeTargets(backend, graph)) {
+      graph = declareFrame(backend, &frame, gpuCulling, ctx.storeCopyCount > 0, 0);
+      placeTargets(backend, graph);
+   }
+   ctx.graph = graph;
+   ctx.gpuCulled = gpuCulling;
+   ctx.chunkCount = chunkCount;
+   for (uint32_t s = 0; s < graph->stepCount; ++s) {
+      const FrameGraphPass *pass = &graph->decl.passes[graph->steps[s].pass];
+      if (pass->user == FRAME_PASS_SCENE) {
+         ctx.sceneStep = s;
+         ctx.sceneTarget = resourceTarget(graph, passUse(pass, true));
+      }
+   }
+
+   stageTimes[2] = ProfilerNow();
+   {
+      PROFILE_ZONE("record");
+      for (uint32_t s = 0; s < ctx.sceneStep; ++s) {
+         if (graph->decl.passes[graph->steps[s].pass].user == FRAME_PASS_CULL) {
+            dispatchCulling(backend, packet, &clipFromWorld);
+         }
+      }
+      JobParallelFor(recordChunk, &ctx, chunkCount);
+   }
+   stageTimes[3] = ProfilerNow();
+   {
+      PROFILE_ZONE("submit");
+      backend->Submit(ctx.lists, chunkCount);
+   }
+   stageTimes[4] = ProfilerNow();
+   {
+      PROFILE_ZONE("present");
+      backend->EndFrame();
+   }
+   stageTimes[5] = ProfilerNow();
+
+   if (stats) {
+      stats->wait = (stageTimes[1] - stageTimes[0]) * 1e-9;
+      stats->prepare = (stageTimes[2] - stageTimes[1]) * 1e-9;
+      stats->record = (stageTimes[3] - stageTimes[2]) * 1e-9;
+      stats->submit = (stageTimes[4] - stageTimes[3]) * 1e-9;
+      stats->present = (stageTimes[5] - stageTimes[4]) * 1e-9;
+      stats->instances = instanceCount;
+      stats->culled = culled;
+      stats->updated = updated;
+      stats->passes = graph->stepCount;
+      stats->culledPasses = graph->culledPasses;
+      stats->transientBytes = graph->transientBytes;
+      stats->unaliasedBytes = graph->unaliasedBytes;
+   }
+   return true;
+}
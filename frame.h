@@ -0,0 +1,84 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+class RenderBackend;
+struct FramePacket;
+struct FrameGraphStats;
+
+// Thread safe; the count is picked up at the start of the next frame.
+void SetInstanceCount(uint32_t instanceCount);
+uint32_t GetInstanceCount();
+
+// How many of the cubes spin, as a percentage; the rest stand still, and only
+// the ones that move cost anything per frame. Thread safe, like the count.
+void SetSpinningPercent(uint32_t percent);
+uint32_t GetSpinningPercent();
+
+enum FrameCulling {
+   FRAME_CULL_NONE,        // every instance is drawn, from the instance store if few of them move
+   FRAME_CULL_GPU,         // culled and drawn by the GPU; see cull.h
+   FRAME_CULL_CPU,         // frustum culled through a BVH, then drawn like NONE; see bvh.h
+};
+
+// Thread safe, like the instance count. Backends that can't cull on the GPU
+// draw everything from the CPU instead.
+void SetCulling(FrameCulling culling);
+FrameCulling GetCulling();
+
+// Copies the finished scene through this many passes on its way to the back
+// buffer, each into a transient target of its own, as a stand-in for
+// post-processing. Up to RENDER_MAX_TARGETS; thread safe, like the count.
+void SetPostPasses(uint32_t count);
+uint32_t GetPostPasses();
+
+// CPU time DrawFrame spent in each stage, in seconds.
+struct FrameStats {
+   double wait;            // BeginFrame: for a frame slot and the back buffer
+   double prepare;         // scene layout and transform updates, camera, CPU culling and the instance store
+   double record;
+   double submit;
+   double present;
+   uint32_t instances;     // drawn or culled, which is fewer than requested if the upload ring ran out
+   uint32_t culled;        // by the CPU
+   uint32_t updated;       // instances whose transforms were recomputed
+
+   // The frame graph: passes run and culled, and the memory of the transient
+   // targets, shared where their lifetimes allow and if they each had their own.
+   uint32_t passes;
+   uint32_t culledPasses;
+   uint64_t transientBytes;
+   uint64_t unaliasedBytes;
+};
+
+// How often the frame graph was compiled rather than found in the cache.
+const FrameGraphStats *GetFrameGraphStats();
+
+// Draws the cube grid as of packet. Returns false if the backend had nothing
+// to draw into. stats may be null.
+bool DrawFrame(RenderBackend *backend, const FramePacket *packet, FrameStats *stats);
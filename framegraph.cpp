@@ -0,0 +1,501 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <string.h>
+
+#include <algorithm>
+
+#include "common.h"
+#include "framegraph.h"
+#include "statetrack.h"
+
+void FrameGraphInit(FrameGraph *graph)
+{
+   for (uint32_t i = 0; i < FRAMEGRAPH_CACHE_SIZE; ++i) {
+      graph->cache[i].valid = false;
+      graph->cache[i].lastUsed = 0;
+      graph->cache[i].barriers.clear();
+   }
+   graph->compileCount = 0;
+   graph->stats = FrameGraphStats();
+   FrameGraphBegin(graph, 0);
+}
+
+void FrameGraphBegin(FrameGraph *graph, uint32_t queueMask)
+{
+   memset(&graph->decl, 0, sizeof(graph->decl));
+   graph->decl.queueMask = queueMask | (1u << FRAMEGRAPH_QUEUE_GRAPHICS);
+}
+
+uint32_t FrameGraphImport(FrameGraph *graph, uint32_t user, uint32_t initialState, uint32_t finalState, bool output)
+{
+   FrameGraphDecl *decl = &graph->decl;
+   ASSERT(decl->resourceCount < FRAMEGRAPH_MAX_RESOURCES);
+   FrameGraphResource *resource = &decl->resources[decl->resourceCount];
+   resource->initialState = initialState;
+   resource->finalState = finalState;
+   resource->flags = FRAMEGRAPH_IMPORTED | (output ? FRAMEGRAPH_OUTPUT : 0);
+   resource->user = user;
+   return decl->resourceCount++;
+}
+
+uint32_t FrameGraphCreate(FrameGraph *graph, uint32_t user, uint64_t size, uint64_t alignment)
+{
+   FrameGraphDecl *decl = &graph->decl;
+   ASSERT(decl->resourceCount < FRAMEGRAPH_MAX_RESOURCES);
+   ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+   FrameGraphResource *resource = &decl->resources[decl->resourceCount];
+   resource->size = size;
+   resource->alignment = alignment;
+   resource->initialState = STATE_INVALID;
+   resource->finalState = STATE_INVALID;
+   resource->user = user;
+   return decl->resourceCount++;
+}
+
+uint32_t FrameGraphAddPass(FrameGraph *graph, const char *name, FrameGraphQueue queue, uint32_t flags, uint32_t user)
+{
+   FrameGraphDecl *decl = &graph->decl;
+   ASSERT(decl->passCount < FRAMEGRAPH_MAX_PASSES);
+   FrameGraphPass *pass = &decl->passes[decl->passCount];
+   pass->name = name;
+   pass->queue = queue;
+   pass->flags = flags;
+   pass->user = user;
+   return decl->passCount++;
+}
+
+static void addUse(FrameGraph *graph, uint32_t pass, uint32_t resource, uint32_t state, bool write)
+{
+   ASSERT(pass < graph->decl.passCount && resource < graph->decl.resourceCount);
+   FrameGraphPass *declared = &graph->decl.passes[pass];
+   ASSERT(declared->useCount < FRAMEGRAPH_MAX_USES);
+   FrameGraphUse *use = &declared->uses[declared->useCount++];
+   use->resource = resource;
+   use->state = state;
+   use->write = write;
+}
+
+void FrameGraphRead(FrameGraph *graph, uint32_t pass, uint32_t resource, uint32_t state)
+{
+   addUse(graph, pass, resource, state, false);
+}
+
+void FrameGraphWrite(FrameGraph *graph, uint32_t pass, uint32_t resource, uint32_t state)
+{
+   addUse(graph, pass, resource, state, true);
+}
+
+static bool sameDecl(const FrameGraphDecl *a, const FrameGraphDecl *b)
+{
+   return a->queueMask == b->queueMask && a->passCount == b->passCount && a->resourceCount == b->resourceCount &&
+      memcmp(a->passes, b->passes, a->passCount * sizeof(FrameGraphPass)) == 0 &&
+      memcmp(a->resources, b->resources, a->resourceCount * sizeof(FrameGraphResource)) == 0;
+}
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+   return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// The state a pass needs a resource in: whatever it writes it as, or all the
+// states it reads it in at once. STATE_INVALID if it doesn't use it.
+static uint32_t passState(const FrameGraphPass *pass, uint32_t resource)
+{
+   uint32_t state = STATE_INVALID;
+   bool written = false;
+   for (uint32_t i = 0; i < pass->useCount; ++i) {
+      const FrameGraphUse *use = &pass->uses[i];
+      if (use->resource != resource || written) {
+         continue;
+      }
+      if (use->write) {
+         state = use->state;
+         written = true;
+      } else {
+         state = state == STATE_INVALID ? use->state : state | use->state;
+      }
+   }
+   return state;
+}
+
+// Walks back from the outputs: a pass is needed if it has side effects or
+// writes something a needed pass reads after it, or an output nothing
+// overwrites. Returns a bit per needed pass.
+static uint32_t livePasses(const FrameGraphDecl *decl)
+{
+   bool needed[FRAMEGRAPH_MAX_RESOURCES];
+   for (uint32_t i = 0; i < decl->resourceCount; ++i) {
+      needed[i] = (decl->resources[i].flags & FRAMEGRAPH_OUTPUT) != 0;
+   }
+
+   uint32_t live = 0;
+   for (uint32_t p = decl->passCount; p-- > 0; ) {
+      const FrameGraphPass *pass = &decl->passes[p];
+      bool isLive = (pass->flags & FRAMEGRAPH_SIDE_EFFECTS) != 0;
+      for (uint32_t i = 0; i < pass->useCount && !isLive; ++i) {
+         isLive = pass->uses[i].write && needed[pass->uses[i].resource];
+      }
+      if (!isLive) {
+         continue;
+      }
+
+      live |= 1u << p;
+      for (uint32_t i = 0; i < pass->useCount; ++i) {
+         if (pass->uses[i].write) {
+            needed[pass->uses[i].resource] = false;
+         }
+      }
+      for (uint32_t i = 0; i < pass->useCount; ++i) {
+         if (!pass->uses[i].write) {
+            needed[pass->uses[i].resource] = true;
+         }
+      }
+   }
+   return live;
+}
+
+// What each live pass has to wait for, as a bit per pass: the last write of
+// everything it reads, and the last write and every read since of everything
+// it writes.
+static void passDependencies(const FrameGraphDecl *decl, uint32_t live, uint32_t *deps)
+{
+   uint32_t lastWriter[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t readers[FRAMEGRAPH_MAX_RESOURCES];
+   for (uint32_t i = 0; i < decl->resourceCount; ++i) {
+      lastWriter[i] = FRAMEGRAPH_NONE;
+      readers[i] = 0;
+   }
+
+   for (uint32_t p = 0; p < decl->passCount; ++p) {
+      deps[p] = 0;
+      if (!(live & (1u << p))) {
+         continue;
+      }
+
+      const FrameGraphPass *pass = &decl->passes[p];
+      for (uint32_t i = 0; i < pass->useCount; ++i) {
+         uint32_t r = pass->uses[i].resource;
+         if (lastWriter[r] != FRAMEGRAPH_NONE) {
+            deps[p] |= 1u << lastWriter[r];
+         }
+         if (pass->uses[i].write) {
+            deps[p] |= readers[r];
+         }
+      }
+      deps[p] &= ~(1u << p);
+
+      for (uint32_t i = 0; i < pass->useCount; ++i) {
+         uint32_t r = pass->uses[i].resource;
+         if (pass->uses[i].write) {
+            lastWriter[r] = p;
+            readers[r] = 0;
+         }
+      }
+      for (uint32_t i = 0; i < pass->useCount; ++i) {
+         if (!pass->uses[i].write) {
+            readers[pass->uses[i].resource] |= 1u << p;
+         }
+      }
+   }
+}
+
+static uint32_t passQueue(const FrameGraphDecl *decl, const FrameGraphPass *pass)
+{
+   if (pass->queue != FRAMEGRAPH_QUEUE_GRAPHICS && (pass->flags & FRAMEGRAPH_ASYNC) &&
+      (decl->queueMask & (1u << pass->queue))) {
+      return pass->queue;
+   }
+   return FRAMEGRAPH_QUEUE_GRAPHICS;
+}
+
+// Orders the live passes so each comes after what it depends on. Of those
+// ready to go, passes for other queues go first, to give them the most time
+// to overlap, then the one declared first.
+static void schedule(FrameGraphCompiled *compiled, uint32_t live, const uint32_t *deps)
+{
+   const FrameGraphDecl *decl = &compiled->decl;
+   uint32_t stepOf[FRAMEGRAPH_MAX_PASSES];
+   uint32_t done = 0;
+   compiled->stepCount = 0;
+
+   while (done != live) {
+      uint32_t best = FRAMEGRAPH_NONE;
+      for (uint32_t p = 0; p < decl->passCount; ++p) {
+         if (!(live & ~done & (1u << p)) || (deps[p] & ~done)) {
+            continue;
+         }
+         if (best == FRAMEGRAPH_NONE ||
+            (passQueue(decl, &decl->passes[p]) != FRAMEGRAPH_QUEUE_GRAPHICS &&
+             passQueue(decl, &decl->passes[best]) == FRAMEGRAPH_QUEUE_GRAPHICS)) {
+            best = p;
+         }
+      }
+      ASSERT(best != FRAMEGRAPH_NONE);   // declaration order rules out cycles
+
+      uint32_t s = compiled->stepCount++;
+      FrameGraphStep *step = &compiled->steps[s];
+      step->pass = best;
+      step->queue = passQueue(decl, &decl->passes[best]);
+      for (uint32_t q = 0; q < FRAMEGRAPH_QUEUE_COUNT; ++q) {
+         step->wait[q] = FRAMEGRAPH_NONE;
+      }
+      for (uint32_t p = 0; p < decl->passCount; ++p) {
+         if (deps[best] & (1u << p)) {
+            const FrameGraphStep *dep = &compiled->steps[stepOf[p]];
+            if (dep->queue != step->queue && (step->wait[dep->queue] == FRAMEGRAPH_NONE || step->wait[dep->queue] < stepOf[p])) {
+               step->wait[dep->queue] = stepOf[p];
+            }
+         }
+      }
+      stepOf[best] = s;
+      done |= 1u << best;
+   }
+}
+
+// Places each transient resource at the lowest offset where it doesn't
+// overlap one that's alive at the same time, biggest first.
+static void placeTransients(FrameGraphCompiled *compiled)
+{
+   const FrameGraphDecl *decl = &compiled->decl;
+   uint32_t order[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t count = 0;
+   compiled->transientCount = 0;
+   compiled->unaliasedBytes = 0;
+   for (uint32_t r = 0; r < decl->resourceCount; ++r) {
+      compiled->transientIndex[r] = FRAMEGRAPH_NONE;
+      compiled->offsets[r] = 0;
+      const FrameGraphResource *resource = &decl->resources[r];
+      if (!(resource->flags & FRAMEGRAPH_IMPORTED) && compiled->firstStep[r] != FRAMEGRAPH_NONE) {
+         compiled->transientIndex[r] = compiled->transientCount++;
+         compiled->unaliasedBytes = alignUp(compiled->unaliasedBytes, resource->alignment) + resource->size;
+         order[count++] = r;
+      }
+   }
+   std::sort(order, order + count, [decl](uint32_t a, uint32_t b) {
+      return decl->resources[a].size != decl->resources[b].size ? decl->resources[a].size > decl->resources[b].size : a < b;
+   });
+
+   uint64_t heapSize = 0;
+   uint32_t placed[FRAMEGRAPH_MAX_RESOURCES];
+   for (uint32_t i = 0; i < count; ++i) {
+      uint32_t r = order[i];
+      const FrameGraphResource *resource = &decl->resources[r];
+
+      // Placed resources alive at the same time, by offset.
+      uint32_t conflicts = 0;
+      for (uint32_t j = 0; j < i; ++j) {
+         uint32_t other = order[j];
+         if (compiled->firstStep[other] <= compiled->lastStep[r] && compiled->firstStep[r] <= compiled->lastStep[other]) {
+            placed[conflicts++] = other;
+         }
+      }
+      std::sort(placed, placed + conflicts, [compiled](uint32_t a, uint32_t b) {
+         return compiled->offsets[a] < compiled->offsets[b];
+      });
+
+      uint64_t offset = 0;
+      for (uint32_t j = 0; j < conflicts; ++j) {
+         uint64_t otherOffset = compiled->offsets[placed[j]];
+         uint64_t otherEnd = otherOffset + decl->resources[placed[j]].size;
+         if (alignUp(offset, resource->alignment) + resource->size <= otherOffset) {
+            break;
+         }
+         if (otherEnd > offset) {
+            offset = otherEnd;
+         }
+      }
+      offset = alignUp(offset, resource->alignment);
+      compiled->offsets[r] = offset;
+      if (offset + resource->size > heapSize) {
+         heapSize = offset + resource->size;
+      }
+   }
+   compiled->transientBytes = heapSize;
+}
+
+static bool overlaps(const FrameGraphCompiled *compiled, uint32_t a, uint32_t b)
+{
+   const FrameGraphResource *resources = compiled->decl.resources;
+   return compiled->offsets[a] < compiled->offsets[b] + resources[b].size &&
+      compiled->offsets[b] < compiled->offsets[a] + resources[a].size;
+}
+
+static void pushBarrier(FrameGraphCompiled *compiled, uint32_t resource, uint32_t before, uint32_t state, uint32_t flags,
+   uint32_t aliasBefore)
+{
+   FrameGraphBarrier barrier;
+   barrier.resource = resource;
+   barrier.before = before;
+   barrier.state = state;
+   barrier.flags = flags;
+   barrier.aliasBefore = aliasBefore;
+   compiled->barriers.push_back(barrier);
+}
+
+// Walks the steps keeping track of every resource's state, and puts the
+// transitions each step needs ahead of it. A transition whose next user
+// isn't the very next step is begun right after the step before instead and
+// left open until then.
+static void placeBarriers(FrameGraphCompiled *compiled)
+{
+   const FrameGraphDecl *decl = &compiled->decl;
+   uint32_t states[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t splitFrom[FRAMEGRAPH_MAX_RESOURCES];   // STATE_INVALID unless a split is open
+   for (uint32_t r = 0; r < decl->resourceCount; ++r) {
+      compiled->restStates[r] = STATE_INVALID;
+      if (compiled->transientIndex[r] != FRAMEGRAPH_NONE) {
+         compiled->restStates[r] = passState(&decl->passes[compiled->steps[compiled->lastStep[r]].pass], r);
+      }
+      states[r] = compiled->transientIndex[r] != FRAMEGRAPH_NONE ? compiled->restStates[r] : decl->resources[r].initialState;
+      splitFrom[r] = STATE_INVALID;
+   }
+   compiled->barriers.clear();
+
+   for (uint32_t s = 0; s < compiled->stepCount; ++s) {
+      FrameGraphStep *step = &compiled->steps[s];
+      const FrameGraphPass *pass = &decl->passes[step->pass];
+      step->firstBarrier = (uint32_t)compiled->barriers.size();
+
+      for (uint32_t r = 0; r < decl->resourceCount; ++r) {
+         uint32_t state = passState(pass, r);
+         if (state == STATE_INVALID) {
+            continue;
+         }
+
+         // Taking over another resource's memory: the last one to have it
+         // this frame, or any of them if that's an earlier frame.
+         if (compiled->firstStep[r] == s && compiled->transientIndex[r] != FRAMEGRAPH_NONE) {
+            bool shared = false;
+            uint32_t before = FRAMEGRAPH_NONE;
+            for (uint32_t other = 0; other < decl->resourceCount; ++other) {
+               if (other == r || compiled->transientIndex[other] == FRAMEGRAPH_NONE || !overlaps(compiled, r, other)) {
+                  continue;
+               }
+               shared = true;
+               if (compiled->lastStep[other] < s &&
+                  (before == FRAMEGRAPH_NONE || compiled->lastStep[other] > compiled->lastStep[before])) {
+                  before = other;
+               }
+            }
+            if (shared) {
+               pushBarrier(compiled, r, STATE_INVALID, STATE_INVALID, FRAMEGRAPH_BARRIER_ALIAS, before);
+            }
+         }
+
+         if (splitFrom[r] != STATE_INVALID) {
+            // Begun for exactly this use.
+            pushBarrier(compiled, r, splitFrom[r], state, FRAMEGRAPH_BARRIER_END, FRAMEGRAPH_NONE);
+            splitFrom[r] = STATE_INVALID;
+         } else if (states[r] != state) {
+            pushBarrier(compiled, r, states[r], state, 0, FRAMEGRAPH_NONE);
+            states[r] = state;
+         }
+      }
+      step->barrierCount = (uint32_t)compiled->barriers.size() - step->firstBarrier;
+
+      step->firstAfter = (uint32_t)compiled->barriers.size();
+      for (uint32_t r = 0; r < decl->resourceCount; ++r) {
+         if (passState(pass, r) == STATE_INVALID) {
+            continue;
+         }
+         for (uint32_t next = s + 1; next < compiled->stepCount; ++next) {
+            uint32_t state = passState(&decl->passes[compiled->steps[next].pass], r);
+            if (state == STATE_INVALID) {
+               continue;
+            }
+            // Split barriers can't span queues.
+            if (state != states[r] && states[r] != STATE_INVALID && next > s + 1 && compiled->steps[next].queue == step->queue) {
+               pushBarrier(compiled, r, states[r], state, FRAMEGRAPH_BARRIER_BEGIN, FRAMEGRAPH_NONE);
+               splitFrom[r] = states[r];
+               states[r] = state;
+            }
+            break;
+         }
+      }
+      step->afterCount = (uint32_t)compiled->barriers.size() - step->firstAfter;
+   }
+
+   compiled->firstEndBarrier = (uint32_t)compiled->barriers.size();
+   for (uint32_t r = 0; r < decl->resourceCount; ++r) {
+      uint32_t finalState = decl->resources[r].finalState;
+      if (finalState != STATE_INVALID && states[r] != finalState) {
+         pushBarrier(compiled, r, states[r], finalState, 0, FRAMEGRAPH_NONE);
+      }
+   }
+   compiled->endBarrierCount = (uint32_t)compiled->barriers.size() - compiled->firstEndBarrier;
+}
+
+static void compile(FrameGraphCompiled *compiled)
+{
+   const FrameGraphDecl *decl = &compiled->decl;
+   uint32_t live = livePasses(decl);
+   uint32_t deps[FRAMEGRAPH_MAX_PASSES];
+   passDependencies(decl, live, deps);
+   schedule(compiled, live, deps);
+   compiled->culledPasses = decl->passCount - compiled->stepCount;
+
+   for (uint32_t r = 0; r < decl->resourceCount; ++r) {
+      compiled->firstStep[r] = FRAMEGRAPH_NONE;
+      compiled->lastStep[r] = FRAMEGRAPH_NONE;
+   }
+   for (uint32_t s = 0; s < compiled->stepCount; ++s) {
+      const FrameGraphPass *pass = &decl->passes[compiled->steps[s].pass];
+      for (uint32_t i = 0; i < pass->useCount; ++i) {
+         uint32_t r = pass->uses[i].resource;
+         if (compiled->firstStep[r] == FRAMEGRAPH_NONE) {
+            compiled->firstStep[r] = s;
+         }
+         compiled->lastStep[r] = s;
+      }
+   }
+
+   placeTransients(compiled);
+   placeBarriers(compiled);
+}
+
+const FrameGraphCompiled *FrameGraphCompile(FrameGraph *graph)
+{
+   ++graph->compileCount;
+
+   FrameGraphCompiled *oldest = &graph->cache[0];
+   for (uint32_t i = 0; i < FRAMEGRAPH_CACHE_SIZE; ++i) {
+      FrameGraphCompiled *entry = &graph->cache[i];
+      if (entry->valid && sameDecl(&entry->decl, &graph->decl)) {
+         entry->lastUsed = graph->compileCount;
+         ++graph->stats.cacheHits;
+         return entry;
+      }
+      if (!entry->valid || (oldest->valid && entry->lastUsed < oldest->lastUsed)) {
+         oldest = entry;
+      }
+   }
+
+   ++graph->stats.compiles;
+   oldest->decl = graph->decl;
+   oldest->valid = true;
+   oldest->lastUsed = graph->compileCount;
+   compile(oldest);
+   return oldest;
+}
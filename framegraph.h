@@ -0,0 +1,181 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A frame described as passes and the resources they read and write, from
+// which the graph works out everything that used to be written out by hand:
+// which passes are needed at all, what order they run in, which queue each
+// runs on and what it waits for, the state every resource has to be in for
+// each pass, and where the transient resources live. States are
+// statetrack.h's; the graph only compares them.
+//
+// Transient resources exist only within the frame. Those whose lifetimes
+// don't overlap share memory: compiling places each at an offset in one heap,
+// and the first pass to use one after another had its memory is preceded by
+// an aliasing barrier. That pass has to overwrite all of it, by clearing it
+// or copying over it. A transient is left in the state its last pass used it
+// in, and the next frame picks it up from there, so it should be created in
+// that state.
+//
+// The graph is declared again every frame, which is cheap. Compiling it is
+// skipped when the declaration matches one compiled recently.
+
+#define FRAMEGRAPH_MAX_PASSES     32
+#define FRAMEGRAPH_MAX_RESOURCES  32
+#define FRAMEGRAPH_MAX_USES       8    // reads and writes per pass
+#define FRAMEGRAPH_CACHE_SIZE     4
+#define FRAMEGRAPH_NONE           UINT32_MAX
+
+enum FrameGraphQueue {
+   FRAMEGRAPH_QUEUE_GRAPHICS,
+   FRAMEGRAPH_QUEUE_COMPUTE,
+   FRAMEGRAPH_QUEUE_COPY,
+   FRAMEGRAPH_QUEUE_COUNT,
+};
+
+// Pass flags.
+#define FRAMEGRAPH_ASYNC          0x1  // runs on its own kind of queue if there is one, else on graphics
+#define FRAMEGRAPH_SIDE_EFFECTS   0x2  // never culled
+
+// Resource flags.
+#define FRAMEGRAPH_IMPORTED       0x1  // lives outside the frame
+#define FRAMEGRAPH_OUTPUT         0x2  // ...and is what the frame is for
+
+// Barrier flags.
+#define FRAMEGRAPH_BARRIER_ALIAS  0x1  // resource takes over memory it shares with aliasBefore
+#define FRAMEGRAPH_BARRIER_BEGIN  0x2  // split: begun after a pass...
+#define FRAMEGRAPH_BARRIER_END    0x4  // ...and ended before the resource's next use
+
+struct FrameGraphResource {
+   uint64_t size;             // transient only
+   uint64_t alignment;
+   uint32_t initialState;     // imported only: as the frame finds it...
+   uint32_t finalState;       // ...and as it has to leave it, or STATE_INVALID for either way
+   uint32_t flags;
+   uint32_t user;
+};
+
+struct FrameGraphUse {
+   uint32_t resource;
+   uint32_t state;
+   uint32_t write;
+};
+
+struct FrameGraphPass {
+   const char *name;
+   uint32_t queue;            // FrameGraphQueue: the kind of work
+   uint32_t flags;
+   uint32_t user;
+   uint32_t useCount;
+   FrameGraphUse uses[FRAMEGRAPH_MAX_USES];
+};
+
+// Zeroed as it's begun, so two declarations of the same graph compare equal
+// byte for byte.
+struct FrameGraphDecl {
+   uint32_t queueMask;        // queues there are, a bit per FrameGraphQueue
+   uint32_t passCount;
+   uint32_t resourceCount;
+   FrameGraphPass passes[FRAMEGRAPH_MAX_PASSES];
+   FrameGraphResource resources[FRAMEGRAPH_MAX_RESOURCES];
+};
+
+struct FrameGraphBarrier {
+   uint32_t resource;
+   uint32_t before;           // the state it's in; none for aliasing barriers
+   uint32_t state;            // ...and the one to transition to
+   uint32_t flags;
+   uint32_t aliasBefore;      // the last resource in the memory, or FRAMEGRAPH_NONE if it could be any
+};
+
+// A pass that survived culling, in the order they run.
+struct FrameGraphStep {
+   uint32_t pass;
+   uint32_t queue;            // the queue it runs on
+   uint32_t wait[FRAMEGRAPH_QUEUE_COUNT];   // last step on each other queue it has to wait for, or FRAMEGRAPH_NONE
+   uint32_t firstBarrier;     // before the pass
+   uint32_t barrierCount;
+   uint32_t firstAfter;       // split transitions begun right after it
+   uint32_t afterCount;
+};
+
+struct FrameGraphCompiled {
+   FrameGraphDecl decl;       // compiled from
+   bool valid;
+   uint64_t lastUsed;
+
+   uint32_t stepCount;
+   FrameGraphStep steps[FRAMEGRAPH_MAX_PASSES];
+   uint32_t culledPasses;
+   std::vector<FrameGraphBarrier> barriers;
+   uint32_t firstEndBarrier;  // after the last step, to leave imported resources as required
+   uint32_t endBarrierCount;
+
+   // Transient resources in use, by resource: their lifetimes in steps, and
+   // where they're placed. transientIndex numbers them from 0, in resource
+   // order, and is FRAMEGRAPH_NONE for the rest.
+   uint32_t firstStep[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t lastStep[FRAMEGRAPH_MAX_RESOURCES];
+   uint64_t offsets[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t transientIndex[FRAMEGRAPH_MAX_RESOURCES];
+   uint32_t restStates[FRAMEGRAPH_MAX_RESOURCES];   // what they're left in
+   uint32_t transientCount;
+   uint64_t transientBytes;   // the heap they share
+   uint64_t unaliasedBytes;   // ...and what they'd take one after another
+};
+
+struct FrameGraphStats {
+   uint64_t compiles;
+   uint64_t cacheHits;
+};
+
+struct FrameGraph {
+   FrameGraphDecl decl;       // being declared
+   FrameGraphCompiled cache[FRAMEGRAPH_CACHE_SIZE];
+   uint64_t compileCount;     // for picking the least recently used entry
+   FrameGraphStats stats;
+};
+
+void FrameGraphInit(FrameGraph *graph);
+
+// Starts a new declaration. queueMask has a bit set for each queue other
+// than graphics there is to run passes on.
+void FrameGraphBegin(FrameGraph *graph, uint32_t queueMask);
+
+uint32_t FrameGraphImport(FrameGraph *graph, uint32_t user, uint32_t initialState, uint32_t finalState, bool output);
+uint32_t FrameGraphCreate(FrameGraph *graph, uint32_t user, uint64_t size, uint64_t alignment);
+
+// Passes are declared in the order their results are meant to be seen: a
+// read sees the last write declared ahead of it.
+uint32_t FrameGraphAddPass(FrameGraph *graph, const char *name, FrameGraphQueue queue, uint32_t flags, uint32_t user);
+void FrameGraphRead(FrameGraph *graph, uint32_t pass, uint32_t resource, uint32_t state);
+void FrameGraphWrite(FrameGraph *graph, uint32_t pass, uint32_t resource, uint32_t state);
+
+// Returns the compiled graph, valid until the next FrameGraphCompile.
+const FrameGraphCompiled *FrameGraphCompile(FrameGraph *graph);
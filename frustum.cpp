@@ -0,0 +1,221 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "common.h"
+#include "frustum.h"
+
+//
+// Lane-wide float operations. Each test runs FRUSTUM_LANES volumes at a time
+// and the rest one by one; the scalar versions give the same answers.
+//
+
+#if VECMATH_KERNEL == VECMATH_KERNEL_AVX
+
+#define FRUSTUM_LANES 8
+
+typedef __m256 FrustumFloat;
+
+static inline FrustumFloat ffSplat(float f) { return _mm256_set1_ps(f); }
+static inline FrustumFloat ffLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline FrustumFloat ffAdd(FrustumFloat a, FrustumFloat b) { return _mm256_add_ps(a, b); }
+static inline FrustumFloat ffMul(FrustumFloat a, FrustumFloat b) { return _mm256_mul_ps(a, b); }
+static inline FrustumFloat ffNeg(FrustumFloat a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+static inline FrustumFloat ffLess(FrustumFloat a, FrustumFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline FrustumFloat ffOr(FrustumFloat a, FrustumFloat b) { return _mm256_or_ps(a, b); }
+static inline uint32_t ffMaskBits(FrustumFloat a) { return (uint32_t)_mm256_movemask_ps(a); }
+
+#elif VECMATH_KERNEL == VECMATH_KERNEL_SSE
+
+#define FRUSTUM_LANES 4
+
+typedef __m128 FrustumFloat;
+
+static inline FrustumFloat ffSplat(float f) { return _mm_set1_ps(f); }
+static inline FrustumFloat ffLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline FrustumFloat ffAdd(FrustumFloat a, FrustumFloat b) { return _mm_add_ps(a, b); }
+static inline FrustumFloat ffMul(FrustumFloat a, FrustumFloat b) { return _mm_mul_ps(a, b); }
+static inline FrustumFloat ffNeg(FrustumFloat a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+static inline FrustumFloat ffLess(FrustumFloat a, FrustumFloat b) { return _mm_cmplt_ps(a, b); }
+static inline FrustumFloat ffOr(FrustumFloat a, FrustumFloat b) { return _mm_or_ps(a, b); }
+static inline uint32_t ffMaskBits(FrustumFloat a) { return (uint32_t)_mm_movemask_ps(a); }
+
+#elif VECMATH_KERNEL == VECMATH_KERNEL_NEON
+
+#define FRUSTUM_LANES 4
+
+typedef float32x4_t FrustumFloat;
+
+static inline FrustumFloat ffSplat(float f) { return vdupq_n_f32(f); }
+static inline FrustumFloat ffLoad(const float *p) { return vld1q_f32(p); }
+static inline FrustumFloat ffAdd(FrustumFloat a, FrustumFloat b) { return vaddq_f32(a, b); }
+static inline FrustumFloat ffMul(FrustumFloat a, FrustumFloat b) { return vmulq_f32(a, b); }
+static inline FrustumFloat ffNeg(FrustumFloat a) { return vnegq_f32(a); }
+static inline FrustumFloat ffLess(FrustumFloat a, FrustumFloat b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+static inline FrustumFloat ffOr(FrustumFloat a, FrustumFloat b)
+{
+   return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+static inline uint32_t ffMaskBits(FrustumFloat a)
+{
+   static const int32_t shifts[4] = { 0, 1, 2, 3 };
+   uint32x4_t bits = vshlq_u32(vshrq_n_u32(vreinterpretq_u32_f32(a), 31), vld1q_s32(shifts));
+   uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+   return vget_lane_u32(vpadd_u32(sum, sum), 0);
+}
+
+#else
+
+#define FRUSTUM_LANES 1
+
+#endif
+
+// The same tests one volume at a time, for the scalar kernel and the volumes
+// left over after the last full set of lanes.
+static inline bool sphereVisible(const Vec4 planes[6], const BoundingSpheres *spheres, uint32_t i)
+{
+   float x = spheres->centerX[i], y = spheres->centerY[i], z = spheres->centerZ[i];
+   float negRadius = -spheres->radius[i];
+   for (int p = 0; p < 6; ++p) {
+      if (planes[p].x * x + planes[p].y * y + planes[p].z * z + planes[p].w < negRadius) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Only the corner furthest along each plane's normal needs testing.
+static inline bool boxVisible(const Vec4 planes[6], const BoundingBoxes *boxes, uint32_t i)
+{
+   for (int p = 0; p < 6; ++p) {
+      float x = planes[p].x >= 0.0f ? boxes->maxX[i] : boxes->minX[i];
+      float y = planes[p].y >= 0.0f ? boxes->maxY[i] : boxes->minY[i];
+      float z = planes[p].z >= 0.0f ? boxes->maxZ[i] : boxes->minZ[i];
+      if (planes[p].x * x + planes[p].y * y + planes[p].z * z + planes[p].w < 0.0f) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static inline uint32_t writeVisible(uint32_t *visible, uint32_t written, uint32_t i, const uint32_t *ids)
+{
+   visible[written] = ids ? ids[i] : i;
+   return written + 1;
+}
+
+#if FRUSTUM_LANES > 1
+// Writes every lane and only advances past the visible ones, which beats
+// branching on each when about half of them are. Never writes past where
+// the ids would go if every volume so far were visible.
+static inline uint32_t writeLanes(uint32_t *visible, uint32_t written, uint32_t first, uint32_t mask, const uint32_t *ids)
+{
+   for (uint32_t lane = 0; lane < FRUSTUM_LANES; ++lane) {
+      visible[written] = ids ? ids[first + lane] : first + lane;
+      written += (mask >> lane) & 1;
+   }
+   return written;
+}
+#endif
+
+uint32_t FrustumCullSpheres(const Vec4 planes[6], const BoundingSpheres *spheres, uint32_t first, uint32_t count,
+   const uint32_t *ids, uint32_t *visible)
+{
+   ASSERT(first + count <= spheres->count);
+
+   uint32_t i = first, end = first + count, written = 0;
+#if FRUSTUM_LANES > 1
+   FrustumFloat px[6], py[6], pz[6], pw[6];
+   for (int p = 0; p < 6; ++p) {
+      px[p] = ffSplat(planes[p].x);
+      py[p] = ffSplat(planes[p].y);
+      pz[p] = ffSplat(planes[p].z);
+      pw[p] = ffSplat(planes[p].w);
+   }
+
+   for (; i + FRUSTUM_LANES <= end; i += FRUSTUM_LANES) {
+      FrustumFloat x = ffLoad(&spheres->centerX[i]);
+      FrustumFloat y = ffLoad(&spheres->centerY[i]);
+      FrustumFloat z = ffLoad(&spheres->centerZ[i]);
+      FrustumFloat negRadius = ffNeg(ffLoad(&spheres->radius[i]));
+
+      FrustumFloat outside = ffLess(ffAdd(ffAdd(ffAdd(ffMul(px[0], x), ffMul(py[0], y)), ffMul(pz[0], z)), pw[0]), negRadius);
+      for (int p = 1; p < 6; ++p) {
+         FrustumFloat d = ffAdd(ffAdd(ffAdd(ffMul(px[p], x), ffMul(py[p], y)), ffMul(pz[p], z)), pw[p]);
+         outside = ffOr(outside, ffLess(d, negRadius));
+      }
+
+      written = writeLanes(visible, written, i, ~ffMaskBits(outside), ids);
+   }
+#endif
+
+   for (; i < end; ++i) {
+      if (sphereVisible(planes, spheres, i)) {
+         written = writeVisible(visible, written, i, ids);
+      }
+   }
+   return written;
+}
+
+uint32_t FrustumCullBoxes(const Vec4 planes[6], const BoundingBoxes *boxes, uint32_t first, uint32_t count,
+   const uint32_t *ids, uint32_t *visible)
+{
+   ASSERT(first + count <= boxes->count);
+
+   uint32_t i = first, end = first + count, written = 0;
+#if FRUSTUM_LANES > 1
+   // Which of min and max each plane tests is the same for every box.
+   FrustumFloat px[6], py[6], pz[6], pw[6];
+   const float *const *cornerX[6], *const *cornerY[6], *const *cornerZ[6];
+   for (int p = 0; p < 6; ++p) {
+      px[p] = ffSplat(planes[p].x);
+      py[p] = ffSplat(planes[p].y);
+      pz[p] = ffSplat(planes[p].z);
+      pw[p] = ffSplat(planes[p].w);
+      cornerX[p] = planes[p].x >= 0.0f ? &boxes->maxX : &boxes->minX;
+      cornerY[p] = planes[p].y >= 0.0f ? &boxes->maxY : &boxes->minY;
+      cornerZ[p] = planes[p].z >= 0.0f ? &boxes->maxZ : &boxes->minZ;
+   }
+
+   FrustumFloat zero = ffSplat(0.0f);
+   for (; i + FRUSTUM_LANES <= end; i += FRUSTUM_LANES) {
+      FrustumFloat outside = zero;
+      for (int p = 0; p < 6; ++p) {
+         FrustumFloat x = ffLoad(&(*cornerX[p])[i]);
+         FrustumFloat y = ffLoad(&(*cornerY[p])[i]);
+         FrustumFloat z = ffLoad(&(*cornerZ[p])[i]);
+         FrustumFloat d = ffAdd(ffAdd(ffAdd(ffMul(px[p], x), ffMul(py[p], y)), ffMul(pz[p], z)), pw[p]);
+         outside = ffOr(outside, ffLess(d, zero));
+      }
+
+      written = writeLanes(visible, written, i, ~ffMaskBits(outside), ids);
+   }
+#endif
+
+   for (; i < end; ++i) {
+      if (boxVisible(planes, boxes, i)) {
+         written = writeVisible(visible, written, i, ids);
+      }
+   }
+   return written;
+}
@@ -0,0 +1,62 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "vecmath.h"
+
+// Frustum tests over structure-of-arrays bounding volumes, as many at a time
+// as the vecmath kernel has lanes: 8 with AVX, 4 with SSE or NEON. Planes
+// come from CullFrustumPlanes (cull.h): normalized and pointing inwards. A
+// volume is visible if no plane has all of it on the outside, which keeps a
+// few volumes near the frustum's corners that are actually outside it.
+
+struct BoundingSpheres {
+   const float *centerX;
+   const float *centerY;
+   const float *centerZ;
+   const float *radius;
+   uint32_t count;
+};
+
+struct BoundingBoxes {
+   const float *minX;
+   const float *minY;
+   const float *minZ;
+   const float *maxX;
+   const float *maxY;
+   const float *maxZ;
+   uint32_t count;
+};
+
+// For each visible volume i in [first, first + count), in order, writes
+// ids[i] to visible, or just i if ids is null. Returns how many were kept.
+// visible needs room for count ids; the entries past the kept ones are
+// scratch.
+uint32_t FrustumCullSpheres(const Vec4 planes[6], const BoundingSpheres *spheres, uint32_t first, uint32_t count,
+   const uint32_t *ids, uint32_t *visible);
+uint32_t FrustumCullBoxes(const Vec4 planes[6], const BoundingBoxes *boxes, uint32_t first, uint32_t count,
+   const uint32_t *ids, uint32_t *visible);
@@ -0,0 +1,323 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <string.h>
+
+#include "deferred.h"
+#include "gpumemory.h"
+
+static const D3D12_HEAP_TYPE s_heapTypes[GPU_HEAP_TYPE_COUNT] = {
+   D3D12_HEAP_TYPE_DEFAULT,
+   D3D12_HEAP_TYPE_UPLOAD,
+   D3D12_HEAP_TYPE_READBACK,
+};
+
+static inline UINT64 alignUp(UINT64 value, UINT64 alignment)
+{
+   return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint32_t resourceKind(const D3D12_RESOURCE_DESC *desc)
+{
+   if (desc->Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) {
+      return RESOURCE_BUFFER;
+   }
+   if (desc->Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) {
+      return RESOURCE_TARGET;
+   }
+   return RESOURCE_TEXTURE;
+}
+
+// Tier 2 puts every kind in the pool tier 1 keeps buffers in.
+static uint32_t poolIndex(const Dx12GpuMemory *memory, D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC *desc)
+{
+   uint32_t type = 0;
+   while (type + 1 < GPU_HEAP_TYPE_COUNT && s_heapTypes[type] != heapType) {
+      ++type;
+   }
+   ASSERT(s_heapTypes[type] == heapType);
+   return type * RESOURCE_KIND_COUNT + (memory->tier2 ? RESOURCE_BUFFER : resourceKind(desc));
+}
+
+// Small textures may sit at 4KB rather than 64KB, but only if the runtime
+// agrees they're small enough; asking is the only way to tell.
+static D3D12_RESOURCE_ALLOCATION_INFO allocationInfo(ID3D12Device *device, D3D12_RESOURCE_DESC *desc)
+{
+   if (resourceKind(desc) == RESOURCE_TEXTURE && desc->SampleDesc.Count == 1 && desc->Alignment == 0) {
+      desc->Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+      D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, desc);
+      if (info.Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) {
+         return info;
+      }
+      desc->Alignment = 0;
+   }
+   return device->GetResourceAllocationInfo(0, 1, desc);
+}
+
+// Big enough for size bytes at any alignment, since offset 0 suits them all.
+static bool addHeap(Dx12GpuMemory *memory, ID3D12Device *device, uint32_t pool, UINT64 size)
+{
+   uint32_t kind = pool % RESOURCE_KIND_COUNT;
+   D3D12_HEAP_DESC heapDesc = {};
+   heapDesc.Properties.Type = s_heapTypes[pool / RESOURCE_KIND_COUNT];
+   if (memory->tier2) {
+      heapDesc.Alignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+      heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+   } else if (kind == RESOURCE_BUFFER) {
+      heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+      heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+   } else {
+      heapDesc.Alignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+      heapDesc.Flags = kind == RESOURCE_TARGET ? D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES :
+         D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+   }
+   heapDesc.SizeInBytes = alignUp(size, heapDesc.Alignment);
+   if (heapDesc.SizeInBytes < GPU_HEAP_BLOCK_SIZE) {
+      heapDesc.SizeInBytes = GPU_HEAP_BLOCK_SIZE;
+   }
+
+   ComPtr<ID3D12Heap> heap;
+   if (heapDesc.SizeInBytes > HEAP_MAX_BLOCK_SIZE || FAILED(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)))) {
+      return false;
+   }
+
+   Dx12MemoryPool *memoryPool = &memory->pools[pool];
+   uint32_t block = HeapAddBlock(&memoryPool->alloc, heapDesc.SizeInBytes);
+   if (block >= memoryPool->heaps.size()) {
+      memoryPool->heaps.resize(block + 1);
+   }
+   memoryPool->heaps[block] = std::move(heap);
+   return true;
+}
+
+bool CreateGpuMemory(Dx12GpuMemory *memory, ID3D12Device *device)
+{
+   D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+   if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)))) {
+      return false;
+   }
+   memory->tier2 = options.ResourceHeapTier >= D3D12_RESOURCE_HEAP_TIER_2;
+
+   for (uint32_t i = 0; i < GPU_POOL_COUNT; ++i) {
+      HeapAllocatorInit(&memory->pools[i].alloc);
+      memory->pools[i].heaps.clear();
+   }
+
+   for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+      if (FAILED(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&memory->allocators[i])))) {
+         return false;
+      }
+   }
+   if (FAILED(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, memory->allocators[0].Get(), nullptr,
+         IID_PPV_ARGS(&memory->commandList)))) {
+      return false;
+   }
+   memory->commandList->Close();
+   return true;
+}
+
+void DestroyGpuMemory(Dx12GpuMemory *memory)
+{
+   for (uint32_t i = 0; i < GPU_POOL_COUNT; ++i) {
+      Dx12MemoryPool *pool = &memory->pools[i];
+      HeapBeginFrame(&pool->alloc, UINT64_MAX);
+      ASSERT(pool->alloc.stats.allocations == 0);
+      HeapAllocatorInit(&pool->alloc);
+      pool->heaps.clear();
+   }
+   memory->commandList = nullptr;
+   for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+      memory->allocators[i] = nullptr;
+   }
+}
+
+bool AllocResource(Dx12Device *device, D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC *desc,
+   D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE *clearValue, Dx12Allocation *allocation)
+{
+   Dx12GpuMemory *memory = &device->memory;
+   ID3D12Device *d3dDevice = device->device.Get();
+
+   D3D12_RESOURCE_DESC placedDesc = *desc;
+   D3D12_RESOURCE_ALLOCATION_INFO info = allocationInfo(d3dDevice, &placedDesc);
+   if (info.SizeInBytes == UINT64_MAX) {
+      return false;
+   }
+
+   uint32_t pool = poolIndex(memory, heapType, &placedDesc);
+   Dx12MemoryPool *memoryPool = &memory->pools[pool];
+   uint32_t handle = HeapAlloc(&memoryPool->alloc, info.SizeInBytes, info.Alignment, nullptr);
+   if (handle == HEAP_INVALID) {
+      if (!addHeap(memory, d3dDevice, pool, info.SizeInBytes)) {
+         return false;
+      }
+      handle = HeapAlloc(&memoryPool->alloc, info.SizeInBytes, info.Alignment, nullptr);
+      ASSERT(handle != HEAP_INVALID);
+   }
+
+   const HeapNode *node = HeapGet(&memoryPool->alloc, handle);
+   ComPtr<ID3D12Resource> resource;
+   if (FAILED(d3dDevice->CreatePlacedResource(memoryPool->heaps[node->block].Get(), node->offset, &placedDesc,
+         initialState, clearValue, IID_PPV_ARGS(&resource)))) {
+      HeapFree(&memoryPool->alloc, handle);
+      return false;
+   }
+
+   allocation->resource = std::move(resource);
+   allocation->pool = pool;
+   allocation->handle = handle;
+   allocation->moved = nullptr;
+   allocation->user = nullptr;
+   return true;
+}
+
+void FreeResource(Dx12Device *device, Dx12Allocation *allocation)
+{
+   if (!allocation->resource) {
+      return;
+   }
+
+   DeferRelease(device, allocation->resource.Get());
+   HeapFreeAfter(&device->memory.pools[allocation->pool].alloc, allocation->handle, device->frameNum - 1);
+   allocation->resource = nullptr;
+   allocation->handle = HEAP_INVALID;
+   allocation->moved = nullptr;
+   allocation->user = nullptr;
+}
+
+void SetMovable(Dx12Device *device, Dx12Allocation *allocation, Dx12MovedFn *moved, void *user)
+{
+   ASSERT(allocation->resource && allocation->pool == RESOURCE_BUFFER);
+   HeapAllocator *alloc = &device->memory.pools[allocation->pool].alloc;
+   HeapSetMovable(alloc, allocation->handle, moved != nullptr);
+   HeapSetUser(alloc, allocation->handle, allocation);
+   allocation->moved = moved;
+   allocation->user = user;
+}
+
+void GpuMemoryBeginFrame(Dx12Device *device, uint64_t completedValue)
+{
+   for (uint32_t i = 0; i < GPU_POOL_COUNT; ++i) {
+      Dx12MemoryPool *pool = &device->memory.pools[i];
+      HeapBeginFrame(&pool->alloc, completedValue);
+
+      // Resources placed in a heap hold on to it, so one can go as soon as
+      // it's empty.
+      bool kept = false;
+      for (uint32_t block = 0; block < (uint32_t)pool->alloc.blocks.size(); ++block) {
+         const HeapBlock *heapBlock = &pool->alloc.blocks[block];
+         if (heapBlock->size == 0 || heapBlock->allocations > 0) {
+            continue;
+         }
+         if (!kept) {
+            kept = true;
+            continue;
+         }
+         HeapRemoveBlock(&pool->alloc, block);
+         pool->heaps[block] = nullptr;
+      }
+   }
+}
+
+uint32_t DefragmentGpuMemory(Dx12Device *device, UINT frameIdx, uint64_t maxBytes)
+{
+   // Only buffers in the default heap move; see SetMovable. The default heap
+   // comes first, so its buffers' pool is RESOURCE_BUFFER.
+   Dx12GpuMemory *memory = &device->memory;
+   Dx12MemoryPool *pool = &memory->pools[RESOURCE_BUFFER];
+   memory->moves.clear();
+   uint32_t count = HeapDefragment(&pool->alloc, maxBytes, &memory->moves);
+   if (count == 0) {
+      return 0;
+   }
+
+   // The slot's last frame has retired, so its allocator is free. Buffers in
+   // COMMON are promoted to copy source and destination, and decay back once
+   // the list has run.
+   ID3D12GraphicsCommandList *commandList = memory->commandList.Get();
+   DX_VERIFY(memory->allocators[frameIdx]->Reset());
+   DX_VERIFY(commandList->Reset(memory->allocators[frameIdx].Get(), nullptr));
+
+   // Each new resource goes over memory that others have used, so it needs
+   // an aliasing barrier before the copy. None of the ranges the moves free
+   // can be handed out again until this list has run, so the new resources
+   // don't overlap each other's sources and all the barriers go in one batch.
+   memory->placed.resize(count);
+   memory->aliasing.resize(count);
+   for (uint32_t i = 0; i < count; ++i) {
+      const HeapNode *node = HeapGet(&pool->alloc, memory->moves[i].allocation);
+      const Dx12Allocation *allocation = (const Dx12Allocation *)node->user;
+      D3D12_RESOURCE_DESC desc = allocation->resource->GetDesc();
+
+      // The range was made for this very resource, so only a removed device
+      // fails this.
+      DX_VERIFY(device->device->CreatePlacedResource(pool->heaps[node->block].Get(), node->offset, &desc,
+         D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&memory->placed[i])));
+
+      D3D12_RESOURCE_BARRIER *barrier = &memory->aliasing[i];
+      barrier->Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+      barrier->Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+      barrier->Aliasing.pResourceBefore = nullptr;
+      barrier->Aliasing.pResourceAfter = memory->placed[i].Get();
+   }
+   commandList->ResourceBarrier(count, memory->aliasing.data());
+
+   for (uint32_t i = 0; i < count; ++i) {
+      const HeapMove *move = &memory->moves[i];
+      Dx12Allocation *allocation = (Dx12Allocation *)HeapGet(&pool->alloc, move->allocation)->user;
+      commandList->CopyResource(memory->placed[i].Get(), allocation->resource.Get());
+
+      // Frames in flight keep reading the old one until they retire.
+      ComPtr<ID3D12Resource> old = std::move(allocation->resource);
+      allocation->resource = std::move(memory->placed[i]);
+      allocation->moved(allocation->user, old.Get());
+      DeferRelease(device, old.Get());
+      HeapFreeAfter(&pool->alloc, move->retired, device->frameNum - 1);
+   }
+   DX_VERIFY(commandList->Close());
+
+   ID3D12CommandList *lists[] = { commandList };
+   device->commandQueue->ExecuteCommandLists(1, lists);
+   return count;
+}
+
+void GetGpuMemoryStats(const Dx12GpuMemory *memory, HeapStats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+   for (uint32_t i = 0; i < GPU_POOL_COUNT; ++i) {
+      HeapStats pool;
+      HeapGetStats(&memory->pools[i].alloc, &pool);
+      stats->blocks += pool.blocks;
+      stats->allocations += pool.allocations;
+      stats->freeRanges += pool.freeRanges;
+      stats->reserved += pool.reserved;
+      stats->used += pool.used;
+      stats->usedHighWater += pool.usedHighWater;
+      stats->failures += pool.failures;
+      stats->moves += pool.moves;
+      stats->movedBytes += pool.movedBytes;
+      if (pool.largestFree > stats->largestFree) {
+         stats->largestFree = pool.largestFree;
+      }
+   }
+}
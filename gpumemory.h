@@ -0,0 +1,73 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "dx12demo.h"
+
+// Placed resources suballocated from heaps of GPU_HEAP_BLOCK_SIZE, or of
+// their own size if they're bigger, by a HeapAllocator per pool; see
+// heapalloc.h. Empty heaps are released, but for one kept in each pool so a
+// resource that comes and goes doesn't keep making one.
+
+#define GPU_HEAP_BLOCK_SIZE    (64ull << 20)
+#define GPU_DEFRAG_BUDGET      (4ull << 20)     // bytes moved per frame at most
+
+bool CreateGpuMemory(Dx12GpuMemory *memory, ID3D12Device *device);
+
+// Everything must have been freed and the GPU be idle.
+void DestroyGpuMemory(Dx12GpuMemory *memory);
+
+// Creates a resource in heap memory of type heapType. Textures that aren't
+// render or depth targets get 4KB alignment if they can have it, 64KB
+// otherwise. Render and depth targets take over memory whatever had it
+// before left, so the first use of one has to clear, discard or copy over
+// all of it. Returns false, and leaves allocation alone, if there's no memory
+// for it.
+bool AllocResource(Dx12Device *device, D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC *desc,
+   D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE *clearValue, Dx12Allocation *allocation);
+
+// Hands the resource to the deferred-release queue; the memory is reused once
+// frames in flight have retired. Does nothing if there's no resource.
+void FreeResource(Dx12Device *device, Dx12Allocation *allocation);
+
+// Lets defragmentation move the resource, and calls moved(user, old) when it
+// has; or stops it, if moved is null. The allocation must stay where it is
+// from here on. Only for buffers in the default heap that rest in COMMON between
+// command lists and aren't in Dx12Device::states; their contents must not
+// change on the GPU other than through the direct queue.
+void SetMovable(Dx12Device *device, Dx12Allocation *allocation, Dx12MovedFn *moved, void *user);
+
+// Reclaims memory freed before completedValue and releases empty heaps.
+void GpuMemoryBeginFrame(Dx12Device *device, uint64_t completedValue);
+
+// Moves up to maxBytes of movable resources out of the emptiest heap of the
+// default heap's buffer pool, the only one SetMovable allows, if the rest of
+// the pool has room for them, and submits the copies.
+// Before the frame's command lists are recorded, from BeginFrame. Returns how
+// many resources moved.
+uint32_t DefragmentGpuMemory(Dx12Device *device, UINT frameIdx, uint64_t maxBytes);
+
+// Summed over the pools; largestFree is the biggest of any.
+void GetGpuMemoryStats(const Dx12GpuMemory *memory, HeapStats *stats);
@@ -0,0 +1,182 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "gpuprofile.h"
+#include "profiler.h"
+
+#define QUERIES_PER_FRAME  (2 * MAX_RECORD_CHUNKS)
+#define QUERY_COUNT        (MAX_FRAMES_IN_FLIGHT * QUERIES_PER_FRAME)
+
+static const char *const s_passNames[MAX_RECORD_CHUNKS] = {
+   "pass 0", "pass 1", "pass 2", "pass 3", "pass 4", "pass 5", "pass 6", "pass 7",
+};
+
+static uint32_t queryIndex(uint32_t frameIdx, uint32_t chunk)
+{
+   return frameIdx * QUERIES_PER_FRAME + chunk * 2;
+}
+
+// Pairs a GPU timestamp with a QueryPerformanceCounter value, then maps that
+// onto ProfilerNow(), so GPU zones line up with the CPU ones in the trace.
+static void calibrate(Dx12GpuProfiler *profiler, ID3D12CommandQueue *queue)
+{
+   UINT64 gpuTimestamp, cpuTimestamp;
+   if (FAILED(queue->GetClockCalibration(&gpuTimestamp, &cpuTimestamp))) {
+      return;
+   }
+
+   LARGE_INTEGER now, frequency;
+   QueryPerformanceCounter(&now);
+   int64_t nowNs = ProfilerNow();
+   QueryPerformanceFrequency(&frequency);
+
+   profiler->gpuBase = gpuTimestamp;
+   profiler->cpuBase = nowNs - (int64_t)((now.QuadPart - (int64_t)cpuTimestamp) * 1e9 / frequency.QuadPart);
+}
+
+static int64_t toProfilerTime(const Dx12GpuProfiler *profiler, uint64_t timestamp)
+{
+   return profiler->cpuBase + (int64_t)((int64_t)(timestamp - profiler->gpuBase) * 1e9 / profiler->frequency);
+}
+
+// Timeline callback, run once the frame that signals value has finished.
+static void readTimestamps(void *user, uint64_t value)
+{
+   Dx12Device *device = (Dx12Device *)user;
+   Dx12GpuProfiler *profiler = &device->gpuProfiler;
+   uint32_t frameIdx = (uint32_t)(value % device->framesInFlight);
+
+   uint32_t first = queryIndex(frameIdx, 0);
+   D3D12_RANGE readRange = { first * sizeof(uint64_t), (first + QUERIES_PER_FRAME) * sizeof(uint64_t) };
+   void *mapped;
+   if (FAILED(profiler->readback->Map(0, &readRange, &mapped))) {
+      return;
+   }
+
+   const uint64_t *timestamps = (const uint64_t *)mapped;
+   for (uint32_t chunk = 0; chunk < MAX_RECORD_CHUNKS; ++chunk) {
+      if (profiler->passTimed[frameIdx][chunk]) {
+         uint32_t index = queryIndex(frameIdx, chunk);
+         ProfilerRecordGpuZone(profiler->track, s_passNames[chunk],
+            toProfilerTime(profiler, timestamps[index]), toProfilerTime(profiler, timestamps[index + 1]));
+      }
+   }
+
+   D3D12_RANGE writeRange = { 0, 0 };
+   profiler->readback->Unmap(0, &writeRange);
+}
+
+void CreateGpuProfiler(Dx12GpuProfiler *profiler, ID3D12Device *device, ID3D12CommandQueue *queue)
+{
+   memset(profiler->passTimed, 0, sizeof(profiler->passTimed));
+   profiler->capturing = false;
+
+   UINT64 frequency;
+   if (FAILED(queue->GetTimestampFrequency(&frequency)) || frequency == 0) {
+      return;
+   }
+
+   D3D12_QUERY_HEAP_DESC heapDesc = {};
+   heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+   heapDesc.Count = QUERY_COUNT;
+
+   D3D12_HEAP_PROPERTIES heapProps = {};
+   heapProps.Type = D3D12_HEAP_TYPE_READBACK;
+
+   D3D12_RESOURCE_DESC desc = {};
+   desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+   desc.Width = QUERY_COUNT * sizeof(uint64_t);
+   desc.Height = 1;
+   desc.DepthOrArraySize = 1;
+   desc.MipLevels = 1;
+   desc.Format = DXGI_FORMAT_UNKNOWN;
+   desc.SampleDesc.Count = 1;
+   desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+   ComPtr<ID3D12QueryHeap> queryHeap;
+   ComPtr<ID3D12Resource> readback;
+   if (FAILED(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&queryHeap))) ||
+      FAILED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &desc,
+         D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&readback)))) {
+      return;
+   }
+
+   profiler->queryHeap = std::move(queryHeap);
+   profiler->readback = std::move(readback);
+   profiler->frequency = frequency;
+   profiler->track = ProfilerCreateGpuTrack("direct queue");
+   calibrate(profiler, queue);
+}
+
+void DestroyGpuProfiler(Dx12GpuProfiler *profiler)
+{
+   profiler->queryHeap = nullptr;
+   profiler->readback = nullptr;
+   profiler->capturing = false;
+}
+
+void GpuProfilerBeginFrame(Dx12Device *device, uint32_t frameIdx, uint64_t fenceValue)
+{
+   Dx12GpuProfiler *profiler = &device->gpuProfiler;
+   if (!profiler->queryHeap) {
+      return;
+   }
+
+   // The clocks drift apart slowly, so calibrating per capture is plenty.
+   bool capturing = ProfilerCapturing();
+   if (capturing && !profiler->capturing) {
+      calibrate(profiler, device->commandQueue.Get());
+   }
+   profiler->capturing = capturing;
+
+   memset(profiler->passTimed[frameIdx], 0, sizeof(profiler->passTimed[frameIdx]));
+   if (capturing) {
+      TimelineOnComplete(&device->timeline, fenceValue, readTimestamps, device);
+   }
+}
+
+void GpuProfilerBeginPass(Dx12GpuProfiler *profiler, ID3D12GraphicsCommandList *commandList, uint32_t frameIdx, uint32_t chunk)
+{
+   if (!profiler->capturing) {
+      return;
+   }
+
+   profiler->passTimed[frameIdx][chunk] = true;
+   commandList->EndQuery(profiler->queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex(frameIdx, chunk));
+}
+
+void GpuProfilerEndPass(Dx12GpuProfiler *profiler, ID3D12GraphicsCommandList *commandList, uint32_t frameIdx, uint32_t chunk)
+{
+   if (!profiler->capturing) {
+      return;
+   }
+
+   uint32_t index = queryIndex(frameIdx, chunk);
+   commandList->EndQuery(profiler->queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, index + 1);
+   commandList->ResolveQueryData(profiler->queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, index, 2,
+      profiler->readback.Get(), index * sizeof(uint64_t));
+}
@@ -0,0 +1,42 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "dx12demo.h"
+
+// Failing leaves the profiler disabled rather than failing the device.
+void CreateGpuProfiler(Dx12GpuProfiler *profiler, ID3D12Device *device, ID3D12CommandQueue *queue);
+void DestroyGpuProfiler(Dx12GpuProfiler *profiler);
+
+// Once the frame slot is free. While a capture is running, registers a
+// callback on the device's timeline that reads the slot's timestamps back
+// when fenceValue retires, so nothing ever waits for them.
+void GpuProfilerBeginFrame(Dx12Device *device, uint32_t frameIdx, uint64_t fenceValue);
+
+// Timestamps the start and end of a pass, and resolves both into the
+// readback buffer at the end.
+void GpuProfilerBeginPass(Dx12GpuProfiler *profiler, ID3D12GraphicsCommandList *commandList, uint32_t frameIdx, uint32_t chunk);
+void GpuProfilerEndPass(Dx12GpuProfiler *profiler, ID3D12GraphicsCommandList *commandList, uint32_t frameIdx, uint32_t chunk);
@@ -0,0 +1,309 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// Runs the frame loop with no window and no GPU, against either the null
+// backend or the software rasterizer, and reports CPU time per frame. Exits
+// non-zero if the backend saw an invalid command stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "bench.h"
+#include "frame.h"
+#include "framegraph.h"
+#include "jobs.h"
+#include "nullrender.h"
+#include "profiler.h"
+#include "sim.h"
+#include "softrender.h"
+
+#define DEFAULT_FRAMES        1000
+#define UPLOAD_RING_SIZE      (64ull << 20)
+#define SIM_TICK_RATE         60.0  // Hz
+#define SIM_MAX_STEPS         8
+
+typedef std::chrono::steady_clock Clock;
+
+struct HeadlessOptions {
+   BenchConfig bench;         // no report unless --report is given
+   bool measured;             // --frames or --seconds was given
+   uint32_t workers;          // 0 picks one per core
+   bool soft;                 // rasterize on the CPU instead of only validating
+   const char *outPath;       // the last frame as a TGA, soft backend only
+   const char *tracePath;     // Chrome trace of the whole run
+};
+
+static double secondsBetween(Clock::time_point from, Clock::time_point to)
+{
+   return std::chrono::duration<double>(to - from).count();
+}
+
+static void usage(const char *program)
+{
+   fprintf(stderr,
+      "usage: %s [options]\n"
+      "  --workers N            job threads, 0 for one per core\n"
+      "  --backend null|soft\n"
+      "  --out image.tga        the last frame, soft backend only\n"
+      "  --trace trace.json\n"
+      "%s", program, BENCH_USAGE);
+}
+
+static bool parseOptions(int argc, char **argv, HeadlessOptions *options)
+{
+   BenchConfig *bench = &options->bench;
+   BenchConfigInit(bench);
+   options->workers = 0;
+   options->soft = false;
+   options->outPath = nullptr;
+   options->tracePath = nullptr;
+
+   for (int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (!value) {
+         return false;
+      }
+
+      int parsed = ParseBenchOption(bench, arg, value);
+      if (parsed < 0) {
+         return false;
+      } else if (parsed > 0) {
+         // Taken care of.
+      } else if (strcmp(arg, "--workers") == 0) {
+         options->workers = (uint32_t)strtoul(value, nullptr, 10);
+      } else if (strcmp(arg, "--backend") == 0) {
+         if (strcmp(value, "soft") == 0) {
+            options->soft = true;
+         } else if (strcmp(value, "null") != 0) {
+            return false;
+         }
+      } else if (strcmp(arg, "--out") == 0) {
+         options->outPath = value;
+      } else if (strcmp(arg, "--trace") == 0) {
+         options->tracePath = value;
+      } else {
+         return false;
+      }
+      ++i;
+   }
+
+   options->measured = BenchEnabled(bench);
+   if (!options->measured) {
+      bench->frames = DEFAULT_FRAMES;
+   }
+   if (options->soft && (bench->width > RASTER_MAX_SIZE || bench->height > RASTER_MAX_SIZE)) {
+      return false;
+   }
+   if (options->outPath && !options->soft) {
+      return false;
+   }
+   return true;
+}
+
+// Uncompressed 32-bit TGA, which stores pixels in the same BGRA order.
+static bool writeTga(const char *path, const uint32_t *pixels, uint32_t width, uint32_t height)
+{
+   FILE *file = fopen(path, "wb");
+   if (!file) {
+      return false;
+   }
+
+   uint8_t header[18] = { 0 };
+   header[2] = 2;                      // uncompressed true-color
+   header[12] = (uint8_t)width;
+   header[13] = (uint8_t)(width >> 8);
+   header[14] = (uint8_t)height;
+   header[15] = (uint8_t)(height >> 8);
+   header[16] = 32;
+   header[17] = 0x28;                  // 8 alpha bits, rows top to bottom
+
+   bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+      fwrite(pixels, sizeof(uint32_t), (size_t)width * height, file) == (size_t)width * height;
+   return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char **argv)
+{
+   HeadlessOptions options;
+   if (!parseOptions(argc, argv, &options)) {
+      usage(argv[0]);
+      return 2;
+   }
+
+   const BenchConfig *bench = &options.bench;
+   ProfilerSetThreadName("main");
+   JobSystemInit(options.workers);
+   SetInstanceCount(bench->instances);
+   SetSpinningPercent(bench->spinningPercent);
+   SetCulling(bench->culling);
+   SetPostPasses(bench->postPasses);
+
+   SoftBackend *soft = nullptr;
+   NullBackend *backend;
+   if (options.soft) {
+      soft = new SoftBackend(bench->width, bench->height, bench->framesInFlight, UPLOAD_RING_SIZE);
+      backend = soft;
+   } else {
+      backend = new NullBackend(bench->width, bench->height, bench->framesInFlight, UPLOAD_RING_SIZE);
+   }
+   backend->SetVsync(bench->vsync);
+
+   // Same pacing as the windowed build: the simulation ticks at a fixed rate
+   // off the monotonic clock and each frame draws one tick behind. Frames
+   // here run far faster than the tick, though, so most would find nothing
+   // new to draw. A measured run ticks once per frame instead, so every
+   // frame does the work it's configured to.
+   FixedTimestep timestep;
+   FixedTimestepInit(&timestep, 1.0 / SIM_TICK_RATE, SIM_MAX_STEPS);
+
+   SimState state;
+   SimInit(&state);
+
+   FramePacket prev, cur;
+   SimPublish(&state, &cur);
+   prev = cur;
+
+   if (options.tracePath) {
+      ProfilerBeginCapture();
+   }
+
+   // Frame times run from the start of one frame to the start of the next.
+   // The backend's counters and the totals here include the warm-up; the
+   // benchmark summary doesn't.
+   BenchRun run;
+   BenchRunInit(&run, bench);
+   uint32_t totalFrames = 0;
+   uint64_t cpuCulled = 0;
+   uint64_t updated = 0;
+   FrameStats lastStats = {};
+   double totalTime = 0.0;
+   Clock::time_point startTime = Clock::now();
+   Clock::time_point lastTime = startTime, curTime = startTime;
+   for (bool running = true; running; ) {
+      double elapsed = secondsBetween(lastTime, curTime);
+      uint32_t steps = options.measured ? 1 : FixedTimestepAdvance(&timestep, elapsed);
+      lastTime = curTime;
+      for (uint32_t j = 0; j < steps; ++j) {
+         SimStep(&state, timestep.step);
+         prev = cur;
+         SimPublish(&state, &cur);
+      }
+
+      FramePacket packet = cur;
+      if (!options.measured) {
+         double renderTime = secondsBetween(startTime, curTime) - timestep.step;
+         InterpolatePackets(&prev, &cur, InterpolationAlpha(&prev, &cur, renderTime), &packet);
+      }
+
+      FrameStats frameStats;
+      DrawFrame(backend, &packet, &frameStats);
+
+      curTime = Clock::now();
+      double frameTime = secondsBetween(lastTime, curTime);
+      totalTime += frameTime;
+      ++totalFrames;
+      cpuCulled += frameStats.culled;
+      updated += frameStats.updated;
+      lastStats = frameStats;
+      running = BenchRunAddFrame(&run, frameTime, &frameStats);
+   }
+
+   int result = 0;
+   if (options.tracePath && !ProfilerEndCapture(options.tracePath)) {
+      fprintf(stderr, "couldn't write %s\n", options.tracePath);
+      result = 1;
+   }
+
+   const char *backendName = options.soft ? "soft" : "null";
+   BenchSummary summary;
+   BenchSummarize(&run, &summary);
+   if (bench->reportPath && !WriteBenchReport(bench, backendName, &summary)) {
+      fprintf(stderr, "couldn't write %s\n", bench->reportPath);
+      result = 1;
+   }
+
+   // Out of the way if the report went to stdout.
+   FILE *out = bench->reportPath && strcmp(bench->reportPath, "-") == 0 ? stderr : stdout;
+   const NullRenderStats *stats = &backend->stats;
+   fprintf(out, "%s backend, %u frames after %u warm-up, %u cubes, %ux%u, %u frames in flight, %u threads\n",
+      backendName, summary.frames, totalFrames - summary.frames, GetInstanceCount(), bench->width, bench->height,
+      bench->framesInFlight, JobThreadCount());
+   fprintf(out, "frame ms: avg %.3f, min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+      summary.mean, summary.min, summary.p50, summary.p95, summary.p99, summary.p999, summary.max);
+   fprintf(out, "stage ms: wait %.3f, prepare %.3f, record %.3f, submit %.3f, present %.3f\n",
+      summary.stageMeans.wait, summary.stageMeans.prepare, summary.stageMeans.record,
+      summary.stageMeans.submit, summary.stageMeans.present);
+   fprintf(out, "per frame: %.1f command lists, %.1f commands, %.1f draws, %.0f instances\n",
+      (double)stats->commandLists / stats->frames, (double)stats->commands / stats->frames,
+      (double)stats->draws / stats->frames, (double)stats->instances / stats->frames);
+   if (stats->culledInstances || cpuCulled) {
+      fprintf(out, "culled per frame: %.0f instances\n", (double)(stats->culledInstances + cpuCulled) / stats->frames);
+   }
+   fprintf(out, "transforms updated per frame: %.0f (%u%% spinning)\n", (double)updated / stats->frames,
+      GetSpinningPercent());
+   RenderStats renderStats;
+   backend->GetStats(&renderStats);
+   const StateTrackerStats *barriers = &renderStats.barriers;
+   fprintf(out, "barriers per frame: %.1f in %.1f calls, %.1f split, %.1f at submit; of %.1f asked for, %.1f redundant, %.1f merged\n",
+      (double)barriers->barriers / stats->frames, (double)barriers->batches / stats->frames,
+      (double)barriers->splitBarriers / stats->frames, (double)barriers->fixups / stats->frames,
+      (double)barriers->requests / stats->frames, (double)barriers->redundant / stats->frames,
+      (double)barriers->merged / stats->frames);
+   const FrameGraphStats *graph = GetFrameGraphStats();
+   fprintf(out, "frame graph: %u passes, %u culled; transient targets %.1f MB, %.1f MB unaliased; %llu compiles, %llu from cache\n",
+      lastStats.passes, lastStats.culledPasses, lastStats.transientBytes / 1048576.0, lastStats.unaliasedBytes / 1048576.0,
+      (unsigned long long)graph->compiles, (unsigned long long)graph->cacheHits);
+   fprintf(out, "upload peak %.1f/%.1f MB\n", backend->ring.highWater / 1048576.0, backend->ring.size / 1048576.0);
+   const TimelineStats *fence = &backend->timeline.stats;
+   fprintf(out, "fence waits: %llu, %llu from cache, %llu polled, %llu blocked\n", (unsigned long long)fence->waits,
+      (unsigned long long)fence->cachedWaits, (unsigned long long)fence->polledWaits, (unsigned long long)fence->blockedWaits);
+
+   if (soft) {
+      const RasterStats *raster = &soft->rast.stats;
+      fprintf(out, "raster: %.1f Mpixels/s written, %.1f Mpixels/s of target, %.0f%% of triangles culled, %.2f%% clipped\n",
+         raster->pixels / totalTime / 1e6, (double)bench->width * bench->height * totalFrames / totalTime / 1e6,
+         raster->triangles ? 100.0 * raster->culled / raster->triangles : 0.0,
+         raster->triangles ? 100.0 * raster->clipped / raster->triangles : 0.0);
+
+      if (options.outPath && !writeTga(options.outPath, soft->pixels.data(), bench->width, bench->height)) {
+         fprintf(stderr, "couldn't write %s\n", options.outPath);
+         result = 1;
+      }
+   }
+
+   if (stats->errors) {
+      fprintf(stderr, "%llu validation errors; first: %s\n", (unsigned long long)stats->errors, backend->error);
+      result = 1;
+   }
+
+   delete backend;
+   JobSystemShutdown();
+   ProfilerShutdown();
+   return result;
+}
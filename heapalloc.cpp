@@ -0,0 +1,666 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <string.h>
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+#include "common.h"
+#include "heapalloc.h"
+
+#define HEAP_SKIPPED_CHECKS  4     // ranges per list findSkipped looks at
+
+static inline uint32_t lowestBit(uint32_t bits)
+{
+   ASSERT(bits != 0);
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward(&index, bits);
+   return index;
+#else
+   return __builtin_ctz(bits);
+#endif
+}
+
+static inline uint32_t highestBit(uint64_t bits)
+{
+   ASSERT(bits != 0);
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanReverse64(&index, bits);
+   return index;
+#else
+   return 63 - __builtin_clzll(bits);
+#endif
+}
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+   return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// The list ranges of size bytes go in. Below HEAP_SL_COUNT granules every
+// size has a list of its own; above, each power of two is split in
+// HEAP_SL_COUNT even steps.
+static void sizeClass(uint64_t size, uint32_t *fl, uint32_t *sl)
+{
+   uint64_t granules = size / HEAP_GRANULARITY;
+   if (granules < HEAP_SL_COUNT) {
+      *fl = 0;
+      *sl = (uint32_t)granules;
+      return;
+   }
+
+   uint32_t log = highestBit(granules);
+   *fl = log - HEAP_SL_BITS + 1;
+   *sl = (uint32_t)(granules >> (log - HEAP_SL_BITS)) - HEAP_SL_COUNT;
+}
+
+// Up to the smallest size of the next class, so any range in its list fits.
+static uint64_t roundUpClass(uint64_t size)
+{
+   uint64_t granules = size / HEAP_GRANULARITY;
+   if (granules >= HEAP_SL_COUNT) {
+      uint64_t step = (uint64_t)1 << (highestBit(granules) - HEAP_SL_BITS);
+      granules = alignUp(granules, step);
+   }
+   return granules * HEAP_GRANULARITY;
+}
+
+static uint32_t newNode(HeapAllocator *alloc)
+{
+   if (!alloc->freeNodes.empty()) {
+      uint32_t index = alloc->freeNodes.back();
+      alloc->freeNodes.pop_back();
+      return index;
+   }
+   alloc->nodes.emplace_back();
+   return (uint32_t)alloc->nodes.size() - 1;
+}
+
+static void releaseNode(HeapAllocator *alloc, uint32_t index)
+{
+   alloc->nodes[index].block = HEAP_INVALID;
+   alloc->freeNodes.push_back(index);
+}
+
+// Neither touches the node's flags, which callers set.
+static void insertFree(HeapAllocator *alloc, uint32_t index)
+{
+   HeapNode *node = &alloc->nodes[index];
+   uint32_t fl, sl;
+   sizeClass(node->size, &fl, &sl);
+
+   uint32_t head = alloc->freeLists[fl][sl];
+   node->prevFree = HEAP_INVALID;
+   node->nextFree = head;
+   if (head != HEAP_INVALID) {
+      alloc->nodes[head].prevFree = index;
+   }
+   alloc->freeLists[fl][sl] = index;
+   alloc->firstLevel |= 1u << fl;
+   alloc->secondLevel[fl] |= 1u << sl;
+   ++alloc->stats.freeRanges;
+}
+
+static void removeFree(HeapAllocator *alloc, uint32_t index)
+{
+   HeapNode *node = &alloc->nodes[index];
+   uint32_t fl, sl;
+   sizeClass(node->size, &fl, &sl);
+
+   if (node->prevFree != HEAP_INVALID) {
+      alloc->nodes[node->prevFree].nextFree = node->nextFree;
+   } else {
+      ASSERT(alloc->freeLists[fl][sl] == index);
+      alloc->freeLists[fl][sl] = node->nextFree;
+      if (node->nextFree == HEAP_INVALID) {
+         alloc->secondLevel[fl] &= ~(1u << sl);
+         if (alloc->secondLevel[fl] == 0) {
+            alloc->firstLevel &= ~(1u << fl);
+         }
+      }
+   }
+   if (node->nextFree != HEAP_INVALID) {
+      alloc->nodes[node->nextFree].prevFree = node->prevFree;
+   }
+   --alloc->stats.freeRanges;
+}
+
+// Head of the first list whose ranges are all at least size bytes, or
+// HEAP_INVALID. Taking a list head rather than searching it for the best fit
+// costs a little memory and keeps this constant time.
+static uint32_t findFree(const HeapAllocator *alloc, uint64_t size)
+{
+   uint32_t fl, sl;
+   sizeClass(roundUpClass(size), &fl, &sl);
+   if (fl >= HEAP_FL_COUNT) {
+      return HEAP_INVALID;
+   }
+
+   uint32_t bits = alloc->secondLevel[fl] & (~0u << sl);
+   if (bits == 0) {
+      uint32_t firstBits = fl + 1 < HEAP_FL_COUNT ? alloc->firstLevel & (~0u << (fl + 1)) : 0;
+      if (firstBits == 0) {
+         return HEAP_INVALID;
+      }
+      fl = lowestBit(firstBits);
+      bits = alloc->secondLevel[fl];
+   }
+   return alloc->freeLists[fl][lowestBit(bits)];
+}
+
+// The first few ranges of each list findFree skips for a request, checked
+// for one that fits once aligned, so one that only just does, like a block
+// just added for a single big resource, isn't missed. Only when findFree
+// finds nothing.
+static uint32_t findSkipped(const HeapAllocator *alloc, uint64_t size, uint64_t alignment)
+{
+   uint32_t fl, sl, endFl, endSl;
+   sizeClass(size, &fl, &sl);
+   sizeClass(roundUpClass(size + alignment - HEAP_GRANULARITY), &endFl, &endSl);
+   while (fl < HEAP_FL_COUNT && (fl < endFl || (fl == endFl && sl < endSl))) {
+      uint32_t index = alloc->freeLists[fl][sl];
+      for (uint32_t i = 0; i < HEAP_SKIPPED_CHECKS && index != HEAP_INVALID; ++i, index = alloc->nodes[index].nextFree) {
+         const HeapNode *node = &alloc->nodes[index];
+         if (alignUp(node->offset, alignment) - node->offset + size <= node->size) {
+            return index;
+         }
+      }
+      if (++sl == HEAP_SL_COUNT) {
+         sl = 0;
+         ++fl;
+      }
+   }
+   return HEAP_INVALID;
+}
+
+// Cuts the node's range at size bytes and returns a new node for the rest,
+// right after it in the block.
+static uint32_t split(HeapAllocator *alloc, uint32_t index, uint64_t size)
+{
+   uint32_t rest = newNode(alloc);
+   HeapNode *node = &alloc->nodes[index];
+   HeapNode *restNode = &alloc->nodes[rest];
+   ASSERT(size < node->size);
+
+   restNode->offset = node->offset + size;
+   restNode->size = node->size - size;
+   restNode->alignment = 0;
+   restNode->block = node->block;
+   restNode->flags = 0;
+   restNode->prevPhysical = index;
+   restNode->nextPhysical = node->nextPhysical;
+   restNode->user = nullptr;
+   if (node->nextPhysical != HEAP_INVALID) {
+      alloc->nodes[node->nextPhysical].prevPhysical = rest;
+   }
+   node->nextPhysical = rest;
+   node->size = size;
+   return rest;
+}
+
+// Folds next, the node right after index in its block, into it.
+static void merge(HeapAllocator *alloc, uint32_t index, uint32_t next)
+{
+   HeapNode *node = &alloc->nodes[index];
+   HeapNode *nextNode = &alloc->nodes[next];
+   ASSERT(node->nextPhysical == next && node->offset + node->size == nextNode->offset);
+
+   node->size += nextNode->size;
+   node->nextPhysical = nextNode->nextPhysical;
+   if (nextNode->nextPhysical != HEAP_INVALID) {
+      alloc->nodes[nextNode->nextPhysical].prevPhysical = index;
+   }
+   releaseNode(alloc, next);
+}
+
+static uint32_t allocate(HeapAllocator *alloc, uint64_t size, uint64_t alignment, void *user)
+{
+   ASSERT(size > 0 && (alignment & (alignment - 1)) == 0);
+   size = alignUp(size, HEAP_GRANULARITY);
+   if (alignment < HEAP_GRANULARITY) {
+      alignment = HEAP_GRANULARITY;
+   }
+
+   // Big enough for the worst padding the alignment could need.
+   uint32_t index = findFree(alloc, size + alignment - HEAP_GRANULARITY);
+   if (index == HEAP_INVALID) {
+      index = findSkipped(alloc, size, alignment);
+      if (index == HEAP_INVALID) {
+         return HEAP_INVALID;
+      }
+   }
+   removeFree(alloc, index);
+
+   // The node was free, so its neighbours aren't, and neither piece cut off
+   // it has anything to merge with.
+   uint64_t offset = alloc->nodes[index].offset;
+   uint64_t padding = alignUp(offset, alignment) - offset;
+   if (padding > 0) {
+      uint32_t rest = split(alloc, index, padding);
+      alloc->nodes[index].flags = HEAP_NODE_FREE;
+      insertFree(alloc, index);
+      index = rest;
+   }
+   if (alloc->nodes[index].size > size) {
+      uint32_t rest = split(alloc, index, size);
+      alloc->nodes[rest].flags = HEAP_NODE_FREE;
+      insertFree(alloc, rest);
+   }
+
+   HeapNode *node = &alloc->nodes[index];
+   node->alignment = alignment;
+   node->flags = 0;
+   node->user = user;
+
+   HeapBlock *block = &alloc->blocks[node->block];
+   block->used += size;
+   ++block->allocations;
+   ++alloc->stats.allocations;
+   alloc->stats.used += size;
+   if (alloc->stats.used > alloc->stats.usedHighWater) {
+      alloc->stats.usedHighWater = alloc->stats.used;
+   }
+   return index;
+}
+
+void HeapAllocatorInit(HeapAllocator *alloc)
+{
+   alloc->nodes.clear();
+   alloc->freeNodes.clear();
+   alloc->blocks.clear();
+   alloc->freeBlocks.clear();
+   alloc->firstLevel = 0;
+   memset(alloc->secondLevel, 0, sizeof(alloc->secondLevel));
+   memset(alloc->freeLists, 0xff, sizeof(alloc->freeLists));
+   alloc->pendingFrees.clear();
+   alloc->pendingFirst = 0;
+   memset(&alloc->stats, 0, sizeof(alloc->stats));
+}
+
+uint32_t HeapAddBlock(HeapAllocator *alloc, uint64_t size)
+{
+   ASSERT(size > 0 && size % HEAP_GRANULARITY == 0 && size <= HEAP_MAX_BLOCK_SIZE);
+
+   uint32_t block;
+   if (!alloc->freeBlocks.empty()) {
+      block = alloc->freeBlocks.back();
+      alloc->freeBlocks.pop_back();
+   } else {
+      alloc->blocks.emplace_back();
+      block = (uint32_t)alloc->blocks.size() - 1;
+   }
+
+   uint32_t index = newNode(alloc);
+   HeapNode *node = &alloc->nodes[index];
+   node->offset = 0;
+   node->size = size;
+   node->alignment = 0;
+   node->block = block;
+   node->flags = HEAP_NODE_FREE;
+   node->prevPhysical = HEAP_INVALID;
+   node->nextPhysical = HEAP_INVALID;
+   node->user = nullptr;
+   insertFree(alloc, index);
+
+   HeapBlock *heapBlock = &alloc->blocks[block];
+   heapBlock->size = size;
+   heapBlock->used = 0;
+   heapBlock->allocations = 0;
+   heapBlock->movable = 0;
+   heapBlock->first = index;
+
+   ++alloc->stats.blocks;
+   alloc->stats.reserved += size;
+   return block;
+}
+
+void HeapRemoveBlock(HeapAllocator *alloc, uint32_t block)
+{
+   HeapBlock *heapBlock = &alloc->blocks[block];
+   ASSERT(heapBlock->size > 0 && heapBlock->allocations == 0);
+
+   uint32_t index = heapBlock->first;
+   ASSERT(alloc->nodes[index].size == heapBlock->size);
+   removeFree(alloc, index);
+   releaseNode(alloc, index);
+
+   --alloc->stats.blocks;
+   alloc->stats.reserved -= heapBlock->size;
+   heapBlock->size = 0;
+   heapBlock->first = HEAP_INVALID;
+   alloc->freeBlocks.push_back(block);
+}
+
+uint32_t HeapAlloc(HeapAllocator *alloc, uint64_t size, uint64_t alignment, void *user)
+{
+   uint32_t index = allocate(alloc, size, alignment, user);
+   if (index == HEAP_INVALID) {
+      ++alloc->stats.failures;
+   }
+   return index;
+}
+
+void HeapFree(HeapAllocator *alloc, uint32_t handle)
+{
+   HeapNode *node = &alloc->nodes[handle];
+   ASSERT(node->block != HEAP_INVALID && !(node->flags & HEAP_NODE_FREE));
+
+   HeapBlock *block = &alloc->blocks[node->block];
+   block->used -= node->size;
+   --block->allocations;
+   if (node->flags & (HEAP_NODE_MOVABLE | HEAP_NODE_RETIRED)) {
+      --block->movable;
+   }
+   --alloc->stats.allocations;
+   alloc->stats.used -= node->size;
+
+   uint32_t index = handle;
+   uint32_t prev = node->prevPhysical;
+   uint32_t next = node->nextPhysical;
+   if (prev != HEAP_INVALID && (alloc->nodes[prev].flags & HEAP_NODE_FREE)) {
+      removeFree(alloc, prev);
+      merge(alloc, prev, index);
+      index = prev;
+   }
+   if (next != HEAP_INVALID && (alloc->nodes[next].flags & HEAP_NODE_FREE)) {
+      removeFree(alloc, next);
+      merge(alloc, index, next);
+   }
+
+   node = &alloc->nodes[index];
+   node->flags = HEAP_NODE_FREE;
+   node->user = nullptr;
+   insertFree(alloc, index);
+}
+
+void HeapFreeAfter(HeapAllocator *alloc, uint32_t handle, uint64_t fenceValue)
+{
+   ASSERT(alloc->pendingFrees.size() == alloc->pendingFirst || alloc->pendingFrees.back().fenceValue <= fenceValue);
+
+   HeapAllocator::PendingFree pending;
+   pending.fenceValue = fenceValue;
+   pending.handle = handle;
+   alloc->pendingFrees.push_back(pending);
+}
+
+void HeapBeginFrame(HeapAllocator *alloc, uint64_t completedValue)
+{
+   size_t first = alloc->pendingFirst;
+   while (first < alloc->pendingFrees.size() && alloc->pendingFrees[first].fenceValue <= completedValue) {
+      HeapFree(alloc, alloc->pendingFrees[first].handle);
+      ++first;
+   }
+
+   if (first == alloc->pendingFrees.size()) {
+      alloc->pendingFrees.clear();
+      first = 0;
+   } else if (first > alloc->pendingFrees.size() / 2) {
+      alloc->pendingFrees.erase(alloc->pendingFrees.begin(), alloc->pendingFrees.begin() + first);
+      first = 0;
+   }
+   alloc->pendingFirst = first;
+}
+
+void HeapSetMovable(HeapAllocator *alloc, uint32_t handle, bool movable)
+{
+   HeapNode *node = &alloc->nodes[handle];
+   ASSERT(!(node->flags & (HEAP_NODE_FREE | HEAP_NODE_RETIRED)));
+   if (movable == ((node->flags & HEAP_NODE_MOVABLE) != 0)) {
+      return;
+   }
+   if (movable) {
+      node->flags |= HEAP_NODE_MOVABLE;
+      ++alloc->blocks[node->block].movable;
+   } else {
+      node->flags &= ~HEAP_NODE_MOVABLE;
+      --alloc->blocks[node->block].movable;
+   }
+}
+
+// Trades the ranges of two allocations in different blocks, so a handle can
+// stay put while what it refers to moves.
+static void swapRanges(HeapAllocator *alloc, uint32_t a, uint32_t b)
+{
+   HeapNode *nodeA = &alloc->nodes[a];
+   HeapNode *nodeB = &alloc->nodes[b];
+   ASSERT(nodeA->block != nodeB->block);
+
+   HeapNode saved = *nodeA;
+   nodeA->offset = nodeB->offset;
+   nodeA->size = nodeB->size;
+   nodeA->block = nodeB->block;
+   nodeA->prevPhysical = nodeB->prevPhysical;
+   nodeA->nextPhysical = nodeB->nextPhysical;
+   nodeB->offset = saved.offset;
+   nodeB->size = saved.size;
+   nodeB->block = saved.block;
+   nodeB->prevPhysical = saved.prevPhysical;
+   nodeB->nextPhysical = saved.nextPhysical;
+
+   uint32_t swapped[2] = { a, b };
+   for (uint32_t index : swapped) {
+      HeapNode *node = &alloc->nodes[index];
+      if (node->prevPhysical != HEAP_INVALID) {
+         alloc->nodes[node->prevPhysical].nextPhysical = index;
+      } else {
+         alloc->blocks[node->block].first = index;
+      }
+      if (node->nextPhysical != HEAP_INVALID) {
+         alloc->nodes[node->nextPhysical].prevPhysical = index;
+      }
+   }
+}
+
+// Takes the free ranges of the source block and of empty blocks out of the
+// lists, or puts them back, so defragmentation doesn't move anything into
+// them. Moving into an empty block only empties another.
+static void hideBlocks(HeapAllocator *alloc, uint32_t source, bool hide)
+{
+   for (uint32_t i = 0; i < (uint32_t)alloc->blocks.size(); ++i) {
+      const HeapBlock *block = &alloc->blocks[i];
+      if (i != source && (block->size == 0 || block->allocations > 0)) {
+         continue;
+      }
+      for (uint32_t index = block->first; index != HEAP_INVALID; index = alloc->nodes[index].nextPhysical) {
+         if (alloc->nodes[index].flags & HEAP_NODE_FREE) {
+            if (hide) {
+               removeFree(alloc, index);
+            } else {
+               insertFree(alloc, index);
+            }
+         }
+      }
+   }
+}
+
+uint32_t HeapDefragment(HeapAllocator *alloc, uint64_t maxBytes, std::vector<HeapMove> *moves)
+{
+   if (alloc->stats.blocks < 2) {
+      return 0;
+   }
+
+   // The block with the least in it that could be emptied, as long as the
+   // others have the room. One whose moves are under way still has them in.
+   uint32_t source = HEAP_INVALID;
+   for (uint32_t i = 0; i < (uint32_t)alloc->blocks.size(); ++i) {
+      const HeapBlock *block = &alloc->blocks[i];
+      if (block->allocations > 0 && block->movable == block->allocations &&
+         (source == HEAP_INVALID || block->used < alloc->blocks[source].used)) {
+         source = i;
+      }
+   }
+   if (source == HEAP_INVALID) {
+      return 0;
+   }
+   uint64_t freeElsewhere = 0;
+   for (uint32_t i = 0; i < (uint32_t)alloc->blocks.size(); ++i) {
+      const HeapBlock *block = &alloc->blocks[i];
+      if (i != source && block->allocations > 0) {
+         freeElsewhere += block->size - block->used;
+      }
+   }
+   const HeapBlock *sourceBlock = &alloc->blocks[source];
+   if (freeElsewhere < sourceBlock->used) {
+      return 0;
+   }
+
+   std::vector<uint32_t> movable;
+   for (uint32_t index = sourceBlock->first; index != HEAP_INVALID; index = alloc->nodes[index].nextPhysical) {
+      if ((alloc->nodes[index].flags & (HEAP_NODE_FREE | HEAP_NODE_MOVABLE)) == HEAP_NODE_MOVABLE) {
+         movable.push_back(index);
+      }
+   }
+
+   // Nothing is freed while blocks are hidden, since the old ranges are held
+   // on to by the moves, and no hidden block gains an allocation.
+   hideBlocks(alloc, source, true);
+   uint32_t count = 0;
+   uint64_t moved = 0;
+   for (uint32_t handle : movable) {
+      const HeapNode *node = &alloc->nodes[handle];
+      if (moved + node->size > maxBytes) {
+         break;
+      }
+      uint32_t retired = allocate(alloc, node->size, node->alignment, nullptr);
+      if (retired == HEAP_INVALID) {
+         break;
+      }
+
+      // The source block loses a movable allocation and gains a retired one.
+      swapRanges(alloc, handle, retired);
+      alloc->nodes[retired].flags = HEAP_NODE_RETIRED;
+      ++alloc->blocks[alloc->nodes[handle].block].movable;
+      moved += alloc->nodes[handle].size;
+
+      HeapMove move;
+      move.allocation = handle;
+      move.retired = retired;
+      moves->push_back(move);
+      ++count;
+   }
+   hideBlocks(alloc, source, false);
+
+   alloc->stats.moves += count;
+   alloc->stats.movedBytes += moved;
+   return count;
+}
+
+void HeapGetStats(const HeapAllocator *alloc, HeapStats *stats)
+{
+   *stats = alloc->stats;
+   stats->largestFree = 0;
+   if (alloc->firstLevel != 0) {
+      uint32_t fl = highestBit(alloc->firstLevel);
+      uint32_t sl = highestBit(alloc->secondLevel[fl]);
+      for (uint32_t index = alloc->freeLists[fl][sl]; index != HEAP_INVALID; index = alloc->nodes[index].nextFree) {
+         if (alloc->nodes[index].size > stats->largestFree) {
+            stats->largestFree = alloc->nodes[index].size;
+         }
+      }
+   }
+}
+
+bool HeapValidate(const HeapAllocator *alloc)
+{
+   uint32_t listed = 0;
+   for (uint32_t fl = 0; fl < HEAP_FL_COUNT; ++fl) {
+      if (((alloc->firstLevel >> fl) & 1) != (alloc->secondLevel[fl] != 0)) {
+         return false;
+      }
+      for (uint32_t sl = 0; sl < HEAP_SL_COUNT; ++sl) {
+         uint32_t head = alloc->freeLists[fl][sl];
+         if (((alloc->secondLevel[fl] >> sl) & 1) != (head != HEAP_INVALID)) {
+            return false;
+         }
+
+         uint32_t prev = HEAP_INVALID;
+         for (uint32_t index = head; index != HEAP_INVALID; index = alloc->nodes[index].nextFree) {
+            const HeapNode *node = &alloc->nodes[index];
+            uint32_t nodeFl, nodeSl;
+            sizeClass(node->size, &nodeFl, &nodeSl);
+            if (!(node->flags & HEAP_NODE_FREE) || node->prevFree != prev || nodeFl != fl || nodeSl != sl ||
+               ++listed > alloc->nodes.size()) {
+               return false;
+            }
+            prev = index;
+         }
+      }
+   }
+
+   uint32_t blocks = 0, allocations = 0, freeRanges = 0;
+   uint64_t reserved = 0, used = 0;
+   for (uint32_t i = 0; i < (uint32_t)alloc->blocks.size(); ++i) {
+      const HeapBlock *block = &alloc->blocks[i];
+      if (block->size == 0) {
+         continue;
+      }
+
+      uint32_t blockAllocations = 0, blockMovable = 0;
+      uint64_t offset = 0, blockUsed = 0;
+      uint32_t prev = HEAP_INVALID;
+      bool prevFree = false;
+      for (uint32_t index = block->first; index != HEAP_INVALID; index = alloc->nodes[index].nextPhysical) {
+         const HeapNode *node = &alloc->nodes[index];
+         bool free = (node->flags & HEAP_NODE_FREE) != 0;
+         if (node->block != i || node->offset != offset || node->prevPhysical != prev || node->size == 0 ||
+            node->size % HEAP_GRANULARITY != 0 || (free && prevFree)) {
+            return false;
+         }
+         if (free) {
+            ++freeRanges;
+         } else {
+            if (node->offset % node->alignment != 0) {
+               return false;
+            }
+            ++blockAllocations;
+            blockMovable += (node->flags & (HEAP_NODE_MOVABLE | HEAP_NODE_RETIRED)) != 0;
+            blockUsed += node->size;
+         }
+         offset += node->size;
+         if (offset > block->size) {
+            return false;
+         }
+         prev = index;
+         prevFree = free;
+      }
+      if (offset != block->size || blockAllocations != block->allocations || blockMovable != block->movable ||
+         blockUsed != block->used) {
+         return false;
+      }
+
+      ++blocks;
+      allocations += blockAllocations;
+      reserved += block->size;
+      used += blockUsed;
+   }
+
+   const HeapStats *stats = &alloc->stats;
+   return listed == freeRanges && freeRanges == stats->freeRanges && blocks == stats->blocks &&
+      allocations == stats->allocations && reserved == stats->reserved && used == stats->used &&
+      alloc->nodes.size() == alloc->freeNodes.size() + freeRanges + allocations;
+}
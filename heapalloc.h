@@ -0,0 +1,176 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define HEAP_INVALID      UINT32_MAX
+#define HEAP_GRANULARITY  4096      // D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+#define HEAP_SL_BITS      4
+#define HEAP_SL_COUNT     (1 << HEAP_SL_BITS)
+#define HEAP_FL_COUNT     32
+
+// Most granules a block may have: the first level runs out after that.
+#define HEAP_MAX_BLOCK_SIZE  ((uint64_t)HEAP_GRANULARITY << (HEAP_FL_COUNT + HEAP_SL_BITS - 2))
+
+// Node flags.
+#define HEAP_NODE_FREE     0x1
+#define HEAP_NODE_MOVABLE  0x2   // the owner can cope with HeapDefragment moving it
+#define HEAP_NODE_RETIRED  0x4   // the old range of a move, waiting to be freed
+
+// Bookkeeping for placed resources in a set of heaps, or any other memory
+// reserved a block at a time and handed out in pieces. Two-level segregated
+// fit: free ranges sit in lists by size class, a power of two split into
+// HEAP_SL_COUNT steps, and two levels of bitmaps say which lists have
+// anything in them, so finding a range that fits and giving one back are
+// constant time, whatever the number of ranges. Freed ranges merge with free
+// neighbours in the same block straight away.
+//
+// Sizes and offsets are in bytes and multiples of HEAP_GRANULARITY; requests
+// are rounded up to it. Blocks are added and removed by the caller, who also
+// creates the memory behind them, so this knows nothing about the GPU.
+struct HeapNode {
+   uint64_t offset;           // in the block
+   uint64_t size;
+   uint64_t alignment;        // asked for, so a move can keep to it
+   uint32_t block;
+   uint32_t flags;
+   uint32_t prevPhysical;     // neighbours in the block, by offset...
+   uint32_t nextPhysical;
+   uint32_t prevFree;         // ...and in its free list, if it's free
+   uint32_t nextFree;
+   void *user;
+};
+
+struct HeapBlock {
+   uint64_t size;             // 0 if the block has been removed
+   uint64_t used;
+   uint32_t allocations;
+   uint32_t movable;          // ...of which movable, or retired by a move
+   uint32_t first;            // node at offset 0
+};
+
+// A move planned by HeapDefragment. The allocation now refers to its new
+// range; retired holds on to the old one, as an allocation of its own, until
+// the caller has copied the contents across and frees it.
+struct HeapMove {
+   uint32_t allocation;
+   uint32_t retired;
+};
+
+struct HeapStats {
+   uint32_t blocks;
+   uint32_t allocations;
+   uint32_t freeRanges;
+   uint64_t reserved;         // bytes in blocks
+   uint64_t used;             // ...allocated
+   uint64_t usedHighWater;
+   uint64_t largestFree;      // bytes in the biggest free range
+   uint64_t failures;         // allocations that didn't fit in any block
+   uint64_t moves;            // planned by HeapDefragment
+   uint64_t movedBytes;
+};
+
+struct HeapAllocator {
+   std::vector<HeapNode> nodes;      // by handle
+   std::vector<uint32_t> freeNodes;
+   std::vector<HeapBlock> blocks;
+   std::vector<uint32_t> freeBlocks;
+
+   uint32_t firstLevel;                        // bit per first level with a free range
+   uint32_t secondLevel[HEAP_FL_COUNT];        // bit per list with a free range
+   uint32_t freeLists[HEAP_FL_COUNT][HEAP_SL_COUNT];
+
+   struct PendingFree {
+      uint64_t fenceValue;
+      uint32_t handle;
+   };
+   std::vector<PendingFree> pendingFrees;      // in fence order
+   size_t pendingFirst;
+
+   HeapStats stats;           // see HeapGetStats
+};
+
+void HeapAllocatorInit(HeapAllocator *alloc);
+
+// Returns the new block's index, which may be one a removed block had.
+uint32_t HeapAddBlock(HeapAllocator *alloc, uint64_t size);
+
+// The block must have nothing allocated in it.
+void HeapRemoveBlock(HeapAllocator *alloc, uint32_t block);
+
+// Returns a handle to size bytes aligned to alignment, a power of two, or
+// HEAP_INVALID if no block has room; the caller adds one and tries again.
+// Alignments above HEAP_GRANULARITY are met by searching for a range with
+// room to spare and giving back what's in front, so the search stays
+// constant time.
+uint32_t HeapAlloc(HeapAllocator *alloc, uint64_t size, uint64_t alignment, void *user);
+
+void HeapFree(HeapAllocator *alloc, uint32_t handle);
+
+// The allocation is freed once fenceValue has completed.
+void HeapFreeAfter(HeapAllocator *alloc, uint32_t handle, uint64_t fenceValue);
+
+// Frees the allocations retired at or before completedValue.
+void HeapBeginFrame(HeapAllocator *alloc, uint64_t completedValue);
+
+// Allocations are movable from here on, or not.
+void HeapSetMovable(HeapAllocator *alloc, uint32_t handle, bool movable);
+
+static inline const HeapNode *HeapGet(const HeapAllocator *alloc, uint32_t handle)
+{
+   return &alloc->nodes[handle];
+}
+
+// Replaces the user pointer the allocation was made with, e.g. once its
+// owner has settled where it lives.
+static inline void HeapSetUser(HeapAllocator *alloc, uint32_t handle, void *user)
+{
+   alloc->nodes[handle].user = user;
+}
+
+// Plans moving up to maxBytes of allocations out of the emptiest block with
+// nothing but movable ones into the others that have something in them, so
+// it can be removed once its moves are done. Appends them to moves and
+// returns how many there are; none if no block can be emptied.
+uint32_t HeapDefragment(HeapAllocator *alloc, uint64_t maxBytes, std::vector<HeapMove> *moves);
+
+// Counts are kept up to date as the allocator goes; only largestFree is
+// worked out here, from the biggest size class in use.
+void HeapGetStats(const HeapAllocator *alloc, HeapStats *stats);
+
+// Checks every invariant the allocator relies on, walking all of it. For
+// tests; returns false at the first one broken.
+bool HeapValidate(const HeapAllocator *alloc);
+
+// Share of the free space that's outside the biggest free range: 0 when it's
+// all one range, towards 1 as it's scattered in pieces.
+static inline double HeapFragmentation(const HeapStats *stats)
+{
+   uint64_t free = stats->reserved - stats->used;
+   return free > 0 ? 1.0 - (double)stats->largestFree / free : 0.0;
+}
@@ -0,0 +1,312 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Times and fuzzes the GPU heap suballocator (heapalloc.h) on its own:
+//
+//    heapbench [--max N] [--ops N] [--fuzz N]
+//
+// Allocations follow what a renderer places: mostly buffers, 64KB aligned,
+// and small textures, 4KB aligned, from 4KB to 4MB, with the odd 4MB aligned
+// multisampled target, in 64MB blocks. For 1K to --max live allocations, the
+// heap is filled, churned by --ops random frees and allocations, has half of
+// what's in it freed and is then defragmented until no block can be emptied.
+// Allocation and free times should stay flat however much is live.
+//
+// --fuzz N instead runs N random operations, every kind the allocator has,
+// against small blocks so ranges split and merge all the time, and checks
+// every invariant after each one, and that no two allocations overlap.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common.h"
+#include "heapalloc.h"
+#include "profiler.h"
+
+#define BLOCK_SIZE        (64ull << 20)
+#define FUZZ_BLOCK_SIZE   (256ull << 10)
+#define DEFRAG_BUDGET     (16ull << 20)    // bytes moved per HeapDefragment, like a frame's worth
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--max N] [--ops N] [--fuzz N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static float random01(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint64_t randomSize(uint32_t *seed, uint64_t maxSize, uint64_t *alignment)
+{
+   float kind = random01(seed);
+   *alignment = kind < 0.6f ? 65536 : kind < 0.98f ? 4096 : 4 << 20;
+   return 1 + (uint64_t)(HEAP_GRANULARITY * pow((double)maxSize / HEAP_GRANULARITY, random01(seed)));
+}
+
+static uint32_t allocOrGrow(HeapAllocator *alloc, uint64_t blockSize, uint64_t size, uint64_t alignment)
+{
+   uint32_t handle = HeapAlloc(alloc, size, alignment, nullptr);
+   if (handle == HEAP_INVALID) {
+      // Offset 0 suits any alignment, so the worst case is the size itself.
+      uint64_t needed = (size + HEAP_GRANULARITY - 1) & ~(uint64_t)(HEAP_GRANULARITY - 1);
+      HeapAddBlock(alloc, needed > blockSize ? needed : blockSize);
+      handle = HeapAlloc(alloc, size, alignment, nullptr);
+      ASSERT(handle != HEAP_INVALID);
+   }
+   return handle;
+}
+
+static void removeEmptyBlocks(HeapAllocator *alloc)
+{
+   for (uint32_t i = 0; i < (uint32_t)alloc->blocks.size(); ++i) {
+      if (alloc->blocks[i].size > 0 && alloc->blocks[i].allocations == 0) {
+         HeapRemoveBlock(alloc, i);
+      }
+   }
+}
+
+static void freeRandom(HeapAllocator *alloc, std::vector<uint32_t> *live, uint32_t *seed)
+{
+   size_t i = (size_t)(random01(seed) * live->size()) % live->size();
+   HeapFree(alloc, (*live)[i]);
+   (*live)[i] = live->back();
+   live->pop_back();
+}
+
+static double nanosecondsSince(int64_t start, uint64_t count)
+{
+   return count > 0 ? (double)(ProfilerNow() - start) / count : 0.0;
+}
+
+static bool noOverlaps(const HeapAllocator *alloc, const std::vector<uint32_t> &live)
+{
+   std::vector<uint32_t> sorted = live;
+   std::sort(sorted.begin(), sorted.end(), [alloc](uint32_t a, uint32_t b) {
+      const HeapNode *nodeA = HeapGet(alloc, a), *nodeB = HeapGet(alloc, b);
+      return nodeA->block != nodeB->block ? nodeA->block < nodeB->block : nodeA->offset < nodeB->offset;
+   });
+   for (size_t i = 1; i < sorted.size(); ++i) {
+      const HeapNode *prev = HeapGet(alloc, sorted[i - 1]), *node = HeapGet(alloc, sorted[i]);
+      if (prev->block == node->block && prev->offset + prev->size > node->offset) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static int fuzz(uint32_t ops)
+{
+   HeapAllocator alloc;
+   HeapAllocatorInit(&alloc);
+   std::vector<uint32_t> live;
+   std::vector<HeapMove> moves;
+   uint64_t frame = 0, completed = 0;
+   uint32_t seed = 1;
+
+   for (uint32_t op = 0; op < ops; ++op) {
+      float what = random01(&seed);
+      if (what < 0.45f || live.empty()) {
+         // Now and then one too big for a block, which gets one of its own.
+         uint64_t alignment;
+         uint64_t size = randomSize(&seed, 64 << 10, &alignment);
+         if (alignment > FUZZ_BLOCK_SIZE / 4) {
+            alignment = FUZZ_BLOCK_SIZE / 4;
+         }
+         if (random01(&seed) < 0.02f) {
+            size += FUZZ_BLOCK_SIZE;
+         }
+         uint32_t handle = allocOrGrow(&alloc, FUZZ_BLOCK_SIZE, size, alignment);
+         if (random01(&seed) < 0.5f) {
+            HeapSetMovable(&alloc, handle, true);
+         }
+         live.push_back(handle);
+      } else if (what < 0.8f) {
+         freeRandom(&alloc, &live, &seed);
+      } else if (what < 0.9f) {
+         // Retired now, freed a couple of frames later.
+         size_t i = (size_t)(random01(&seed) * live.size()) % live.size();
+         HeapFreeAfter(&alloc, live[i], frame);
+         live[i] = live.back();
+         live.pop_back();
+      } else if (what < 0.95f) {
+         ++frame;
+         completed = frame > 2 ? frame - 2 : 0;
+         HeapBeginFrame(&alloc, completed);
+         removeEmptyBlocks(&alloc);
+      } else {
+         moves.clear();
+         HeapDefragment(&alloc, (uint64_t)(random01(&seed) * 4 * FUZZ_BLOCK_SIZE), &moves);
+         for (const HeapMove &move : moves) {
+            if (!(HeapGet(&alloc, move.allocation)->flags & HEAP_NODE_MOVABLE) ||
+               HeapGet(&alloc, move.allocation)->block == HeapGet(&alloc, move.retired)->block) {
+               fprintf(stderr, "op %u: bad move\n", op);
+               return 1;
+            }
+            HeapFreeAfter(&alloc, move.retired, frame);
+         }
+      }
+
+      if (!HeapValidate(&alloc)) {
+         fprintf(stderr, "op %u: allocator is inconsistent\n", op);
+         return 1;
+      }
+      if (op % 64 == 0 && !noOverlaps(&alloc, live)) {
+         fprintf(stderr, "op %u: allocations overlap\n", op);
+         return 1;
+      }
+   }
+
+   for (uint32_t handle : live) {
+      HeapFree(&alloc, handle);
+   }
+   HeapBeginFrame(&alloc, UINT64_MAX);
+   removeEmptyBlocks(&alloc);
+   if (!HeapValidate(&alloc) || alloc.stats.reserved != 0) {
+      fprintf(stderr, "blocks left over after freeing everything\n");
+      return 1;
+   }
+
+   HeapStats stats;
+   HeapGetStats(&alloc, &stats);
+   printf("%u operations, %llu moves, no errors\n", ops, (unsigned long long)stats.moves);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t maxLive = 100000, ops = 1000000, fuzzOps = 0;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--max") == 0) {
+         maxLive = value;
+      } else if (strcmp(argv[i], "--ops") == 0) {
+         ops = value;
+      } else if (strcmp(argv[i], "--fuzz") == 0 && value > 0) {
+         fuzzOps = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+   if (fuzzOps > 0) {
+      return fuzz(fuzzOps);
+   }
+
+   printf("ns per allocation while filling, per free while emptying and per churn operation; blocks and MB\n");
+   printf("after churn, then blocks and fragmentation after freeing half and after defragmenting\n");
+   printf("%8s %8s %8s %8s %8s %12s %12s %12s %10s %10s\n",
+      "live", "fill", "free", "churn", "blocks", "used MB", "half frag", "defrag", "moved MB", "ms");
+
+   uint32_t seed = 1;
+   for (uint32_t count = 1000; count <= maxLive; count *= 10) {
+      HeapAllocator alloc;
+      HeapAllocatorInit(&alloc);
+      std::vector<uint32_t> live;
+      live.reserve(count);
+
+      // Made up front, so the timings are the allocator's alone.
+      uint32_t requestCount = count + ops / 2;
+      std::vector<uint64_t> sizes(requestCount), alignments(requestCount);
+      for (uint32_t i = 0; i < requestCount; ++i) {
+         sizes[i] = randomSize(&seed, 4 << 20, &alignments[i]);
+      }
+
+      int64_t start = ProfilerNow();
+      for (uint32_t i = 0; i < count; ++i) {
+         live.push_back(allocOrGrow(&alloc, BLOCK_SIZE, sizes[i], alignments[i]));
+      }
+      double allocNs = nanosecondsSince(start, count);
+
+      // Half frees, half allocations, around the same live count.
+      start = ProfilerNow();
+      for (uint32_t op = 0; op < ops; ++op) {
+         if (op & 1) {
+            uint32_t i = count + op / 2;
+            live.push_back(allocOrGrow(&alloc, BLOCK_SIZE, sizes[i], alignments[i]));
+         } else {
+            freeRandom(&alloc, &live, &seed);
+         }
+      }
+      double churnNs = nanosecondsSince(start, ops);
+      HeapStats churned;
+      HeapGetStats(&alloc, &churned);
+
+      for (uint32_t i = 0; i < count / 2; ++i) {
+         freeRandom(&alloc, &live, &seed);
+      }
+      removeEmptyBlocks(&alloc);
+      HeapStats half;
+      HeapGetStats(&alloc, &half);
+
+      // Everything is movable; copies are assumed done at once.
+      for (uint32_t handle : live) {
+         HeapSetMovable(&alloc, handle, true);
+      }
+      std::vector<HeapMove> moves;
+      start = ProfilerNow();
+      while (HeapDefragment(&alloc, DEFRAG_BUDGET, &moves) > 0) {
+         for (const HeapMove &move : moves) {
+            HeapFree(&alloc, move.retired);
+         }
+         moves.clear();
+         removeEmptyBlocks(&alloc);
+      }
+      double defragMs = (ProfilerNow() - start) * 1e-6;
+      HeapStats defragged;
+      HeapGetStats(&alloc, &defragged);
+
+      start = ProfilerNow();
+      uint32_t freed = (uint32_t)live.size();
+      for (uint32_t handle : live) {
+         HeapFree(&alloc, handle);
+      }
+      double freeNs = nanosecondsSince(start, freed);
+      removeEmptyBlocks(&alloc);
+      if (!HeapValidate(&alloc) || alloc.stats.reserved != 0) {
+         fprintf(stderr, "%u live: allocator is inconsistent\n", count);
+         return 1;
+      }
+
+      char blocks[32], used[32], frag[32], defrag[32];
+      snprintf(blocks, sizeof(blocks), "%u", churned.blocks);
+      snprintf(used, sizeof(used), "%.0f/%.0f", churned.used / 1048576.0, churned.reserved / 1048576.0);
+      snprintf(frag, sizeof(frag), "%u, %.0f%%", half.blocks, HeapFragmentation(&half) * 100.0);
+      snprintf(defrag, sizeof(defrag), "%u, %.0f%%", defragged.blocks, HeapFragmentation(&defragged) * 100.0);
+      printf("%8u %8.0f %8.0f %8.0f %8s %12s %12s %12s %10.0f %10.3f\n", count, allocNs, freeNs, churnNs,
+         blocks, used, frag, defrag, defragged.movedBytes / 1048576.0, defragMs);
+   }
+   return 0;
+}
@@ -0,0 +1,203 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <math.h>
+
+#include <algorithm>
+
+#include "common.h"
+#include "hierarchy.h"
+#include "jobs.h"
+
+void HierarchyClear(Hierarchy *hierarchy)
+{
+   hierarchy->parent.clear();
+   hierarchy->subtreeEnd.clear();
+   hierarchy->local.clear();
+   hierarchy->world.clear();
+   hierarchy->dirty.clear();
+   hierarchy->dirtyNodes.clear();
+   hierarchy->changed.clear();
+   hierarchy->changedNodes = 0;
+}
+
+uint32_t HierarchyAddNode(Hierarchy *hierarchy, uint32_t parent, const HierarchyTransform *local)
+{
+   uint32_t node = (uint32_t)hierarchy->parent.size();
+
+   // The parent's subtree has to end where the new node goes, which is only
+   // true of the last node and its ancestors. All of them grow by one.
+   ASSERT(parent == HIERARCHY_NONE || (parent < node && hierarchy->subtreeEnd[parent] == node));
+   for (uint32_t ancestor = parent; ancestor != HIERARCHY_NONE; ancestor = hierarchy->parent[ancestor]) {
+      hierarchy->subtreeEnd[ancestor] = node + 1;
+   }
+
+   hierarchy->parent.push_back(parent);
+   hierarchy->subtreeEnd.push_back(node + 1);
+   hierarchy->local.push_back(*local);
+   hierarchy->world.emplace_back();
+   hierarchy->dirty.push_back(1);
+   hierarchy->dirtyNodes.push_back(node);
+   return node;
+}
+
+void HierarchySetLocal(Hierarchy *hierarchy, uint32_t node, const HierarchyTransform *local)
+{
+   ASSERT(node < hierarchy->local.size());
+
+   hierarchy->local[node] = *local;
+   if (!hierarchy->dirty[node]) {
+      hierarchy->dirty[node] = 1;
+      hierarchy->dirtyNodes.push_back(node);
+   }
+}
+
+// Parents come first in the range, so theirs are always up to date.
+static void updateRange(Hierarchy *hierarchy, uint32_t first, uint32_t end)
+{
+   const uint32_t *parents = hierarchy->parent.data();
+   const HierarchyTransform *locals = hierarchy->local.data();
+   Mat4 *worlds = hierarchy->world.data();
+   uint8_t *dirty = hierarchy->dirty.data();
+
+   for (uint32_t i = first; i < end; ++i) {
+      const HierarchyTransform *local = &locals[i];
+      float sn = sinf(local->rotY) * local->scale;
+      float cs = cosf(local->rotY) * local->scale;
+
+      // Columns of worldFromLocal relative to the parent.
+      Vec4 c0 = { cs, 0.0f, sn, 0.0f };
+      Vec4 c1 = { 0.0f, local->scale, 0.0f, 0.0f };
+      Vec4 c2 = { -sn, 0.0f, cs, 0.0f };
+      Vec4 c3 = { local->posX, local->posY, local->posZ, 1.0f };
+
+      Mat4 *world = &worlds[i];
+      if (parents[i] == HIERARCHY_NONE) {
+         world->m[0] = c0;
+         world->m[1] = c1;
+         world->m[2] = c2;
+         world->m[3] = c3;
+      } else {
+         const Mat4 *parent = &worlds[parents[i]];
+         vm4Store(&world->m[0], mat4MulVm4(parent, vm4Load(&c0)));
+         vm4Store(&world->m[1], mat4MulVm4(parent, vm4Load(&c1)));
+         vm4Store(&world->m[2], mat4MulVm4(parent, vm4Load(&c2)));
+         vm4Store(&world->m[3], mat4MulVm4(parent, vm4Load(&c3)));
+      }
+      dirty[i] = 0;
+   }
+}
+
+static void updateJob(void *data, uint32_t job)
+{
+   Hierarchy *hierarchy = (Hierarchy *)data;
+   uint32_t first = hierarchy->jobStarts[job];
+   uint32_t end = hierarchy->jobStarts[job + 1];
+   for (uint32_t i = first; i < end; ++i) {
+      updateRange(hierarchy, hierarchy->jobRanges[i].first, hierarchy->jobRanges[i].end);
+   }
+}
+
+// Cuts the changed runs into pieces that can be updated independently and
+// groups them into jobs of about HIERARCHY_JOB_NODES nodes. A run can be cut
+// in front of any node whose parent is outside it: that node starts a
+// subtree of its own, and nothing after it hangs off anything before it.
+static uint32_t splitJobs(Hierarchy *hierarchy)
+{
+   std::vector<HierarchyRange> *pieces = &hierarchy->jobRanges;
+   std::vector<uint32_t> *jobStarts = &hierarchy->jobStarts;
+   pieces->clear();
+   jobStarts->clear();
+   jobStarts->push_back(0);
+
+   const uint32_t *parents = hierarchy->parent.data();
+   uint32_t jobNodes = 0;
+   for (size_t i = 0; i < hierarchy->changed.size(); ++i) {
+      HierarchyRange run = hierarchy->changed[i];
+      while (run.first < run.end) {
+         uint32_t cut = run.end;
+         if (run.end - run.first > HIERARCHY_JOB_NODES - jobNodes) {
+            cut = run.first + (HIERARCHY_JOB_NODES - jobNodes);
+            while (cut < run.end && parents[cut] != HIERARCHY_NONE && parents[cut] >= run.first) {
+               ++cut;
+            }
+         }
+
+         HierarchyRange piece = { run.first, cut };
+         pieces->push_back(piece);
+         jobNodes += cut - run.first;
+         if (jobNodes >= HIERARCHY_JOB_NODES) {
+            jobStarts->push_back((uint32_t)pieces->size());
+            jobNodes = 0;
+         }
+         run.first = cut;
+      }
+   }
+   if (jobStarts->back() != pieces->size()) {
+      jobStarts->push_back((uint32_t)pieces->size());
+   }
+   return (uint32_t)jobStarts->size() - 1;
+}
+
+uint32_t HierarchyUpdate(Hierarchy *hierarchy)
+{
+   std::vector<uint32_t> *dirtyNodes = &hierarchy->dirtyNodes;
+   std::vector<HierarchyRange> *changed = &hierarchy->changed;
+   changed->clear();
+   hierarchy->changedNodes = 0;
+
+   // In index order, every dirty node either starts a subtree to update or
+   // lies inside the last one, which takes care of it. Subtrees that follow
+   // one another make one run: a forward pass over it still meets every
+   // parent before its children, and any parent outside it is clean.
+   if (!std::is_sorted(dirtyNodes->begin(), dirtyNodes->end())) {
+      std::sort(dirtyNodes->begin(), dirtyNodes->end());
+   }
+   uint32_t coveredEnd = 0;
+   for (size_t i = 0; i < dirtyNodes->size(); ++i) {
+      uint32_t node = (*dirtyNodes)[i];
+      if (node < coveredEnd) {
+         continue;
+      }
+      uint32_t end = hierarchy->subtreeEnd[node];
+      if (!changed->empty() && changed->back().end == node) {
+         changed->back().end = end;
+      } else {
+         HierarchyRange run = { node, end };
+         changed->push_back(run);
+      }
+      hierarchy->changedNodes += end - node;
+      coveredEnd = end;
+   }
+   dirtyNodes->clear();
+
+   if (hierarchy->changedNodes < 2 * HIERARCHY_JOB_NODES || JobThreadCount() == 1) {
+      for (size_t i = 0; i < changed->size(); ++i) {
+         updateRange(hierarchy, (*changed)[i].first, (*changed)[i].end);
+      }
+   } else {
+      JobParallelFor(updateJob, hierarchy, splitJobs(hierarchy));
+   }
+   return hierarchy->changedNodes;
+}
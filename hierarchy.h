@@ -0,0 +1,87 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "vecmath.h"
+
+// A transform hierarchy kept in flat arrays, nodes in depth-first order: a
+// parent always comes before its children and every subtree is one
+// contiguous run of nodes, so a world matrix can be recomputed from its
+// parent's in a single forward pass over the run.
+//
+// Setting a node's local transform marks it dirty. HierarchyUpdate then
+// recomputes only the dirty subtrees and reports which nodes it touched, so
+// a frame in which little moves costs little, however big the hierarchy is.
+
+#define HIERARCHY_NONE        0xffffffffu // no parent
+#define HIERARCHY_JOB_NODES   4096        // about this many nodes per update job
+
+// Uniformly scaled, rotated about Y and then translated, like TransformBatch.
+struct HierarchyTransform {
+   float posX, posY, posZ;
+   float rotY;                // in radians
+   float scale;
+};
+
+// Nodes [first, end).
+struct HierarchyRange {
+   uint32_t first;
+   uint32_t end;
+};
+
+struct Hierarchy {
+   std::vector<uint32_t> parent;       // HIERARCHY_NONE, or an earlier node
+   std::vector<uint32_t> subtreeEnd;   // one past the node's last descendant
+   std::vector<HierarchyTransform> local;
+   std::vector<Mat4> world;            // worldFromLocal as of the last update
+   std::vector<uint8_t> dirty;
+   std::vector<uint32_t> dirtyNodes;   // set since the last update, in no order
+
+   // What the last update recomputed, as sorted runs with gaps between them.
+   std::vector<HierarchyRange> changed;
+   uint32_t changedNodes;
+
+   // Scratch for spreading an update across jobs: changed, cut into pieces,
+   // and where each job's share of them starts.
+   std::vector<HierarchyRange> jobRanges;
+   std::vector<uint32_t> jobStarts;
+};
+
+void HierarchyClear(Hierarchy *hierarchy);
+
+// Appends a node and returns its index. Nodes must be added depth first: the
+// parent has to be HIERARCHY_NONE, the last node added, or an ancestor of it.
+// New nodes are dirty.
+uint32_t HierarchyAddNode(Hierarchy *hierarchy, uint32_t parent, const HierarchyTransform *local);
+
+void HierarchySetLocal(Hierarchy *hierarchy, uint32_t node, const HierarchyTransform *local);
+
+// Recomputes the world matrix of every dirty node and all of their
+// descendants, and leaves the nodes it did in hierarchy->changed. Returns how
+// many there were. Separate subtrees are spread across the job system.
+uint32_t HierarchyUpdate(Hierarchy *hierarchy);
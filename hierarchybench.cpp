@@ -0,0 +1,188 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Times transform hierarchy updates (hierarchy.h) over scenes of 10K to 1M
+// nodes:
+//
+//    hierarchybench [--workers N] [--max N] [--frames N]
+//
+// Each scene is a forest of small trees, a few levels deep, like props
+// grouped under the things they sit on. Every frame a fraction of the nodes
+// is moved, with everything under them, and the hierarchy updated; the cost
+// should follow what moved rather than the size of the scene. A full
+// recompute, i.e. every node moving, is the baseline, and the incremental
+// results are checked against it.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "common.h"
+#include "hierarchy.h"
+#include "jobs.h"
+#include "profiler.h"
+
+#define PI              3.14159265f
+#define MAX_CHILDREN    8        // per node, picked at random
+#define MAX_DEPTH       4        // below each root
+
+static const uint32_t s_movedPer100K[] = { 10, 100, 1000, 10000 };   // i.e. 0.01% to 10%
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--workers N] [--max N] [--frames N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static float random01(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static void randomTransform(HierarchyTransform *local, uint32_t *seed)
+{
+   local->posX = (random01(seed) - 0.5f) * 10.0f;
+   local->posY = random01(seed);
+   local->posZ = (random01(seed) - 0.5f) * 10.0f;
+   local->rotY = random01(seed) * 2.0f * PI;
+   local->scale = 0.5f + random01(seed);
+}
+
+// Depth first, as the hierarchy needs.
+static void addSubtree(Hierarchy *hierarchy, uint32_t parent, uint32_t depth, uint32_t count, uint32_t *seed)
+{
+   HierarchyTransform local;
+   randomTransform(&local, seed);
+   uint32_t node = HierarchyAddNode(hierarchy, parent, &local);
+
+   uint32_t children = depth < MAX_DEPTH ? (uint32_t)(random01(seed) * (MAX_CHILDREN + 1)) : 0;
+   for (uint32_t i = 0; i < children && hierarchy->parent.size() < count; ++i) {
+      addSubtree(hierarchy, node, depth + 1, count, seed);
+   }
+}
+
+static void makeScene(Hierarchy *hierarchy, uint32_t count, uint32_t *seed)
+{
+   HierarchyClear(hierarchy);
+   while (hierarchy->parent.size() < count) {
+      addSubtree(hierarchy, HIERARCHY_NONE, 0, count, seed);
+   }
+   HierarchyUpdate(hierarchy);
+}
+
+static double millisecondsSince(int64_t start)
+{
+   return (ProfilerNow() - start) * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t workers = 0, maxNodes = 1000000, frames = 16;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--workers") == 0) {
+         workers = value;
+      } else if (strcmp(argv[i], "--max") == 0) {
+         maxNodes = value;
+      } else if (strcmp(argv[i], "--frames") == 0 && value > 0) {
+         frames = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   JobSystemInit(workers);
+   printf("%u threads, mean ms per frame over %u frames; nodes updated in brackets\n", JobThreadCount(), frames);
+   printf("%10s %10s", "nodes", "full");
+   for (uint32_t i = 0; i < ARRAY_COUNT(s_movedPer100K); ++i) {
+      char header[32];
+      snprintf(header, sizeof(header), "%g%% moved", s_movedPer100K[i] / 1000.0);
+      printf(" %20s", header);
+   }
+   printf("\n");
+
+   uint32_t seed = 1;
+   for (uint32_t count = 10000; count <= maxNodes; count *= 10) {
+      Hierarchy hierarchy, check;
+      makeScene(&hierarchy, count, &seed);
+
+      // Every root dirty recomputes everything.
+      double fullMs = 0.0;
+      for (uint32_t frame = 0; frame < frames; ++frame) {
+         for (uint32_t node = 0; node < count; node = hierarchy.subtreeEnd[node]) {
+            HierarchySetLocal(&hierarchy, node, &hierarchy.local[node]);
+         }
+         int64_t start = ProfilerNow();
+         HierarchyUpdate(&hierarchy);
+         fullMs += millisecondsSince(start);
+      }
+      printf("%10u %10.3f", count, fullMs / frames);
+
+      for (uint32_t i = 0; i < ARRAY_COUNT(s_movedPer100K); ++i) {
+         uint32_t moved = (uint32_t)((uint64_t)count * s_movedPer100K[i] / 100000);
+         double updateMs = 0.0;
+         uint64_t updated = 0;
+         for (uint32_t frame = 0; frame < frames; ++frame) {
+            for (uint32_t j = 0; j < moved; ++j) {
+               uint32_t node = (uint32_t)(random01(&seed) * count) % count;
+               HierarchyTransform local = hierarchy.local[node];
+               local.rotY += 0.1f;
+               HierarchySetLocal(&hierarchy, node, &local);
+            }
+            int64_t start = ProfilerNow();
+            updated += HierarchyUpdate(&hierarchy);
+            updateMs += millisecondsSince(start);
+         }
+
+         char cell[32];
+         snprintf(cell, sizeof(cell), "%.3f (%.0f)", updateMs / frames, (double)updated / frames);
+         printf(" %20s", cell);
+      }
+      printf("\n");
+
+      // The same transforms from scratch have to give the same matrices.
+      check = hierarchy;
+      for (uint32_t node = 0; node < count; node = check.subtreeEnd[node]) {
+         HierarchySetLocal(&check, node, &check.local[node]);
+      }
+      HierarchyUpdate(&check);
+      if (memcmp(check.world.data(), hierarchy.world.data(), count * sizeof(Mat4)) != 0) {
+         fprintf(stderr, "%u nodes: incremental updates don't match a full recompute\n", count);
+         JobSystemShutdown();
+         return 1;
+      }
+   }
+
+   JobSystemShutdown();
+   return 0;
+}
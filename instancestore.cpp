@@ -0,0 +1,102 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "instancestore.h"
+#include "barriers.h"
+#include "descriptors.h"
+#include "gpumemory.h"
+
+bool ResizeInstanceStore(Dx12InstanceStore *store, Dx12Device *device, UINT64 size)
+{
+   if (store->buffer.resource && store->size >= size) {
+      return true;
+   }
+
+   D3D12_RESOURCE_DESC desc = {};
+   desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+   desc.Width = size;
+   desc.Height = 1;
+   desc.DepthOrArraySize = 1;
+   desc.MipLevels = 1;
+   desc.Format = DXGI_FORMAT_UNKNOWN;
+   desc.SampleDesc.Count = 1;
+   desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+   // Frames hold on to its address, so it never moves.
+   Dx12Allocation buffer;
+   uint32_t view;
+   if (!AllocResource(device, D3D12_HEAP_TYPE_DEFAULT, &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, &buffer)) {
+      return false;
+   }
+   if (!AddBindlessBuffer(device, buffer.resource.Get(), &view)) {
+      FreeResource(device, &buffer);
+      return false;
+   }
+
+   if (store->buffer.resource) {
+      StateTrackerRemove(&device->states, store->state);
+      RemoveBindlessBuffer(device, &store->view);
+   }
+   FreeResource(device, &store->buffer);
+   store->buffer = std::move(buffer);
+   store->size = size;
+   store->view = view;
+   store->state = StateTrackerAdd(&device->states, 1, STATE_COMMON, STATE_DECAYS, store->buffer.resource.Get());
+   return true;
+}
+
+void DestroyInstanceStore(Dx12InstanceStore *store, Dx12Device *device)
+{
+   if (store->buffer.resource) {
+      StateTrackerRemove(&device->states, store->state);
+      RemoveBindlessBuffer(device, &store->view);
+   }
+   FreeResource(device, &store->buffer);
+   store->size = 0;
+}
+
+void CmdUpdateInstanceStore(ID3D12GraphicsCommandList *commandList, StateList *states, Dx12InstanceStore *store,
+   ID3D12Resource *src, UINT64 srcOffset, const RenderStoreCopy *copies, uint32_t count)
+{
+   if (count == 0) {
+      return;
+   }
+
+   // Usually the store is in COMMON, from which the first copy promotes it.
+   StateListTransition(states, store->state, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   CmdFlushBarriers(commandList, states);
+
+   ID3D12Resource *buffer = store->buffer.resource.Get();
+   for (uint32_t i = 0; i < count; ++i) {
+      const RenderStoreCopy *copy = &copies[i];
+      ASSERT(copy->dstOffset + copy->size <= store->size);
+      commandList->CopyBufferRegion(buffer, copy->dstOffset, src, srcOffset + copy->srcOffset, copy->size);
+   }
+
+   // Draws can't promote it out of COPY_DEST. The transition is begun here
+   // and ended by the first one bound to the store, so the GPU can overlap
+   // it with whatever is recorded in between.
+   StateListBeginSplit(states, store->state, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   CmdFlushBarriers(commandList, states);
+}
@@ -0,0 +1,41 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "dx12demo.h"
+#include "render.h"
+#include "statetrack.h"
+
+// Replaces the store with one of at least size bytes, unless it's already
+// that big. The old buffer goes to the deferred-release queue, so frames in
+// flight can keep drawing from it.
+bool ResizeInstanceStore(Dx12InstanceStore *store, Dx12Device *device, UINT64 size);
+void DestroyInstanceStore(Dx12InstanceStore *store, Dx12Device *device);
+
+// Copies ranges of src, starting at srcOffset, into the store and begins its
+// transition to NON_PIXEL_SHADER_RESOURCE, which the next transition of the
+// store in states ends.
+void CmdUpdateInstanceStore(ID3D12GraphicsCommandList *commandList, StateList *states, Dx12InstanceStore *store,
+   ID3D12Resource *src, UINT64 srcOffset, const RenderStoreCopy *copies, uint32_t count);
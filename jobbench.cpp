@@ -0,0 +1,333 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks and times the job system (jobs.h):
+//
+//    jobbench [--workers N] [--max N]
+//
+// First checks that every job runs exactly once when jobs wait on jobs they
+// spawned, several levels deep; when several threads that aren't workers
+// submit and wait at once, stealing from each other and the workers; and
+// when one thread runs more batches than its batch ring has room for before
+// waiting, while the oldest are still queued or running. Then times
+// spawning and running 1K to --max jobs of a few sizes, against running the
+// same work in a plain loop on one thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+#include "jobs.h"
+#include "profiler.h"
+
+#define NEST_DEPTH      4
+#define NEST_FANOUT     8
+#define SUBMITTERS      4        // threads besides the workers submitting at once
+#define SUBMIT_ROUNDS   200
+
+static const uint32_t s_workPerJob[] = { 0, 100, 1000 };   // iterations of spin()
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--workers N] [--max N]\n", program);
+}
+
+static double millisecondsSince(int64_t start)
+{
+   return (ProfilerNow() - start) * 1e-6;
+}
+
+// Busy work the compiler can't drop.
+static uint32_t spin(uint32_t iterations, uint32_t seed)
+{
+   for (uint32_t i = 0; i < iterations; ++i) {
+      seed = seed * 1664525u + 1013904223u;
+   }
+   return seed;
+}
+
+// Each job below the top spawns NEST_FANOUT more and waits for them, so
+// workers end up waiting inside jobs on work other threads have stolen.
+struct NestData {
+   std::atomic<uint32_t> *hits;   // one per leaf
+   uint32_t depth;
+   uint32_t first;                // first leaf under this level
+   uint32_t round;                // hits each leaf has once this round's done
+};
+
+static void nestJob(void *data, uint32_t index)
+{
+   const NestData *parent = (const NestData *)data;
+   uint32_t leaves = 1;
+   for (uint32_t i = parent->depth + 1; i < NEST_DEPTH; ++i) {
+      leaves *= NEST_FANOUT;
+   }
+
+   NestData child;
+   child.hits = parent->hits;
+   child.depth = parent->depth + 1;
+   child.first = parent->first + index * leaves;
+   child.round = parent->round;
+   if (child.depth == NEST_DEPTH) {
+      parent->hits[child.first].fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+
+   JobCounter counter;
+   JobRun(nestJob, &child, NEST_FANOUT, &counter);
+   spin(100, index);
+   JobWait(&counter);
+
+   // Everything under this one has to be done once the wait returns.
+   for (uint32_t i = 0; i < leaves; ++i) {
+      if (child.hits[child.first + i].load(std::memory_order_relaxed) != child.round) {
+         fprintf(stderr, "nested: leaf %u not done when its parent's wait returned\n", child.first + i);
+         abort();
+      }
+   }
+}
+
+static bool checkNested()
+{
+   uint32_t leaves = 1;
+   for (uint32_t i = 0; i < NEST_DEPTH; ++i) {
+      leaves *= NEST_FANOUT;
+   }
+   std::vector<std::atomic<uint32_t>> hits(leaves);
+   for (std::atomic<uint32_t> &hit : hits) {
+      hit.store(0);
+   }
+
+   for (uint32_t round = 0; round < 20; ++round) {
+      NestData top;
+      top.hits = hits.data();
+      top.depth = 0;
+      top.first = 0;
+      top.round = round + 1;
+      JobParallelFor(nestJob, &top, NEST_FANOUT);
+      for (uint32_t i = 0; i < leaves; ++i) {
+         if (hits[i].load() != round + 1) {
+            fprintf(stderr, "nested: leaf %u ran %u times in %u rounds\n", i, hits[i].load(), round + 1);
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+// Records which thread ran each job, so the check can tell it was shared.
+struct CountData {
+   std::atomic<uint32_t> *hits;
+   uint32_t thread;
+   std::atomic<uint32_t> *foreign;   // jobs run by a thread other than the submitter
+};
+
+static thread_local uint32_t t_threadId;
+
+static void countJob(void *data, uint32_t index)
+{
+   const CountData *count = (const CountData *)data;
+   count->hits[index].fetch_add(1, std::memory_order_relaxed);
+   if (t_threadId != count->thread) {
+      count->foreign->fetch_add(1, std::memory_order_relaxed);
+   }
+   spin(200, index);
+}
+
+static bool checkContention(uint32_t jobsPerRound)
+{
+   std::vector<std::atomic<uint32_t>> hits(SUBMITTERS * jobsPerRound);
+   for (std::atomic<uint32_t> &hit : hits) {
+      hit.store(0);
+   }
+   std::atomic<uint32_t> foreign(0);
+
+   std::thread submitters[SUBMITTERS];
+   for (uint32_t t = 0; t < SUBMITTERS; ++t) {
+      submitters[t] = std::thread([&, t]() {
+         t_threadId = t + 1;
+         CountData count;
+         count.hits = &hits[t * jobsPerRound];
+         count.thread = t_threadId;
+         count.foreign = &foreign;
+         for (uint32_t round = 0; round < SUBMIT_ROUNDS; ++round) {
+            JobParallelFor(countJob, &count, jobsPerRound);
+         }
+      });
+   }
+   for (uint32_t t = 0; t < SUBMITTERS; ++t) {
+      submitters[t].join();
+   }
+
+   for (uint32_t i = 0; i < (uint32_t)hits.size(); ++i) {
+      if (hits[i].load() != SUBMIT_ROUNDS) {
+         fprintf(stderr, "contention: job %u of submitter %u ran %u times in %u rounds\n", i % jobsPerRound,
+            i / jobsPerRound, hits[i].load(), SUBMIT_ROUNDS);
+         return false;
+      }
+   }
+   printf("contention: %u threads submitting, %.1f%% of jobs run by another thread\n", SUBMITTERS,
+      100.0 * foreign.load() / (SUBMITTERS * jobsPerRound * SUBMIT_ROUNDS));
+   return true;
+}
+
+// One JobRun per call, more of them than the thread's batch ring holds, all
+// waited on together at the end. The first ring's worth hold their thread
+// until the ring has been gone round, so batches are reused while jobs of
+// the ones they replace are still queued or running.
+struct RingData {
+   std::atomic<uint32_t> *hits;
+   std::atomic<uint32_t> *issued;
+   uint32_t call;
+};
+
+static void ringJob(void *data, uint32_t index)
+{
+   const RingData *ring = (const RingData *)data;
+   ASSERT(index == 0);
+   if (ring->call < JOB_DEQUE_SIZE) {
+      while (ring->issued->load(std::memory_order_acquire) <= JOB_DEQUE_SIZE) {
+         std::this_thread::yield();
+      }
+   }
+   ring->hits[ring->call].fetch_add(1, std::memory_order_relaxed);
+}
+
+static bool checkBatchRing()
+{
+   const uint32_t calls = 3 * JOB_DEQUE_SIZE;
+   std::vector<std::atomic<uint32_t>> hits(calls);
+   std::vector<RingData> data(calls);
+   std::atomic<uint32_t> issued(0);
+   for (uint32_t i = 0; i < calls; ++i) {
+      hits[i].store(0);
+      data[i].hits = hits.data();
+      data[i].issued = &issued;
+      data[i].call = i;
+   }
+
+   JobCounter counter;
+   for (uint32_t i = 0; i < calls; ++i) {
+      issued.fetch_add(1, std::memory_order_release);
+      JobRun(ringJob, &data[i], 1, &counter);
+   }
+   JobWait(&counter);
+
+   for (uint32_t i = 0; i < calls; ++i) {
+      if (hits[i].load() != 1) {
+         fprintf(stderr, "batch ring: call %u's job ran %u times\n", i, hits[i].load());
+         return false;
+      }
+   }
+   return true;
+}
+
+struct SpinData {
+   uint32_t work;
+   uint32_t *results;
+};
+
+static void spinJob(void *data, uint32_t index)
+{
+   const SpinData *spinData = (const SpinData *)data;
+   spinData->results[index] = spin(spinData->work, index);
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t workers = 0, maxJobs = 1000000;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--workers") == 0) {
+         workers = value;
+      } else if (strcmp(argv[i], "--max") == 0 && value >= 1000) {
+         maxJobs = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   JobSystemInit(workers);
+   if (!checkNested() || !checkContention(256) || !checkBatchRing()) {
+      JobSystemShutdown();
+      return 1;
+   }
+
+   // Each size of job is run once as a plain loop, then as jobs; the jobs'
+   // time includes spawning them and waiting.
+   printf("%u threads, million jobs per second; speedup over one thread in brackets\n", JobThreadCount());
+   printf("%10s", "jobs");
+   for (uint32_t i = 0; i < ARRAY_COUNT(s_workPerJob); ++i) {
+      char header[32];
+      snprintf(header, sizeof(header), "%u-step jobs", s_workPerJob[i]);
+      printf(" %24s", header);
+   }
+   printf("\n");
+
+   std::vector<uint32_t> expected(maxJobs), results(maxJobs);
+   for (uint32_t count = 1000; count <= maxJobs; count *= 10) {
+      printf("%10u", count);
+      for (uint32_t i = 0; i < ARRAY_COUNT(s_workPerJob); ++i) {
+         SpinData data = { s_workPerJob[i], expected.data() };
+         int64_t start = ProfilerNow();
+         for (uint32_t j = 0; j < count; ++j) {
+            spinJob(&data, j);
+         }
+         double loopMs = millisecondsSince(start);
+
+         // Several rounds at the smaller sizes, for a stable time.
+         uint32_t rounds = maxJobs / count < 100 ? maxJobs / count : 100;
+         data.results = results.data();
+         start = ProfilerNow();
+         for (uint32_t round = 0; round < rounds; ++round) {
+            JobParallelFor(spinJob, &data, count);
+         }
+         double jobMs = millisecondsSince(start) / rounds;
+
+         if (memcmp(expected.data(), results.data(), count * sizeof(uint32_t)) != 0) {
+            fprintf(stderr, "%u jobs: results don't match the loop's\n", count);
+            JobSystemShutdown();
+            return 1;
+         }
+
+         char cell[32];
+         snprintf(cell, sizeof(cell), "%.2f (%.2fx)", count / jobMs * 1e-3, loopMs / jobMs);
+         printf(" %24s", cell);
+      }
+      printf("\n");
+   }
+
+   JobSystemShutdown();
+   return 0;
+}
@@ -0,0 +1,343 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+#include "jobs.h"
+#include "profiler.h"
+
+struct JobBatch {
+   JobFn *fn;
+   void *data;
+   JobCounter *counter;
+   std::atomic<uint32_t> pending;   // jobs not finished; the batch is reused once none are
+};
+
+// Deque slots are written by the owner while thieves may be reading them, so
+// each field is an atomic; the compare-exchange on top decides who got it.
+struct JobSlot {
+   std::atomic<JobBatch *> batch;
+   std::atomic<uint32_t> index;
+};
+
+struct Job {
+   JobBatch *batch;
+   uint32_t index;
+};
+
+// Chase-Lev deque, using the memory orderings from "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (Le et al. 2013). The owner pushes and
+// takes at the bottom, thieves steal from the top.
+struct alignas(64) JobDeque {
+   std::atomic<int64_t> top;
+   char pad0[64 - sizeof(std::atomic<int64_t>)];
+   std::atomic<int64_t> bottom;
+   char pad1[64 - sizeof(std::atomic<int64_t>)];
+   JobSlot slots[JOB_DEQUE_SIZE];
+};
+
+struct JobSystem {
+   JobDeque deques[JOB_MAX_THREADS];
+   std::atomic<uint32_t> dequeCount;
+
+   std::thread workers[JOB_MAX_THREADS];
+   uint32_t workerCount;
+
+   std::mutex sleepMutex;
+   std::condition_variable sleepCond;
+   std::atomic<uint32_t> sleepers;
+   std::atomic<uint64_t> wakeups;   // bumped on every push so sleepers can't miss one
+   std::atomic<bool> quit;
+};
+
+static JobSystem s_jobSystem;
+static JobSystem *s_jobs;
+static thread_local int32_t t_dequeIdx = -1;
+
+static bool dequePush(JobDeque *dq, JobBatch *batch, uint32_t index)
+{
+   int64_t b = dq->bottom.load(std::memory_order_relaxed);
+   int64_t t = dq->top.load(std::memory_order_acquire);
+   if (b - t >= JOB_DEQUE_SIZE) {
+      return false;
+   }
+
+   JobSlot *slot = &dq->slots[b & (JOB_DEQUE_SIZE - 1)];
+   slot->batch.store(batch, std::memory_order_relaxed);
+   slot->index.store(index, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   dq->bottom.store(b + 1, std::memory_order_relaxed);
+   return true;
+}
+
+static bool dequeTake(JobDeque *dq, Job *job)
+{
+   int64_t b = dq->bottom.load(std::memory_order_relaxed) - 1;
+   dq->bottom.store(b, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t t = dq->top.load(std::memory_order_relaxed);
+
+   if (t > b) {
+      dq->bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+   }
+
+   JobSlot *slot = &dq->slots[b & (JOB_DEQUE_SIZE - 1)];
+   job->batch = slot->batch.load(std::memory_order_relaxed);
+   job->index = slot->index.load(std::memory_order_relaxed);
+   if (t == b) {
+      // Last one: race the thieves for it.
+      bool won = dq->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      dq->bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+   }
+   return true;
+}
+
+static bool dequeSteal(JobDeque *dq, Job *job)
+{
+   int64_t t = dq->top.load(std::memory_order_acquire);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t b = dq->bottom.load(std::memory_order_acquire);
+   if (t >= b) {
+      return false;
+   }
+
+   JobSlot *slot = &dq->slots[t & (JOB_DEQUE_SIZE - 1)];
+   job->batch = slot->batch.load(std::memory_order_relaxed);
+   job->index = slot->index.load(std::memory_order_relaxed);
+   return dq->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+static int32_t currentDeque()
+{
+   if (t_dequeIdx < 0) {
+      uint32_t idx = s_jobs->dequeCount.fetch_add(1);
+      ASSERT(idx < JOB_MAX_THREADS);
+      t_dequeIdx = (int32_t)idx;
+   }
+   return t_dequeIdx;
+}
+
+static void runJob(const Job *job)
+{
+   JobBatch *batch = job->batch;
+   JobCounter *counter = batch->counter;
+   batch->fn(batch->data, job->index);
+
+   // The submitting thread may reuse the batch as soon as this drops, so the
+   // counter was read before.
+   batch->pending.fetch_sub(1, std::memory_order_release);
+   counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+// Takes from our own deque first, then tries everybody else's starting at a
+// different victim each time so thieves spread out.
+static bool findJob(int32_t self, uint32_t *seed, Job *job)
+{
+   if (dequeTake(&s_jobs->deques[self], job)) {
+      return true;
+   }
+
+   uint32_t count = s_jobs->dequeCount.load(std::memory_order_acquire);
+   *seed = *seed * 1664525u + 1013904223u;
+   uint32_t start = *seed % count;
+   for (uint32_t i = 0; i < count; ++i) {
+      uint32_t victim = (start + i) % count;
+      if ((int32_t)victim != self && dequeSteal(&s_jobs->deques[victim], job)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+static void workerMain(uint32_t workerIdx)
+{
+   char name[PROFILE_NAME_LENGTH];
+   snprintf(name, sizeof(name), "job worker %u", workerIdx);
+   ProfilerSetThreadName(name);
+
+   int32_t self = currentDeque();
+   uint32_t seed = workerIdx * 2654435761u + 1;
+   Job job;
+
+   while (!s_jobs->quit.load(std::memory_order_acquire)) {
+      uint64_t wakeups = s_jobs->wakeups.load(std::memory_order_acquire);
+      if (findJob(self, &seed, &job)) {
+         runJob(&job);
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(s_jobs->sleepMutex);
+      s_jobs->sleepers.fetch_add(1);
+      s_jobs->sleepCond.wait(lock, [wakeups] {
+         return s_jobs->quit.load(std::memory_order_acquire) || s_jobs->wakeups.load(std::memory_order_acquire) != wakeups;
+      });
+      s_jobs->sleepers.fetch_sub(1);
+   }
+}
+
+void JobSystemInit(uint32_t workerCount)
+{
+   ASSERT(!s_jobs);
+
+   if (workerCount == 0) {
+      uint32_t cores = std::thread::hardware_concurrency();
+      workerCount = cores > 1 ? cores - 1 : 0;
+   }
+   if (workerCount > JOB_MAX_THREADS / 2) {
+      workerCount = JOB_MAX_THREADS / 2;   // leave deques for non-worker threads
+   }
+
+   s_jobs = &s_jobSystem;
+   for (uint32_t i = 0; i < JOB_MAX_THREADS; ++i) {
+      s_jobs->deques[i].top.store(0, std::memory_order_relaxed);
+      s_jobs->deques[i].bottom.store(0, std::memory_order_relaxed);
+   }
+   s_jobs->dequeCount.store(0);
+   s_jobs->sleepers.store(0);
+   s_jobs->wakeups.store(0);
+   s_jobs->quit.store(false);
+
+   t_dequeIdx = -1;
+   currentDeque();
+
+   s_jobs->workerCount = workerCount;
+   for (uint32_t i = 0; i < workerCount; ++i) {
+      s_jobs->workers[i] = std::thread(workerMain, i + 1);
+   }
+}
+
+void JobSystemShutdown()
+{
+   if (!s_jobs) {
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(s_jobs->sleepMutex);
+      s_jobs->quit.store(true, std::memory_order_release);
+   }
+   s_jobs->sleepCond.notify_all();
+
+   for (uint32_t i = 0; i < s_jobs->workerCount; ++i) {
+      s_jobs->workers[i].join();
+   }
+
+   s_jobs = nullptr;
+   t_dequeIdx = -1;
+}
+
+uint32_t JobThreadCount()
+{
+   return s_jobs ? s_jobs->workerCount + 1 : 1;
+}
+
+void JobRun(JobFn *fn, void *data, uint32_t count, JobCounter *counter)
+{
+   if (count == 0) {
+      return;
+   }
+
+   // Without a job system everything runs inline, which keeps tools and
+   // single-threaded builds working unchanged.
+   if (!s_jobs) {
+      for (uint32_t i = 0; i < count; ++i) {
+         fn(data, i);
+      }
+      return;
+   }
+
+   // The batch has to outlive the jobs, so it's carved out of a per-thread
+   // ring. That's normally far larger than the number of batches in flight,
+   // but a thread that runs more batches than it has slots before waiting
+   // comes back round to ones that may still have jobs queued or running.
+   // It helps with those until they're done, as in JobWait.
+   static thread_local JobBatch t_batches[JOB_DEQUE_SIZE];
+   static thread_local uint32_t t_nextBatch;
+   JobBatch *batch = &t_batches[t_nextBatch++ & (JOB_DEQUE_SIZE - 1)];
+   int32_t self = currentDeque();
+   if (batch->pending.load(std::memory_order_acquire) != 0) {
+      uint32_t seed = (uint32_t)self * 2654435761u + 1;
+      Job job;
+      while (batch->pending.load(std::memory_order_acquire) != 0) {
+         if (findJob(self, &seed, &job)) {
+            runJob(&job);
+         } else {
+            std::this_thread::yield();
+         }
+      }
+   }
+   batch->fn = fn;
+   batch->data = data;
+   batch->counter = counter;
+   batch->pending.store(count, std::memory_order_relaxed);
+
+   counter->pending.fetch_add(count, std::memory_order_relaxed);
+
+   JobDeque *dq = &s_jobs->deques[self];
+   for (uint32_t i = 0; i < count; ++i) {
+      if (!dequePush(dq, batch, i)) {
+         Job job = { batch, i };
+         runJob(&job);
+      }
+   }
+
+   s_jobs->wakeups.fetch_add(1, std::memory_order_release);
+   if (s_jobs->sleepers.load(std::memory_order_acquire) > 0) {
+      std::lock_guard<std::mutex> lock(s_jobs->sleepMutex);
+      s_jobs->sleepCond.notify_all();
+   }
+}
+
+void JobWait(JobCounter *counter)
+{
+   if (!s_jobs) {
+      return;
+   }
+
+   int32_t self = currentDeque();
+   uint32_t seed = (uint32_t)self * 2654435761u + 1;
+   Job job;
+   while (counter->pending.load(std::memory_order_acquire) != 0) {
+      if (findJob(self, &seed, &job)) {
+         runJob(&job);
+      } else {
+         std::this_thread::yield();
+      }
+   }
+}
+
+void JobParallelFor(JobFn *fn, void *data, uint32_t count)
+{
+   JobCounter counter;
+   JobRun(fn, data, count, &counter);
+   JobWait(&counter);
+}
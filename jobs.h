@@ -0,0 +1,61 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#define JOB_MAX_THREADS    64
+#define JOB_DEQUE_SIZE     4096   // per thread, must be a power of two
+
+typedef void JobFn(void *data, uint32_t index);
+
+// Counts the jobs of one or more JobRun calls that haven't finished yet.
+struct JobCounter {
+   std::atomic<uint32_t> pending;
+
+   JobCounter() : pending(0) {}
+};
+
+// Starts workerCount worker threads; 0 means one per core, less the calling
+// thread. Each thread that submits jobs gets its own work-stealing deque; idle
+// threads steal from the others' deques.
+void JobSystemInit(uint32_t workerCount);
+void JobSystemShutdown();
+
+// Threads that will execute jobs, i.e. the workers plus the thread that called
+// JobSystemInit.
+uint32_t JobThreadCount();
+
+// Queues fn(data, i) for i in [0, count) and adds count to counter. data must
+// stay valid until the counter has been waited on.
+void JobRun(JobFn *fn, void *data, uint32_t count, JobCounter *counter);
+
+// Runs queued jobs on the calling thread until counter drops to zero.
+void JobWait(JobCounter *counter);
+
+// JobRun then JobWait.
+void JobParallelFor(JobFn *fn, void *data, uint32_t count);
@@ -0,0 +1,198 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "common.h"
+#include "mapfile.h"
+
+#define MAX_PATH_LENGTH 1024
+
+#ifdef _WIN32
+
+bool MapFile(MappedFile *file, const char *path)
+{
+   memset(file, 0, sizeof(*file));
+
+   HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (handle == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+
+   LARGE_INTEGER size;
+   if (!GetFileSizeEx(handle, &size)) {
+      CloseHandle(handle);
+      return false;
+   }
+   if (size.QuadPart == 0) {
+      CloseHandle(handle);
+      return true;
+   }
+
+   HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (!mapping) {
+      CloseHandle(handle);
+      return false;
+   }
+
+   void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   if (!data) {
+      CloseHandle(mapping);
+      CloseHandle(handle);
+      return false;
+   }
+
+   file->data = (const uint8_t *)data;
+   file->size = (uint64_t)size.QuadPart;
+   file->file = (intptr_t)handle;
+   file->mapping = (intptr_t)mapping;
+   return true;
+}
+
+void UnmapFile(MappedFile *file)
+{
+   if (file->data) {
+      UnmapViewOfFile(file->data);
+      CloseHandle((HANDLE)file->mapping);
+      CloseHandle((HANDLE)file->file);
+   }
+   memset(file, 0, sizeof(*file));
+}
+
+static bool writeFile(const char *path, const void *data, uint64_t size)
+{
+   HANDLE handle = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (handle == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+
+   const uint8_t *bytes = (const uint8_t *)data;
+   bool ok = true;
+   while (ok && size > 0) {
+      DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+      DWORD written;
+      ok = WriteFile(handle, bytes, chunk, &written, nullptr) && written == chunk;
+      bytes += chunk;
+      size -= chunk;
+   }
+   return CloseHandle(handle) && ok;
+}
+
+static bool replaceFile(const char *from, const char *to)
+{
+   return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static void removeFile(const char *path)
+{
+   DeleteFileA(path);
+}
+
+#else
+
+bool MapFile(MappedFile *file, const char *path)
+{
+   memset(file, 0, sizeof(*file));
+
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return false;
+   }
+
+   struct stat st;
+   if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+   }
+   if (st.st_size == 0) {
+      close(fd);
+      return true;
+   }
+
+   void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED) {
+      return false;
+   }
+
+   file->data = (const uint8_t *)data;
+   file->size = (uint64_t)st.st_size;
+   return true;
+}
+
+void UnmapFile(MappedFile *file)
+{
+   if (file->data) {
+      munmap((void *)file->data, (size_t)file->size);
+   }
+   memset(file, 0, sizeof(*file));
+}
+
+static bool writeFile(const char *path, const void *data, uint64_t size)
+{
+   FILE *out = fopen(path, "wb");
+   if (!out) {
+      return false;
+   }
+   bool ok = fwrite(data, 1, (size_t)size, out) == size;
+   return fclose(out) == 0 && ok;
+}
+
+static bool replaceFile(const char *from, const char *to)
+{
+   return rename(from, to) == 0;
+}
+
+static void removeFile(const char *path)
+{
+   remove(path);
+}
+
+#endif
+
+bool WriteFileAtomic(const char *path, const void *data, uint64_t size)
+{
+   char tmpPath[MAX_PATH_LENGTH];
+   if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath)) {
+      return false;
+   }
+
+   if (!writeFile(tmpPath, data, size) || !replaceFile(tmpPath, path)) {
+      removeFile(tmpPath);
+      return false;
+   }
+   return true;
+}
@@ -0,0 +1,49 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// A read-only view of a whole file. Platform-independent interface; the
+// mapping itself is done with CreateFileMapping on Windows and mmap elsewhere.
+struct MappedFile {
+   const uint8_t *data;
+   uint64_t size;
+
+   // Platform handles, owned by mapfile.cpp.
+   intptr_t file;
+   intptr_t mapping;
+};
+
+// Returns false if the file doesn't exist or can't be mapped; *file is left
+// empty either way so UnmapFile is always safe. Empty files map to a null
+// pointer with size 0.
+bool MapFile(MappedFile *file, const char *path);
+void UnmapFile(MappedFile *file);
+
+// Writes size bytes to path.tmp and moves it over path, so readers never see
+// a half-written file. Fails on Windows if path is still mapped.
+bool WriteFileAtomic(const char *path, const void *data, uint64_t size);
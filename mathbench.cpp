@@ -0,0 +1,446 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Times the vecmath.h kernel this is built with against the scalar matrix
+// code it replaced, and checks they give the same bits:
+//
+//    mathbench [--count N] [--rounds N]
+//
+// Build it once per kernel, forcing it with -DVECMATH_KERNEL=N (0 scalar,
+// 1 SSE, 2 AVX, 3 NEON). Each round runs every function below count times
+// on random inputs, both ways, alternating which goes first: the matrix and
+// matrix-vector products, the vm4 register helpers, and the rotation,
+// projection and camera matrix builders. The results only match bit for bit
+// if the compiler doesn't fuse multiplies and adds into FMAs, which it may
+// do to the scalar code and to the kernels' separate multiply and add
+// intrinsics alike once FMA is enabled, e.g. by -mfma or -march=native;
+// build with -ffp-contract=off for the comparison to hold.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "common.h"
+#include "profiler.h"
+#include "vecmath.h"
+
+#if VECMATH_KERNEL == VECMATH_KERNEL_AVX
+#  define KERNEL_NAME "AVX"
+#elif VECMATH_KERNEL == VECMATH_KERNEL_SSE
+#  define KERNEL_NAME "SSE"
+#elif VECMATH_KERNEL == VECMATH_KERNEL_NEON
+#  define KERNEL_NAME "NEON"
+#else
+#  define KERNEL_NAME "scalar"
+#endif
+
+#ifdef _MSC_VER
+#  define NOINLINE __declspec(noinline)
+#else
+#  define NOINLINE __attribute__((noinline))
+#endif
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--count N] [--rounds N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static float random11(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return (*state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+static double millisecondsSince(int64_t start)
+{
+   return (ProfilerNow() - start) * 1e-6;
+}
+
+// The scalar multiply the kernels replaced, as it was.
+static void referenceMul(Mat4 *r, const Mat4 *a, const Mat4 *b)
+{
+   Mat4 tmp;
+
+   tmp.m[0].x = a->m[0].x * b->m[0].x + a->m[1].x * b->m[0].y + a->m[2].x * b->m[0].z + a->m[3].x * b->m[0].w;
+   tmp.m[0].y = a->m[0].y * b->m[0].x + a->m[1].y * b->m[0].y + a->m[2].y * b->m[0].z + a->m[3].y * b->m[0].w;
+   tmp.m[0].z = a->m[0].z * b->m[0].x + a->m[1].z * b->m[0].y + a->m[2].z * b->m[0].z + a->m[3].z * b->m[0].w;
+   tmp.m[0].w = a->m[0].w * b->m[0].x + a->m[1].w * b->m[0].y + a->m[2].w * b->m[0].z + a->m[3].w * b->m[0].w;
+
+   tmp.m[1].x = a->m[0].x * b->m[1].x + a->m[1].x * b->m[1].y + a->m[2].x * b->m[1].z + a->m[3].x * b->m[1].w;
+   tmp.m[1].y = a->m[0].y * b->m[1].x + a->m[1].y * b->m[1].y + a->m[2].y * b->m[1].z + a->m[3].y * b->m[1].w;
+   tmp.m[1].z = a->m[0].z * b->m[1].x + a->m[1].z * b->m[1].y + a->m[2].z * b->m[1].z + a->m[3].z * b->m[1].w;
+   tmp.m[1].w = a->m[0].w * b->m[1].x + a->m[1].w * b->m[1].y + a->m[2].w * b->m[1].z + a->m[3].w * b->m[1].w;
+
+   tmp.m[2].x = a->m[0].x * b->m[2].x + a->m[1].x * b->m[2].y + a->m[2].x * b->m[2].z + a->m[3].x * b->m[2].w;
+   tmp.m[2].y = a->m[0].y * b->m[2].x + a->m[1].y * b->m[2].y + a->m[2].y * b->m[2].z + a->m[3].y * b->m[2].w;
+   tmp.m[2].z = a->m[0].z * b->m[2].x + a->m[1].z * b->m[2].y + a->m[2].z * b->m[2].z + a->m[3].z * b->m[2].w;
+   tmp.m[2].w = a->m[0].w * b->m[2].x + a->m[1].w * b->m[2].y + a->m[2].w * b->m[2].z + a->m[3].w * b->m[2].w;
+
+   tmp.m[3].x = a->m[0].x * b->m[3].x + a->m[1].x * b->m[3].y + a->m[2].x * b->m[3].z + a->m[3].x * b->m[3].w;
+   tmp.m[3].y = a->m[0].y * b->m[3].x + a->m[1].y * b->m[3].y + a->m[2].y * b->m[3].z + a->m[3].y * b->m[3].w;
+   tmp.m[3].z = a->m[0].z * b->m[3].x + a->m[1].z * b->m[3].y + a->m[2].z * b->m[3].z + a->m[3].z * b->m[3].w;
+   tmp.m[3].w = a->m[0].w * b->m[3].x + a->m[1].w * b->m[3].y + a->m[2].w * b->m[3].z + a->m[3].w * b->m[3].w;
+
+   memcpy(r, &tmp, sizeof(tmp));
+}
+
+// ...and the matrix-vector product, the same way round.
+static Vec4 referenceMulVec4(const Mat4 *m, Vec4 v)
+{
+   Vec4 r;
+   r.x = m->m[0].x * v.x + m->m[1].x * v.y + m->m[2].x * v.z + m->m[3].x * v.w;
+   r.y = m->m[0].y * v.x + m->m[1].y * v.y + m->m[2].y * v.z + m->m[3].y * v.w;
+   r.z = m->m[0].z * v.x + m->m[1].z * v.y + m->m[2].z * v.z + m->m[3].z * v.w;
+   r.w = m->m[0].w * v.x + m->m[1].w * v.y + m->m[2].w * v.z + m->m[3].w * v.w;
+   return r;
+}
+
+// The builders, as written out before they moved into vecmath.h.
+static void referenceRotY(Mat4 *m, float angle)
+{
+   float c = cosf(angle);
+   float s = sinf(angle);
+   Mat4 r = {{
+      { c, 0.0f, s, 0.0f },
+      { 0.0f, 1.0f, 0.0f, 0.0f },
+      { -s, 0.0f, c, 0.0f },
+      { 0.0f, 0.0f, 0.0f, 1.0f },
+   }};
+   *m = r;
+}
+
+// Reversed-Z: near maps to 1 and far to 0, or to 0 at infinity if far isn't
+// beyond near.
+static void referencePerspectiveFov(Mat4 *m, float fovY, float aspect, float nearDist, float farDist)
+{
+   float y = tanf(fovY * 0.5f);
+   float x = aspect * y;
+   float c = 0.0f, d = nearDist;
+   if (nearDist < farDist) {
+      c = nearDist / (nearDist - farDist);
+      d = -farDist * nearDist / (nearDist - farDist);
+   }
+   Mat4 r = {{
+      { 1.0f / x, 0.0f, 0.0f, 0.0f },
+      { 0.0f, -1.0f / y, 0.0f, 0.0f },
+      { 0.0f, 0.0f, c, 1.0f },
+      { 0.0f, 0.0f, d, 0.0f },
+   }};
+   *m = r;
+}
+
+static void referenceLookAt(Mat4 *m, Vec3 eye, Vec3 target, Vec3 up)
+{
+   float fx = target.x - eye.x, fy = target.y - eye.y, fz = target.z - eye.z;
+   float f = 1.0f / sqrtf(fx * fx + fy * fy + fz * fz);
+   fx *= f;
+   fy *= f;
+   fz *= f;
+
+   float rx = up.y * fz - up.z * fy, ry = up.z * fx - up.x * fz, rz = up.x * fy - up.y * fx;
+   float r = 1.0f / sqrtf(rx * rx + ry * ry + rz * rz);
+   rx *= r;
+   ry *= r;
+   rz *= r;
+
+   float ux = ry * fz - rz * fy, uy = rz * fx - rx * fz, uz = rx * fy - ry * fx;
+
+   Mat4 v = {{
+      { rx, ry, rz, 0.0f },
+      { ux, uy, uz, 0.0f },
+      { fx, fy, fz, 0.0f },
+      { -eye.x * rx - eye.y * ux - eye.z * fx, -eye.x * ry - eye.y * uy - eye.z * fy,
+        -eye.x * rz - eye.y * uz - eye.z * fz, 1.0f },
+   }};
+   *m = v;
+}
+
+// What vm4Ops computes, a lane at a time.
+static Vec4 referenceVm4Ops(Vec4 a, Vec4 b)
+{
+   float t = b.y * a.z, u = a.w * 0.5f;
+   Vec4 r = { a.x * b.x + t - u, a.y * b.x + t - u, a.z * b.x + t - u, a.w * b.x + t - u };
+   return r;
+}
+
+// Goes through every register helper: a * b.x + b.y * a.z - a.w * 0.5.
+static inline Vm4 vm4Ops(Vm4 a, Vm4 b)
+{
+   Vm4 r = vm4Add(vm4Mul(a, vm4SplatX(b)), vm4Mul(vm4SplatY(b), vm4SplatZ(a)));
+   return vm4Sub(r, vm4Mul(vm4SplatW(a), vm4Splat(0.5f)));
+}
+
+struct Inputs {
+   std::vector<Mat4> a, b;
+   std::vector<Vec4> v, w;
+   std::vector<float> angle, fovY, aspect, nearDist, farDist;
+   std::vector<Vec3> eye, target;
+};
+
+// Fills count outputs from the inputs, into Mat4s or Vec4s as the function
+// returns.
+typedef void BenchFn(const Inputs *in, Vec4 *out, uint32_t count);
+
+// Out of line, so neither side gets folded into the timing loop differently.
+static NOINLINE void referenceMulAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      referenceMul((Mat4 *)out + i, &in->a[i], &in->b[i]);
+   }
+}
+
+static NOINLINE void kernelMulAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      mat4Mul((Mat4 *)out + i, &in->a[i], &in->b[i]);
+   }
+}
+
+static NOINLINE void referenceMulVec4All(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      out[i] = referenceMulVec4(&in->a[i], in->v[i]);
+   }
+}
+
+static NOINLINE void kernelMulVec4All(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      out[i] = mat4MulVec4(&in->a[i], in->v[i]);
+   }
+}
+
+static NOINLINE void referenceVm4OpsAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      out[i] = referenceVm4Ops(in->v[i], in->w[i]);
+   }
+}
+
+// Stored, not streamed: these outputs are read straight back. transformbench
+// times the streaming path.
+static NOINLINE void kernelVm4OpsAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      vm4Store(&out[i], vm4Ops(vm4Load(&in->v[i]), vm4Load(&in->w[i])));
+   }
+}
+
+static NOINLINE void referenceRotYAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      referenceRotY((Mat4 *)out + i, in->angle[i]);
+   }
+}
+
+static NOINLINE void kernelRotYAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      mat4RotY((Mat4 *)out + i, in->angle[i]);
+   }
+}
+
+static NOINLINE void referencePerspectiveFovAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      referencePerspectiveFov((Mat4 *)out + i, in->fovY[i], in->aspect[i], in->nearDist[i], in->farDist[i]);
+   }
+}
+
+static NOINLINE void kernelPerspectiveFovAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      mat4PerspectiveFov((Mat4 *)out + i, in->fovY[i], in->aspect[i], in->nearDist[i], in->farDist[i]);
+   }
+}
+
+static NOINLINE void referenceLookAtAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   const Vec3 up = { 0.0f, 1.0f, 0.0f };
+   for (uint32_t i = 0; i < count; ++i) {
+      referenceLookAt((Mat4 *)out + i, in->eye[i], in->target[i], up);
+   }
+}
+
+static NOINLINE void kernelLookAtAll(const Inputs *in, Vec4 *out, uint32_t count)
+{
+   const Vec3 up = { 0.0f, 1.0f, 0.0f };
+   for (uint32_t i = 0; i < count; ++i) {
+      mat4LookAt((Mat4 *)out + i, in->eye[i], in->target[i], up);
+   }
+}
+
+struct Bench {
+   const char *name;
+   BenchFn *reference;
+   BenchFn *kernel;
+   uint32_t floats;           // per output
+   double referenceMs;
+   double kernelMs;
+};
+
+// Floats differing in the last bits differ by that many in their bit
+// patterns, for the same sign.
+static uint32_t ulps(float a, float b)
+{
+   int32_t ia, ib;
+   memcpy(&ia, &a, sizeof(ia));
+   memcpy(&ib, &b, sizeof(ib));
+   if ((ia < 0) != (ib < 0)) {
+      return a == b ? 0 : UINT32_MAX;
+   }
+   return ia > ib ? (uint32_t)(ia - ib) : (uint32_t)(ib - ia);
+}
+
+// Counts the floats that differ and returns the largest difference in ulps.
+static uint32_t compare(const float *a, const float *b, uint32_t count, uint32_t *differ)
+{
+   uint32_t worst = 0;
+   *differ = 0;
+   for (uint32_t i = 0; i < count; ++i) {
+      if (memcmp(&a[i], &b[i], sizeof(float)) != 0) {
+         ++*differ;
+         uint32_t d = ulps(a[i], b[i]);
+         worst = d > worst ? d : worst;
+      }
+   }
+   return worst;
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t count = 4096, rounds = 1000;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--count") == 0 && value > 0) {
+         count = value;
+      } else if (strcmp(argv[i], "--rounds") == 0 && value > 0) {
+         rounds = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   Inputs in;
+   in.a.resize(count);
+   in.b.resize(count);
+   in.v.resize(count);
+   in.w.resize(count);
+   in.angle.resize(count);
+   in.fovY.resize(count);
+   in.aspect.resize(count);
+   in.nearDist.resize(count);
+   in.farDist.resize(count);
+   in.eye.resize(count);
+   in.target.resize(count);
+   uint32_t seed = 1;
+   for (uint32_t i = 0; i < count; ++i) {
+      float *fa = &in.a[i].m[0].x, *fb = &in.b[i].m[0].x;
+      for (uint32_t j = 0; j < 16; ++j) {
+         fa[j] = random11(&seed) * 100.0f;
+         fb[j] = random11(&seed);
+      }
+      in.v[i].x = random11(&seed) * 100.0f;
+      in.v[i].y = random11(&seed) * 100.0f;
+      in.v[i].z = random11(&seed) * 100.0f;
+      in.v[i].w = 1.0f;
+      in.w[i].x = random11(&seed);
+      in.w[i].y = random11(&seed);
+      in.w[i].z = random11(&seed);
+      in.w[i].w = random11(&seed);
+
+      in.angle[i] = random11(&seed) * 6.2831853f;
+      in.fovY[i] = 1.0f + random11(&seed) * 0.5f;
+      in.aspect[i] = 1.5f + random11(&seed) * 0.5f;
+      in.nearDist[i] = 0.55f + random11(&seed) * 0.45f;
+      // Every eighth one has no far plane, for the other branch.
+      in.farDist[i] = i % 8 == 0 ? 0.0f : 1000.0f + random11(&seed) * 900.0f;
+
+      // Clear of straight up or down, where the camera has no right vector.
+      in.eye[i].x = random11(&seed) * 100.0f;
+      in.eye[i].y = random11(&seed) * 10.0f;
+      in.eye[i].z = random11(&seed) * 100.0f;
+      in.target[i].x = in.eye[i].x + random11(&seed) * 50.0f + 60.0f;
+      in.target[i].y = in.eye[i].y + random11(&seed) * 10.0f;
+      in.target[i].z = in.eye[i].z + random11(&seed) * 50.0f;
+   }
+
+   Bench benches[] = {
+      { "mat4Mul", referenceMulAll, kernelMulAll, 16, 0.0, 0.0 },
+      { "mat4MulVec4", referenceMulVec4All, kernelMulVec4All, 4, 0.0, 0.0 },
+      { "vm4 helpers", referenceVm4OpsAll, kernelVm4OpsAll, 4, 0.0, 0.0 },
+      { "mat4RotY", referenceRotYAll, kernelRotYAll, 16, 0.0, 0.0 },
+      { "mat4PerspectiveFov", referencePerspectiveFovAll, kernelPerspectiveFovAll, 16, 0.0, 0.0 },
+      { "mat4LookAt", referenceLookAtAll, kernelLookAtAll, 16, 0.0, 0.0 },
+   };
+   const uint32_t benchCount = sizeof(benches) / sizeof(benches[0]);
+
+   std::vector<Mat4> reference(count), kernel(count);
+   double products = (double)count * rounds;
+   printf("%s kernel, %u calls x %u rounds, millions per second\n", KERNEL_NAME, count, rounds);
+   printf("%18s %10s %10s %8s %16s\n", "", "scalar", KERNEL_NAME, "speedup", "floats differing");
+
+   uint32_t worst = 0;
+   bool differs = false;
+   for (uint32_t b = 0; b < benchCount; ++b) {
+      Bench *bench = &benches[b];
+      // Alternate which side goes first, so neither always finds the caches
+      // warmed by the other.
+      for (uint32_t round = 0; round < rounds; ++round) {
+         for (uint32_t side = 0; side < 2; ++side) {
+            bool kernelSide = (side ^ (round & 1)) != 0;
+            int64_t start = ProfilerNow();
+            if (kernelSide) {
+               bench->kernel(&in, &kernel[0].m[0], count);
+               bench->kernelMs += millisecondsSince(start);
+            } else {
+               bench->reference(&in, &reference[0].m[0], count);
+               bench->referenceMs += millisecondsSince(start);
+            }
+         }
+      }
+
+      uint32_t differ;
+      uint32_t benchWorst = compare(&reference[0].m[0].x, &kernel[0].m[0].x, count * bench->floats, &differ);
+      worst = benchWorst > worst ? benchWorst : worst;
+      differs = differs || differ > 0;
+      printf("%18s %10.1f %10.1f %7.2fx %16u\n", bench->name, products / bench->referenceMs * 1e-3,
+         products / bench->kernelMs * 1e-3, bench->referenceMs / bench->kernelMs, differ);
+   }
+
+   if (differs) {
+      fprintf(stderr, "results differ from the scalar code's by up to %u ulps; was this built with "
+         "-ffp-contract=off?\n", worst);
+      return 1;
+   }
+   return 0;
+}
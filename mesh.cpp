@@ -0,0 +1,283 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "mesh.h"
+#include "shadercache.h"
+
+static const uint32_t s_formatSizes[MESH_FORMAT_COUNT] = {
+   0,    // MESH_FORMAT_NONE
+   8,    // MESH_FORMAT_FLOAT2
+   12,   // MESH_FORMAT_FLOAT3
+   16,   // MESH_FORMAT_FLOAT4
+   4,    // MESH_FORMAT_UNORM8X4
+};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+   return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t MeshFormatSize(uint32_t format)
+{
+   return format < MESH_FORMAT_COUNT ? s_formatSizes[format] : 0;
+}
+
+// Whether [offset, offset + size) is an aligned range inside the payload.
+// Written so that nothing can overflow, whatever the header says.
+static bool validRange(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+   return offset % MESH_ALIGNMENT == 0 && offset >= MESH_DATA_OFFSET && offset <= fileSize && size <= fileSize - offset;
+}
+
+static bool fail(const char **error, const char *message)
+{
+   if (error) {
+      *error = message;
+   }
+   return false;
+}
+
+static bool validateContents(const uint8_t *data, const MeshHeader *header, const char **error)
+{
+   if (HashBytes(HASH_SEED, data + MESH_DATA_OFFSET, (size_t)(header->fileSize - MESH_DATA_OFFSET)) != header->payloadHash) {
+      return fail(error, "payload hash mismatch");
+   }
+
+   const uint8_t *indices = data + header->indexOffset;
+   for (uint32_t i = 0; i < header->indexCount; ++i) {
+      uint32_t index;
+      if (header->indexSize == 2) {
+         uint16_t index16;
+         memcpy(&index16, indices + i * 2, 2);
+         index = index16;
+      } else {
+         memcpy(&index, indices + i * 4, 4);
+      }
+      if (index >= header->vertexCount) {
+         return fail(error, "index out of range");
+      }
+   }
+
+   const MeshStreamDesc *positions = &header->streams[MESH_POSITION];
+   for (uint32_t i = 0; i < header->vertexCount; ++i) {
+      float pos[3];
+      memcpy(pos, data + positions->offset + (uint64_t)i * positions->stride, sizeof(pos));
+      for (uint32_t k = 0; k < 3; ++k) {
+         if (!(pos[k] >= header->boundsMin[k] && pos[k] <= header->boundsMax[k])) {
+            return fail(error, "position outside the bounds");
+         }
+      }
+   }
+   return true;
+}
+
+bool ValidateMesh(const void *data, uint64_t size, uint32_t flags, const char **error)
+{
+   if (size < MESH_DATA_OFFSET) {
+      return fail(error, "too small for a header");
+   }
+
+   const MeshHeader *header = (const MeshHeader *)data;
+   if (header->magic != MESH_MAGIC) {
+      return fail(error, "not a mesh file");
+   }
+   if (header->version != MESH_VERSION) {
+      return fail(error, "unsupported version");
+   }
+   if (header->fileSize != size) {
+      return fail(error, "truncated or padded");
+   }
+   if (header->vertexCount == 0 || header->indexCount == 0 || header->indexCount % 3 != 0) {
+      return fail(error, "not a triangle list");
+   }
+   if (header->indexSize != 2 && header->indexSize != 4) {
+      return fail(error, "bad index size");
+   }
+   for (uint32_t k = 0; k < 3; ++k) {
+      if (!(header->boundsMin[k] <= header->boundsMax[k])) {
+         return fail(error, "bad bounds");
+      }
+   }
+
+   if (!validRange(header->indexOffset, (uint64_t)header->indexCount * header->indexSize, size)) {
+      return fail(error, "index buffer out of range");
+   }
+
+   // Ranges in file order would do for the overlap check, but there are few
+   // enough of them to just compare every pair.
+   uint64_t starts[MESH_MAX_STREAMS + 1], ends[MESH_MAX_STREAMS + 1];
+   uint32_t rangeCount = 0;
+   starts[rangeCount] = header->indexOffset;
+   ends[rangeCount++] = header->indexOffset + (uint64_t)header->indexCount * header->indexSize;
+
+   for (uint32_t i = 0; i < MESH_MAX_STREAMS; ++i) {
+      const MeshStreamDesc *stream = &header->streams[i];
+      if (stream->format == MESH_FORMAT_NONE) {
+         continue;
+      }
+
+      uint32_t formatSize = MeshFormatSize(stream->format);
+      if (formatSize == 0 || stream->stride < formatSize || stream->stride % 4 != 0) {
+         return fail(error, "bad stream format");
+      }
+      if (stream->size != (uint64_t)stream->stride * header->vertexCount || !validRange(stream->offset, stream->size, size)) {
+         return fail(error, "stream out of range");
+      }
+      starts[rangeCount] = stream->offset;
+      ends[rangeCount++] = stream->offset + stream->size;
+   }
+
+   if (header->streams[MESH_POSITION].format != MESH_FORMAT_FLOAT3) {
+      return fail(error, "positions missing or not float3");
+   }
+
+   for (uint32_t i = 0; i < rangeCount; ++i) {
+      for (uint32_t j = i + 1; j < rangeCount; ++j) {
+         if (starts[i] < ends[j] && starts[j] < ends[i]) {
+            return fail(error, "overlapping streams");
+         }
+      }
+   }
+
+   if (flags & MESH_VALIDATE_CONTENTS) {
+      return validateContents((const uint8_t *)data, header, error);
+   }
+   return true;
+}
+
+bool MeshOpen(Mesh *mesh, const char *path, uint32_t validateFlags, const char **error)
+{
+   mesh->header = nullptr;
+   if (!MapFile(&mesh->file, path)) {
+      return fail(error, "couldn't map the file");
+   }
+   if (!ValidateMesh(mesh->file.data, mesh->file.size, validateFlags, error)) {
+      UnmapFile(&mesh->file);
+      return false;
+   }
+
+   mesh->header = (const MeshHeader *)mesh->file.data;
+   return true;
+}
+
+void MeshClose(Mesh *mesh)
+{
+   UnmapFile(&mesh->file);
+   mesh->header = nullptr;
+}
+
+const uint8_t *MeshPayload(const Mesh *mesh, uint64_t *size)
+{
+   *size = mesh->file.size - MESH_DATA_OFFSET;
+   return mesh->file.data + MESH_DATA_OFFSET;
+}
+
+const void *MeshStream(const Mesh *mesh, MeshSemantic semantic)
+{
+   const MeshStreamDesc *stream = &mesh->header->streams[semantic];
+   return stream->format != MESH_FORMAT_NONE ? mesh->file.data + stream->offset : nullptr;
+}
+
+const void *MeshIndices(const Mesh *mesh)
+{
+   return mesh->file.data + mesh->header->indexOffset;
+}
+
+bool BuildMesh(const MeshDesc *desc, std::vector<uint8_t> *file)
+{
+   if (desc->vertexCount == 0 || desc->indexCount == 0 || desc->indexCount % 3 != 0 ||
+      !desc->streams[MESH_POSITION] || desc->formats[MESH_POSITION] != MESH_FORMAT_FLOAT3) {
+      return false;
+   }
+   for (uint32_t i = 0; i < desc->indexCount; ++i) {
+      if (desc->indices[i] >= desc->vertexCount) {
+         return false;
+      }
+   }
+
+   MeshHeader header;
+   memset(&header, 0, sizeof(header));
+   header.magic = MESH_MAGIC;
+   header.version = MESH_VERSION;
+   header.vertexCount = desc->vertexCount;
+   header.indexCount = desc->indexCount;
+   header.indexSize = desc->vertexCount <= 0x10000 ? 2 : 4;
+
+   uint64_t offset = MESH_DATA_OFFSET;
+   for (uint32_t i = 0; i < MESH_MAX_STREAMS; ++i) {
+      uint32_t formatSize = MeshFormatSize(desc->formats[i]);
+      if (!desc->streams[i] || formatSize == 0) {
+         continue;
+      }
+      MeshStreamDesc *stream = &header.streams[i];
+      stream->format = desc->formats[i];
+      stream->stride = formatSize;
+      stream->offset = offset;
+      stream->size = (uint64_t)formatSize * desc->vertexCount;
+      offset = alignUp(offset + stream->size, MESH_ALIGNMENT);
+   }
+   header.indexOffset = offset;
+   header.fileSize = offset + (uint64_t)desc->indexCount * header.indexSize;
+
+   const float *positions = (const float *)desc->streams[MESH_POSITION];
+   for (uint32_t k = 0; k < 3; ++k) {
+      header.boundsMin[k] = INFINITY;
+      header.boundsMax[k] = -INFINITY;
+   }
+   for (uint32_t i = 0; i < desc->vertexCount; ++i) {
+      for (uint32_t k = 0; k < 3; ++k) {
+         float value = positions[i * 3 + k];
+         if (!isfinite(value)) {
+            return false;
+         }
+         header.boundsMin[k] = value < header.boundsMin[k] ? value : header.boundsMin[k];
+         header.boundsMax[k] = value > header.boundsMax[k] ? value : header.boundsMax[k];
+      }
+   }
+
+   file->assign((size_t)header.fileSize, 0);
+   uint8_t *data = file->data();
+   for (uint32_t i = 0; i < MESH_MAX_STREAMS; ++i) {
+      if (header.streams[i].format != MESH_FORMAT_NONE) {
+         memcpy(data + header.streams[i].offset, desc->streams[i], (size_t)header.streams[i].size);
+      }
+   }
+   for (uint32_t i = 0; i < desc->indexCount; ++i) {
+      if (header.indexSize == 2) {
+         uint16_t index = (uint16_t)desc->indices[i];
+         memcpy(data + header.indexOffset + i * 2, &index, 2);
+      } else {
+         memcpy(data + header.indexOffset + i * 4, &desc->indices[i], 4);
+      }
+   }
+
+   header.payloadHash = HashBytes(HASH_SEED, data + MESH_DATA_OFFSET, (size_t)(header.fileSize - MESH_DATA_OFFSET));
+   memcpy(data, &header, sizeof(header));
+   return true;
+}
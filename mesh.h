@@ -0,0 +1,138 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "mapfile.h"
+
+// Binary mesh container, meant to be memory-mapped and copied straight into
+// GPU buffers:
+//
+//    MeshHeader
+//    padding to MESH_DATA_OFFSET
+//    vertex streams and the index buffer, each MESH_ALIGNMENT aligned
+//
+// Everything after the header is the payload, laid out exactly as it goes on
+// the GPU: one buffer holding the payload, with the streams and indices at
+// their file offsets less MESH_DATA_OFFSET. Each stream is non-interleaved
+// and tightly strided, so a loader that only needs positions only touches
+// those pages. Little-endian throughout. Written by meshconv.
+
+#define MESH_MAGIC        0x534d5844u    // "DXMS"
+#define MESH_VERSION      1
+#define MESH_ALIGNMENT    64             // of each stream and the indices
+#define MESH_MAX_STREAMS  4
+
+// Also the input assembler slot each stream is bound to.
+enum MeshSemantic {
+   MESH_POSITION,
+   MESH_COLOR,
+   MESH_NORMAL,
+   MESH_TEXCOORD,
+};
+
+enum MeshFormat {
+   MESH_FORMAT_NONE,       // the stream isn't there
+   MESH_FORMAT_FLOAT2,
+   MESH_FORMAT_FLOAT3,
+   MESH_FORMAT_FLOAT4,
+   MESH_FORMAT_UNORM8X4,
+   MESH_FORMAT_COUNT,
+};
+
+struct MeshStreamDesc {
+   uint32_t format;        // MeshFormat
+   uint32_t stride;        // at least the format's size, a multiple of 4
+   uint64_t offset;        // from the start of the file
+   uint64_t size;          // stride * vertexCount
+};
+
+struct MeshHeader {
+   uint32_t magic;
+   uint32_t version;
+   uint64_t fileSize;
+   uint32_t vertexCount;
+   uint32_t indexCount;    // a multiple of 3; triangle lists only
+   uint32_t indexSize;     // 2 or 4 bytes
+   uint32_t reserved;
+   float boundsMin[3];     // of the positions
+   float boundsMax[3];
+   uint64_t indexOffset;
+   uint64_t payloadHash;   // HashBytes of everything from MESH_DATA_OFFSET on
+   MeshStreamDesc streams[MESH_MAX_STREAMS];   // indexed by MeshSemantic
+};
+
+#define MESH_DATA_OFFSET  ((sizeof(MeshHeader) + MESH_ALIGNMENT - 1) & ~(uint64_t)(MESH_ALIGNMENT - 1))
+
+static_assert(sizeof(MeshStreamDesc) == 24 && sizeof(MeshHeader) == 168, "MeshHeader is a file format");
+
+// Bytes per vertex of a format; 0 for MESH_FORMAT_NONE or anything unknown.
+uint32_t MeshFormatSize(uint32_t format);
+
+enum {
+   // Also hashes the payload, checks every index against the vertex count and
+   // every position against the bounds. Touches the whole file.
+   MESH_VALIDATE_CONTENTS = 1 << 0,
+};
+
+// Checks that data is a mesh whose every offset and size stays inside it, so
+// a loader can trust the header. Without MESH_VALIDATE_CONTENTS it only reads
+// the header. On failure, *error says why.
+bool ValidateMesh(const void *data, uint64_t size, uint32_t flags, const char **error);
+
+struct Mesh {
+   MappedFile file;
+   const MeshHeader *header;     // in file; null if not open
+};
+
+// Maps and validates path. Nothing past the header is read until the caller
+// touches it.
+bool MeshOpen(Mesh *mesh, const char *path, uint32_t validateFlags, const char **error);
+void MeshClose(Mesh *mesh);
+
+// What goes in the GPU buffer: everything from MESH_DATA_OFFSET on.
+const uint8_t *MeshPayload(const Mesh *mesh, uint64_t *size);
+
+// Null if the mesh has no such stream.
+const void *MeshStream(const Mesh *mesh, MeshSemantic semantic);
+const void *MeshIndices(const Mesh *mesh);
+
+// Input to WriteMesh: tightly packed streams of vertexCount vertices, null
+// for missing ones. A position stream is required.
+struct MeshDesc {
+   uint32_t vertexCount;
+   const void *streams[MESH_MAX_STREAMS];
+   uint32_t formats[MESH_MAX_STREAMS];
+   const uint32_t *indices;
+   uint32_t indexCount;
+};
+
+// Lays desc out as a mesh file, with 16-bit indices if they fit, and fills
+// in the bounds and hash. Returns false if desc is invalid.
+bool BuildMesh(const MeshDesc *desc, std::vector<uint8_t> *file);
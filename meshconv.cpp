@@ -0,0 +1,290 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// Writes and checks mesh files (mesh.h):
+//
+//    meshconv cube out.mesh           the demo's cube
+//    meshconv obj in.obj out.mesh     positions, plus colors if the OBJ has them
+//    meshconv info file.mesh...       validates everything and prints a summary
+//
+// OBJ support is the subset that matters here: "v x y z [r g b]" and "f"
+// lines with any number of corners, which are fanned into triangles.
+// Texture coordinates and normals are ignored.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "mapfile.h"
+#include "mesh.h"
+
+static void usage(const char *program)
+{
+   fprintf(stderr,
+      "usage: %s cube out.mesh\n"
+      "       %s obj in.obj out.mesh\n"
+      "       %s info file.mesh...\n",
+      program, program, program);
+}
+
+static uint8_t unorm8(float value)
+{
+   value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+   return (uint8_t)(value * 255.0f + 0.5f);
+}
+
+static bool writeMesh(const char *path, const MeshDesc *desc)
+{
+   std::vector<uint8_t> file;
+   if (!BuildMesh(desc, &file)) {
+      fprintf(stderr, "%s: invalid mesh\n", path);
+      return false;
+   }
+   if (!WriteFileAtomic(path, file.data(), file.size())) {
+      fprintf(stderr, "couldn't write %s\n", path);
+      return false;
+   }
+   return true;
+}
+
+// Same corners, colors and winding as the soft rasterizer's copy in raster.cpp.
+static bool writeCube(const char *path)
+{
+   static const float positions[8][3] = {
+      { -1.0f, -1.0f, -1.0f },
+      {  1.0f, -1.0f, -1.0f },
+      { -1.0f,  1.0f, -1.0f },
+      {  1.0f,  1.0f, -1.0f },
+      { -1.0f, -1.0f,  1.0f },
+      {  1.0f, -1.0f,  1.0f },
+      { -1.0f,  1.0f,  1.0f },
+      {  1.0f,  1.0f,  1.0f },
+   };
+
+   // The corner's position mapped from [-1, 1] to [0, 1], as RGB.
+   uint8_t colors[8][4];
+   for (uint32_t i = 0; i < 8; ++i) {
+      for (uint32_t k = 0; k < 3; ++k) {
+         colors[i][k] = unorm8(positions[i][k] * 0.5f + 0.5f);
+      }
+      colors[i][3] = 255;
+   }
+
+   static const uint32_t indices[36] = {
+      1, 0, 2,
+      1, 2, 3,
+      5, 1, 3,
+      5, 3, 7,
+      4, 5, 7,
+      4, 7, 6,
+      0, 4, 6,
+      0, 6, 2,
+      6, 7, 3,
+      6, 3, 2,
+      1, 4, 0,
+      1, 5, 4,
+   };
+
+   MeshDesc desc = {};
+   desc.vertexCount = 8;
+   desc.streams[MESH_POSITION] = positions;
+   desc.formats[MESH_POSITION] = MESH_FORMAT_FLOAT3;
+   desc.streams[MESH_COLOR] = colors;
+   desc.formats[MESH_COLOR] = MESH_FORMAT_UNORM8X4;
+   desc.indices = indices;
+   desc.indexCount = 36;
+   return writeMesh(path, &desc);
+}
+
+// One face corner: the vertex index before any '/', 1-based or negative
+// counting back from the last vertex.
+static bool parseCorner(const char **cursor, uint32_t vertexCount, uint32_t *index)
+{
+   char *end;
+   long value = strtol(*cursor, &end, 10);
+   if (end == *cursor) {
+      return false;
+   }
+   while (*end && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n') {
+      ++end;
+   }
+   *cursor = end;
+
+   long resolved = value < 0 ? (long)vertexCount + value : value - 1;
+   if (value == 0 || resolved < 0 || resolved >= (long)vertexCount) {
+      return false;
+   }
+   *index = (uint32_t)resolved;
+   return true;
+}
+
+static bool convertObj(const char *inPath, const char *outPath)
+{
+   MappedFile obj;
+   if (!MapFile(&obj, inPath)) {
+      fprintf(stderr, "couldn't read %s\n", inPath);
+      return false;
+   }
+
+   // strtof needs a terminator.
+   std::string text((const char *)obj.data, (size_t)obj.size);
+   UnmapFile(&obj);
+
+   std::vector<float> positions;
+   std::vector<uint8_t> colors;
+   std::vector<uint32_t> indices;
+   bool hasColors = true;
+   uint32_t lineNum = 0;
+
+   for (const char *line = text.c_str(); *line; ) {
+      const char *next = strchr(line, '\n');
+      next = next ? next + 1 : line + strlen(line);
+      ++lineNum;
+
+      if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+         float values[6];
+         int count = 0;
+         const char *cursor = line + 2;
+         while (count < 6) {
+            char *end;
+            float value = strtof(cursor, &end);
+            if (end == cursor || end > next) {
+               break;
+            }
+            values[count++] = value;
+            cursor = end;
+         }
+         if (count < 3) {
+            fprintf(stderr, "%s:%u: bad vertex\n", inPath, lineNum);
+            return false;
+         }
+         positions.insert(positions.end(), values, values + 3);
+         hasColors = hasColors && count == 6;
+         if (count == 6) {
+            uint8_t rgba[4] = { unorm8(values[3]), unorm8(values[4]), unorm8(values[5]), 255 };
+            colors.insert(colors.end(), rgba, rgba + 4);
+         }
+      } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+         uint32_t vertexCount = (uint32_t)(positions.size() / 3);
+         uint32_t corners[3];
+         uint32_t cornerCount = 0;
+         const char *cursor = line + 2;
+         for (;;) {
+            while (*cursor == ' ' || *cursor == '\t') {
+               ++cursor;
+            }
+            if (cursor >= next || *cursor == '\r' || *cursor == '\n' || !*cursor) {
+               break;
+            }
+
+            uint32_t index;
+            if (!parseCorner(&cursor, vertexCount, &index)) {
+               fprintf(stderr, "%s:%u: bad face\n", inPath, lineNum);
+               return false;
+            }
+
+            // Fan: (first, previous, this) for every corner after the second.
+            if (cornerCount < 2) {
+               corners[cornerCount++] = index;
+            } else {
+               indices.push_back(corners[0]);
+               indices.push_back(corners[1]);
+               indices.push_back(index);
+               corners[1] = index;
+            }
+         }
+      }
+
+      line = next;
+   }
+
+   if (positions.empty() || indices.empty()) {
+      fprintf(stderr, "%s: no triangles\n", inPath);
+      return false;
+   }
+
+   MeshDesc desc = {};
+   desc.vertexCount = (uint32_t)(positions.size() / 3);
+   desc.streams[MESH_POSITION] = positions.data();
+   desc.formats[MESH_POSITION] = MESH_FORMAT_FLOAT3;
+   if (hasColors) {
+      desc.streams[MESH_COLOR] = colors.data();
+      desc.formats[MESH_COLOR] = MESH_FORMAT_UNORM8X4;
+   }
+   desc.indices = indices.data();
+   desc.indexCount = (uint32_t)indices.size();
+   return writeMesh(outPath, &desc);
+}
+
+static bool printInfo(const char *path)
+{
+   static const char *const semanticNames[MESH_MAX_STREAMS] = { "position", "color", "normal", "texcoord" };
+   static const char *const formatNames[MESH_FORMAT_COUNT] = { "none", "float2", "float3", "float4", "unorm8x4" };
+
+   Mesh mesh;
+   const char *error;
+   if (!MeshOpen(&mesh, path, MESH_VALIDATE_CONTENTS, &error)) {
+      fprintf(stderr, "%s: %s\n", path, error);
+      return false;
+   }
+
+   const MeshHeader *header = mesh.header;
+   printf("%s: %u vertices, %u triangles, %u-bit indices, %llu bytes\n", path, header->vertexCount,
+      header->indexCount / 3, header->indexSize * 8, (unsigned long long)header->fileSize);
+   printf("  bounds (%g, %g, %g) - (%g, %g, %g)\n", header->boundsMin[0], header->boundsMin[1], header->boundsMin[2],
+      header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+   for (uint32_t i = 0; i < MESH_MAX_STREAMS; ++i) {
+      const MeshStreamDesc *stream = &header->streams[i];
+      if (stream->format != MESH_FORMAT_NONE) {
+         printf("  %-8s %-8s stride %u at %llu\n", semanticNames[i], formatNames[stream->format], stream->stride,
+            (unsigned long long)stream->offset);
+      }
+   }
+
+   MeshClose(&mesh);
+   return true;
+}
+
+int main(int argc, char **argv)
+{
+   if (argc == 3 && strcmp(argv[1], "cube") == 0) {
+      return writeCube(argv[2]) ? 0 : 1;
+   } else if (argc == 4 && strcmp(argv[1], "obj") == 0) {
+      return convertObj(argv[2], argv[3]) ? 0 : 1;
+   } else if (argc >= 3 && strcmp(argv[1], "info") == 0) {
+      int result = 0;
+      for (int i = 2; i < argc; ++i) {
+         result |= printInfo(argv[i]) ? 0 : 1;
+      }
+      return result;
+   }
+
+   usage(argv[0]);
+   return 2;
+}
@@ -0,0 +1,130 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gpumemory.h"
+#include "meshes.h"
+#include "transfers.h"
+
+static void closeSource(void *user)
+{
+   MeshClose(&((Dx12Mesh *)user)->source);
+}
+
+bool LoadMesh(Dx12Mesh *mesh, Dx12Device *device, const char *path)
+{
+   // Only the header is validated here; the rest is read once, by the copy
+   // into staging memory.
+   const char *error;
+   if (!MeshOpen(&mesh->source, path, 0, &error)) {
+      char message[256];
+      sprintf_s(message, "%s: %s\n", path, error);
+      OutputDebugStringA(message);
+      return false;
+   }
+
+   uint64_t payloadSize;
+   const uint8_t *payload = MeshPayload(&mesh->source, &payloadSize);
+
+   D3D12_RESOURCE_DESC desc = {};
+   desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+   desc.Width = payloadSize;
+   desc.Height = 1;
+   desc.DepthOrArraySize = 1;
+   desc.MipLevels = 1;
+   desc.Format = DXGI_FORMAT_UNKNOWN;
+   desc.SampleDesc.Count = 1;
+   desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+   // Created in COMMON, as the copy queue needs; see UploadBuffer.
+   if (!AllocResource(device, D3D12_HEAP_TYPE_DEFAULT, &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, &mesh->buffer)) {
+      MeshClose(&mesh->source);
+      return false;
+   }
+
+   const MeshHeader *header = mesh->source.header;
+   D3D12_GPU_VIRTUAL_ADDRESS base = mesh->buffer.resource->GetGPUVirtualAddress() - MESH_DATA_OFFSET;
+   for (uint32_t i = 0; i < MESH_MAX_STREAMS; ++i) {
+      const MeshStreamDesc *stream = &header->streams[i];
+      D3D12_VERTEX_BUFFER_VIEW *view = &mesh->vertexViews[i];
+      if (stream->format == MESH_FORMAT_NONE) {
+         memset(view, 0, sizeof(*view));
+         continue;
+      }
+      view->BufferLocation = base + stream->offset;
+      view->SizeInBytes = (UINT)stream->size;
+      view->StrideInBytes = stream->stride;
+   }
+
+   mesh->indexView.BufferLocation = base + header->indexOffset;
+   mesh->indexView.SizeInBytes = header->indexCount * header->indexSize;
+   mesh->indexView.Format = header->indexSize == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+   mesh->indexCount = header->indexCount;
+   memcpy(mesh->boundsMin, header->boundsMin, sizeof(mesh->boundsMin));
+   memcpy(mesh->boundsMax, header->boundsMax, sizeof(mesh->boundsMax));
+
+   // The file stays mapped until the payload has been staged, a chunk at a
+   // time, over however many frames that takes.
+   mesh->transfer = UploadBuffer(&device->transfers, mesh->buffer.resource.Get(), 0, payload, payloadSize, closeSource, mesh);
+   return true;
+}
+
+// The views are read as lists are recorded, so frames already recorded keep
+// the old buffer's.
+static void meshMoved(void *user, ID3D12Resource *old)
+{
+   Dx12Mesh *mesh = (Dx12Mesh *)user;
+   D3D12_GPU_VIRTUAL_ADDRESS delta = mesh->buffer.resource->GetGPUVirtualAddress() - old->GetGPUVirtualAddress();
+   for (uint32_t i = 0; i < MESH_MAX_STREAMS; ++i) {
+      if (mesh->vertexViews[i].BufferLocation != 0) {
+         mesh->vertexViews[i].BufferLocation += delta;
+      }
+   }
+   mesh->indexView.BufferLocation += delta;
+}
+
+void MeshBeginFrame(Dx12Mesh *mesh, Dx12Device *device)
+{
+   if (mesh->buffer.resource && !mesh->buffer.moved && TransferFenceValue(&device->transfers.queue, mesh->transfer) == 0) {
+      SetMovable(device, &mesh->buffer, meshMoved, mesh);
+   }
+}
+
+void DestroyMesh(Dx12Mesh *mesh, Dx12Device *device)
+{
+   if (mesh->buffer.resource) {
+      // The upload is submitted first, which closes the source.
+      TransferFlush(&device->transfers.queue, mesh->transfer);
+   }
+   FreeResource(device, &mesh->buffer);
+}
+
+void CmdBindMesh(ID3D12GraphicsCommandList *commandList, const Dx12Mesh *mesh)
+{
+   commandList->IASetVertexBuffers(0, MESH_MAX_STREAMS, mesh->vertexViews);
+   commandList->IASetIndexBuffer(&mesh->indexView);
+}
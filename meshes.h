@@ -0,0 +1,47 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "dx12demo.h"
+
+// Maps the mesh file at path, creates a default-heap buffer for its payload
+// and queues the payload for upload on the device's copy queue. The payload
+// goes from the mapping straight into staging memory, so the only CPU copy
+// is the one into memory the GPU can read, and only pages of the file that
+// are actually part of the mesh get touched. Frames that draw the mesh must
+// UseTransfer(mesh->transfer).
+bool LoadMesh(Dx12Mesh *mesh, Dx12Device *device, const char *path);
+
+// Called at the start of each frame. Once the upload has completed, lets
+// defragmentation move the buffer; see gpumemory.h.
+void MeshBeginFrame(Dx12Mesh *mesh, Dx12Device *device);
+
+// Hands the buffer to the deferred-release queue. It may still be the
+// destination of a copy until DestroyTransfers.
+void DestroyMesh(Dx12Mesh *mesh, Dx12Device *device);
+
+// Binds every stream to the slot of its semantic and the index buffer.
+void CmdBindMesh(ID3D12GraphicsCommandList *commandList, const Dx12Mesh *mesh);
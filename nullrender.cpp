@@ -0,0 +1,737 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "common.h"
+#include "nullrender.h"
+
+static inline NullCommandList *nullList(RenderCommandList *list)
+{
+   return (NullCommandList *)list;
+}
+
+static void listError(NullCommandList *list, const char *error)
+{
+   if (list->errors++ == 0) {
+      list->error = error;
+   }
+}
+
+static void frameError(NullBackend *backend, const char *error)
+{
+   if (backend->stats.errors++ == 0) {
+      backend->error = error;
+   }
+}
+
+// Counted like a ResourceBarrier call, but nothing needs doing.
+static void flushBarriers(NullCommandList *list)
+{
+   const StateBarrier *barriers;
+   StateListFlush(&list->states, &barriers);
+}
+
+static void pushCommand(NullCommandList *list, NullCommandType type, uint32_t arg0, uint32_t arg1, uint64_t gpu)
+{
+   NullCommand command = {};
+   command.type = type;
+   command.arg0 = arg0;
+   command.arg1 = arg1;
+   command.gpu = gpu;
+   list->commands.push_back(command);
+}
+
+static inline bool validTarget(const NullBackend *backend, uint32_t target)
+{
+   return target <= backend->targetCount;
+}
+
+// Whether two transient targets share memory.
+static bool targetsOverlap(const NullBackend *backend, uint32_t a, uint32_t b)
+{
+   const NullTarget *x = &backend->targets[a];
+   const NullTarget *y = &backend->targets[b];
+   uint64_t xSize = (uint64_t)x->desc.width * x->desc.height * sizeof(uint32_t);
+   uint64_t ySize = (uint64_t)y->desc.width * y->desc.height * sizeof(uint32_t);
+   return a != b && x->offset < y->offset + ySize && y->offset < x->offset + xSize;
+}
+
+// Returns the end of the upload containing gpu, or 0 if it isn't in one.
+static uint64_t findUploadEnd(const NullBackend *backend, uint64_t gpu)
+{
+   // A frame makes a handful of uploads at most, so a scan will do.
+   for (size_t i = 0; i < backend->uploads.size(); ++i) {
+      const NullUpload *upload = &backend->uploads[i];
+      if (gpu >= upload->gpu && gpu < upload->gpu + upload->size) {
+         return upload->gpu + upload->size;
+      }
+   }
+   return 0;
+}
+
+NullBackend::NullBackend(uint32_t width, uint32_t height, uint32_t framesInFlight, uint64_t uploadSize)
+   : width(width), height(height), framesInFlight(framesInFlight),
+   frameNum(RENDER_MAX_FRAMES), curFrame(0), inFrame(false), submitted(false), storeSize(0), targetCount(0),
+   cullCommandCount(0), cullVisible(0), culled(false), submittedCount(0), stats(), error(nullptr)
+{
+   ASSERT(framesInFlight >= 1 && framesInFlight <= RENDER_MAX_FRAMES);
+
+   StateTrackerInit(&states);
+   memset(targets, 0, sizeof(targets));
+   targets[RENDER_BACK_BUFFER].desc.width = width;
+   targets[RENDER_BACK_BUFFER].desc.height = height;
+   targets[RENDER_BACK_BUFFER].state = StateTrackerAdd(&states, 1, STATE_PRESENT, 0, nullptr);
+   storeState = StateTrackerAdd(&states, 1, STATE_COMMON, STATE_DECAYS, nullptr);
+
+   fence.value = RENDER_MAX_FRAMES - 1;
+   TimelineInit(&timeline, &fence);
+
+   RingInit(&ring, uploadSize);
+   memory.resize((size_t)uploadSize + RENDER_UPLOAD_ALIGNMENT);
+   cpuBase = (uint8_t *)(((uintptr_t)memory.data() + RENDER_UPLOAD_ALIGNMENT - 1) & ~(uintptr_t)(RENDER_UPLOAD_ALIGNMENT - 1));
+
+   for (uint32_t i = 0; i < RENDER_MAX_CHUNKS; ++i) {
+      lists[i].chunk = i;
+      lists[i].open = false;
+      lists[i].inPass = false;
+      lists[i].errors = 0;
+      lists[i].error = nullptr;
+   }
+   memset(submittedLists, 0, sizeof(submittedLists));
+}
+
+void NullBackend::Resize(uint32_t newWidth, uint32_t newHeight)
+{
+   if (inFrame) {
+      frameError(this, "Resize inside a frame");
+   }
+   width = newWidth;
+   height = newHeight;
+   targets[RENDER_BACK_BUFFER].desc.width = newWidth;
+   targets[RENDER_BACK_BUFFER].desc.height = newHeight;
+}
+
+void NullBackend::SetFramesInFlight(uint32_t newFramesInFlight)
+{
+   ASSERT(newFramesInFlight >= 1 && newFramesInFlight <= RENDER_MAX_FRAMES);
+   if (inFrame) {
+      frameError(this, "SetFramesInFlight inside a frame");
+   }
+   framesInFlight = newFramesInFlight;
+}
+
+void NullBackend::GetStats(RenderStats *renderStats) const
+{
+   renderStats->framesInFlight = framesInFlight;
+   renderStats->uploadSize = ring.size;
+   renderStats->uploadHighWater = ring.highWater;
+   renderStats->gpuWaits = timeline.stats.waits;
+   renderStats->gpuBlockedWaits = timeline.stats.blockedWaits;
+   renderStats->gpuBlockedSeconds = timeline.stats.blockedSeconds;
+   renderStats->gpuPollSeconds = timeline.stats.pollSeconds;
+   renderStats->barriers = states.stats;
+   memset(&renderStats->memory, 0, sizeof(renderStats->memory));
+}
+
+bool NullBackend::BeginFrame(RenderFrame *frame)
+{
+   if (inFrame) {
+      frameError(this, "BeginFrame without EndFrame");
+   }
+   if (width == 0 || height == 0) {
+      return false;
+   }
+
+   curFrame = frameNum++;
+   TimelineWait(&timeline, curFrame - framesInFlight);
+   RingBeginFrame(&ring, timeline.completed);
+
+   uploads.clear();
+   submitted = false;
+   culled = false;
+   inFrame = true;
+
+   frame->frameNum = curFrame;
+   frame->width = width;
+   frame->height = height;
+   frame->maxChunks = RENDER_MAX_CHUNKS;
+   return true;
+}
+
+bool NullBackend::AllocUpload(uint64_t size, uint64_t alignment, RenderUpload *upload)
+{
+   if (!inFrame) {
+      frameError(this, "AllocUpload outside a frame");
+      return false;
+   }
+
+   uint64_t offset = RingAlloc(&ring, size, alignment);
+   if (offset == RING_INVALID) {
+      return false;
+   }
+
+   NullUpload record;
+   record.gpu = NULL_GPU_BASE + offset;
+   record.size = size;
+   uploads.push_back(record);
+
+   upload->cpu = cpuBase + offset;
+   upload->gpu = record.gpu;
+   return true;
+}
+
+bool NullBackend::SetInstanceStore(uint64_t size, uint64_t *gpu)
+{
+   for (uint32_t i = 0; i < RENDER_MAX_CHUNKS; ++i) {
+      if (lists[i].open) {
+         frameError(this, "SetInstanceStore while a command list is open");
+      }
+   }
+
+   if (size > storeSize) {
+      store.assign((size_t)((size + sizeof(Mat4) - 1) / sizeof(Mat4)), Mat4());
+      storeSize = size;
+   }
+   *gpu = NULL_STORE_BASE;
+   return true;
+}
+
+void NullBackend::GetTargetAllocation(const RenderTargetDesc *desc, uint64_t *size, uint64_t *alignment)
+{
+   uint64_t bytes = (uint64_t)desc->width * desc->height * sizeof(uint32_t);
+   *size = (bytes + NULL_TARGET_ALIGNMENT - 1) & ~(NULL_TARGET_ALIGNMENT - 1);
+   *alignment = NULL_TARGET_ALIGNMENT;
+}
+
+bool NullBackend::SetTransientTargets(const RenderTargetPlacement *placements, uint32_t count, uint64_t heapSize)
+{
+   ASSERT(count <= RENDER_MAX_TARGETS);
+   for (uint32_t i = 0; i < RENDER_MAX_CHUNKS; ++i) {
+      if (lists[i].open) {
+         frameError(this, "SetTransientTargets while a command list is open");
+      }
+   }
+
+   for (uint32_t i = 1; i <= targetCount; ++i) {
+      StateTrackerRemove(&states, targets[i].state);
+   }
+   targetCount = 0;
+
+   for (uint32_t i = 0; i < count; ++i) {
+      const RenderTargetPlacement *placement = &placements[i];
+      uint64_t size, alignment;
+      GetTargetAllocation(&placement->desc, &size, &alignment);
+      if (placement->offset % alignment != 0 || placement->offset + size > heapSize) {
+         frameError(this, "transient target placed outside its heap or misaligned");
+         return false;
+      }
+   }
+
+   targetMemory.assign((size_t)(heapSize / sizeof(uint32_t)), 0);
+   for (uint32_t i = 0; i < count; ++i) {
+      NullTarget *target = &targets[i + 1];
+      target->desc = placements[i].desc;
+      target->offset = placements[i].offset;
+      target->state = StateTrackerAdd(&states, 1, placements[i].state, 0, nullptr);
+   }
+   targetCount = count;
+   return true;
+}
+
+RenderCommandList *NullBackend::BeginCommandList(uint32_t chunk)
+{
+   ASSERT(chunk < RENDER_MAX_CHUNKS);
+   NullCommandList *list = &lists[chunk];
+
+   if (!inFrame) {
+      listError(list, "command list begun outside a frame");
+   }
+   if (list->open) {
+      listError(list, "command list begun twice");
+   }
+
+   list->open = true;
+   list->inPass = false;
+   list->instanceGpu = 0;
+   list->instanceEnd = 0;
+   list->instanceStride = 0;
+   list->storeCopies.clear();
+   list->barriers.clear();
+   list->commands.clear();
+   StateListBegin(&list->states, &states);
+   return (RenderCommandList *)list;
+}
+
+void NullBackend::CmdBarriers(RenderCommandList *renderList, const RenderBarrier *barriers, uint32_t count)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdBarriers on a closed command list");
+   }
+   if (list->inPass) {
+      listError(list, "CmdBarriers inside a pass");
+   }
+
+   for (uint32_t i = 0; i < count; ++i) {
+      const RenderBarrier *barrier = &barriers[i];
+      if (!validTarget(this, barrier->target)) {
+         listError(list, "barrier for a target that doesn't exist");
+         return;
+      }
+      uint32_t id = targets[barrier->target].state;
+
+      if (barrier->flags & RENDER_BARRIER_ALIAS) {
+         if (barrier->target == RENDER_BACK_BUFFER || barrier->aliasBefore == RENDER_BACK_BUFFER ||
+            (barrier->aliasBefore != RENDER_NO_TARGET && !validTarget(this, barrier->aliasBefore))) {
+            listError(list, "aliasing barrier between targets that can't alias");
+            return;
+         }
+         StateListAlias(&list->states, barrier->aliasBefore == RENDER_NO_TARGET ? STATE_INVALID :
+            targets[barrier->aliasBefore].state, id);
+         continue;
+      }
+
+      // Transitions say what they expect, which is how the list knows the
+      // state of a target it hasn't used yet.
+      uint32_t current = StateListState(&list->states, id, STATE_ALL_SUBRESOURCES);
+      uint32_t expected = barrier->flags & RENDER_BARRIER_END ? barrier->after : barrier->before;
+      if (current == STATE_INVALID) {
+         if (expected != STATE_INVALID) {
+            StateListTransition(&list->states, id, STATE_ALL_SUBRESOURCES, expected);
+         }
+      } else if (current != expected) {
+         listError(list, "barrier from a state the target isn't in");
+      }
+      if (barrier->flags & RENDER_BARRIER_BEGIN) {
+         StateListBeginSplit(&list->states, id, STATE_ALL_SUBRESOURCES, barrier->after);
+      } else {
+         StateListTransition(&list->states, id, STATE_ALL_SUBRESOURCES, barrier->after);
+      }
+   }
+   flushBarriers(list);
+
+   pushCommand(list, NULL_CMD_BARRIERS, (uint32_t)list->barriers.size(), count, 0);
+   list->barriers.insert(list->barriers.end(), barriers, barriers + count);
+}
+
+// Whether the list has the target in state, or leaves it to whatever came
+// before, and from now on uses it in state.
+static bool useTarget(NullBackend *backend, NullCommandList *list, uint32_t target, uint32_t state)
+{
+   uint32_t id = backend->targets[target].state;
+   uint32_t current = StateListState(&list->states, id, STATE_ALL_SUBRESOURCES);
+   StateListTransition(&list->states, id, STATE_ALL_SUBRESOURCES, state);
+   return current == STATE_INVALID || current == state;
+}
+
+void NullBackend::CmdBeginPass(RenderCommandList *renderList, uint32_t target, const float *clearColor,
+   const float *clearDepth)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdBeginPass on a closed command list");
+   }
+   if (list->inPass) {
+      listError(list, "CmdBeginPass inside a pass");
+   }
+
+   if (!validTarget(this, target)) {
+      listError(list, "CmdBeginPass on a target that doesn't exist");
+      target = RENDER_BACK_BUFFER;
+   } else if (!useTarget(this, list, target, STATE_RENDER_TARGET)) {
+      listError(list, "pass target not in RENDER_TARGET");
+   }
+   if (targets[target].desc.width != width || targets[target].desc.height != height) {
+      listError(list, "pass target isn't the size of the depth buffer");
+   }
+   flushBarriers(list);
+
+   list->inPass = true;
+   uint32_t clears = (clearColor ? NULL_CLEAR_COLOR : 0) | (clearDepth ? NULL_CLEAR_DEPTH : 0);
+   pushCommand(list, NULL_CMD_BEGIN_PASS, clears, target, 0);
+   if (clearColor) {
+      memcpy(list->commands.back().clearColor, clearColor, sizeof(list->commands.back().clearColor));
+   }
+   if (clearDepth) {
+      list->commands.back().clearDepth = *clearDepth;
+   }
+}
+
+void NullBackend::CmdSetInstanceBuffer(RenderCommandList *renderList, uint64_t gpu, uint32_t stride)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdSetInstanceBuffer on a closed command list");
+   }
+   if (stride == 0) {
+      listError(list, "CmdSetInstanceBuffer with zero stride");
+   }
+
+   // Uploads don't change while lists are recorded, so this is safe from any thread.
+   uint64_t end = findUploadEnd(this, gpu);
+   if (gpu >= NULL_STORE_BASE && gpu < NULL_STORE_BASE + storeSize) {
+      end = NULL_STORE_BASE + storeSize;
+      StateListTransition(&list->states, storeState, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+      flushBarriers(list);
+   } else if (end == 0) {
+      listError(list, "instance buffer is not in this frame's upload memory or the store");
+   }
+
+   list->instanceGpu = gpu;
+   list->instanceEnd = end;
+   list->instanceStride = stride;
+   pushCommand(list, NULL_CMD_SET_INSTANCE_BUFFER, stride, 0, gpu);
+}
+
+void NullBackend::CmdUpdateInstanceStore(RenderCommandList *renderList, uint64_t src, const RenderStoreCopy *copies,
+   uint32_t count)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdUpdateInstanceStore on a closed command list");
+   }
+   if (list->inPass) {
+      listError(list, "CmdUpdateInstanceStore inside a pass");
+   }
+
+   uint64_t srcEnd = findUploadEnd(this, src);
+   if (srcEnd == 0) {
+      listError(list, "store update source is not in this frame's upload memory");
+   }
+   for (uint32_t i = 0; i < count; ++i) {
+      const RenderStoreCopy *copy = &copies[i];
+      if (src + copy->srcOffset + copy->size > srcEnd) {
+         listError(list, "store update reads past the end of its upload");
+      }
+      if (copy->dstOffset + copy->size > storeSize) {
+         listError(list, "store update writes past the end of the store");
+      }
+   }
+
+   pushCommand(list, NULL_CMD_UPDATE_INSTANCE_STORE, (uint32_t)list->storeCopies.size(), count, src);
+   list->storeCopies.insert(list->storeCopies.end(), copies, copies + count);
+
+   // Same transitions as the D3D12 backend's copies.
+   if (count) {
+      StateListTransition(&list->states, storeState, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+      flushBarriers(list);
+      StateListBeginSplit(&list->states, storeState, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+      flushBarriers(list);
+   }
+}
+
+void NullBackend::CmdDraw(RenderCommandList *renderList, uint32_t indexCount, uint32_t instanceCount)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdDraw on a closed command list");
+   }
+   if (!list->inPass) {
+      listError(list, "CmdDraw outside a pass");
+   }
+   if (indexCount == 0 || instanceCount == 0) {
+      listError(list, "empty draw");
+   }
+   if (list->instanceGpu == 0) {
+      listError(list, "CmdDraw without an instance buffer");
+   } else if (list->instanceGpu + (uint64_t)instanceCount * list->instanceStride > list->instanceEnd) {
+      listError(list, "draw reads past the end of its instance buffer");
+   }
+
+   pushCommand(list, NULL_CMD_DRAW, indexCount, instanceCount, 0);
+}
+
+bool NullBackend::SetCullScene(const CullInstance *instances, uint32_t count)
+{
+   if (culled) {
+      frameError(this, "SetCullScene after this frame's CullScene");
+   }
+
+   cullScene.assign(instances, instances + count);
+   uint32_t groups = CullGroupCount(count);
+   cullOutput.resize((size_t)groups * CULL_GROUP_SIZE);
+   cullGroupCounts.resize(groups);
+   cullCommands.resize(groups);
+   return true;
+}
+
+void NullBackend::CullScene(const CullConstants *constants)
+{
+   if (!inFrame) {
+      frameError(this, "CullScene outside a frame");
+   }
+   if (culled) {
+      frameError(this, "more than one CullScene in a frame");
+   }
+
+   CullConstants frameConstants = *constants;
+   frameConstants.instanceCount = (uint32_t)cullScene.size();
+   frameConstants.outputBase = 0;
+   cullCommandCount = ::CullScene(&frameConstants, cullScene.data(), cullOutput.data(), cullGroupCounts.data(), cullCommands.data());
+
+   cullVisible = 0;
+   for (uint32_t i = 0; i < cullCommandCount; ++i) {
+      cullVisible += cullCommands[i].instanceCount;
+   }
+   stats.culledInstances += cullScene.size() - cullVisible;
+   culled = true;
+}
+
+void NullBackend::CmdDrawCulled(RenderCommandList *renderList)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdDrawCulled on a closed command list");
+   }
+   if (!list->inPass) {
+      listError(list, "CmdDrawCulled outside a pass");
+   }
+   if (!culled) {
+      listError(list, "CmdDrawCulled without CullScene");
+   }
+
+   pushCommand(list, NULL_CMD_DRAW_CULLED, 0, 0, 0);
+}
+
+void NullBackend::CmdEndPass(RenderCommandList *renderList)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->inPass) {
+      listError(list, "CmdEndPass outside a pass");
+   }
+
+   list->inPass = false;
+   pushCommand(list, NULL_CMD_END_PASS, 0, 0, 0);
+}
+
+void NullBackend::CmdCopyTarget(RenderCommandList *renderList, uint32_t src, uint32_t dst)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "CmdCopyTarget on a closed command list");
+   }
+   if (list->inPass) {
+      listError(list, "CmdCopyTarget inside a pass");
+   }
+
+   if (!validTarget(this, src) || !validTarget(this, dst) || src == dst) {
+      listError(list, "CmdCopyTarget between targets that don't exist or are the same");
+      return;
+   }
+   if (targets[src].desc.width != targets[dst].desc.width || targets[src].desc.height != targets[dst].desc.height) {
+      listError(list, "CmdCopyTarget between targets of different sizes");
+   }
+   if (!useTarget(this, list, src, STATE_COPY_SOURCE)) {
+      listError(list, "copy source not in COPY_SOURCE");
+   }
+   if (!useTarget(this, list, dst, STATE_COPY_DEST)) {
+      listError(list, "copy destination not in COPY_DEST");
+   }
+   flushBarriers(list);
+
+   pushCommand(list, NULL_CMD_COPY_TARGET, src, dst, 0);
+}
+
+void NullBackend::EndCommandList(RenderCommandList *renderList)
+{
+   NullCommandList *list = nullList(renderList);
+   if (!list->open) {
+      listError(list, "command list ended twice");
+   }
+   if (list->inPass) {
+      listError(list, "command list ended inside a pass");
+   }
+
+   StateListEnd(&list->states);
+   flushBarriers(list);
+   list->open = false;
+}
+
+void NullBackend::Submit(RenderCommandList *const *renderLists, uint32_t count)
+{
+   if (!inFrame) {
+      frameError(this, "Submit outside a frame");
+   }
+   if (submitted) {
+      frameError(this, "more than one Submit in a frame");
+   }
+   ASSERT(count <= RENDER_MAX_CHUNKS);
+
+   // Across the whole submission: the back buffer's first use overwrites it,
+   // the first pass clears depth, and a transient target that shares memory
+   // is only used between the aliasing barrier that hands the memory to it
+   // and the next one that hands it on, and only once it's been overwritten.
+   bool backBufferWritten = false;
+   bool depthCleared = false;
+   bool owned[RENDER_MAX_TARGETS + 1];
+   bool defined[RENDER_MAX_TARGETS + 1];
+   for (uint32_t t = 1; t <= targetCount; ++t) {
+      owned[t] = true;
+      for (uint32_t u = 1; u <= targetCount; ++u) {
+         owned[t] = owned[t] && !targetsOverlap(this, t, u);
+      }
+      defined[t] = false;
+   }
+
+   for (uint32_t i = 0; i < count; ++i) {
+      NullCommandList *list = nullList(renderLists[i]);
+      if (list->chunk != i) {
+         listError(list, "command lists submitted out of chunk order");
+      }
+      if (list->open) {
+         listError(list, "command list submitted while open");
+      }
+
+      // Nothing to put in front of the list, but the count is the D3D12
+      // backend's too.
+      fixups.clear();
+      StateTrackerResolve(&states, &list->states, &fixups);
+
+      for (size_t j = 0; j < list->commands.size(); ++j) {
+         const NullCommand *command = &list->commands[j];
+         switch (command->type) {
+         case NULL_CMD_BARRIERS:
+            for (uint32_t k = 0; k < command->arg1; ++k) {
+               const RenderBarrier *barrier = &list->barriers[command->arg0 + k];
+               if (!(barrier->flags & RENDER_BARRIER_ALIAS)) {
+                  continue;
+               }
+               for (uint32_t t = 1; t <= targetCount; ++t) {
+                  if (targetsOverlap(this, t, barrier->target)) {
+                     owned[t] = false;
+                     defined[t] = false;
+                  }
+               }
+               owned[barrier->target] = true;
+               defined[barrier->target] = false;
+            }
+            break;
+         case NULL_CMD_BEGIN_PASS:
+            if (command->arg0 & NULL_CLEAR_DEPTH) {
+               depthCleared = true;
+            } else if (!depthCleared) {
+               frameError(this, "pass before the depth buffer is cleared");
+            }
+            if (command->arg1 == RENDER_BACK_BUFFER) {
+               if (!backBufferWritten && !(command->arg0 & NULL_CLEAR_COLOR)) {
+                  frameError(this, "back buffer drawn to before it's cleared or copied over");
+               }
+               backBufferWritten = true;
+            } else if (!owned[command->arg1]) {
+               frameError(this, "pass on a target whose memory another target has");
+            } else if (command->arg0 & NULL_CLEAR_COLOR) {
+               defined[command->arg1] = true;
+            } else if (!defined[command->arg1]) {
+               frameError(this, "pass on a target before it's cleared or copied over");
+            }
+            break;
+         case NULL_CMD_COPY_TARGET:
+            if (command->arg0 == RENDER_BACK_BUFFER ? !backBufferWritten :
+               !owned[command->arg0] || !defined[command->arg0]) {
+               frameError(this, "copy from a target with nothing in it");
+            }
+            if (command->arg1 == RENDER_BACK_BUFFER) {
+               backBufferWritten = true;
+            } else if (!owned[command->arg1]) {
+               frameError(this, "copy to a target whose memory another target has");
+            } else {
+               defined[command->arg1] = true;
+            }
+            break;
+         case NULL_CMD_UPDATE_INSTANCE_STORE:
+            // Checked when recorded; a list with errors copies nothing.
+            for (uint32_t k = 0; k < command->arg1 && !list->errors; ++k) {
+               const RenderStoreCopy *copy = &list->storeCopies[command->arg0 + k];
+               memcpy((uint8_t *)store.data() + copy->dstOffset, CpuAddress(command->gpu + copy->srcOffset), (size_t)copy->size);
+            }
+            break;
+         case NULL_CMD_DRAW:
+            ++stats.draws;
+            stats.instances += command->arg1;
+            break;
+         case NULL_CMD_DRAW_CULLED:
+            stats.draws += cullCommandCount;
+            stats.instances += cullVisible;
+            break;
+         default:
+            break;
+         }
+      }
+
+      stats.commands += list->commands.size();
+      stats.errors += list->errors;
+      if (list->errors && !error) {
+         error = list->error;
+      }
+      list->errors = 0;
+      list->error = nullptr;
+      submittedLists[i] = list;
+   }
+
+   if (!backBufferWritten) {
+      frameError(this, "back buffer never drawn");
+   }
+   if (states.resources[targets[RENDER_BACK_BUFFER].state].states[0] != STATE_PRESENT) {
+      frameError(this, "back buffer not left in PRESENT");
+   }
+   StateTrackerEndSubmit(&states);
+
+   stats.commandLists += count;
+   submittedCount = count;
+   submitted = true;
+}
+
+void NullBackend::EndFrame()
+{
+   if (!inFrame) {
+      frameError(this, "EndFrame outside a frame");
+      return;
+   }
+   if (!submitted) {
+      frameError(this, "EndFrame without Submit");
+   }
+
+   RingEndFrame(&ring, curFrame);
+   ++stats.frames;
+   culled = false;
+   inFrame = false;
+}
+
+const uint8_t *NullBackend::CpuAddress(uint64_t gpu) const
+{
+   if (gpu >= NULL_STORE_BASE) {
+      return (const uint8_t *)store.data() + (gpu - NULL_STORE_BASE);
+   }
+   return cpuBase + (gpu - NULL_GPU_BASE);
+}
+
+uint32_t *NullBackend::TargetPixels(uint32_t target)
+{
+   if (target == RENDER_BACK_BUFFER || target > targetCount) {
+      return nullptr;
+   }
+   return targetMemory.data() + targets[target].offset / sizeof(uint32_t);
+}
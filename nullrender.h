@@ -0,0 +1,208 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "render.h"
+#include "ring.h"
+#include "timeline.h"
+
+// A backend with no GPU behind it. Upload memory is plain host memory, the
+// fence retires each frame as soon as the next frame would have to wait for
+// it, and every command is checked against the rules the D3D12 backend relies
+// on, then kept so the last frame's stream can be inspected.
+
+#define NULL_GPU_BASE   (1ull << 40)   // fake address of the first upload byte
+#define NULL_STORE_BASE (1ull << 41)   // ...and of the instance store
+#define NULL_TARGET_ALIGNMENT (64ull << 10)   // D3D12's default resource placement alignment
+
+enum NullCommandType {
+   NULL_CMD_BARRIERS,
+   NULL_CMD_BEGIN_PASS,
+   NULL_CMD_SET_INSTANCE_BUFFER,
+   NULL_CMD_UPDATE_INSTANCE_STORE,
+   NULL_CMD_DRAW,
+   NULL_CMD_DRAW_CULLED,
+   NULL_CMD_END_PASS,
+   NULL_CMD_COPY_TARGET,
+};
+
+// BEGIN_PASS clears.
+#define NULL_CLEAR_COLOR   0x1
+#define NULL_CLEAR_DEPTH   0x2
+
+struct NullCommand {
+   NullCommandType type;
+   uint32_t arg0;       // BARRIERS: first barrier, BEGIN_PASS: clears, SET_INSTANCE_BUFFER: stride,
+                        // UPDATE_INSTANCE_STORE: first copy, DRAW: index count, COPY_TARGET: source
+   uint32_t arg1;       // BARRIERS: barrier count, BEGIN_PASS: target, UPDATE_INSTANCE_STORE: copy count,
+                        // DRAW: instance count, COPY_TARGET: destination
+   uint64_t gpu;        // SET_INSTANCE_BUFFER, UPDATE_INSTANCE_STORE: source
+   float clearColor[4]; // BEGIN_PASS with NULL_CLEAR_COLOR
+   float clearDepth;    // ...and with NULL_CLEAR_DEPTH
+};
+
+struct NullCommandList {
+   uint32_t chunk;
+   bool open;
+   bool inPass;
+
+   uint64_t instanceGpu;      // 0 until CmdSetInstanceBuffer
+   uint64_t instanceEnd;      // end of the upload or store holding instanceGpu
+   uint32_t instanceStride;
+   std::vector<RenderStoreCopy> storeCopies;   // for UPDATE_INSTANCE_STORE commands
+   std::vector<RenderBarrier> barriers;        // for BARRIERS commands
+   StateList states;          // transitions are tracked as the D3D12 backend does, and counted
+
+   uint32_t errors;
+   const char *error;         // the first one
+   std::vector<NullCommand> commands;
+};
+
+struct NullTarget {
+   RenderTargetDesc desc;
+   uint64_t offset;           // into NullBackend::targetMemory
+   uint32_t state;            // tracker id
+};
+
+struct NullUpload {
+   uint64_t gpu;
+   uint64_t size;
+};
+
+// Stands in for the GPU's fence: a value completes when the CPU blocks on it
+// and not before.
+class NullFence : public TimelineFence {
+public:
+   uint64_t value;
+
+   NullFence() : value(0) {}
+
+   uint64_t CompletedValue() override { return value; }
+   void Block(uint64_t target) override { value = target; }
+};
+
+struct NullRenderStats {
+   uint64_t frames;
+   uint64_t commandLists;
+   uint64_t commands;
+   uint64_t draws;
+   uint64_t instances;
+   uint64_t culledInstances;  // left out by CullScene
+   uint64_t errors;
+};
+
+class NullBackend : public RenderBackend {
+public:
+   uint32_t width;
+   uint32_t height;
+   uint32_t framesInFlight;
+
+   uint64_t frameNum;         // fence value the next frame will signal
+   NullFence fence;
+   Timeline timeline;
+   uint64_t curFrame;
+   bool inFrame;
+   bool submitted;
+
+   RingAllocator ring;
+   std::vector<uint8_t> memory;
+   uint8_t *cpuBase;          // memory, aligned for RENDER_UPLOAD_ALIGNMENT
+   std::vector<NullUpload> uploads;   // this frame's
+
+   // Updated as each submission is validated, so the soft backend's draws
+   // see every update of their submission, wherever in it they were made.
+   // The frame loop only makes them ahead of any draw.
+   std::vector<Mat4> store;
+   uint64_t storeSize;
+
+   // Render targets by number. The back buffer has no memory here; the
+   // transient ones overlap in targetMemory just as they would in a heap.
+   NullTarget targets[RENDER_MAX_TARGETS + 1];
+   uint32_t targetCount;      // transient ones
+   std::vector<uint32_t> targetMemory;
+
+   StateTracker states;
+   uint32_t storeState;       // tracker id
+   std::vector<StateBarrier> fixups;
+
+   // The cull scene, and the results of this frame's CullScene, which runs
+   // cull.h's CPU version on the spot. Command instance addresses are byte
+   // offsets into cullOutput.
+   std::vector<CullInstance> cullScene;
+   std::vector<Mat4> cullOutput;
+   std::vector<uint32_t> cullGroupCounts;
+   std::vector<CullDrawCommand> cullCommands;
+   uint32_t cullCommandCount;
+   uint32_t cullVisible;
+   bool culled;               // CullScene has run this frame
+
+   NullCommandList lists[RENDER_MAX_CHUNKS];
+   const NullCommandList *submittedLists[RENDER_MAX_CHUNKS];  // last frame's, in submission order
+   uint32_t submittedCount;
+
+   NullRenderStats stats;
+   const char *error;         // first validation failure, if any
+
+   NullBackend(uint32_t width, uint32_t height, uint32_t framesInFlight, uint64_t uploadSize);
+
+   void Resize(uint32_t width, uint32_t height) override;
+   void SetFramesInFlight(uint32_t framesInFlight) override;
+   void SetVsync(bool) override {}   // nothing is presented
+   void GetStats(RenderStats *stats) const override;
+
+   bool BeginFrame(RenderFrame *frame) override;
+   bool AllocUpload(uint64_t size, uint64_t alignment, RenderUpload *upload) override;
+   bool SetInstanceStore(uint64_t size, uint64_t *gpu) override;
+   void CmdUpdateInstanceStore(RenderCommandList *list, uint64_t src, const RenderStoreCopy *copies,
+      uint32_t count) override;
+
+   void GetTargetAllocation(const RenderTargetDesc *desc, uint64_t *size, uint64_t *alignment) override;
+   bool SetTransientTargets(const RenderTargetPlacement *placements, uint32_t count, uint64_t heapSize) override;
+
+   RenderCommandList *BeginCommandList(uint32_t chunk) override;
+   void CmdBarriers(RenderCommandList *list, const RenderBarrier *barriers, uint32_t count) override;
+   void CmdBeginPass(RenderCommandList *list, uint32_t target, const float *clearColor, const float *clearDepth) override;
+   void CmdSetInstanceBuffer(RenderCommandList *list, uint64_t gpu, uint32_t stride) override;
+   void CmdDraw(RenderCommandList *list, uint32_t indexCount, uint32_t instanceCount) override;
+   bool SetCullScene(const CullInstance *instances, uint32_t count) override;
+   void CullScene(const CullConstants *constants) override;
+   void CmdDrawCulled(RenderCommandList *list) override;
+   void CmdEndPass(RenderCommandList *list) override;
+   void CmdCopyTarget(RenderCommandList *list, uint32_t src, uint32_t dst) override;
+   void EndCommandList(RenderCommandList *list) override;
+
+   void Submit(RenderCommandList *const *lists, uint32_t count) override;
+   void EndFrame() override;
+
+   // Host memory behind an upload or store address.
+   const uint8_t *CpuAddress(uint64_t gpu) const;
+
+   // A transient target's pixels; the back buffer has none.
+   uint32_t *TargetPixels(uint32_t target);
+};
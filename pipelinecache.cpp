@@ -0,0 +1,271 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "common.h"
+#include "pipelinecache.h"
+#include "profiler.h"
+
+static_assert((PIPELINE_CACHE_CAPACITY & (PIPELINE_CACHE_CAPACITY - 1)) == 0, "PIPELINE_CACHE_CAPACITY must be a power of two");
+
+// Lock-free: slots are only ever filled in, and a slot's key is published
+// after the rest of it.
+static PipelineCacheEntry *findEntry(const PipelineCache *cache, PipelineKey key)
+{
+   uint64_t wanted = (uint64_t)key.bits + 1;
+   uint32_t index = (uint32_t)key.hash() & (PIPELINE_CACHE_CAPACITY - 1);
+   for (uint32_t i = 0; i < PIPELINE_CACHE_CAPACITY; ++i) {
+      PipelineCacheEntry *entry = &cache->entries[index];
+      uint64_t entryKey = entry->key.load(std::memory_order_acquire);
+      if (entryKey == wanted) {
+         return entry;
+      } else if (entryKey == 0) {
+         return nullptr;
+      }
+      index = (index + 1) & (PIPELINE_CACHE_CAPACITY - 1);
+   }
+   return nullptr;
+}
+
+// Under the lock. Returns the existing entry for key, or a new one in the
+// given state, or null if the table is full.
+static PipelineCacheEntry *findOrAddEntry(PipelineCache *cache, PipelineKey key, PipelineState state, bool *added)
+{
+   *added = false;
+   PipelineCacheEntry *entry = findEntry(cache, key);
+   if (entry) {
+      return entry;
+   }
+
+   // Keep a free slot so probes for missing keys always terminate early.
+   ASSERT(cache->count < PIPELINE_CACHE_CAPACITY - 1);
+   if (cache->count >= PIPELINE_CACHE_CAPACITY - 1) {
+      return nullptr;
+   }
+
+   uint32_t index = (uint32_t)key.hash() & (PIPELINE_CACHE_CAPACITY - 1);
+   while (cache->entries[index].key.load(std::memory_order_relaxed) != 0) {
+      index = (index + 1) & (PIPELINE_CACHE_CAPACITY - 1);
+   }
+
+   entry = &cache->entries[index];
+   entry->pipeline = nullptr;
+   entry->state.store(state, std::memory_order_relaxed);
+   entry->key.store((uint64_t)key.bits + 1, std::memory_order_release);
+   ++cache->count;
+   ++cache->pending;
+   *added = true;
+   return entry;
+}
+
+// Runs without the lock; entry must already be CREATING, owned by the caller.
+static void createPipeline(PipelineCache *cache, PipelineCacheEntry *entry, PipelineKey key, bool background)
+{
+   void *pipeline;
+   {
+      PROFILE_ZONE("create pipeline");
+      pipeline = cache->create(cache->user, key);
+   }
+
+   {
+      std::lock_guard<std::mutex> guard(cache->lock);
+      entry->pipeline = pipeline;
+      entry->state.store(pipeline ? PIPELINE_READY : PIPELINE_FAILED, std::memory_order_release);
+      --cache->pending;
+      if (pipeline) {
+         ++cache->stats.created;
+         cache->stats.precompiled += background ? 1 : 0;
+      } else {
+         ++cache->stats.failed;
+      }
+   }
+   cache->finished.notify_all();
+}
+
+static void compileThreadMain(PipelineCache *cache, uint32_t index)
+{
+   char name[PROFILE_NAME_LENGTH];
+   snprintf(name, sizeof(name), "pipeline compile %u", index);
+   ProfilerSetThreadName(name);
+
+   std::unique_lock<std::mutex> guard(cache->lock);
+   for (;;) {
+      cache->queued.wait(guard, [cache] { return cache->quit || !cache->queue.empty(); });
+      if (cache->quit) {
+         return;
+      }
+
+      // A lookup may have claimed it in the meantime.
+      PipelineCacheEntry *entry = cache->queue.front();
+      cache->queue.erase(cache->queue.begin());
+      if (entry->state.load(std::memory_order_relaxed) != PIPELINE_QUEUED) {
+         continue;
+      }
+
+      entry->state.store(PIPELINE_CREATING, std::memory_order_relaxed);
+      PipelineKey key((uint32_t)(entry->key.load(std::memory_order_relaxed) - 1));
+      guard.unlock();
+      createPipeline(cache, entry, key, true);
+      guard.lock();
+   }
+}
+
+void PipelineCacheInit(PipelineCache *cache, PipelineCreateFn *create, PipelineDestroyFn *destroy, void *user)
+{
+   cache->create = create;
+   cache->destroy = destroy;
+   cache->user = user;
+
+   cache->entries = new PipelineCacheEntry[PIPELINE_CACHE_CAPACITY];
+   for (uint32_t i = 0; i < PIPELINE_CACHE_CAPACITY; ++i) {
+      cache->entries[i].key.store(0, std::memory_order_relaxed);
+      cache->entries[i].state.store(PIPELINE_FAILED, std::memory_order_relaxed);
+      cache->entries[i].pipeline = nullptr;
+   }
+   cache->count = 0;
+   cache->pending = 0;
+   cache->queue.clear();
+   cache->quit = false;
+   memset(&cache->stats, 0, sizeof(cache->stats));
+
+   for (uint32_t i = 0; i < PIPELINE_CACHE_THREADS; ++i) {
+      cache->threads[i] = std::thread(compileThreadMain, cache, i);
+   }
+}
+
+void PipelineCacheShutdown(PipelineCache *cache)
+{
+   {
+      std::lock_guard<std::mutex> guard(cache->lock);
+      cache->quit = true;
+   }
+   cache->queued.notify_all();
+   for (uint32_t i = 0; i < PIPELINE_CACHE_THREADS; ++i) {
+      cache->threads[i].join();
+   }
+
+   for (uint32_t i = 0; i < PIPELINE_CACHE_CAPACITY; ++i) {
+      PipelineCacheEntry *entry = &cache->entries[i];
+      if (entry->key.load(std::memory_order_relaxed) && entry->pipeline) {
+         cache->destroy(cache->user, entry->pipeline);
+      }
+   }
+
+   delete[] cache->entries;
+   cache->entries = nullptr;
+   cache->count = 0;
+   cache->pending = 0;
+   cache->queue.clear();
+}
+
+void *PipelineCacheGet(PipelineCache *cache, PipelineKey key)
+{
+   PipelineCacheEntry *entry = findEntry(cache, key);
+   if (entry && entry->state.load(std::memory_order_acquire) == PIPELINE_READY) {
+      return entry->pipeline;
+   }
+
+   PROFILE_ZONE("pipeline stall");
+   std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+   std::unique_lock<std::mutex> guard(cache->lock);
+   bool added;
+   entry = findOrAddEntry(cache, key, PIPELINE_CREATING, &added);
+   if (!entry) {
+      return nullptr;
+   }
+
+   uint32_t state = entry->state.load(std::memory_order_relaxed);
+   if (state == PIPELINE_READY || state == PIPELINE_FAILED) {
+      // Finished between the probe and taking the lock.
+      return entry->pipeline;
+   }
+
+   if (added || state == PIPELINE_QUEUED) {
+      // Not started yet, so don't wait for a background thread to get to it;
+      // the queue skips entries that are no longer QUEUED.
+      entry->state.store(PIPELINE_CREATING, std::memory_order_relaxed);
+      guard.unlock();
+      createPipeline(cache, entry, key, false);
+      guard.lock();
+   } else {
+      cache->finished.wait(guard, [entry] {
+         return entry->state.load(std::memory_order_relaxed) != PIPELINE_CREATING;
+      });
+   }
+
+   ++cache->stats.stalls;
+   cache->stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+   return entry->pipeline;
+}
+
+void *PipelineCacheTryGet(PipelineCache *cache, PipelineKey key)
+{
+   PipelineCacheEntry *entry = findEntry(cache, key);
+   if (entry) {
+      return entry->state.load(std::memory_order_acquire) == PIPELINE_READY ? entry->pipeline : nullptr;
+   }
+
+   PipelineCachePrecompile(cache, &key, 1);
+   return nullptr;
+}
+
+void PipelineCachePrecompile(PipelineCache *cache, const PipelineKey *keys, uint32_t count)
+{
+   uint32_t queuedCount = 0;
+   {
+      std::lock_guard<std::mutex> guard(cache->lock);
+      for (uint32_t i = 0; i < count; ++i) {
+         bool added;
+         PipelineCacheEntry *entry = findOrAddEntry(cache, keys[i], PIPELINE_QUEUED, &added);
+         if (added) {
+            cache->queue.push_back(entry);
+            ++queuedCount;
+         }
+      }
+   }
+
+   if (queuedCount == 1) {
+      cache->queued.notify_one();
+   } else if (queuedCount > 1) {
+      cache->queued.notify_all();
+   }
+}
+
+void PipelineCacheWaitIdle(PipelineCache *cache)
+{
+   std::unique_lock<std::mutex> guard(cache->lock);
+   cache->finished.wait(guard, [cache] { return cache->pending == 0; });
+}
+
+void PipelineCacheGetStats(PipelineCache *cache, PipelineCacheStats *stats)
+{
+   std::lock_guard<std::mutex> guard(cache->lock);
+   *stats = cache->stats;
+}
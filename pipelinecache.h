@@ -0,0 +1,114 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pipelinekey.h"
+
+#define PIPELINE_CACHE_CAPACITY  1024   // distinct keys over the cache's life; a power of two
+#define PIPELINE_CACHE_THREADS   2      // background compile threads
+
+// Makes the backend's pipeline object for key; returns null on failure. May
+// be called from several threads at once.
+typedef void *PipelineCreateFn(void *user, PipelineKey key);
+typedef void PipelineDestroyFn(void *user, void *pipeline);
+
+enum PipelineState {
+   PIPELINE_QUEUED,     // waiting for a background thread
+   PIPELINE_CREATING,
+   PIPELINE_READY,
+   PIPELINE_FAILED,
+};
+
+struct PipelineCacheEntry {
+   std::atomic<uint64_t> key;       // bits + 1, so 0 marks an empty slot
+   std::atomic<uint32_t> state;     // PipelineState
+   void *pipeline;                  // set before state becomes READY
+};
+
+struct PipelineCacheStats {
+   uint32_t created;                // on the calling thread or in the background
+   uint32_t precompiled;            // ...of which in the background
+   uint32_t failed;
+   uint32_t stalls;                 // lookups that had to create or wait for a pipeline
+   double stallSeconds;
+};
+
+// Pipelines by key, created once each. Lookups of existing pipelines are a
+// lock-free hash probe; the first lookup of a key creates the pipeline on the
+// calling thread, unless a background thread is already at it, in which case
+// it waits for that one. Precompile hands a set of keys to background
+// threads up front, so by the time a frame asks for them they're ready.
+//
+// Background threads are separate from the job system, so a long compile
+// never lands in the middle of a frame's JobWait. Entries are never removed.
+struct PipelineCache {
+   PipelineCreateFn *create;
+   PipelineDestroyFn *destroy;
+   void *user;
+
+   PipelineCacheEntry *entries;     // PIPELINE_CACHE_CAPACITY of them
+   uint32_t count;                  // under lock, like everything below
+   uint32_t pending;                // entries QUEUED or CREATING
+
+   std::mutex lock;
+   std::condition_variable queued;  // work for the background threads
+   std::condition_variable finished;   // some entry left CREATING
+   std::vector<PipelineCacheEntry *> queue;
+   std::thread threads[PIPELINE_CACHE_THREADS];
+   bool quit;
+
+   PipelineCacheStats stats;
+};
+
+void PipelineCacheInit(PipelineCache *cache, PipelineCreateFn *create, PipelineDestroyFn *destroy, void *user);
+
+// Drops anything still queued, waits for the background threads and destroys
+// every pipeline.
+void PipelineCacheShutdown(PipelineCache *cache);
+
+// The pipeline for key, creating it if need be. Returns null if creation
+// failed, now or earlier; failures aren't retried.
+void *PipelineCacheGet(PipelineCache *cache, PipelineKey key);
+
+// Like PipelineCacheGet but never blocks: returns null if the pipeline isn't
+// ready yet, after queueing it for a background thread.
+void *PipelineCacheTryGet(PipelineCache *cache, PipelineKey key);
+
+// Queues every key that isn't known yet for the background threads.
+void PipelineCachePrecompile(PipelineCache *cache, const PipelineKey *keys, uint32_t count);
+
+// Blocks until nothing is queued or being created.
+void PipelineCacheWaitIdle(PipelineCache *cache);
+
+void PipelineCacheGetStats(PipelineCache *cache, PipelineCacheStats *stats);
@@ -0,0 +1,181 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Everything that varies between the pipelines the renderer uses, packed into
+// one integer. Keys are built with constexpr setters, so a whole variant table
+// can be declared at compile time:
+//
+//    static constexpr PipelineKey WIRE = PipelineKey().withProgram(PROGRAM_CUBE).withFill(PIPELINE_FILL_WIREFRAME);
+//
+// Zero is the most common value of every field, so a default key is an opaque,
+// back-face culled, solid triangle pipeline with no depth buffer, drawing
+// program 0 into a single sRGB BGRA8 target. Backends translate keys into
+// their own pipeline descriptions; nothing here is API specific.
+
+enum PipelineBlend {
+   PIPELINE_BLEND_OPAQUE,
+   PIPELINE_BLEND_ALPHA,            // src * a + dst * (1 - a)
+   PIPELINE_BLEND_PREMULTIPLIED,    // src + dst * (1 - a)
+   PIPELINE_BLEND_ADDITIVE,         // src + dst
+};
+
+enum PipelineCull {
+   PIPELINE_CULL_BACK,
+   PIPELINE_CULL_NONE,
+   PIPELINE_CULL_FRONT,
+};
+
+enum PipelineFill {
+   PIPELINE_FILL_SOLID,
+   PIPELINE_FILL_WIREFRAME,
+};
+
+enum PipelineDepth {
+   PIPELINE_DEPTH_OFF,
+   PIPELINE_DEPTH_TEST,             // read only
+   PIPELINE_DEPTH_TEST_WRITE,
+};
+
+enum PipelineCompare {
+   PIPELINE_COMPARE_LESS_EQUAL,
+   PIPELINE_COMPARE_LESS,
+   PIPELINE_COMPARE_GREATER_EQUAL,  // reversed Z
+   PIPELINE_COMPARE_GREATER,
+   PIPELINE_COMPARE_EQUAL,
+   PIPELINE_COMPARE_ALWAYS,
+};
+
+enum PipelineColorFormat {
+   PIPELINE_COLOR_BGRA8_SRGB,       // the swap chain's
+   PIPELINE_COLOR_NONE,             // depth only
+   PIPELINE_COLOR_RGBA8,
+   PIPELINE_COLOR_RGBA16F,
+   PIPELINE_COLOR_RGB10A2,
+};
+
+enum PipelineDepthFormat {
+   PIPELINE_DEPTH_FORMAT_NONE,
+   PIPELINE_DEPTH_FORMAT_D32,
+   PIPELINE_DEPTH_FORMAT_D24S8,
+   PIPELINE_DEPTH_FORMAT_D16,
+};
+
+enum PipelineTopology {
+   PIPELINE_TOPOLOGY_TRIANGLE,
+   PIPELINE_TOPOLOGY_LINE,
+   PIPELINE_TOPOLOGY_POINT,
+};
+
+// Bumped whenever the layout below changes, so hashes of old keys never match
+// new ones.
+#define PIPELINE_KEY_VERSION 1
+
+#define PIPELINE_MAX_PROGRAMS 256
+
+struct PipelineKey {
+   // Field layout: shift and width in bits.
+   enum {
+      PROGRAM_SHIFT = 0,         PROGRAM_BITS = 8,
+      BLEND_SHIFT = 8,           BLEND_BITS = 3,
+      CULL_SHIFT = 11,           CULL_BITS = 2,
+      FILL_SHIFT = 13,           FILL_BITS = 1,
+      DEPTH_SHIFT = 14,          DEPTH_BITS = 2,
+      COMPARE_SHIFT = 16,        COMPARE_BITS = 3,
+      COLOR_FORMAT_SHIFT = 19,   COLOR_FORMAT_BITS = 3,
+      DEPTH_FORMAT_SHIFT = 22,   DEPTH_FORMAT_BITS = 2,
+      TOPOLOGY_SHIFT = 24,       TOPOLOGY_BITS = 2,
+      SAMPLES_SHIFT = 26,        SAMPLES_BITS = 3,    // log2 of the sample count
+      USED_BITS = 29,
+   };
+
+   uint32_t bits;
+
+   constexpr PipelineKey() : bits(0) {}
+   constexpr explicit PipelineKey(uint32_t bits) : bits(bits) {}
+
+   constexpr uint32_t field(uint32_t shift, uint32_t width) const
+   {
+      return (bits >> shift) & ((1u << width) - 1);
+   }
+
+   constexpr PipelineKey withField(uint32_t shift, uint32_t width, uint32_t value) const
+   {
+      return PipelineKey((bits & ~(((1u << width) - 1) << shift)) | ((value & ((1u << width) - 1)) << shift));
+   }
+
+   constexpr uint32_t program() const { return field(PROGRAM_SHIFT, PROGRAM_BITS); }
+   constexpr PipelineBlend blend() const { return (PipelineBlend)field(BLEND_SHIFT, BLEND_BITS); }
+   constexpr PipelineCull cull() const { return (PipelineCull)field(CULL_SHIFT, CULL_BITS); }
+   constexpr PipelineFill fill() const { return (PipelineFill)field(FILL_SHIFT, FILL_BITS); }
+   constexpr PipelineDepth depth() const { return (PipelineDepth)field(DEPTH_SHIFT, DEPTH_BITS); }
+   constexpr PipelineCompare depthCompare() const { return (PipelineCompare)field(COMPARE_SHIFT, COMPARE_BITS); }
+   constexpr PipelineColorFormat colorFormat() const { return (PipelineColorFormat)field(COLOR_FORMAT_SHIFT, COLOR_FORMAT_BITS); }
+   constexpr PipelineDepthFormat depthFormat() const { return (PipelineDepthFormat)field(DEPTH_FORMAT_SHIFT, DEPTH_FORMAT_BITS); }
+   constexpr PipelineTopology topology() const { return (PipelineTopology)field(TOPOLOGY_SHIFT, TOPOLOGY_BITS); }
+   constexpr uint32_t sampleCount() const { return 1u << field(SAMPLES_SHIFT, SAMPLES_BITS); }
+
+   constexpr PipelineKey withProgram(uint32_t program) const { return withField(PROGRAM_SHIFT, PROGRAM_BITS, program); }
+   constexpr PipelineKey withBlend(PipelineBlend blend) const { return withField(BLEND_SHIFT, BLEND_BITS, blend); }
+   constexpr PipelineKey withCull(PipelineCull cull) const { return withField(CULL_SHIFT, CULL_BITS, cull); }
+   constexpr PipelineKey withFill(PipelineFill fill) const { return withField(FILL_SHIFT, FILL_BITS, fill); }
+   constexpr PipelineKey withDepth(PipelineDepth depth, PipelineCompare compare = PIPELINE_COMPARE_LESS_EQUAL) const
+   {
+      return withField(DEPTH_SHIFT, DEPTH_BITS, depth).withField(COMPARE_SHIFT, COMPARE_BITS, compare);
+   }
+   constexpr PipelineKey withColorFormat(PipelineColorFormat format) const { return withField(COLOR_FORMAT_SHIFT, COLOR_FORMAT_BITS, format); }
+   constexpr PipelineKey withDepthFormat(PipelineDepthFormat format) const { return withField(DEPTH_FORMAT_SHIFT, DEPTH_FORMAT_BITS, format); }
+   constexpr PipelineKey withTopology(PipelineTopology topology) const { return withField(TOPOLOGY_SHIFT, TOPOLOGY_BITS, topology); }
+
+   // Power of two sample counts up to 64.
+   constexpr PipelineKey withSampleCount(uint32_t count) const
+   {
+      return withField(SAMPLES_SHIFT, SAMPLES_BITS,
+         count >= 64 ? 6 : count >= 32 ? 5 : count >= 16 ? 4 : count >= 8 ? 3 : count >= 4 ? 2 : count >= 2 ? 1 : 0);
+   }
+
+   constexpr bool operator==(PipelineKey other) const { return bits == other.bits; }
+   constexpr bool operator!=(PipelineKey other) const { return bits != other.bits; }
+
+   // FNV-1a of the version and the bits, byte by byte so it's the same on
+   // every compiler and platform. Safe to persist, e.g. as a pipeline
+   // library name.
+   constexpr uint64_t hash() const
+   {
+      uint64_t result = 0xcbf29ce484222325ull;
+      uint64_t value = ((uint64_t)PIPELINE_KEY_VERSION << 32) | bits;
+      for (int i = 0; i < 8; ++i) {
+         result = (result ^ ((value >> (i * 8)) & 0xff)) * 0x100000001b3ull;
+      }
+      return result;
+   }
+};
+
+static_assert(PipelineKey::USED_BITS <= 32, "PipelineKey fields don't fit");
+static_assert(PipelineKey().withProgram(PIPELINE_MAX_PROGRAMS - 1).program() == PIPELINE_MAX_PROGRAMS - 1,
+   "PIPELINE_MAX_PROGRAMS doesn't match the program field");
@@ -0,0 +1,295 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "deferred.h"
+#include "pipelines.h"
+#include "shaders.h"
+#include "D3DCompiler.h"
+
+// Each vertex stream comes from the slot of its MeshSemantic.
+static const D3D12_INPUT_ELEMENT_DESC s_meshLayout[] = {
+   { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, MESH_POSITION, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+   { "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, MESH_COLOR, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
+struct ProgramSource {
+   const char *vertexPath;
+   const char *pixelPath;
+   const D3D12_INPUT_ELEMENT_DESC *inputLayout;
+   UINT inputCount;
+};
+
+static const ProgramSource s_programs[PROGRAM_COUNT] = {
+   { "cube.vert", "cube.frag", s_meshLayout, ARRAY_COUNT(s_meshLayout) },    // PROGRAM_CUBE
+};
+
+static const DXGI_FORMAT s_colorFormats[] = {
+   DXGI_FORMAT_B8G8R8A8_UNORM_SRGB,    // PIPELINE_COLOR_BGRA8_SRGB
+   DXGI_FORMAT_UNKNOWN,                // PIPELINE_COLOR_NONE
+   DXGI_FORMAT_R8G8B8A8_UNORM,         // PIPELINE_COLOR_RGBA8
+   DXGI_FORMAT_R16G16B16A16_FLOAT,     // PIPELINE_COLOR_RGBA16F
+   DXGI_FORMAT_R10G10B10A2_UNORM,      // PIPELINE_COLOR_RGB10A2
+};
+
+static const DXGI_FORMAT s_depthFormats[] = {
+   DXGI_FORMAT_UNKNOWN,                // PIPELINE_DEPTH_FORMAT_NONE
+   DXGI_FORMAT_D32_FLOAT,              // PIPELINE_DEPTH_FORMAT_D32
+   DXGI_FORMAT_D24_UNORM_S8_UINT,      // PIPELINE_DEPTH_FORMAT_D24S8
+   DXGI_FORMAT_D16_UNORM,              // PIPELINE_DEPTH_FORMAT_D16
+};
+
+static const D3D12_COMPARISON_FUNC s_compareFuncs[] = {
+   D3D12_COMPARISON_FUNC_LESS_EQUAL,   // PIPELINE_COMPARE_LESS_EQUAL
+   D3D12_COMPARISON_FUNC_LESS,         // PIPELINE_COMPARE_LESS
+   D3D12_COMPARISON_FUNC_GREATER_EQUAL,   // PIPELINE_COMPARE_GREATER_EQUAL
+   D3D12_COMPARISON_FUNC_GREATER,      // PIPELINE_COMPARE_GREATER
+   D3D12_COMPARISON_FUNC_EQUAL,        // PIPELINE_COMPARE_EQUAL
+   D3D12_COMPARISON_FUNC_ALWAYS,       // PIPELINE_COMPARE_ALWAYS
+};
+
+static const D3D12_CULL_MODE s_cullModes[] = {
+   D3D12_CULL_MODE_BACK,               // PIPELINE_CULL_BACK
+   D3D12_CULL_MODE_NONE,               // PIPELINE_CULL_NONE
+   D3D12_CULL_MODE_FRONT,              // PIPELINE_CULL_FRONT
+};
+
+static const D3D12_PRIMITIVE_TOPOLOGY_TYPE s_topologies[] = {
+   D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,   // PIPELINE_TOPOLOGY_TRIANGLE
+   D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE,       // PIPELINE_TOPOLOGY_LINE
+   D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT,      // PIPELINE_TOPOLOGY_POINT
+};
+
+static_assert(ARRAY_COUNT(s_colorFormats) == PIPELINE_COLOR_RGB10A2 + 1, "s_colorFormats doesn't match PipelineColorFormat");
+static_assert(ARRAY_COUNT(s_depthFormats) == PIPELINE_DEPTH_FORMAT_D16 + 1, "s_depthFormats doesn't match PipelineDepthFormat");
+static_assert(ARRAY_COUNT(s_compareFuncs) == PIPELINE_COMPARE_ALWAYS + 1, "s_compareFuncs doesn't match PipelineCompare");
+static_assert(ARRAY_COUNT(s_cullModes) == PIPELINE_CULL_FRONT + 1, "s_cullModes doesn't match PipelineCull");
+static_assert(ARRAY_COUNT(s_topologies) == PIPELINE_TOPOLOGY_POINT + 1, "s_topologies doesn't match PipelineTopology");
+
+// PipelineCreateFn; runs on the pipeline cache's threads as well as the
+// render thread. The shader cache's pipeline path and the pipeline library
+// are both safe to use concurrently.
+static void *createPipeline(void *user, PipelineKey key)
+{
+   Dx12Pipelines *pipelines = (Dx12Pipelines *)user;
+
+   D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+   BuildPipelineDesc(pipelines, key, &desc);
+
+   ID3D12PipelineState *pipelineState = nullptr;
+   if (!CreateGraphicsPipeline(&pipelines->device->shaderCache, pipelines->device->device.Get(), &desc,
+      &pipelines->rootSignatureCode, &pipelineState)) {
+      return nullptr;
+   }
+   return pipelineState;
+}
+
+// PipelineDestroyFn; only called once the background threads have stopped.
+static void destroyPipeline(void *user, void *pipeline)
+{
+   Dx12Pipelines *pipelines = (Dx12Pipelines *)user;
+   ID3D12PipelineState *pipelineState = (ID3D12PipelineState *)pipeline;
+   DeferRelease(pipelines->device, pipelineState);
+   pipelineState->Release();
+}
+
+bool CreatePipelines(Dx12Pipelines *pipelines, Dx12Device *device, bool bindless)
+{
+   pipelines->device = device;
+
+   D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+   if (bindless && (FAILED(device->device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) ||
+      options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2)) {
+      bindless = false;
+   }
+   pipelines->bindless = bindless;
+
+   UINT compileFlags = 0;
+#ifndef NDEBUG
+   compileFlags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+   // Resource arrays take shader model 5.1.
+   static const D3D_SHADER_MACRO bindlessDefines[] = { { "BINDLESS", "1" }, { nullptr, nullptr } };
+   const D3D_SHADER_MACRO *defines = bindless ? bindlessDefines : nullptr;
+   const char *vertexTarget = bindless ? "vs_5_1" : "vs_5_0";
+   const char *pixelTarget = bindless ? "ps_5_1" : "ps_5_0";
+
+   // Only pipeline creation moves to other threads; compiling goes through
+   // the shader cache, which isn't thread-safe, and costs nothing once warm.
+   for (uint32_t i = 0; i < PROGRAM_COUNT; ++i) {
+      if (!CompileShader(&device->shaderCache, s_programs[i].vertexPath, defines, "main", vertexTarget, compileFlags, &pipelines->vertexCode[i]) ||
+         !CompileShader(&device->shaderCache, s_programs[i].pixelPath, defines, "main", pixelTarget, compileFlags, &pipelines->pixelCode[i])) {
+         return false;
+      }
+   }
+
+   D3D12_ROOT_PARAMETER params[2];
+   if (bindless) {
+      params[DRAW_PARAM_INSTANCES].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+      params[DRAW_PARAM_INSTANCES].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+      params[DRAW_PARAM_INSTANCES].Constants.ShaderRegister = 0;
+      params[DRAW_PARAM_INSTANCES].Constants.RegisterSpace = 0;
+      params[DRAW_PARAM_INSTANCES].Constants.Num32BitValues = sizeof(BindlessRef) / 4;
+   } else {
+      // Bound as a root SRV, so no descriptor heap is needed.
+      params[DRAW_PARAM_INSTANCES].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+      params[DRAW_PARAM_INSTANCES].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+      params[DRAW_PARAM_INSTANCES].Descriptor.ShaderRegister = 0;
+      params[DRAW_PARAM_INSTANCES].Descriptor.RegisterSpace = 0;
+   }
+
+   // The whole heap, once as buffers in space1 and again as textures in
+   // space2, both from slot 0, so an index means the same in either.
+   D3D12_DESCRIPTOR_RANGE ranges[2];
+   for (UINT i = 0; i < ARRAY_COUNT(ranges); ++i) {
+      ranges[i].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+      ranges[i].NumDescriptors = UINT_MAX;
+      ranges[i].BaseShaderRegister = 0;
+      ranges[i].RegisterSpace = 1 + i;
+      ranges[i].OffsetInDescriptorsFromTableStart = 0;
+   }
+   params[DRAW_PARAM_TABLE].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+   params[DRAW_PARAM_TABLE].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+   params[DRAW_PARAM_TABLE].DescriptorTable.NumDescriptorRanges = ARRAY_COUNT(ranges);
+   params[DRAW_PARAM_TABLE].DescriptorTable.pDescriptorRanges = ranges;
+
+   D3D12_ROOT_SIGNATURE_DESC rsDesc;
+   rsDesc.NumParameters = bindless ? 2 : 1;
+   rsDesc.pParameters = params;
+   rsDesc.NumStaticSamplers = 0;
+   rsDesc.pStaticSamplers = nullptr;
+   rsDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+
+   if (!SerializeRootSignature(&device->shaderCache, &rsDesc, &pipelines->rootSignatureCode)) {
+      return false;
+   }
+
+   ComPtr<ID3D12RootSignature> rootSignature;
+   if (FAILED(device->device->CreateRootSignature(0, pipelines->rootSignatureCode.pShaderBytecode,
+      pipelines->rootSignatureCode.BytecodeLength, IID_PPV_ARGS(&rootSignature)))) {
+      return false;
+   }
+   pipelines->rootSignature = std::move(rootSignature);
+
+   PipelineCacheInit(&pipelines->cache, createPipeline, destroyPipeline, pipelines);
+   return true;
+}
+
+void DestroyPipelines(Dx12Pipelines *pipelines)
+{
+   if (!pipelines->rootSignature) {
+      return;
+   }
+
+#ifndef NDEBUG
+   PipelineCacheStats stats;
+   PipelineCacheGetStats(&pipelines->cache, &stats);
+   char message[160];
+   sprintf_s(message, "Pipelines: %u created, %u in the background, %u failed; %u stalls, %.3f ms\n",
+      stats.created, stats.precompiled, stats.failed, stats.stalls, stats.stallSeconds * 1000.0);
+   OutputDebugStringA(message);
+#endif
+
+   PipelineCacheShutdown(&pipelines->cache);
+   DeferRelease(pipelines->device, pipelines->rootSignature.Get());
+   pipelines->rootSignature = nullptr;
+}
+
+void BuildPipelineDesc(const Dx12Pipelines *pipelines, PipelineKey key, D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc)
+{
+   ASSERT(key.program() < PROGRAM_COUNT);
+   ASSERT(key.cull() < ARRAY_COUNT(s_cullModes) && key.depthCompare() < ARRAY_COUNT(s_compareFuncs));
+   ASSERT(key.colorFormat() < ARRAY_COUNT(s_colorFormats) && key.depthFormat() < ARRAY_COUNT(s_depthFormats));
+   ASSERT(key.topology() < ARRAY_COUNT(s_topologies));
+
+   memset(desc, 0, sizeof(*desc));
+   desc->pRootSignature = pipelines->rootSignature.Get();
+   desc->VS = pipelines->vertexCode[key.program()];
+   desc->PS = pipelines->pixelCode[key.program()];
+
+   D3D12_RENDER_TARGET_BLEND_DESC *blend = &desc->BlendState.RenderTarget[0];
+   blend->BlendEnable = key.blend() != PIPELINE_BLEND_OPAQUE;
+   blend->LogicOpEnable = FALSE;
+   blend->SrcBlend = key.blend() == PIPELINE_BLEND_ALPHA ? D3D12_BLEND_SRC_ALPHA : D3D12_BLEND_ONE;
+   blend->DestBlend = key.blend() == PIPELINE_BLEND_ADDITIVE ? D3D12_BLEND_ONE : D3D12_BLEND_INV_SRC_ALPHA;
+   blend->BlendOp = D3D12_BLEND_OP_ADD;
+   blend->SrcBlendAlpha = D3D12_BLEND_ONE;
+   blend->DestBlendAlpha = key.blend() == PIPELINE_BLEND_ADDITIVE ? D3D12_BLEND_ONE : D3D12_BLEND_INV_SRC_ALPHA;
+   blend->BlendOpAlpha = D3D12_BLEND_OP_ADD;
+   blend->LogicOp = D3D12_LOGIC_OP_CLEAR;
+   blend->RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+
+   desc->SampleMask = UINT_MAX;
+
+   desc->RasterizerState.FillMode = key.fill() == PIPELINE_FILL_WIREFRAME ? D3D12_FILL_MODE_WIREFRAME : D3D12_FILL_MODE_SOLID;
+   desc->RasterizerState.CullMode = s_cullModes[key.cull()];
+   desc->RasterizerState.FrontCounterClockwise = FALSE;
+   desc->RasterizerState.DepthClipEnable = key.depth() != PIPELINE_DEPTH_OFF;
+   desc->RasterizerState.MultisampleEnable = key.sampleCount() > 1;
+   desc->RasterizerState.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+   D3D12_DEPTH_STENCIL_DESC *depth = &desc->DepthStencilState;
+   depth->DepthEnable = key.depth() != PIPELINE_DEPTH_OFF;
+   depth->DepthWriteMask = key.depth() == PIPELINE_DEPTH_TEST ? D3D12_DEPTH_WRITE_MASK_ZERO : D3D12_DEPTH_WRITE_MASK_ALL;
+   depth->DepthFunc = s_compareFuncs[key.depthCompare()];
+   depth->StencilEnable = FALSE;
+   depth->StencilReadMask = 0xff;
+   depth->StencilWriteMask = 0xff;
+   depth->FrontFace.StencilFailOp = D3D12_STENCIL_OP_KEEP;
+   depth->FrontFace.StencilDepthFailOp = D3D12_STENCIL_OP_KEEP;
+   depth->FrontFace.StencilPassOp = D3D12_STENCIL_OP_KEEP;
+   depth->FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+   depth->BackFace = depth->FrontFace;
+
+   desc->InputLayout.pInputElementDescs = s_programs[key.program()].inputLayout;
+   desc->InputLayout.NumElements = s_programs[key.program()].inputCount;
+   desc->IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
+   desc->PrimitiveTopologyType = s_topologies[key.topology()];
+
+   DXGI_FORMAT colorFormat = s_colorFormats[key.colorFormat()];
+   desc->NumRenderTargets = colorFormat != DXGI_FORMAT_UNKNOWN ? 1 : 0;
+   desc->RTVFormats[0] = colorFormat;
+   for (uint32_t i = 1; i < ARRAY_COUNT(desc->RTVFormats); ++i) {
+      desc->RTVFormats[i] = DXGI_FORMAT_UNKNOWN;
+   }
+   desc->DSVFormat = s_depthFormats[key.depthFormat()];
+
+   desc->SampleDesc.Count = key.sampleCount();
+   desc->SampleDesc.Quality = 0;
+   desc->Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+}
+
+ID3D12PipelineState *GetPipeline(Dx12Pipelines *pipelines, PipelineKey key)
+{
+   return (ID3D12PipelineState *)PipelineCacheGet(&pipelines->cache, key);
+}
+
+void PrecompilePipelines(Dx12Pipelines *pipelines, const PipelineKey *keys, uint32_t count)
+{
+   PipelineCachePrecompile(&pipelines->cache, keys, count);
+}
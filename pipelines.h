@@ -0,0 +1,52 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "dx12demo.h"
+#include "pipelinekey.h"
+
+// Compiles every program and creates the shared root signature, all through
+// the shader cache, and starts the pipeline cache's background threads. The
+// pipelines are bindless if that's asked for and the device has resource
+// binding tier 2, which unbounded tables need; pipelines->bindless says.
+bool CreatePipelines(Dx12Pipelines *pipelines, Dx12Device *device, bool bindless);
+
+// Stops the background threads and hands every pipeline and the root
+// signature to the deferred-release queue. Must happen before the shader
+// cache is closed, since pipelines may still be being created from it.
+void DestroyPipelines(Dx12Pipelines *pipelines);
+
+// The full D3D12 description for key. Shader bytecode and the root signature
+// point into pipelines.
+void BuildPipelineDesc(const Dx12Pipelines *pipelines, PipelineKey key, D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc);
+
+// The pipeline state for key, created on first use. Null if it couldn't be
+// created.
+ID3D12PipelineState *GetPipeline(Dx12Pipelines *pipelines, PipelineKey key);
+
+// Starts creating these on background threads, so GetPipeline finds them
+// ready later on.
+void PrecompilePipelines(Dx12Pipelines *pipelines, const PipelineKey *keys, uint32_t count);
@@ -0,0 +1,262 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "common.h"
+#include "mapfile.h"
+#include "profiler.h"
+
+#define PROFILE_MAX_BUFFERS  128   // threads plus GPU tracks, over the life of the process
+
+#define CPU_PID  1
+#define GPU_PID  2
+
+struct ProfileEvent {
+   const char *name;
+   int64_t start;
+   int64_t end;
+};
+
+// Written only by its owner: a thread, or whoever records a GPU track. The
+// owner publishes events by bumping count, so a capture can be written out
+// while threads are still recording.
+struct ProfileBuffer {
+   uint32_t tid;
+   bool gpu;
+   char name[PROFILE_NAME_LENGTH];
+
+   std::atomic<uint64_t> capture;   // which capture the events belong to
+   std::atomic<uint32_t> count;
+   std::atomic<uint32_t> dropped;
+   ProfileEvent events[PROFILE_THREAD_EVENTS];
+};
+
+std::atomic<bool> g_profilerCapturing;
+
+static std::atomic<uint64_t> s_capture;
+static int64_t s_captureStart;
+
+static std::mutex s_createMutex;
+static std::atomic<ProfileBuffer *> s_buffers[PROFILE_MAX_BUFFERS];
+static std::atomic<uint32_t> s_bufferCount;
+
+static thread_local ProfileBuffer *t_buffer;
+
+static ProfileBuffer *createBuffer(const char *name, bool gpu)
+{
+   std::lock_guard<std::mutex> lock(s_createMutex);
+
+   uint32_t index = s_bufferCount.load(std::memory_order_relaxed);
+   if (index == PROFILE_MAX_BUFFERS) {
+      return nullptr;
+   }
+
+   ProfileBuffer *buffer = new ProfileBuffer;
+   buffer->tid = index + 1;
+   buffer->gpu = gpu;
+   if (name) {
+      snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+   } else {
+      snprintf(buffer->name, sizeof(buffer->name), "thread %u", buffer->tid);
+   }
+   buffer->capture.store(0, std::memory_order_relaxed);
+   buffer->count.store(0, std::memory_order_relaxed);
+   buffer->dropped.store(0, std::memory_order_relaxed);
+
+   s_buffers[index].store(buffer, std::memory_order_release);
+   s_bufferCount.store(index + 1, std::memory_order_release);
+   return buffer;
+}
+
+static void recordEvent(ProfileBuffer *buffer, const char *name, int64_t start, int64_t end)
+{
+   if (!buffer) {
+      return;
+   }
+
+   // The first event of a new capture throws away the last one's.
+   uint64_t capture = s_capture.load(std::memory_order_acquire);
+   uint32_t count = buffer->count.load(std::memory_order_relaxed);
+   if (buffer->capture.load(std::memory_order_relaxed) != capture) {
+      buffer->count.store(0, std::memory_order_relaxed);
+      buffer->dropped.store(0, std::memory_order_relaxed);
+      buffer->capture.store(capture, std::memory_order_release);
+      count = 0;
+   }
+
+   if (count == PROFILE_THREAD_EVENTS) {
+      buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+
+   ProfileEvent *event = &buffer->events[count];
+   event->name = name;
+   event->start = start;
+   event->end = end;
+   buffer->count.store(count + 1, std::memory_order_release);
+}
+
+int64_t ProfilerNow()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ProfilerSetThreadName(const char *name)
+{
+   if (!t_buffer) {
+      t_buffer = createBuffer(name, false);
+   }
+}
+
+void ProfilerRecordZone(const char *name, int64_t start, int64_t end)
+{
+   if (!t_buffer) {
+      t_buffer = createBuffer(nullptr, false);
+   }
+   recordEvent(t_buffer, name, start, end);
+}
+
+uint32_t ProfilerCreateGpuTrack(const char *name)
+{
+   ProfileBuffer *buffer = createBuffer(name, true);
+   return buffer ? buffer->tid : 0;
+}
+
+void ProfilerRecordGpuZone(uint32_t track, const char *name, int64_t start, int64_t end)
+{
+   if (track == 0 || !ProfilerCapturing()) {
+      return;
+   }
+   recordEvent(s_buffers[track - 1].load(std::memory_order_acquire), name, start, end);
+}
+
+void ProfilerBeginCapture()
+{
+   s_captureStart = ProfilerNow();
+   s_capture.fetch_add(1, std::memory_order_release);
+   g_profilerCapturing.store(true, std::memory_order_release);
+}
+
+static void appendf(std::string *out, const char *format, ...)
+{
+   char buffer[256];
+   va_list args;
+   va_start(args, format);
+   int length = vsnprintf(buffer, sizeof(buffer), format, args);
+   va_end(args);
+   if (length > 0) {
+      out->append(buffer, length < (int)sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+   }
+}
+
+static void appendString(std::string *out, const char *str)
+{
+   out->push_back('"');
+   for (const char *c = str; *c; ++c) {
+      if (*c == '"' || *c == '\\') {
+         out->push_back('\\');
+      }
+      if ((unsigned char)*c >= 0x20) {
+         out->push_back(*c);
+      }
+   }
+   out->push_back('"');
+}
+
+static void appendMetadata(std::string *out, const char *what, uint32_t pid, uint32_t tid, const char *name)
+{
+   appendf(out, "{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"%s\",\"args\":{\"name\":", pid, tid, what);
+   appendString(out, name);
+   out->append("}},\n");
+}
+
+bool ProfilerEndCapture(const char *path)
+{
+   g_profilerCapturing.store(false, std::memory_order_release);
+   int64_t captureEnd = ProfilerNow();
+   uint64_t capture = s_capture.load(std::memory_order_relaxed);
+
+   std::string json;
+   json.reserve(1 << 20);
+   json.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+   appendMetadata(&json, "process_name", CPU_PID, 0, "CPU");
+   appendMetadata(&json, "process_name", GPU_PID, 0, "GPU");
+
+   uint32_t bufferCount = s_bufferCount.load(std::memory_order_acquire);
+   for (uint32_t i = 0; i < bufferCount; ++i) {
+      const ProfileBuffer *buffer = s_buffers[i].load(std::memory_order_acquire);
+      uint32_t pid = buffer->gpu ? GPU_PID : CPU_PID;
+      appendMetadata(&json, "thread_name", pid, buffer->tid, buffer->name);
+
+      if (buffer->capture.load(std::memory_order_acquire) != capture) {
+         continue;
+      }
+
+      // Timestamps are relative to the start of the capture, in microseconds.
+      uint32_t count = buffer->count.load(std::memory_order_acquire);
+      for (uint32_t j = 0; j < count; ++j) {
+         const ProfileEvent *event = &buffer->events[j];
+         if (event->end > captureEnd || event->start < s_captureStart) {
+            continue;
+         }
+         json.append("{\"ph\":\"X\",\"name\":");
+         appendString(&json, event->name);
+         appendf(&json, ",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n", pid, buffer->tid,
+            (event->start - s_captureStart) / 1000.0, (event->end - event->start) / 1000.0);
+      }
+
+      uint32_t dropped = buffer->dropped.load(std::memory_order_relaxed);
+      if (dropped) {
+         appendf(&json, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%u zones dropped\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f},\n",
+            dropped, pid, buffer->tid, (captureEnd - s_captureStart) / 1000.0);
+      }
+   }
+
+   // Every entry ends in ",\n"; JSON wants no comma after the last.
+   json.resize(json.size() - 2);
+   json.append("\n]}\n");
+   return WriteFileAtomic(path, json.data(), json.size());
+}
+
+void ProfilerShutdown()
+{
+   g_profilerCapturing.store(false);
+
+   std::lock_guard<std::mutex> lock(s_createMutex);
+   uint32_t bufferCount = s_bufferCount.load(std::memory_order_relaxed);
+   for (uint32_t i = 0; i < bufferCount; ++i) {
+      delete s_buffers[i].load(std::memory_order_relaxed);
+      s_buffers[i].store(nullptr, std::memory_order_relaxed);
+   }
+   s_bufferCount.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,99 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#define PROFILE_THREAD_EVENTS  (1u << 16)   // per thread or GPU track and capture; later zones are dropped
+#define PROFILE_NAME_LENGTH    32
+
+// Scoped CPU zones and GPU timings, captured on demand and written out as a
+// Chrome trace (chrome://tracing, ui.perfetto.dev).
+//
+// Each thread records into its own buffer, so recording never takes a lock.
+// Outside a capture a zone costs one relaxed atomic load. Zone names must be
+// string literals or otherwise outlive the capture.
+
+// Nanoseconds on a monotonic clock shared by every thread. GPU timestamps
+// have to be converted to it before they're recorded.
+int64_t ProfilerNow();
+
+// Labels the calling thread in traces.
+void ProfilerSetThreadName(const char *name);
+
+void ProfilerRecordZone(const char *name, int64_t start, int64_t end);
+
+extern std::atomic<bool> g_profilerCapturing;
+
+static inline bool ProfilerCapturing()
+{
+   return g_profilerCapturing.load(std::memory_order_relaxed);
+}
+
+// A timeline of GPU work, e.g. one per queue. Zones on a track must be
+// recorded by one thread at a time.
+uint32_t ProfilerCreateGpuTrack(const char *name);
+void ProfilerRecordGpuZone(uint32_t track, const char *name, int64_t start, int64_t end);
+
+// Starts collecting zones, dropping anything from a previous capture.
+void ProfilerBeginCapture();
+
+// Stops collecting and writes everything recorded since ProfilerBeginCapture
+// to path. Threads may still be recording; zones they haven't finished by
+// now are left out.
+bool ProfilerEndCapture(const char *path);
+
+// Frees every thread's buffer. No thread may record after this.
+void ProfilerShutdown();
+
+class ProfileScope {
+   const char *m_name;
+   int64_t m_start;
+   bool m_active;
+
+public:
+   explicit ProfileScope(const char *name) : m_name(name), m_start(0), m_active(ProfilerCapturing())
+   {
+      if (m_active) {
+         m_start = ProfilerNow();
+      }
+   }
+
+   ~ProfileScope()
+   {
+      if (m_active) {
+         ProfilerRecordZone(m_name, m_start, ProfilerNow());
+      }
+   }
+
+   ProfileScope(const ProfileScope &) = delete;
+   ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name)    ProfileScope PROFILE_CONCAT(profileZone, __LINE__)(name)
@@ -0,0 +1,771 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "jobs.h"
+#include "raster.h"
+
+#define RASTER_GUARD_BAND       3.0f     // clip-space |x|, |y| limit, in multiples of w
+#define RASTER_NEAR_W           1.0e-5f  // the depth planes keep w positive for any perspective projection, but not every matrix
+#define RASTER_MIN_BIN_INSTANCES 256
+#define RASTER_CLIP_PLANES      7        // w, near and far depth, then the guard band
+#define SRGB_TABLE_BITS         12
+
+//
+// Lane-wide integer and float operations for the inner loop. A block row is
+// RASTER_BLOCK_SIZE pixels, done RASTER_LANES at a time.
+//
+
+#if VECMATH_KERNEL == VECMATH_KERNEL_AVX && defined(__AVX2__)
+
+#define RASTER_LANES 8
+
+typedef __m256i RasterInt;
+typedef __m256 RasterFloat;
+
+static inline RasterInt riSplat(int32_t i) { return _mm256_set1_epi32(i); }
+static inline RasterInt riLoad(const int32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline RasterInt riAdd(RasterInt a, RasterInt b) { return _mm256_add_epi32(a, b); }
+static inline RasterInt riOr(RasterInt a, RasterInt b) { return _mm256_or_si256(a, b); }
+static inline uint32_t riSignBits(RasterInt a) { return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(a)); }
+static inline RasterFloat rfSplat(float f) { return _mm256_set1_ps(f); }
+static inline RasterFloat rfLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline void rfStore(float *p, RasterFloat v) { _mm256_storeu_ps(p, v); }
+static inline RasterFloat rfAdd(RasterFloat a, RasterFloat b) { return _mm256_add_ps(a, b); }
+static inline RasterFloat rfMul(RasterFloat a, RasterFloat b) { return _mm256_mul_ps(a, b); }
+static inline RasterFloat rfDiv(RasterFloat a, RasterFloat b) { return _mm256_div_ps(a, b); }
+
+#elif VECMATH_KERNEL == VECMATH_KERNEL_SSE || VECMATH_KERNEL == VECMATH_KERNEL_AVX
+
+#include <emmintrin.h>
+
+#define RASTER_LANES 4
+
+typedef __m128i RasterInt;
+typedef __m128 RasterFloat;
+
+static inline RasterInt riSplat(int32_t i) { return _mm_set1_epi32(i); }
+static inline RasterInt riLoad(const int32_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline RasterInt riAdd(RasterInt a, RasterInt b) { return _mm_add_epi32(a, b); }
+static inline RasterInt riOr(RasterInt a, RasterInt b) { return _mm_or_si128(a, b); }
+static inline uint32_t riSignBits(RasterInt a) { return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(a)); }
+static inline RasterFloat rfSplat(float f) { return _mm_set1_ps(f); }
+static inline RasterFloat rfLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline void rfStore(float *p, RasterFloat v) { _mm_storeu_ps(p, v); }
+static inline RasterFloat rfAdd(RasterFloat a, RasterFloat b) { return _mm_add_ps(a, b); }
+static inline RasterFloat rfMul(RasterFloat a, RasterFloat b) { return _mm_mul_ps(a, b); }
+static inline RasterFloat rfDiv(RasterFloat a, RasterFloat b) { return _mm_div_ps(a, b); }
+
+#elif VECMATH_KERNEL == VECMATH_KERNEL_NEON
+
+#define RASTER_LANES 4
+
+typedef int32x4_t RasterInt;
+typedef float32x4_t RasterFloat;
+
+static inline RasterInt riSplat(int32_t i) { return vdupq_n_s32(i); }
+static inline RasterInt riLoad(const int32_t *p) { return vld1q_s32(p); }
+static inline RasterInt riAdd(RasterInt a, RasterInt b) { return vaddq_s32(a, b); }
+static inline RasterInt riOr(RasterInt a, RasterInt b) { return vorrq_s32(a, b); }
+static inline uint32_t riSignBits(RasterInt a)
+{
+   static const int32_t shifts[4] = { 0, 1, 2, 3 };
+   uint32x4_t bits = vshlq_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), 31), vld1q_s32(shifts));
+   uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+   return vget_lane_u32(vpadd_u32(sum, sum), 0);
+}
+static inline RasterFloat rfSplat(float f) { return vdupq_n_f32(f); }
+static inline RasterFloat rfLoad(const float *p) { return vld1q_f32(p); }
+static inline void rfStore(float *p, RasterFloat v) { vst1q_f32(p, v); }
+static inline RasterFloat rfAdd(RasterFloat a, RasterFloat b) { return vaddq_f32(a, b); }
+static inline RasterFloat rfMul(RasterFloat a, RasterFloat b) { return vmulq_f32(a, b); }
+static inline RasterFloat rfDiv(RasterFloat a, RasterFloat b)
+{
+   // No divide on 32-bit ARM; two Newton steps get the estimate to full precision.
+   RasterFloat r = vrecpeq_f32(b);
+   r = vmulq_f32(r, vrecpsq_f32(b, r));
+   r = vmulq_f32(r, vrecpsq_f32(b, r));
+   return vmulq_f32(a, r);
+}
+
+#else
+
+#define RASTER_LANES 1
+
+typedef int32_t RasterInt;
+typedef float RasterFloat;
+
+static inline RasterInt riSplat(int32_t i) { return i; }
+static inline RasterInt riLoad(const int32_t *p) { return *p; }
+static inline RasterInt riAdd(RasterInt a, RasterInt b) { return a + b; }
+static inline RasterInt riOr(RasterInt a, RasterInt b) { return a | b; }
+static inline uint32_t riSignBits(RasterInt a) { return (uint32_t)a >> 31; }
+static inline RasterFloat rfSplat(float f) { return f; }
+static inline RasterFloat rfLoad(const float *p) { return *p; }
+static inline void rfStore(float *p, RasterFloat v) { *p = v; }
+static inline RasterFloat rfAdd(RasterFloat a, RasterFloat b) { return a + b; }
+static inline RasterFloat rfMul(RasterFloat a, RasterFloat b) { return a * b; }
+static inline RasterFloat rfDiv(RasterFloat a, RasterFloat b) { return a / b; }
+
+#endif
+
+static_assert(RASTER_BLOCK_SIZE % RASTER_LANES == 0, "block rows are done a whole number of lanes at a time");
+static_assert(RASTER_TILE_SIZE % RASTER_BLOCK_SIZE == 0, "tiles are a whole number of blocks");
+
+// Mirrors cube.mesh, as written by "meshconv cube".
+static const Vec4 s_boxVerts[8] = {
+   { -1.0f, -1.0f, -1.0f,  1.0f },
+   {  1.0f, -1.0f, -1.0f,  1.0f },
+   { -1.0f,  1.0f, -1.0f,  1.0f },
+   {  1.0f,  1.0f, -1.0f,  1.0f },
+   { -1.0f, -1.0f,  1.0f,  1.0f },
+   {  1.0f, -1.0f,  1.0f,  1.0f },
+   { -1.0f,  1.0f,  1.0f,  1.0f },
+   {  1.0f,  1.0f,  1.0f,  1.0f },
+};
+
+static const float s_boxColors[8][4] = {
+   { 0.0f, 0.0f, 0.0f, 1.0f },
+   { 1.0f, 0.0f, 0.0f, 1.0f },
+   { 0.0f, 1.0f, 0.0f, 1.0f },
+   { 1.0f, 1.0f, 0.0f, 1.0f },
+   { 0.0f, 0.0f, 1.0f, 1.0f },
+   { 1.0f, 0.0f, 1.0f, 1.0f },
+   { 0.0f, 1.0f, 1.0f, 1.0f },
+   { 1.0f, 1.0f, 1.0f, 1.0f },
+};
+
+static const uint8_t s_boxIndices[36] = {
+   1, 0, 2,
+   1, 2, 3,
+   5, 1, 3,
+   5, 3, 7,
+   4, 5, 7,
+   4, 7, 6,
+   0, 4, 6,
+   0, 6, 2,
+   6, 7, 3,
+   6, 3, 2,
+   1, 4, 0,
+   1, 5, 4,
+};
+
+// Linear to 8-bit sRGB, indexed by the linear value in SRGB_TABLE_BITS fixed point.
+static uint8_t s_srgbTable[1 << SRGB_TABLE_BITS];
+
+struct ClipVertex {
+   float x, y, z, w;
+   float color[4];
+};
+
+// Snapped to RASTER_SUBPIXEL_BITS in render target space, y down.
+struct ScreenVertex {
+   int32_t x, y;
+   float z;                      // over w
+   float invW;
+   float color[4];
+};
+
+struct DrawContext {
+   Rasterizer *rast;
+   const RasterTarget *target;
+   const Mat4 *clipFromLocal;
+   uint32_t instanceCount;
+   uint32_t instancesPerBinner;
+   uint32_t binnerCount;
+   uint32_t triangleCount;       // per instance
+};
+
+struct ClearContext {
+   const RasterTarget *target;
+   uint32_t color;
+   float depth;
+};
+
+static inline uint32_t quantize(float f, float scale)
+{
+   if (!(f > 0.0f)) {
+      return 0;
+   }
+   return f < 1.0f ? (uint32_t)(f * scale + 0.5f) : (uint32_t)scale;
+}
+
+static inline uint32_t encodePixel(float r, float g, float b, float a)
+{
+   const float tableScale = (float)((1 << SRGB_TABLE_BITS) - 1);
+   return (uint32_t)s_srgbTable[quantize(b, tableScale)] |
+      (uint32_t)s_srgbTable[quantize(g, tableScale)] << 8 |
+      (uint32_t)s_srgbTable[quantize(r, tableScale)] << 16 |
+      quantize(a, 255.0f) << 24;
+}
+
+static void projectVertex(ScreenVertex *out, const ClipVertex *v, float halfWidth, float halfHeight)
+{
+   const float subpixelScale = (float)(1 << RASTER_SUBPIXEL_BITS);
+
+   float invW = 1.0f / v->w;
+   float x = (v->x * invW + 1.0f) * halfWidth;
+   float y = (1.0f - v->y * invW) * halfHeight;
+   out->x = (int32_t)floorf(x * subpixelScale + 0.5f);
+   out->y = (int32_t)floorf(y * subpixelScale + 0.5f);
+   out->z = v->z * invW;
+   out->invW = invW;
+   memcpy(out->color, v->color, sizeof(out->color));
+}
+
+static inline bool insideGuardBand(const ClipVertex *v)
+{
+   float limit = v->w * RASTER_GUARD_BAND;
+   return v->w >= RASTER_NEAR_W && v->z >= 0.0f && v->z <= v->w &&
+      v->x <= limit && -v->x <= limit && v->y <= limit && -v->y <= limit;
+}
+
+// Signed distance to clip plane i: where w runs out, the two depth planes
+// (DepthClipEnable), then the four guard-band planes.
+static inline float planeDistance(const ClipVertex *v, uint32_t plane)
+{
+   switch (plane) {
+   case 0: return v->w - RASTER_NEAR_W;
+   case 1: return v->z;
+   case 2: return v->w - v->z;
+   case 3: return v->w * RASTER_GUARD_BAND - v->x;
+   case 4: return v->w * RASTER_GUARD_BAND + v->x;
+   case 5: return v->w * RASTER_GUARD_BAND - v->y;
+   default: return v->w * RASTER_GUARD_BAND + v->y;
+   }
+}
+
+// Sutherland-Hodgman against every plane in turn. A triangle comes out with
+// at most 3 + RASTER_CLIP_PLANES vertices, still wound the same way.
+static uint32_t clipPolygon(ClipVertex *poly, uint32_t count)
+{
+   ClipVertex scratch[3 + RASTER_CLIP_PLANES];
+   ClipVertex *in = poly, *out = scratch;
+
+   for (uint32_t plane = 0; plane < RASTER_CLIP_PLANES && count > 0; ++plane) {
+      uint32_t outCount = 0;
+      for (uint32_t i = 0; i < count; ++i) {
+         const ClipVertex *a = &in[i];
+         const ClipVertex *b = &in[(i + 1) % count];
+         float da = planeDistance(a, plane);
+         float db = planeDistance(b, plane);
+
+         if (da >= 0.0f) {
+            out[outCount++] = *a;
+         }
+         if ((da >= 0.0f) != (db >= 0.0f)) {
+            float t = da / (da - db);
+            ClipVertex *v = &out[outCount++];
+            v->x = a->x + (b->x - a->x) * t;
+            v->y = a->y + (b->y - a->y) * t;
+            v->z = a->z + (b->z - a->z) * t;
+            v->w = a->w + (b->w - a->w) * t;
+            for (uint32_t c = 0; c < 4; ++c) {
+               v->color[c] = a->color[c] + (b->color[c] - a->color[c]) * t;
+            }
+         }
+      }
+
+      ClipVertex *swap = in;
+      in = out;
+      out = swap;
+      count = outCount;
+   }
+
+   if (in != poly) {
+      memcpy(poly, in, count * sizeof(ClipVertex));
+   }
+   return count;
+}
+
+// Returns false if the triangle can't cover any pixel.
+static bool setupTriangle(RasterBinner *binner, const RasterTarget *target, uint32_t tilesX,
+   const ScreenVertex *v0, const ScreenVertex *v1, const ScreenVertex *v2)
+{
+   // Front faces are clockwise on screen (FrontCounterClockwise = FALSE), which
+   // with y down makes their area positive.
+   int64_t area = (int64_t)(v1->x - v0->x) * (v2->y - v0->y) - (int64_t)(v2->x - v0->x) * (v1->y - v0->y);
+   if (area <= 0) {
+      return false;
+   }
+
+   // Pixels whose centers fall inside the bounding box.
+   const int32_t half = 1 << (RASTER_SUBPIXEL_BITS - 1);
+   int32_t minX = v0->x < v1->x ? v0->x : v1->x;
+   int32_t maxX = v0->x > v1->x ? v0->x : v1->x;
+   int32_t minY = v0->y < v1->y ? v0->y : v1->y;
+   int32_t maxY = v0->y > v1->y ? v0->y : v1->y;
+   minX = v2->x < minX ? v2->x : minX;
+   maxX = v2->x > maxX ? v2->x : maxX;
+   minY = v2->y < minY ? v2->y : minY;
+   maxY = v2->y > maxY ? v2->y : maxY;
+
+   int32_t pixMinX = (minX - half + (1 << RASTER_SUBPIXEL_BITS) - 1) >> RASTER_SUBPIXEL_BITS;
+   int32_t pixMinY = (minY - half + (1 << RASTER_SUBPIXEL_BITS) - 1) >> RASTER_SUBPIXEL_BITS;
+   int32_t pixMaxX = (maxX - half) >> RASTER_SUBPIXEL_BITS;
+   int32_t pixMaxY = (maxY - half) >> RASTER_SUBPIXEL_BITS;
+   pixMinX = pixMinX > 0 ? pixMinX : 0;
+   pixMinY = pixMinY > 0 ? pixMinY : 0;
+   pixMaxX = pixMaxX < (int32_t)target->width - 1 ? pixMaxX : (int32_t)target->width - 1;
+   pixMaxY = pixMaxY < (int32_t)target->height - 1 ? pixMaxY : (int32_t)target->height - 1;
+   if (pixMinX > pixMaxX || pixMinY > pixMaxY) {
+      return false;
+   }
+
+   binner->triangles.resize(binner->triangles.size() + 1);
+   RasterTriangle *tri = &binner->triangles.back();
+
+   // The edge values sum to the area, give or take the top-left bias, so
+   // weighting z / w by them over it interpolates depth linearly on screen.
+   float invArea = 1.0f / (float)area;
+
+   const ScreenVertex *v[3] = { v0, v1, v2 };
+   for (uint32_t k = 0; k < 3; ++k) {
+      const ScreenVertex *from = v[k];
+      const ScreenVertex *to = v[(k + 1) % 3];
+      const ScreenVertex *opposite = v[(k + 2) % 3];
+      int32_t dx = to->x - from->x;
+      int32_t dy = to->y - from->y;
+
+      // E(p) = dx * (p.y - from.y) - dy * (p.x - from.x), positive inside.
+      // Pixel centers exactly on an edge belong to the triangle only if it's a
+      // top or left edge, which with y down and clockwise winding means the
+      // edge runs up, or runs right along the top.
+      bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+      int64_t c = (int64_t)dy * from->x - (int64_t)dx * from->y;
+      c += (int64_t)half * (dx - dy) - (topLeft ? 0 : 1);
+
+      tri->a[k] = -dy * (1 << RASTER_SUBPIXEL_BITS);
+      tri->b[k] = dx * (1 << RASTER_SUBPIXEL_BITS);
+      tri->c[k] = c;
+      tri->invW[k] = opposite->invW;
+      tri->depth[k] = opposite->z * invArea;
+      for (uint32_t i = 0; i < 4; ++i) {
+         tri->colorW[k][i] = opposite->color[i] * opposite->invW;
+      }
+   }
+
+   tri->minX = (uint16_t)pixMinX;
+   tri->minY = (uint16_t)pixMinY;
+   tri->maxX = (uint16_t)pixMaxX;
+   tri->maxY = (uint16_t)pixMaxY;
+
+   uint32_t index = (uint32_t)binner->triangles.size() - 1;
+   for (uint32_t ty = pixMinY / RASTER_TILE_SIZE; ty <= (uint32_t)pixMaxY / RASTER_TILE_SIZE; ++ty) {
+      for (uint32_t tx = pixMinX / RASTER_TILE_SIZE; tx <= (uint32_t)pixMaxX / RASTER_TILE_SIZE; ++tx) {
+         binner->bins[ty * tilesX + tx].push_back(index);
+      }
+   }
+   return true;
+}
+
+static void clipAndSetup(RasterBinner *binner, const RasterTarget *target, uint32_t tilesX,
+   const ClipVertex *v0, const ClipVertex *v1, const ClipVertex *v2)
+{
+   ++binner->stats.clipped;
+
+   ClipVertex poly[3 + RASTER_CLIP_PLANES] = { *v0, *v1, *v2 };
+   uint32_t count = clipPolygon(poly, 3);
+   if (count < 3) {
+      ++binner->stats.culled;
+      return;
+   }
+
+   float halfWidth = target->width * 0.5f;
+   float halfHeight = target->height * 0.5f;
+   ScreenVertex screen[3 + RASTER_CLIP_PLANES];
+   for (uint32_t i = 0; i < count; ++i) {
+      projectVertex(&screen[i], &poly[i], halfWidth, halfHeight);
+   }
+   bool drawn = false;
+   for (uint32_t i = 1; i + 1 < count; ++i) {
+      drawn |= setupTriangle(binner, target, tilesX, &screen[0], &screen[i], &screen[i + 1]);
+   }
+   if (!drawn) {
+      ++binner->stats.culled;
+   }
+}
+
+// Job entry point: runs the vertex stage for a contiguous range of instances
+// and bins the resulting triangles.
+static void binInstances(void *data, uint32_t binnerIdx)
+{
+   const DrawContext *ctx = (const DrawContext *)data;
+   const RasterTarget *target = ctx->target;
+   uint32_t tilesX = ctx->rast->tilesX;
+   RasterBinner *binner = &ctx->rast->binners[binnerIdx];
+   binner->triangles.clear();
+
+   uint32_t first = binnerIdx * ctx->instancesPerBinner;
+   uint32_t last = first + ctx->instancesPerBinner < ctx->instanceCount ? first + ctx->instancesPerBinner : ctx->instanceCount;
+   float halfWidth = target->width * 0.5f;
+   float halfHeight = target->height * 0.5f;
+
+   for (uint32_t instance = first; instance < last; ++instance) {
+      const Mat4 *clipFromLocal = &ctx->clipFromLocal[instance];
+      binner->stats.triangles += ctx->triangleCount;
+
+      ClipVertex clip[8];
+      uint32_t outsideAll = 0x7f, insideCount = 0;
+      for (uint32_t i = 0; i < 8; ++i) {
+         Vec4 pos = mat4MulVec4(clipFromLocal, s_boxVerts[i]);
+         clip[i].x = pos.x;
+         clip[i].y = pos.y;
+         clip[i].z = pos.z;
+         clip[i].w = pos.w;
+         memcpy(clip[i].color, s_boxColors[i], sizeof(clip[i].color));
+
+         // Bits for the depth planes and the real frustum sides, so a cube
+         // that's entirely off screen goes without looking at its triangles.
+         uint32_t outside = (pos.w < RASTER_NEAR_W) | (pos.x > pos.w) << 1 | (-pos.x > pos.w) << 2 |
+            (pos.y > pos.w) << 3 | (-pos.y > pos.w) << 4 | (pos.z < 0.0f) << 5 | (pos.z > pos.w) << 6;
+         outsideAll &= outside;
+         insideCount += insideGuardBand(&clip[i]);
+      }
+
+      if (outsideAll) {
+         binner->stats.culled += ctx->triangleCount;
+         continue;
+      }
+
+      ScreenVertex screen[8];
+      if (insideCount == 8) {
+         for (uint32_t i = 0; i < 8; ++i) {
+            projectVertex(&screen[i], &clip[i], halfWidth, halfHeight);
+         }
+      }
+
+      for (uint32_t t = 0; t < ctx->triangleCount; ++t) {
+         uint32_t i0 = s_boxIndices[t * 3 + 0];
+         uint32_t i1 = s_boxIndices[t * 3 + 1];
+         uint32_t i2 = s_boxIndices[t * 3 + 2];
+         if (insideCount == 8) {
+            binner->stats.culled += !setupTriangle(binner, target, tilesX, &screen[i0], &screen[i1], &screen[i2]);
+         } else if (insideGuardBand(&clip[i0]) && insideGuardBand(&clip[i1]) && insideGuardBand(&clip[i2])) {
+            ScreenVertex tri[3];
+            projectVertex(&tri[0], &clip[i0], halfWidth, halfHeight);
+            projectVertex(&tri[1], &clip[i1], halfWidth, halfHeight);
+            projectVertex(&tri[2], &clip[i2], halfWidth, halfHeight);
+            binner->stats.culled += !setupTriangle(binner, target, tilesX, &tri[0], &tri[1], &tri[2]);
+         } else {
+            clipAndSetup(binner, target, tilesX, &clip[i0], &clip[i1], &clip[i2]);
+         }
+      }
+   }
+}
+
+// Draws the part of tri inside [x0, x1) x [y0, y1), a block at a time. Returns
+// the number of pixels written.
+static uint64_t drawTriangle(const RasterTriangle *tri, const RasterTarget *target,
+   uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+   uint32_t minX = tri->minX > x0 ? tri->minX : x0;
+   uint32_t minY = tri->minY > y0 ? tri->minY : y0;
+   uint32_t maxX = (uint32_t)tri->maxX + 1 < x1 ? (uint32_t)tri->maxX + 1 : x1;
+   uint32_t maxY = (uint32_t)tri->maxY + 1 < y1 ? (uint32_t)tri->maxY + 1 : y1;
+   if (minX >= maxX || minY >= maxY) {
+      return 0;
+   }
+
+   // Per-lane offsets along a block row.
+   int32_t laneStep[3][RASTER_BLOCK_SIZE];
+   float laneStepF[3][RASTER_BLOCK_SIZE];
+   for (uint32_t k = 0; k < 3; ++k) {
+      for (uint32_t i = 0; i < RASTER_BLOCK_SIZE; ++i) {
+         laneStep[k][i] = tri->a[k] * (int32_t)i;
+         laneStepF[k][i] = (float)laneStep[k][i];
+      }
+   }
+
+   const uint32_t blockMask = RASTER_BLOCK_SIZE - 1;
+   const uint32_t laneMask = (1u << RASTER_LANES) - 1;
+   uint64_t written = 0;
+
+   for (uint32_t by = y0 + ((minY - y0) & ~blockMask); by < maxY; by += RASTER_BLOCK_SIZE) {
+      uint32_t rowEnd = by + RASTER_BLOCK_SIZE < maxY ? by + RASTER_BLOCK_SIZE : maxY;
+
+      for (uint32_t bx = x0 + ((minX - x0) & ~blockMask); bx < maxX; bx += RASTER_BLOCK_SIZE) {
+         // Classify each edge against the block's corner pixels. An edge with
+         // every corner inside can be ignored for coverage; one that crosses
+         // the block is small enough there to step in 32 bits.
+         int32_t edge[3];
+         float edgeF[3];
+         uint32_t partial = 0;
+         bool reject = false;
+         for (uint32_t k = 0; k < 3; ++k) {
+            int64_t e = (int64_t)tri->a[k] * bx + (int64_t)tri->b[k] * by + tri->c[k];
+            int64_t stepX = (int64_t)tri->a[k] * (RASTER_BLOCK_SIZE - 1);
+            int64_t stepY = (int64_t)tri->b[k] * (RASTER_BLOCK_SIZE - 1);
+            int64_t lo = e + (stepX < 0 ? stepX : 0) + (stepY < 0 ? stepY : 0);
+            int64_t hi = e + (stepX > 0 ? stepX : 0) + (stepY > 0 ? stepY : 0);
+            if (hi < 0) {
+               reject = true;
+               break;
+            }
+            if (lo < 0) {
+               partial |= 1u << k;
+            }
+            edge[k] = (int32_t)e;
+            edgeF[k] = (float)e;
+         }
+         if (reject) {
+            continue;
+         }
+
+         uint32_t columns = maxX - bx < RASTER_BLOCK_SIZE ? maxX - bx : RASTER_BLOCK_SIZE;
+         uint32_t columnMask = (1u << columns) - 1;
+
+         for (uint32_t y = by; y < rowEnd; ++y) {
+            int32_t row = (int32_t)(y - by);
+            uint32_t *dst = target->pixels + (size_t)y * target->stride + bx;
+            float *dstDepth = target->depth ? target->depth + (size_t)y * target->stride + bx : nullptr;
+
+            for (uint32_t lane = 0; lane < RASTER_BLOCK_SIZE; lane += RASTER_LANES) {
+               uint32_t covered = (columnMask >> lane) & laneMask;
+               if (!covered) {
+                  break;
+               }
+
+               if (partial) {
+                  RasterInt outside = riSplat(0);
+                  for (uint32_t k = 0; k < 3; ++k) {
+                     if (partial & (1u << k)) {
+                        outside = riOr(outside, riAdd(riSplat(edge[k] + tri->b[k] * row), riLoad(&laneStep[k][lane])));
+                     }
+                  }
+                  covered &= ~riSignBits(outside);
+                  if (!covered) {
+                     continue;
+                  }
+               }
+
+               // Perspective-correct interpolation: the edge values are the
+               // unnormalized screen-space barycentrics of the opposite vertices.
+               RasterFloat sumW = rfSplat(0.0f);
+               RasterFloat sumDepth = sumW;
+               RasterFloat sum[4] = { sumW, sumW, sumW, sumW };
+               for (uint32_t k = 0; k < 3; ++k) {
+                  RasterFloat e = rfAdd(rfSplat(edgeF[k] + (float)tri->b[k] * row), rfLoad(&laneStepF[k][lane]));
+                  sumW = rfAdd(sumW, rfMul(e, rfSplat(tri->invW[k])));
+                  sumDepth = rfAdd(sumDepth, rfMul(e, rfSplat(tri->depth[k])));
+                  for (uint32_t c = 0; c < 4; ++c) {
+                     sum[c] = rfAdd(sum[c], rfMul(e, rfSplat(tri->colorW[k][c])));
+                  }
+               }
+
+               float depth[RASTER_LANES];
+               rfStore(depth, sumDepth);
+               if (dstDepth) {
+                  for (uint32_t i = 0; i < RASTER_LANES; ++i) {
+                     if ((covered & (1u << i)) && !(depth[i] >= dstDepth[lane + i])) {
+                        covered &= ~(1u << i);
+                     }
+                  }
+                  if (!covered) {
+                     continue;
+                  }
+               }
+
+               float color[4][RASTER_LANES];
+               RasterFloat invSumW = rfDiv(rfSplat(1.0f), sumW);
+               for (uint32_t c = 0; c < 4; ++c) {
+                  rfStore(color[c], rfMul(sum[c], invSumW));
+               }
+
+               for (uint32_t i = 0; i < RASTER_LANES; ++i) {
+                  if (covered & (1u << i)) {
+                     dst[lane + i] = encodePixel(color[0][i], color[1][i], color[2][i], color[3][i]);
+                     if (dstDepth) {
+                        dstDepth[lane + i] = depth[i];
+                     }
+                     ++written;
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   return written;
+}
+
+// Job entry point: draws every binned triangle touching one tile, in order,
+// and empties the tile's bins for the next batch.
+static void drawTile(void *data, uint32_t tile)
+{
+   const DrawContext *ctx = (const DrawContext *)data;
+   Rasterizer *rast = ctx->rast;
+   const RasterTarget *target = ctx->target;
+
+   uint32_t x0 = (tile % rast->tilesX) * RASTER_TILE_SIZE;
+   uint32_t y0 = (tile / rast->tilesX) * RASTER_TILE_SIZE;
+   uint32_t x1 = x0 + RASTER_TILE_SIZE < target->width ? x0 + RASTER_TILE_SIZE : target->width;
+   uint32_t y1 = y0 + RASTER_TILE_SIZE < target->height ? y0 + RASTER_TILE_SIZE : target->height;
+
+   uint64_t written = 0;
+   for (uint32_t i = 0; i < ctx->binnerCount; ++i) {
+      RasterBinner *binner = &rast->binners[i];
+      std::vector<uint32_t> *bin = &binner->bins[tile];
+      for (size_t j = 0; j < bin->size(); ++j) {
+         written += drawTriangle(&binner->triangles[(*bin)[j]], target, x0, y0, x1, y1);
+      }
+      bin->clear();
+   }
+   rast->tilePixels[tile] += written;
+}
+
+static void clearRows(void *data, uint32_t tileRow)
+{
+   const ClearContext *ctx = (const ClearContext *)data;
+   const RasterTarget *target = ctx->target;
+
+   uint32_t y0 = tileRow * RASTER_TILE_SIZE;
+   uint32_t y1 = y0 + RASTER_TILE_SIZE < target->height ? y0 + RASTER_TILE_SIZE : target->height;
+   for (uint32_t y = y0; y < y1; ++y) {
+      uint32_t *dst = target->pixels + (size_t)y * target->stride;
+      for (uint32_t x = 0; x < target->width; ++x) {
+         dst[x] = ctx->color;
+      }
+   }
+}
+
+static void clearDepthRows(void *data, uint32_t tileRow)
+{
+   const ClearContext *ctx = (const ClearContext *)data;
+   const RasterTarget *target = ctx->target;
+
+   uint32_t y0 = tileRow * RASTER_TILE_SIZE;
+   uint32_t y1 = y0 + RASTER_TILE_SIZE < target->height ? y0 + RASTER_TILE_SIZE : target->height;
+   for (uint32_t y = y0; y < y1; ++y) {
+      float *dst = target->depth + (size_t)y * target->stride;
+      for (uint32_t x = 0; x < target->width; ++x) {
+         dst[x] = ctx->depth;
+      }
+   }
+}
+
+static void accumulateStats(RasterStats *total, const RasterStats *stats)
+{
+   total->triangles += stats->triangles;
+   total->culled += stats->culled;
+   total->clipped += stats->clipped;
+   total->pixels += stats->pixels;
+}
+
+void RasterInit(Rasterizer *rast)
+{
+   const float tableScale = (float)((1 << SRGB_TABLE_BITS) - 1);
+   for (uint32_t i = 0; i < ARRAY_COUNT(s_srgbTable); ++i) {
+      float linear = i / tableScale;
+      float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+      s_srgbTable[i] = (uint8_t)(srgb * 255.0f + 0.5f);
+   }
+
+   for (uint32_t i = 0; i < RASTER_MAX_BINNERS; ++i) {
+      rast->binners[i].triangles.clear();
+      rast->binners[i].bins.clear();
+      memset(&rast->binners[i].stats, 0, sizeof(rast->binners[i].stats));
+   }
+   rast->tilesX = 0;
+   rast->tilesY = 0;
+   rast->tilePixels.clear();
+   memset(&rast->stats, 0, sizeof(rast->stats));
+}
+
+uint32_t RasterEncodeColor(const float color[4])
+{
+   return encodePixel(color[0], color[1], color[2], color[3]);
+}
+
+void RasterClear(Rasterizer * /*rast*/, const RasterTarget *target, const float color[4])
+{
+   ClearContext ctx;
+   ctx.target = target;
+   ctx.color = RasterEncodeColor(color);
+   ctx.depth = 0.0f;
+   JobParallelFor(clearRows, &ctx, (target->height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE);
+}
+
+void RasterClearDepth(Rasterizer * /*rast*/, const RasterTarget *target, float depth)
+{
+   ASSERT(target->depth);
+
+   ClearContext ctx;
+   ctx.target = target;
+   ctx.color = 0;
+   ctx.depth = depth;
+   JobParallelFor(clearDepthRows, &ctx, (target->height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE);
+}
+
+void RasterDrawCubes(Rasterizer *rast, const RasterTarget *target, const Mat4 *clipFromLocal,
+   uint32_t instanceCount, uint32_t indexCount)
+{
+   ASSERT(target->width <= RASTER_MAX_SIZE && target->height <= RASTER_MAX_SIZE);
+   ASSERT(indexCount <= ARRAY_COUNT(s_boxIndices));
+
+   uint32_t tilesX = (target->width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+   uint32_t tilesY = (target->height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+   if (tilesX != rast->tilesX || tilesY != rast->tilesY) {
+      for (uint32_t i = 0; i < RASTER_MAX_BINNERS; ++i) {
+         rast->binners[i].bins.clear();
+         rast->binners[i].bins.resize(tilesX * tilesY);
+      }
+      rast->tilesX = tilesX;
+      rast->tilesY = tilesY;
+   }
+   rast->tilePixels.assign(tilesX * tilesY, 0);
+
+   uint32_t maxBinners = JobThreadCount() < RASTER_MAX_BINNERS ? JobThreadCount() : RASTER_MAX_BINNERS;
+
+   DrawContext ctx;
+   ctx.rast = rast;
+   ctx.target = target;
+   ctx.triangleCount = indexCount / 3;
+
+   for (uint32_t first = 0; first < instanceCount; first += RASTER_BATCH_INSTANCES) {
+      uint32_t count = instanceCount - first < RASTER_BATCH_INSTANCES ? instanceCount - first : RASTER_BATCH_INSTANCES;
+      uint32_t binnerCount = (count + RASTER_MIN_BIN_INSTANCES - 1) / RASTER_MIN_BIN_INSTANCES;
+      binnerCount = binnerCount < maxBinners ? binnerCount : maxBinners;
+
+      ctx.clipFromLocal = clipFromLocal + first;
+      ctx.instanceCount = count;
+      ctx.binnerCount = binnerCount;
+      ctx.instancesPerBinner = (count + binnerCount - 1) / binnerCount;
+
+      JobParallelFor(binInstances, &ctx, binnerCount);
+      JobParallelFor(drawTile, &ctx, tilesX * tilesY);
+   }
+
+   for (uint32_t i = 0; i < RASTER_MAX_BINNERS; ++i) {
+      accumulateStats(&rast->stats, &rast->binners[i].stats);
+      memset(&rast->binners[i].stats, 0, sizeof(rast->binners[i].stats));
+   }
+   for (uint32_t i = 0; i < tilesX * tilesY; ++i) {
+      rast->stats.pixels += rast->tilePixels[i];
+   }
+}
@@ -0,0 +1,104 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "vecmath.h"
+
+// CPU reference implementation of the cube pipeline: cube.vert over the
+// geometry of cube.mesh, cube.frag's interpolated color, back faces culled,
+// clipped to 0 <= z <= w, a greater-or-equal depth test that writes a D32
+// buffer (reversed Z, see render.h) and no blending, written to an sRGB
+// B8G8R8A8 target.
+//
+// Triangles are set up and binned into tiles in parallel, then each tile is
+// rasterized by one thread, so draw order is kept without any locking. Edge
+// functions are evaluated in fixed point with D3D's top-left rule a SIMD
+// row at a time.
+
+#define RASTER_TILE_SIZE        64    // pixels; the unit of binning and of parallel work
+#define RASTER_BLOCK_SIZE       8     // pixels; the unit of coverage testing inside a tile
+#define RASTER_SUBPIXEL_BITS    4
+#define RASTER_MAX_SIZE         4096  // the fixed-point setup has no headroom for larger targets
+#define RASTER_MAX_BINNERS      16
+#define RASTER_BATCH_INSTANCES  16384 // instances binned before the tiles are drawn
+
+struct RasterTarget {
+   uint32_t *pixels;
+   float *depth;              // laid out like pixels; null draws without a depth test
+   uint32_t width;
+   uint32_t height;
+   uint32_t stride;           // in pixels
+};
+
+struct RasterStats {
+   uint64_t triangles;        // submitted
+   uint64_t culled;           // back-facing, off screen or covering no pixel centers
+   uint64_t clipped;          // had to be clipped against the near or guard-band planes
+   uint64_t pixels;           // written by triangles, overdraw included
+};
+
+// Set up for rasterizing: edge k runs from vertex k to vertex k + 1, and is
+// zero at that edge and largest at the vertex opposite it, whose attributes
+// are stored alongside.
+struct RasterTriangle {
+   int32_t a[3];              // edge step per pixel in x
+   int32_t b[3];              // ...and in y
+   int64_t c[3];              // edge value at the center of pixel (0, 0), top-left biased
+   float invW[3];
+   float colorW[3][4];        // color / w
+   float depth[3];            // z / w, over the sum of the edge values
+   uint16_t minX, minY, maxX, maxY;   // covered pixel bounds, inclusive
+};
+
+struct RasterBinner {
+   std::vector<RasterTriangle> triangles;
+   std::vector<std::vector<uint32_t>> bins;   // per tile, indices into triangles in draw order
+   RasterStats stats;
+};
+
+struct Rasterizer {
+   RasterBinner binners[RASTER_MAX_BINNERS];
+   uint32_t tilesX;
+   uint32_t tilesY;
+   std::vector<uint64_t> tilePixels;
+   RasterStats stats;         // since RasterInit
+};
+
+void RasterInit(Rasterizer *rast);
+
+// Linear color in, as ClearRenderTargetView would write it to an sRGB view.
+uint32_t RasterEncodeColor(const float color[4]);
+
+void RasterClear(Rasterizer *rast, const RasterTarget *target, const float color[4]);
+void RasterClearDepth(Rasterizer *rast, const RasterTarget *target, float depth);
+
+// The equivalent of DrawIndexedInstanced(indexCount, instanceCount) with the
+// cube pipeline and mesh bound and clipFromLocal as its instance buffer.
+void RasterDrawCubes(Rasterizer *rast, const RasterTarget *target, const Mat4 *clipFromLocal,
+   uint32_t instanceCount, uint32_t indexCount);
@@ -0,0 +1,201 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "cull.h"
+#include "heapalloc.h"
+#include "statetrack.h"
+
+// The rendering interface the frame loop is written against. The D3D12
+// backend lives in dx12demo.cpp; nullrender.cpp validates and records the
+// command stream in memory so the loop can run without a GPU.
+
+#define RENDER_MAX_CHUNKS        8     // command lists per frame
+#define RENDER_MAX_FRAMES        4     // most frames the CPU may run ahead
+#define RENDER_UPLOAD_ALIGNMENT  256   // satisfies D3D12 constant and structured buffer placement
+#define RENDER_MAX_TARGETS       8     // transient render targets
+
+// Render targets: the back buffer, or one of the transient targets, which are
+// numbered from 1.
+#define RENDER_BACK_BUFFER       0
+#define RENDER_NO_TARGET         UINT32_MAX
+
+// The depth buffer is D32 with reversed Z: the near plane is at 1, the far
+// plane at 0, and nearer fragments pass a greater-or-equal test.
+#define RENDER_DEPTH_CLEAR       0.0f
+
+// Opaque; each backend casts its own command list type to and from this.
+struct RenderCommandList;
+
+struct RenderFrame {
+   uint64_t frameNum;      // fence value the frame will signal
+   uint32_t width;
+   uint32_t height;
+   uint32_t maxChunks;     // at most RENDER_MAX_CHUNKS
+};
+
+struct RenderUpload {
+   void *cpu;              // write-combined on the GPU backends, so write only
+   uint64_t gpu;           // for CmdSetInstanceBuffer
+};
+
+// One range copied into the instance store.
+struct RenderStoreCopy {
+   uint64_t srcOffset;     // from the start of the upload
+   uint64_t dstOffset;     // into the store
+   uint64_t size;
+};
+
+// Transient targets have the back buffer's format. They live in one heap, at
+// offsets the caller picks, and may overlap as long as no two that do are
+// used at the same time: see CmdBarriers.
+struct RenderTargetDesc {
+   uint32_t width;
+   uint32_t height;
+};
+
+struct RenderTargetPlacement {
+   RenderTargetDesc desc;
+   uint64_t offset;        // into the heap, aligned as GetTargetAllocation says
+   uint32_t state;         // statetrack.h state it's created in
+};
+
+// Barrier flags.
+#define RENDER_BARRIER_ALIAS     0x1   // target takes over the heap memory it shares with aliasBefore
+#define RENDER_BARRIER_BEGIN     0x2   // split transition, begun here...
+#define RENDER_BARRIER_END       0x4   // ...and ended here, with the same states
+
+struct RenderBarrier {
+   uint32_t target;
+   uint32_t before;        // statetrack.h states, ignored for aliasing barriers
+   uint32_t after;
+   uint32_t flags;
+   uint32_t aliasBefore;   // the target last in the memory, or RENDER_NO_TARGET if it could be any
+};
+
+// Counters are totals since the backend was created.
+struct RenderStats {
+   uint32_t framesInFlight;
+   uint64_t uploadSize;
+   uint64_t uploadHighWater;
+
+   uint64_t gpuWaits;            // for a frame slot or an idle GPU
+   uint64_t gpuBlockedWaits;     // ...that found the GPU behind and blocked
+   double gpuBlockedSeconds;
+   double gpuPollSeconds;        // reading the fence without blocking
+
+   StateTrackerStats barriers;   // resource transitions, see statetrack.h
+   HeapStats memory;             // placed resources, see heapalloc.h; zero without a GPU
+};
+
+// BeginFrame, AllocUpload, Submit and EndFrame are called from one thread.
+// Command lists may be recorded concurrently, but each one only by a single
+// thread at a time.
+class RenderBackend {
+public:
+   virtual ~RenderBackend() {}
+
+   // Only between frames. Either may drain the GPU. A zero width or height
+   // means minimized: BeginFrame returns false until the next real size.
+   virtual void Resize(uint32_t width, uint32_t height) = 0;
+   virtual void SetFramesInFlight(uint32_t framesInFlight) = 0;
+   virtual void GetStats(RenderStats *stats) const = 0;
+
+   // Whether presents wait for vertical blank. On by default; takes effect
+   // from the next frame.
+   virtual void SetVsync(bool vsync) = 0;
+
+   // Waits until a frame slot is free. Returns false if there is nothing to
+   // draw into, e.g. the window is minimized.
+   virtual bool BeginFrame(RenderFrame *frame) = 0;
+
+   // Memory for this frame only; reclaimed once the GPU is done with it.
+   virtual bool AllocUpload(uint64_t size, uint64_t alignment, RenderUpload *upload) = 0;
+
+   // Chunk indexes the frame's command lists, and lists are submitted in chunk
+   // order. The cube pipeline and mesh are bound on return.
+   virtual RenderCommandList *BeginCommandList(uint32_t chunk) = 0;
+
+   // Transient render targets. GetTargetAllocation says how much heap memory
+   // one takes. SetTransientTargets replaces them all with count new ones, in
+   // a heap of heapSize bytes; only before the frame's first command list is
+   // begun, and frames in flight keep the old ones. Returns false if there's
+   // no memory for them, leaving none.
+   virtual void GetTargetAllocation(const RenderTargetDesc *desc, uint64_t *size, uint64_t *alignment) = 0;
+   virtual bool SetTransientTargets(const RenderTargetPlacement *placements, uint32_t count, uint64_t heapSize) = 0;
+
+   // Transitions and aliasing barriers for render targets, outside a pass.
+   // Every target has to be in RENDER_TARGET for a pass, COPY_SOURCE and
+   // COPY_DEST for a copy, and the back buffer in PRESENT by the end of the
+   // frame, which is what presents it. A target that takes over aliased
+   // memory has to be cleared or copied over before anything else.
+   virtual void CmdBarriers(RenderCommandList *list, const RenderBarrier *barriers, uint32_t count) = 0;
+
+   // Binds target, and the backend's depth buffer, which is the size of the
+   // back buffer and so has to be the target's size too. A non-null
+   // clearColor clears the target and a non-null clearDepth the depth buffer.
+   // The back buffer's first use in a frame has to be a clear or a copy into
+   // it, and the first pass has to clear depth.
+   virtual void CmdBeginPass(RenderCommandList *list, uint32_t target, const float *clearColor,
+      const float *clearDepth) = 0;
+   virtual void CmdSetInstanceBuffer(RenderCommandList *list, uint64_t gpu, uint32_t stride) = 0;
+   // Draws the first indexCount indices of the cube mesh.
+   virtual void CmdDraw(RenderCommandList *list, uint32_t indexCount, uint32_t instanceCount) = 0;
+
+   // Instance data that stays put from one frame to the next, for scenes in
+   // which little changes per frame: only what did is copied in.
+   // SetInstanceStore makes the store at least size bytes and returns its
+   // address for CmdSetInstanceBuffer. Only before the frame's first command
+   // list is begun; a store that grows loses its contents. Returns false if
+   // there's no memory for it.
+   virtual bool SetInstanceStore(uint64_t size, uint64_t *gpu) = 0;
+   // Copies ranges of an upload made this frame into the store, outside a
+   // pass. Draws recorded after it, in this list or a later one, see the new
+   // contents; earlier frames still in flight see the old.
+   virtual void CmdUpdateInstanceStore(RenderCommandList *list, uint64_t src, const RenderStoreCopy *copies,
+      uint32_t count) = 0;
+
+   // GPU-driven culling; see cull.h. SetCullScene copies count instances
+   // into the backend as the scene to cull, and returns false if the backend
+   // can't cull, in which case the frame has to be drawn from the CPU. Not
+   // between CullScene and the end of that frame. CullScene starts this frame's culling, before any
+   // command list is begun; the backend fills in the constants' instance
+   // count and output address. CmdDrawCulled draws whatever survived it.
+   virtual bool SetCullScene(const CullInstance *instances, uint32_t count) = 0;
+   virtual void CullScene(const CullConstants *constants) = 0;
+   virtual void CmdDrawCulled(RenderCommandList *list) = 0;
+
+   virtual void CmdEndPass(RenderCommandList *list) = 0;
+
+   // Copies all of src over dst, outside a pass. They have to be the same size.
+   virtual void CmdCopyTarget(RenderCommandList *list, uint32_t src, uint32_t dst) = 0;
+   virtual void EndCommandList(RenderCommandList *list) = 0;
+
+   virtual void Submit(RenderCommandList *const *lists, uint32_t count) = 0;
+   virtual void EndFrame() = 0;
+};
@@ -0,0 +1,105 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "common.h"
+#include "ring.h"
+
+void RingInit(RingAllocator *ring, uint64_t size)
+{
+   memset(ring, 0, sizeof(*ring));
+   ring->size = size;
+}
+
+void RingBeginFrame(RingAllocator *ring, uint64_t completedValue)
+{
+   while (ring->retireCount > 0) {
+      const RingAllocator::Retirement *r = &ring->retirements[ring->retireFirst];
+      if (r->fenceValue > completedValue) {
+         break;
+      }
+      ring->tail = r->end;
+      ring->retireFirst = (ring->retireFirst + 1) % RING_MAX_FRAMES;
+      --ring->retireCount;
+   }
+
+   ring->frameStart = ring->head;
+}
+
+uint64_t RingAlloc(RingAllocator *ring, uint64_t size, uint64_t alignment)
+{
+   ASSERT(alignment && (alignment & (alignment - 1)) == 0);
+
+   if (size == 0 || size > ring->size) {
+      ++ring->failedAllocs;
+      return RING_INVALID;
+   }
+
+   uint64_t start = (ring->head + alignment - 1) & ~(alignment - 1);
+   uint64_t offset = start % ring->size;
+   if (offset + size > ring->size) {
+      // Skip the tail end of the ring; it's reclaimed along with this frame.
+      start += ring->size - offset;
+      offset = 0;
+   }
+
+   uint64_t end = start + size;
+   if (end - ring->tail > ring->size) {
+      ++ring->failedAllocs;
+      return RING_INVALID;
+   }
+
+   ring->head = end;
+   if (end - ring->tail > ring->highWater) {
+      ring->highWater = end - ring->tail;
+   }
+   if (end - ring->frameStart > ring->frameHighWater) {
+      ring->frameHighWater = end - ring->frameStart;
+   }
+   return offset;
+}
+
+void RingEndFrame(RingAllocator *ring, uint64_t fenceValue)
+{
+   if (ring->head == ring->frameStart) {
+      return;
+   }
+
+   // Frames in flight are bounded by the swap chain, so running out of
+   // retirement slots means a frame was never begun or ended.
+   ASSERT(ring->retireCount < RING_MAX_FRAMES);
+
+   uint32_t idx = (ring->retireFirst + ring->retireCount) % RING_MAX_FRAMES;
+   ring->retirements[idx].fenceValue = fenceValue;
+   ring->retirements[idx].end = ring->head;
+   ++ring->retireCount;
+   ring->frameStart = ring->head;
+}
+
+uint64_t RingAvailable(const RingAllocator *ring)
+{
+   return ring->size - (ring->head - ring->tail);
+}
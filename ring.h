@@ -0,0 +1,73 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define RING_MAX_FRAMES  8
+#define RING_INVALID     UINT64_MAX
+
+// Bookkeeping for a linear ring of per-frame regions. Each frame bumps a head
+// pointer through the ring; when the frame ends its extent is tagged with the
+// fence value that will signal its completion, and the space is handed back
+// once that value has passed. Knows nothing about the memory it manages, so it
+// can back both upload heaps and descriptor rings.
+//
+// head and tail grow monotonically; offsets into the ring are taken modulo
+// size. Allocations never straddle the end of the ring.
+struct RingAllocator {
+   uint64_t size;
+   uint64_t head;
+   uint64_t tail;
+   uint64_t frameStart;
+
+   struct Retirement {
+      uint64_t fenceValue;
+      uint64_t end;
+   } retirements[RING_MAX_FRAMES];
+   uint32_t retireFirst;
+   uint32_t retireCount;
+
+   uint64_t highWater;        // most bytes ever in flight at once
+   uint64_t frameHighWater;   // most bytes used by a single frame
+   uint64_t failedAllocs;
+};
+
+void RingInit(RingAllocator *ring, uint64_t size);
+
+// Reclaims the space of every frame whose fence value is <= completedValue.
+void RingBeginFrame(RingAllocator *ring, uint64_t completedValue);
+
+// Returns the offset of size bytes aligned to alignment (a power of two), or
+// RING_INVALID if the ring is full.
+uint64_t RingAlloc(RingAllocator *ring, uint64_t size, uint64_t alignment);
+
+// Everything allocated since RingBeginFrame is released once fenceValue passes.
+void RingEndFrame(RingAllocator *ring, uint64_t fenceValue);
+
+// Bytes still available to the current frame, ignoring alignment and waste at
+// the end of the ring.
+uint64_t RingAvailable(const RingAllocator *ring);
@@ -0,0 +1,247 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common.h"
+#include "shadercache.h"
+
+#define SHADER_CACHE_MAGIC     0x43535844u  // "DXSC"
+#define SHADER_CACHE_VERSION   1
+#define SHADER_CACHE_ALIGNMENT 16
+
+#define FNV_PRIME  0x100000001b3ull
+
+// File layout: header, entry table sorted by key, then the blobs, each
+// starting on a SHADER_CACHE_ALIGNMENT boundary. Everything is little-endian.
+struct ShaderCacheHeader {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t entryCount;
+   uint32_t reserved;
+   uint64_t fileSize;
+};
+
+struct ShaderCacheEntry {
+   uint64_t key;
+   uint64_t offset;     // from the start of the file
+   uint64_t size;
+   uint64_t checksum;   // HashBytes of the blob
+};
+
+uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+   const uint8_t *bytes = (const uint8_t *)data;
+   for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * FNV_PRIME;
+   }
+   return hash;
+}
+
+uint64_t HashString(uint64_t hash, const char *str)
+{
+   if (!str) {
+      return HashU64(hash, FNV_PRIME);
+   }
+   return HashBytes(hash, str, strlen(str) + 1);
+}
+
+static bool validateFile(const MappedFile *file)
+{
+   if (file->size < sizeof(ShaderCacheHeader)) {
+      return false;
+   }
+
+   const ShaderCacheHeader *header = (const ShaderCacheHeader *)file->data;
+   if (header->magic != SHADER_CACHE_MAGIC || header->version != SHADER_CACHE_VERSION ||
+      header->fileSize != file->size ||
+      header->entryCount > (file->size - sizeof(ShaderCacheHeader)) / sizeof(ShaderCacheEntry)) {
+      return false;
+   }
+
+   const ShaderCacheEntry *entries = (const ShaderCacheEntry *)(header + 1);
+   uint64_t dataStart = sizeof(ShaderCacheHeader) + header->entryCount * sizeof(ShaderCacheEntry);
+   for (uint32_t i = 0; i < header->entryCount; ++i) {
+      const ShaderCacheEntry *entry = &entries[i];
+      if (i > 0 && entry->key <= entries[i - 1].key) {
+         return false;
+      }
+      if (entry->offset < dataStart || entry->offset > file->size || entry->size > file->size - entry->offset) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static const ShaderCacheEntry *findEntry(const ShaderCache *cache, uint64_t key)
+{
+   const ShaderCacheEntry *end = cache->entries + cache->entryCount;
+   const ShaderCacheEntry *entry = std::lower_bound(cache->entries, end, key,
+      [](const ShaderCacheEntry &e, uint64_t k) { return e.key < k; });
+   return entry != end && entry->key == key ? entry : nullptr;
+}
+
+static ShaderCacheBlob *findAdded(ShaderCache *cache, uint64_t key)
+{
+   for (ShaderCacheBlob &blob : cache->added) {
+      if (blob.key == key) {
+         return &blob;
+      }
+   }
+   return nullptr;
+}
+
+bool ShaderCacheOpen(ShaderCache *cache, const char *path)
+{
+   cache->path = path;
+   cache->entries = nullptr;
+   cache->entryCount = 0;
+   cache->added.clear();
+   memset(&cache->stats, 0, sizeof(cache->stats));
+
+   if (!MapFile(&cache->file, path)) {
+      return false;
+   }
+   if (!validateFile(&cache->file)) {
+      UnmapFile(&cache->file);
+      return false;
+   }
+
+   const ShaderCacheHeader *header = (const ShaderCacheHeader *)cache->file.data;
+   cache->entries = (const ShaderCacheEntry *)(header + 1);
+   cache->entryCount = header->entryCount;
+   return true;
+}
+
+void ShaderCacheClose(ShaderCache *cache)
+{
+   UnmapFile(&cache->file);
+   cache->entries = nullptr;
+   cache->entryCount = 0;
+   cache->added.clear();
+}
+
+bool ShaderCacheFind(ShaderCache *cache, uint64_t key, const void **data, uint64_t *size)
+{
+   if (const ShaderCacheBlob *blob = findAdded(cache, key)) {
+      *data = blob->data.data();
+      *size = blob->data.size();
+      ++cache->stats.hits;
+      return true;
+   }
+
+   if (const ShaderCacheEntry *entry = findEntry(cache, key)) {
+      const uint8_t *bytes = cache->file.data + entry->offset;
+      if (HashBytes(HASH_SEED, bytes, (size_t)entry->size) == entry->checksum) {
+         *data = bytes;
+         *size = entry->size;
+         ++cache->stats.hits;
+         return true;
+      }
+      ++cache->stats.corrupt;
+   }
+
+   ++cache->stats.misses;
+   return false;
+}
+
+const void *ShaderCacheInsert(ShaderCache *cache, uint64_t key, const void *data, uint64_t size)
+{
+   ShaderCacheBlob *blob = findAdded(cache, key);
+   if (!blob) {
+      cache->added.emplace_back();
+      blob = &cache->added.back();
+      blob->key = key;
+   }
+
+   const uint8_t *bytes = (const uint8_t *)data;
+   blob->data.assign(bytes, bytes + size);
+   ++cache->stats.inserts;
+   return blob->data.data();
+}
+
+bool ShaderCacheSave(ShaderCache *cache)
+{
+   if (cache->added.empty()) {
+      return true;
+   }
+
+   // Gather the surviving mapped entries and the added blobs, sorted by key.
+   struct Source {
+      uint64_t key;
+      const uint8_t *data;
+      uint64_t size;
+   };
+   std::vector<Source> sources;
+   sources.reserve(cache->entryCount + cache->added.size());
+   for (uint32_t i = 0; i < cache->entryCount; ++i) {
+      const ShaderCacheEntry *entry = &cache->entries[i];
+      if (!findAdded(cache, entry->key)) {
+         sources.push_back({ entry->key, cache->file.data + entry->offset, entry->size });
+      }
+   }
+   for (const ShaderCacheBlob &blob : cache->added) {
+      sources.push_back({ blob.key, blob.data.data(), blob.data.size() });
+   }
+   std::sort(sources.begin(), sources.end(), [](const Source &a, const Source &b) { return a.key < b.key; });
+
+   uint64_t offset = sizeof(ShaderCacheHeader) + sources.size() * sizeof(ShaderCacheEntry);
+   std::vector<ShaderCacheEntry> entries(sources.size());
+   for (size_t i = 0; i < sources.size(); ++i) {
+      offset = (offset + SHADER_CACHE_ALIGNMENT - 1) & ~(uint64_t)(SHADER_CACHE_ALIGNMENT - 1);
+      entries[i].key = sources[i].key;
+      entries[i].offset = offset;
+      entries[i].size = sources[i].size;
+      entries[i].checksum = HashBytes(HASH_SEED, sources[i].data, (size_t)sources[i].size);
+      offset += sources[i].size;
+   }
+
+   std::vector<uint8_t> out((size_t)offset, 0);
+   ShaderCacheHeader header = {};
+   header.magic = SHADER_CACHE_MAGIC;
+   header.version = SHADER_CACHE_VERSION;
+   header.entryCount = (uint32_t)entries.size();
+   header.fileSize = offset;
+   memcpy(out.data(), &header, sizeof(header));
+   if (!entries.empty()) {
+      memcpy(out.data() + sizeof(header), entries.data(), entries.size() * sizeof(ShaderCacheEntry));
+   }
+   for (size_t i = 0; i < sources.size(); ++i) {
+      if (sources[i].size) {
+         memcpy(out.data() + entries[i].offset, sources[i].data, (size_t)sources[i].size);
+      }
+   }
+
+   // Windows won't replace a file that's still mapped.
+   std::string path = cache->path;
+   ShaderCacheStats stats = cache->stats;
+   ShaderCacheClose(cache);
+   bool written = WriteFileAtomic(path.c_str(), out.data(), out.size());
+   ShaderCacheOpen(cache, path.c_str());
+   cache->stats = stats;
+   return written;
+}
@@ -0,0 +1,102 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "mapfile.h"
+
+// 64-bit FNV-1a. Chain calls by passing the previous result as hash.
+#define HASH_SEED 0xcbf29ce484222325ull
+
+uint64_t HashBytes(uint64_t hash, const void *data, size_t size);
+
+// Includes the terminator, so ("ab", "c") and ("a", "bc") hash differently.
+// A null string hashes differently from an empty one.
+uint64_t HashString(uint64_t hash, const char *str);
+
+static inline uint64_t HashU64(uint64_t hash, uint64_t value)
+{
+   return HashBytes(hash, &value, sizeof(value));
+}
+
+struct ShaderCacheEntry;
+
+// A blob added since the file was mapped. The outer vector may move these
+// around but the bytes stay put, so pointers into data are stable.
+struct ShaderCacheBlob {
+   uint64_t key;
+   std::vector<uint8_t> data;
+};
+
+struct ShaderCacheStats {
+   uint32_t hits;
+   uint32_t misses;
+   uint32_t corrupt;    // entries whose checksum didn't match; treated as misses
+   uint32_t inserts;
+};
+
+// Content-addressed blob store backed by a single memory-mapped file. Keys are
+// hashes of everything that determines a blob's contents (source, defines,
+// profile, flags, compiler version...) so a changed input simply misses and
+// stale entries are never returned. Nothing is parsed at startup: the file is
+// mapped and its sorted entry table searched in place.
+//
+// Not thread-safe.
+struct ShaderCache {
+   std::string path;
+   MappedFile file;
+   const ShaderCacheEntry *entries;    // sorted by key, inside file
+   uint32_t entryCount;
+
+   std::vector<ShaderCacheBlob> added;
+   ShaderCacheStats stats;
+};
+
+// Maps path if it holds a valid cache. Returns false if it doesn't exist or
+// is unreadable, in which case the cache starts out empty but still usable
+// and ShaderCacheSave will replace the file.
+bool ShaderCacheOpen(ShaderCache *cache, const char *path);
+
+// Discards anything not yet saved.
+void ShaderCacheClose(ShaderCache *cache);
+
+// Blobs added since the last save win over ones in the file. The pointer stays
+// valid until the next ShaderCacheSave or ShaderCacheClose.
+bool ShaderCacheFind(ShaderCache *cache, uint64_t key, const void **data, uint64_t *size);
+
+// Copies data into the cache, replacing any blob with the same key, and
+// returns the copy.
+const void *ShaderCacheInsert(ShaderCache *cache, uint64_t key, const void *data, uint64_t size);
+
+// Merges added blobs with the mapped ones and rewrites the file, then maps
+// the new one. Does nothing if nothing was added. Invalidates every pointer
+// returned by ShaderCacheFind and ShaderCacheInsert.
+bool ShaderCacheSave(ShaderCache *cache);
@@ -0,0 +1,336 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "shaders.h"
+#include "D3DCompiler.h"
+
+// Bumped whenever the way keys are built changes.
+#define SHADER_KEY_VERSION 1
+
+static void debugOutput(ID3DBlob *errors)
+{
+#ifndef NDEBUG
+   if (errors) {
+      OutputDebugStringA((const char *)errors->GetBufferPointer());
+   }
+#else
+   (void)errors;
+#endif
+}
+
+static uint64_t hashBytecode(uint64_t key, const D3D12_SHADER_BYTECODE *code)
+{
+   key = HashU64(key, code->BytecodeLength);
+   return HashBytes(key, code->pShaderBytecode, code->BytecodeLength);
+}
+
+static uint64_t hashRootSignature(const D3D12_ROOT_SIGNATURE_DESC *desc)
+{
+   uint64_t key = HashString(HASH_SEED, "root signature");
+   key = HashU64(key, SHADER_KEY_VERSION);
+   key = HashU64(key, D3D_ROOT_SIGNATURE_VERSION_1_0);
+   key = HashU64(key, desc->Flags);
+
+   key = HashU64(key, desc->NumParameters);
+   for (UINT i = 0; i < desc->NumParameters; ++i) {
+      const D3D12_ROOT_PARAMETER *param = &desc->pParameters[i];
+      key = HashU64(key, param->ParameterType);
+      key = HashU64(key, param->ShaderVisibility);
+      switch (param->ParameterType) {
+      case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+         key = HashU64(key, param->DescriptorTable.NumDescriptorRanges);
+         key = HashBytes(key, param->DescriptorTable.pDescriptorRanges,
+            param->DescriptorTable.NumDescriptorRanges * sizeof(D3D12_DESCRIPTOR_RANGE));
+         break;
+      case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+         key = HashBytes(key, &param->Constants, sizeof(param->Constants));
+         break;
+      default:
+         key = HashBytes(key, &param->Descriptor, sizeof(param->Descriptor));
+         break;
+      }
+   }
+
+   key = HashU64(key, desc->NumStaticSamplers);
+   return HashBytes(key, desc->pStaticSamplers, desc->NumStaticSamplers * sizeof(D3D12_STATIC_SAMPLER_DESC));
+}
+
+// Hashes contents rather than pointers, and goes field by field wherever a
+// struct has padding, so equal descriptions always get equal keys.
+static uint64_t hashPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc, const D3D12_SHADER_BYTECODE *rootSignature)
+{
+   uint64_t key = HashString(HASH_SEED, "pipeline");
+   key = HashU64(key, SHADER_KEY_VERSION);
+   key = hashBytecode(key, rootSignature);
+   key = hashBytecode(key, &desc->VS);
+   key = hashBytecode(key, &desc->PS);
+   key = hashBytecode(key, &desc->DS);
+   key = hashBytecode(key, &desc->HS);
+   key = hashBytecode(key, &desc->GS);
+
+   const D3D12_STREAM_OUTPUT_DESC *so = &desc->StreamOutput;
+   key = HashU64(key, so->NumEntries);
+   for (UINT i = 0; i < so->NumEntries; ++i) {
+      const D3D12_SO_DECLARATION_ENTRY *entry = &so->pSODeclaration[i];
+      key = HashU64(key, entry->Stream);
+      key = HashString(key, entry->SemanticName);
+      key = HashU64(key, entry->SemanticIndex);
+      key = HashU64(key, entry->StartComponent);
+      key = HashU64(key, entry->ComponentCount);
+      key = HashU64(key, entry->OutputSlot);
+   }
+   key = HashU64(key, so->NumStrides);
+   key = HashBytes(key, so->pBufferStrides, so->NumStrides * sizeof(UINT));
+   key = HashU64(key, so->RasterizedStream);
+
+   const D3D12_BLEND_DESC *blend = &desc->BlendState;
+   key = HashU64(key, blend->AlphaToCoverageEnable);
+   key = HashU64(key, blend->IndependentBlendEnable);
+   for (UINT i = 0; i < ARRAY_COUNT(blend->RenderTarget); ++i) {
+      const D3D12_RENDER_TARGET_BLEND_DESC *rt = &blend->RenderTarget[i];
+      key = HashBytes(key, rt, offsetof(D3D12_RENDER_TARGET_BLEND_DESC, RenderTargetWriteMask));
+      key = HashU64(key, rt->RenderTargetWriteMask);
+   }
+
+   key = HashU64(key, desc->SampleMask);
+   key = HashBytes(key, &desc->RasterizerState, sizeof(desc->RasterizerState));
+
+   const D3D12_DEPTH_STENCIL_DESC *ds = &desc->DepthStencilState;
+   key = HashBytes(key, ds, offsetof(D3D12_DEPTH_STENCIL_DESC, StencilReadMask));
+   key = HashU64(key, ds->StencilReadMask);
+   key = HashU64(key, ds->StencilWriteMask);
+   key = HashBytes(key, &ds->FrontFace, sizeof(ds->FrontFace));
+   key = HashBytes(key, &ds->BackFace, sizeof(ds->BackFace));
+
+   key = HashU64(key, desc->InputLayout.NumElements);
+   for (UINT i = 0; i < desc->InputLayout.NumElements; ++i) {
+      const D3D12_INPUT_ELEMENT_DESC *element = &desc->InputLayout.pInputElementDescs[i];
+      key = HashString(key, element->SemanticName);
+      key = HashU64(key, element->SemanticIndex);
+      key = HashU64(key, element->Format);
+      key = HashU64(key, element->InputSlot);
+      key = HashU64(key, element->AlignedByteOffset);
+      key = HashU64(key, element->InputSlotClass);
+      key = HashU64(key, element->InstanceDataStepRate);
+   }
+
+   key = HashU64(key, desc->IBStripCutValue);
+   key = HashU64(key, desc->PrimitiveTopologyType);
+   key = HashU64(key, desc->NumRenderTargets);
+   key = HashBytes(key, desc->RTVFormats, sizeof(desc->RTVFormats));
+   key = HashU64(key, desc->DSVFormat);
+   key = HashBytes(key, &desc->SampleDesc, sizeof(desc->SampleDesc));
+   key = HashU64(key, desc->NodeMask);
+   return HashU64(key, desc->Flags);
+}
+
+static uint64_t hashComputePipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc, const D3D12_SHADER_BYTECODE *rootSignature)
+{
+   uint64_t key = HashString(HASH_SEED, "compute pipeline");
+   key = HashU64(key, SHADER_KEY_VERSION);
+   key = hashBytecode(key, rootSignature);
+   key = hashBytecode(key, &desc->CS);
+   key = HashU64(key, desc->NodeMask);
+   return HashU64(key, desc->Flags);
+}
+
+void OpenShaderCache(Dx12ShaderCache *cache, ID3D12Device *device, const DXGI_ADAPTER_DESC1 *adapter, const char *path)
+{
+   ShaderCacheOpen(&cache->blobs, path);
+   cache->library = nullptr;
+   cache->libraryDirty = false;
+   cache->pipelineHits = 0;
+   cache->pipelineMisses = 0;
+
+   // A serialized library is only good on the hardware that made it. Driver
+   // updates are caught by CreatePipelineLibrary itself.
+   uint64_t key = HashString(HASH_SEED, "pipeline library");
+   key = HashU64(key, SHADER_KEY_VERSION);
+   key = HashU64(key, adapter->VendorId);
+   key = HashU64(key, adapter->DeviceId);
+   key = HashU64(key, adapter->SubSysId);
+   key = HashU64(key, adapter->Revision);
+   cache->libraryKey = key;
+
+   ComPtr<ID3D12Device1> device1;
+   if (FAILED(device->QueryInterface(IID_PPV_ARGS(&device1)))) {
+      return;
+   }
+
+   // The library reads straight out of the mapping, which stays put until
+   // CloseShaderCache.
+   const void *data;
+   uint64_t size;
+   if (ShaderCacheFind(&cache->blobs, key, &data, &size) &&
+      SUCCEEDED(device1->CreatePipelineLibrary(data, (SIZE_T)size, IID_PPV_ARGS(&cache->library)))) {
+      return;
+   }
+
+   // Missing, corrupt or from another driver version: start an empty one,
+   // which replaces the old copy when saved.
+   if (SUCCEEDED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&cache->library)))) {
+      cache->libraryDirty = true;
+   }
+}
+
+void CloseShaderCache(Dx12ShaderCache *cache)
+{
+   if (cache->library && cache->libraryDirty) {
+      SIZE_T size = cache->library->GetSerializedSize();
+      std::vector<uint8_t> data(size);
+      if (SUCCEEDED(cache->library->Serialize(data.data(), size))) {
+         ShaderCacheInsert(&cache->blobs, cache->libraryKey, data.data(), size);
+      }
+   }
+
+   // Saving replaces the mapping the library may be reading from.
+   cache->library = nullptr;
+   cache->libraryDirty = false;
+
+#ifndef NDEBUG
+   char message[192];
+   sprintf_s(message, "Shader cache: %u hits, %u misses, %u corrupt; pipelines %u hits, %u misses\n",
+      cache->blobs.stats.hits, cache->blobs.stats.misses, cache->blobs.stats.corrupt,
+      cache->pipelineHits.load(), cache->pipelineMisses.load());
+   OutputDebugStringA(message);
+#endif
+
+   ShaderCacheSave(&cache->blobs);
+   ShaderCacheClose(&cache->blobs);
+}
+
+bool CompileShader(Dx12ShaderCache *cache, const char *path, const D3D_SHADER_MACRO *defines,
+   const char *entry, const char *target, UINT flags, D3D12_SHADER_BYTECODE *bytecode)
+{
+   MappedFile source;
+   if (!MapFile(&source, path)) {
+      return false;
+   }
+
+   // The path goes in too since debug builds embed it.
+   uint64_t key = HashString(HASH_SEED, "shader");
+   key = HashU64(key, SHADER_KEY_VERSION);
+   key = HashU64(key, D3D_COMPILER_VERSION);
+   key = HashU64(key, source.size);
+   key = HashBytes(key, source.data, (size_t)source.size);
+   key = HashString(key, path);
+   for (const D3D_SHADER_MACRO *define = defines; define && define->Name; ++define) {
+      key = HashString(key, define->Name);
+      key = HashString(key, define->Definition);
+   }
+   key = HashString(key, nullptr);
+   key = HashString(key, entry);
+   key = HashString(key, target);
+   key = HashU64(key, flags);
+
+   const void *data;
+   uint64_t size;
+   if (!ShaderCacheFind(&cache->blobs, key, &data, &size)) {
+      ComPtr<ID3DBlob> code, errors;
+      HRESULT hr = D3DCompile(source.data, (SIZE_T)source.size, path, defines, nullptr, entry, target, flags, 0, &code, &errors);
+      if (FAILED(hr)) {
+         debugOutput(errors.Get());
+         UnmapFile(&source);
+         return false;
+      }
+
+      size = code->GetBufferSize();
+      data = ShaderCacheInsert(&cache->blobs, key, code->GetBufferPointer(), size);
+   }
+
+   UnmapFile(&source);
+   bytecode->pShaderBytecode = data;
+   bytecode->BytecodeLength = (SIZE_T)size;
+   return true;
+}
+
+bool SerializeRootSignature(Dx12ShaderCache *cache, const D3D12_ROOT_SIGNATURE_DESC *desc, D3D12_SHADER_BYTECODE *blob)
+{
+   uint64_t key = hashRootSignature(desc);
+
+   const void *data;
+   uint64_t size;
+   if (!ShaderCacheFind(&cache->blobs, key, &data, &size)) {
+      ComPtr<ID3DBlob> code, errors;
+      if (FAILED(D3D12SerializeRootSignature(desc, D3D_ROOT_SIGNATURE_VERSION_1_0, &code, &errors))) {
+         debugOutput(errors.Get());
+         return false;
+      }
+
+      size = code->GetBufferSize();
+      data = ShaderCacheInsert(&cache->blobs, key, code->GetBufferPointer(), size);
+   }
+
+   blob->pShaderBytecode = data;
+   blob->BytecodeLength = (SIZE_T)size;
+   return true;
+}
+
+bool CreateGraphicsPipeline(Dx12ShaderCache *cache, ID3D12Device *device, const D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc,
+   const D3D12_SHADER_BYTECODE *rootSignature, ID3D12PipelineState **pipelineState)
+{
+   wchar_t name[17];
+   swprintf_s(name, L"%016llx", (unsigned long long)hashPipeline(desc, rootSignature));
+
+   if (cache->library && SUCCEEDED(cache->library->LoadGraphicsPipeline(name, desc, IID_PPV_ARGS(pipelineState)))) {
+      ++cache->pipelineHits;
+      return true;
+   }
+
+   ++cache->pipelineMisses;
+   if (FAILED(device->CreateGraphicsPipelineState(desc, IID_PPV_ARGS(pipelineState)))) {
+      return false;
+   }
+
+   if (cache->library && SUCCEEDED(cache->library->StorePipeline(name, *pipelineState))) {
+      cache->libraryDirty = true;
+   }
+   return true;
+}
+
+bool CreateComputePipeline(Dx12ShaderCache *cache, ID3D12Device *device, const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc,
+   const D3D12_SHADER_BYTECODE *rootSignature, ID3D12PipelineState **pipelineState)
+{
+   wchar_t name[17];
+   swprintf_s(name, L"%016llx", (unsigned long long)hashComputePipeline(desc, rootSignature));
+
+   if (cache->library && SUCCEEDED(cache->library->LoadComputePipeline(name, desc, IID_PPV_ARGS(pipelineState)))) {
+      ++cache->pipelineHits;
+      return true;
+   }
+
+   ++cache->pipelineMisses;
+   if (FAILED(device->CreateComputePipelineState(desc, IID_PPV_ARGS(pipelineState)))) {
+      return false;
+   }
+
+   if (cache->library && SUCCEEDED(cache->library->StorePipeline(name, *pipelineState))) {
+      cache->libraryDirty = true;
+   }
+   return true;
+}
@@ -0,0 +1,65 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "dx12demo.h"
+
+// Relative to the working directory, like the shader sources.
+#define SHADER_CACHE_PATH  "dx12demo.cache"
+
+// Maps the cache file and creates the pipeline library from the copy stored
+// for this adapter. A missing, stale or corrupt file, or a driver without
+// pipeline library support, just means a cold cache: everything below falls
+// back to compiling and creating directly.
+void OpenShaderCache(Dx12ShaderCache *cache, ID3D12Device *device, const DXGI_ADAPTER_DESC1 *adapter, const char *path);
+
+// Serializes the pipeline library if anything was stored in it, releases it
+// and writes the cache file. Pipeline states created from the library stay
+// valid.
+void CloseShaderCache(Dx12ShaderCache *cache);
+
+// Compiles the HLSL file at path, or returns the bytecode compiled last time
+// for the same source text, defines, entry point, target and flags. The
+// bytecode is owned by the cache and valid until CloseShaderCache. #include
+// isn't supported, since included files wouldn't be part of the key.
+bool CompileShader(Dx12ShaderCache *cache, const char *path, const D3D_SHADER_MACRO *defines,
+   const char *entry, const char *target, UINT flags, D3D12_SHADER_BYTECODE *bytecode);
+
+// D3D12SerializeRootSignature through the cache, keyed by the description's
+// contents.
+bool SerializeRootSignature(Dx12ShaderCache *cache, const D3D12_ROOT_SIGNATURE_DESC *desc, D3D12_SHADER_BYTECODE *blob);
+
+// Loads the pipeline from the library, or creates it and stores it there.
+// rootSignature is the serialized form desc->pRootSignature was created from;
+// the key covers it and every shader's bytecode rather than the pointers.
+// Unlike everything else here, safe to call from several threads at once: it
+// only touches the pipeline library, which is free-threaded, and atomics.
+bool CreateGraphicsPipeline(Dx12ShaderCache *cache, ID3D12Device *device, const D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc,
+   const D3D12_SHADER_BYTECODE *rootSignature, ID3D12PipelineState **pipelineState);
+
+// Same as above for a compute pipeline.
+bool CreateComputePipeline(Dx12ShaderCache *cache, ID3D12Device *device, const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc,
+   const D3D12_SHADER_BYTECODE *rootSignature, ID3D12PipelineState **pipelineState);
@@ -0,0 +1,114 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <math.h>
+
+#include "common.h"
+#include "sim.h"
+
+#define CUBE_SPIN_SPEED    0.5f // turns per second
+
+void FixedTimestepInit(FixedTimestep *ts, double step, uint32_t maxSteps)
+{
+   ASSERT(step > 0.0 && maxSteps > 0);
+   ts->step = step;
+   ts->accumulator = 0.0;
+   ts->maxSteps = maxSteps;
+   ts->droppedSteps = 0;
+}
+
+uint32_t FixedTimestepAdvance(FixedTimestep *ts, double elapsed)
+{
+   if (elapsed > 0.0) {
+      ts->accumulator += elapsed;
+   }
+
+   uint32_t steps = 0;
+   while (ts->accumulator >= ts->step && steps < ts->maxSteps) {
+      ts->accumulator -= ts->step;
+      ++steps;
+   }
+
+   if (ts->accumulator >= ts->step) {
+      uint64_t dropped = (uint64_t)(ts->accumulator / ts->step);
+      ts->droppedSteps += dropped;
+      ts->accumulator -= dropped * ts->step;
+   }
+
+   return steps;
+}
+
+void SimInit(SimState *state)
+{
+   state->tick = 0;
+   state->time = 0.0;
+   state->cubeRot = 0.0f;
+}
+
+void SimStep(SimState *state, double step)
+{
+   state->cubeRot += (float)step * CUBE_SPIN_SPEED;
+   state->cubeRot -= floorf(state->cubeRot);
+   state->time += step;
+   ++state->tick;
+}
+
+void SimPublish(const SimState *state, FramePacket *packet)
+{
+   packet->tick = state->tick;
+   packet->time = state->time;
+   packet->cubeRot = state->cubeRot;
+}
+
+// Lerps angles in turns the short way round.
+static float lerpTurns(float a, float b, float alpha)
+{
+   float d = b - a;
+   if (d > 0.5f) {
+      d -= 1.0f;
+   } else if (d < -0.5f) {
+      d += 1.0f;
+   }
+
+   float r = a + d * alpha;
+   return r - floorf(r);
+}
+
+void InterpolatePackets(const FramePacket *prev, const FramePacket *cur, float alpha, FramePacket *out)
+{
+   out->tick = alpha < 1.0f ? prev->tick : cur->tick;
+   out->time = prev->time + (cur->time - prev->time) * alpha;
+   out->cubeRot = lerpTurns(prev->cubeRot, cur->cubeRot, alpha);
+}
+
+float InterpolationAlpha(const FramePacket *prev, const FramePacket *cur, double renderTime)
+{
+   if (cur->time <= prev->time) {
+      return 1.0f;
+   }
+
+   double alpha = (renderTime - prev->time) / (cur->time - prev->time);
+   return alpha < 0.0 ? 0.0f : alpha > 1.0 ? 1.0f : (float)alpha;
+}
@@ -0,0 +1,67 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Everything the render thread needs from one simulation tick. Immutable once
+// published.
+struct FramePacket {
+   uint64_t tick;
+   double time;         // simulation time at the end of the tick, in seconds
+   float cubeRot;       // in turns
+};
+
+struct SimState {
+   uint64_t tick;
+   double time;
+   float cubeRot;       // in turns
+};
+
+// Turns wall-clock deltas into a whole number of fixed-length ticks, carrying
+// the remainder over to the next call.
+struct FixedTimestep {
+   double step;
+   double accumulator;
+   uint32_t maxSteps;   // cap per Advance so a long stall doesn't snowball
+   uint64_t droppedSteps;
+};
+
+void FixedTimestepInit(FixedTimestep *ts, double step, uint32_t maxSteps);
+
+// Adds elapsed seconds and returns how many ticks to simulate. Time beyond
+// maxSteps ticks is discarded.
+uint32_t FixedTimestepAdvance(FixedTimestep *ts, double elapsed);
+
+void SimInit(SimState *state);
+void SimStep(SimState *state, double step);
+void SimPublish(const SimState *state, FramePacket *packet);
+
+// Blends two consecutive packets; alpha 0 gives prev, 1 gives cur.
+void InterpolatePackets(const FramePacket *prev, const FramePacket *cur, float alpha, FramePacket *out);
+
+// Where renderTime falls between prev and cur, clamped to [0, 1].
+float InterpolationAlpha(const FramePacket *prev, const FramePacket *cur, double renderTime);
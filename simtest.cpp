@@ -0,0 +1,271 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks the simulation side of the frame loop: the packet queue (spsc.h)
+// and fixed-timestep ticking and interpolation (sim.h):
+//
+//    simtest [--packets N]
+//
+// The queue is filled, drained and wrapped on one thread, then run with a
+// producer and a consumer thread, small enough that both often find it full
+// or empty, checking every packet arrives once, whole and in order. Prints
+// nothing and returns 0 if everything holds.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+
+#include "common.h"
+#include "sim.h"
+#include "spsc.h"
+
+#define STEP   (1.0 / 64)     // exact in binary, so sums of steps are too
+
+static uint32_t s_failures;
+
+#define CHECK(x) \
+   do { \
+      if (!(x)) { \
+         fprintf(stderr, "%s(%d): %s\n", __FILE__, __LINE__, #x); \
+         ++s_failures; \
+      } \
+   } while (0)
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--packets N]\n", program);
+}
+
+// Every field follows from the tick, so the consumer can tell a torn packet.
+static void makePacket(uint64_t tick, FramePacket *packet)
+{
+   packet->tick = tick;
+   packet->time = tick * STEP;
+   packet->cubeRot = (float)(tick % 1000) / 1000.0f;
+}
+
+static bool packetIs(const FramePacket *packet, uint64_t tick)
+{
+   FramePacket expected;
+   makePacket(tick, &expected);
+   return packet->tick == expected.tick && packet->time == expected.time && packet->cubeRot == expected.cubeRot;
+}
+
+static void testQueue()
+{
+   static SpscQueue<FramePacket, 8> queue;
+   FramePacket packet;
+   CHECK(!queue.pop(&packet));
+   CHECK(queue.size() == 0);
+
+   // Full at exactly its size.
+   for (uint64_t i = 0; i < 8; ++i) {
+      makePacket(i, &packet);
+      CHECK(queue.push(packet));
+   }
+   makePacket(8, &packet);
+   CHECK(!queue.push(packet));
+   CHECK(queue.size() == 8);
+
+   for (uint64_t i = 0; i < 8; ++i) {
+      CHECK(queue.pop(&packet) && packetIs(&packet, i));
+   }
+   CHECK(!queue.pop(&packet));
+   CHECK(queue.size() == 0);
+
+   // Kept part full while going round many times, so every slot is reused
+   // from every position.
+   uint64_t pushed = 0, popped = 0;
+   for (uint32_t round = 0; round < 1000; ++round) {
+      uint32_t pushes = 1 + round % 7, pops = 1 + (round * 5) % 7;
+      for (uint32_t i = 0; i < pushes; ++i) {
+         makePacket(pushed, &packet);
+         if (queue.push(packet)) {
+            ++pushed;
+         } else {
+            CHECK(pushed - popped == 8);
+         }
+      }
+      for (uint32_t i = 0; i < pops; ++i) {
+         if (queue.pop(&packet)) {
+            CHECK(packetIs(&packet, popped));
+            ++popped;
+         } else {
+            CHECK(pushed == popped);
+         }
+      }
+      CHECK(queue.size() == pushed - popped);
+   }
+   CHECK(pushed > 100 * 8);
+}
+
+static void testQueueThreads(uint64_t packets)
+{
+   static SpscQueue<FramePacket, 4> queue;
+   uint64_t full = 0, empty = 0;
+
+   std::thread producer([&]() {
+      for (uint64_t tick = 0; tick < packets; ++tick) {
+         FramePacket packet;
+         makePacket(tick, &packet);
+         while (!queue.push(packet)) {
+            ++full;
+            std::this_thread::yield();
+         }
+      }
+   });
+
+   uint64_t next = 0;
+   while (next < packets) {
+      FramePacket packet;
+      if (!queue.pop(&packet)) {
+         ++empty;
+         std::this_thread::yield();
+         continue;
+      }
+      if (!packetIs(&packet, next)) {
+         fprintf(stderr, "packet %llu arrived as tick %llu, or torn\n", (unsigned long long)next,
+            (unsigned long long)packet.tick);
+         ++s_failures;
+         break;
+      }
+      ++next;
+   }
+   producer.join();
+
+   FramePacket packet;
+   CHECK(!queue.pop(&packet));
+   // Both ends have to have waited on the other for this to mean anything.
+   CHECK(full > 0 && empty > 0);
+}
+
+static void testTimestep()
+{
+   FixedTimestep ts;
+   FixedTimestepInit(&ts, STEP, 4);
+
+   // Whole ticks only; the rest carries over.
+   CHECK(FixedTimestepAdvance(&ts, STEP / 2) == 0);
+   CHECK(FixedTimestepAdvance(&ts, STEP / 2) == 1);
+   CHECK(ts.accumulator == 0.0);
+   CHECK(FixedTimestepAdvance(&ts, STEP * 2.5) == 2);
+   CHECK(ts.accumulator == STEP / 2);
+   CHECK(FixedTimestepAdvance(&ts, -1.0) == 0);   // a clock going backwards is ignored
+   CHECK(ts.accumulator == STEP / 2);
+   CHECK(FixedTimestepAdvance(&ts, STEP / 2) == 1);
+
+   // A stall runs at most maxSteps ticks and drops the rest, keeping the
+   // fraction, rather than trying to catch up over the next frames.
+   CHECK(FixedTimestepAdvance(&ts, 100 * STEP + STEP / 4) == 4);
+   CHECK(ts.droppedSteps == 96);
+   CHECK(ts.accumulator == STEP / 4);
+   CHECK(FixedTimestepAdvance(&ts, 0.0) == 0);
+   CHECK(FixedTimestepAdvance(&ts, 4 * STEP) == 4);
+   CHECK(ts.droppedSteps == 96);
+
+   // Over many uneven frames, no time goes missing.
+   FixedTimestepInit(&ts, 1.0 / 60, 8);
+   uint32_t seed = 1;
+   double total = 0.0;
+   uint64_t ticks = 0;
+   for (uint32_t frame = 0; frame < 100000; ++frame) {
+      seed = seed * 1664525u + 1013904223u;
+      double elapsed = (seed >> 8) * (1.0 / 16777216.0) * (1.0 / 30);   // up to two ticks
+      total += elapsed;
+      ticks += FixedTimestepAdvance(&ts, elapsed);
+   }
+   CHECK(ts.droppedSteps == 0);
+   CHECK(fabs(ticks / 60.0 + ts.accumulator - total) < 1e-6);
+   CHECK(ts.accumulator >= 0.0 && ts.accumulator < 1.0 / 60);
+}
+
+static void testSim()
+{
+   SimState state;
+   SimInit(&state);
+   for (uint32_t i = 0; i < 64; ++i) {
+      SimStep(&state, STEP);
+   }
+   CHECK(state.tick == 64 && state.time == 1.0);
+   CHECK(state.cubeRot == 0.5f);
+
+   FramePacket prev, cur, out;
+   SimPublish(&state, &prev);
+   for (uint32_t i = 0; i < 16; ++i) {
+      SimStep(&state, STEP);
+   }
+   SimPublish(&state, &cur);
+   CHECK(cur.tick == 80 && cur.time == 1.25);
+
+   // Where render time falls between the two, clamped.
+   CHECK(InterpolationAlpha(&prev, &cur, 1.0625) == 0.25f);
+   CHECK(InterpolationAlpha(&prev, &cur, 0.5) == 0.0f);
+   CHECK(InterpolationAlpha(&prev, &cur, 2.0) == 1.0f);
+   CHECK(InterpolationAlpha(&cur, &cur, 1.25) == 1.0f);
+
+   InterpolatePackets(&prev, &cur, 0.0f, &out);
+   CHECK(out.tick == prev.tick && out.time == prev.time && out.cubeRot == prev.cubeRot);
+   InterpolatePackets(&prev, &cur, 1.0f, &out);
+   CHECK(out.tick == cur.tick && out.time == cur.time && out.cubeRot == cur.cubeRot);
+   InterpolatePackets(&prev, &cur, 0.5f, &out);
+   CHECK(out.tick == prev.tick && out.time == 1.125);
+   CHECK(fabsf(out.cubeRot - 0.5625f) < 1e-6f);
+
+   // Rotation wraps at a whole turn and blends the short way round.
+   prev.cubeRot = 0.9f;
+   cur.cubeRot = 0.1f;
+   InterpolatePackets(&prev, &cur, 0.25f, &out);
+   CHECK(fabsf(out.cubeRot - 0.95f) < 1e-6f);
+   InterpolatePackets(&prev, &cur, 0.75f, &out);
+   CHECK(fabsf(out.cubeRot - 0.05f) < 1e-6f);
+   InterpolatePackets(&cur, &prev, 0.75f, &out);
+   CHECK(fabsf(out.cubeRot - 0.95f) < 1e-6f);
+}
+
+int main(int argc, char **argv)
+{
+   uint64_t packets = 1000000;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint64_t value = strtoull(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--packets") == 0 && value > 0) {
+         packets = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   testQueue();
+   testQueueThreads(packets);
+   testTimestep();
+   testSim();
+   return s_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "common.h"
+#include "profiler.h"
+#include "softrender.h"
+
+SoftBackend::SoftBackend(uint32_t width, uint32_t height, uint32_t framesInFlight, uint64_t uploadSize)
+   : NullBackend(width, height, framesInFlight, uploadSize)
+{
+   ASSERT(width <= RASTER_MAX_SIZE && height <= RASTER_MAX_SIZE);
+
+   RasterInit(&rast);
+   pixels.resize((size_t)width * height);
+   depth.resize((size_t)width * height);
+}
+
+void SoftBackend::Resize(uint32_t newWidth, uint32_t newHeight)
+{
+   ASSERT(newWidth <= RASTER_MAX_SIZE && newHeight <= RASTER_MAX_SIZE);
+
+   NullBackend::Resize(newWidth, newHeight);
+   pixels.resize((size_t)newWidth * newHeight);
+   depth.resize((size_t)newWidth * newHeight);
+}
+
+// Gathers what every indirect command would draw into one batch, in command
+// order, so the rasterizer bins it all in one go rather than a group at a
+// time.
+static void drawCulled(SoftBackend *backend, const RasterTarget *target)
+{
+   if (backend->cullCommandCount == 0) {
+      return;
+   }
+
+   backend->culledInstances.resize(backend->cullVisible);
+   Mat4 *out = backend->culledInstances.data();
+   for (uint32_t i = 0; i < backend->cullCommandCount; ++i) {
+      const CullDrawCommand *command = &backend->cullCommands[i];
+      const Mat4 *instances = backend->cullOutput.data() + command->instances / sizeof(Mat4);
+      memcpy(out, instances, command->instanceCount * sizeof(Mat4));
+      out += command->instanceCount;
+   }
+   RasterDrawCubes(&backend->rast, target, backend->culledInstances.data(), backend->cullVisible,
+      backend->cullCommands[0].indexCount);
+}
+
+static RasterTarget targetRaster(SoftBackend *backend, uint32_t target)
+{
+   RasterTarget raster;
+   raster.pixels = target == RENDER_BACK_BUFFER ? backend->pixels.data() : backend->TargetPixels(target);
+   raster.depth = backend->depth.data();
+   raster.width = backend->targets[target].desc.width;
+   raster.height = backend->targets[target].desc.height;
+   raster.stride = raster.width;
+   return raster;
+}
+
+void SoftBackend::Submit(RenderCommandList *const *renderLists, uint32_t count)
+{
+   // Only run command streams that validated; anything else could read
+   // outside the upload memory.
+   uint64_t errors = stats.errors;
+   NullBackend::Submit(renderLists, count);
+   if (stats.errors != errors) {
+      return;
+   }
+
+   PROFILE_ZONE("rasterize");
+   RasterTarget backBuffer = targetRaster(this, RENDER_BACK_BUFFER);
+   for (uint32_t i = 0; i < submittedCount; ++i) {
+      const NullCommandList *list = submittedLists[i];
+      const Mat4 *instances = nullptr;
+      RasterTarget target = backBuffer;
+
+      for (size_t j = 0; j < list->commands.size(); ++j) {
+         const NullCommand *command = &list->commands[j];
+         switch (command->type) {
+         case NULL_CMD_BEGIN_PASS:
+            target = targetRaster(this, command->arg1);
+            if (command->arg0 & NULL_CLEAR_COLOR) {
+               RasterClear(&rast, &target, command->clearColor);
+            }
+            if (command->arg0 & NULL_CLEAR_DEPTH) {
+               RasterClearDepth(&rast, &target, command->clearDepth);
+            }
+            break;
+         case NULL_CMD_SET_INSTANCE_BUFFER:
+            ASSERT(command->arg0 == sizeof(Mat4));
+            instances = (const Mat4 *)CpuAddress(command->gpu);
+            break;
+         case NULL_CMD_DRAW:
+            RasterDrawCubes(&rast, &target, instances, command->arg1, command->arg0);
+            break;
+         case NULL_CMD_DRAW_CULLED:
+            drawCulled(this, &target);
+            break;
+         case NULL_CMD_COPY_TARGET: {
+            // Validated as the same size, and every target is packed.
+            RasterTarget src = targetRaster(this, command->arg0);
+            RasterTarget dst = targetRaster(this, command->arg1);
+            memcpy(dst.pixels, src.pixels, (size_t)src.width * src.height * sizeof(uint32_t));
+            break;
+         }
+         default:
+            break;
+         }
+      }
+   }
+}
@@ -0,0 +1,48 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "nullrender.h"
+#include "raster.h"
+
+// The null backend's validation and recording, plus a CPU rasterizer that
+// executes each submission into an sRGB B8G8R8A8 image the size of the
+// surface. Frames are finished by the time Submit returns.
+class SoftBackend : public NullBackend {
+public:
+   Rasterizer rast;
+   std::vector<uint32_t> pixels;    // width * height, rows top to bottom
+   std::vector<float> depth;        // ...likewise, bound with every pass's target
+   std::vector<Mat4> culledInstances;  // every culled draw's instances, back to back
+
+   SoftBackend(uint32_t width, uint32_t height, uint32_t framesInFlight, uint64_t uploadSize);
+
+   void Resize(uint32_t width, uint32_t height) override;
+   void Submit(RenderCommandList *const *lists, uint32_t count) override;
+};
@@ -0,0 +1,75 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Bounded single-producer, single-consumer queue. One thread may push and one
+// other thread may pop, with no locks; Size must be a power of two. The two
+// indices live on separate cache lines so the threads don't false-share.
+template <class T, uint32_t Size>
+class SpscQueue {
+   static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+   alignas(64) std::atomic<uint32_t> m_head;   // next slot to pop, owned by the consumer
+   alignas(64) std::atomic<uint32_t> m_tail;   // next slot to push, owned by the producer
+   alignas(64) T m_items[Size];
+
+public:
+   SpscQueue() : m_head(0), m_tail(0) {}
+
+   bool push(const T &item)
+   {
+      uint32_t tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_head.load(std::memory_order_acquire) == Size) {
+         return false;
+      }
+
+      m_items[tail & (Size - 1)] = item;
+      m_tail.store(tail + 1, std::memory_order_release);
+      return true;
+   }
+
+   bool pop(T *item)
+   {
+      uint32_t head = m_head.load(std::memory_order_relaxed);
+      if (head == m_tail.load(std::memory_order_acquire)) {
+         return false;
+      }
+
+      *item = m_items[head & (Size - 1)];
+      m_head.store(head + 1, std::memory_order_release);
+      return true;
+   }
+
+   // Only a snapshot; exact only when called from the consumer with the
+   // producer idle.
+   uint32_t size() const
+   {
+      return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+   }
+};
@@ -0,0 +1,390 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "statetrack.h"
+#include "common.h"
+
+// Whether a subresource in current needs no transition to be used as state.
+static bool satisfies(uint32_t current, uint32_t state)
+{
+   if (current == state) {
+      return true;
+   }
+   return state != STATE_COMMON && (current & ~STATE_READ_MASK) == 0 && (state & ~current) == 0;
+}
+
+static void addStats(StateTrackerStats *to, const StateTrackerStats *from)
+{
+   to->requests += from->requests;
+   to->redundant += from->redundant;
+   to->merged += from->merged;
+   to->promotions += from->promotions;
+   to->barriers += from->barriers;
+   to->splitBarriers += from->splitBarriers;
+   to->aliasing += from->aliasing;
+   to->fixups += from->fixups;
+   to->batches += from->batches;
+}
+
+void StateTrackerInit(StateTracker *tracker)
+{
+   tracker->resources.clear();
+   tracker->freeIds.clear();
+   tracker->stats = StateTrackerStats();
+}
+
+uint32_t StateTrackerAdd(StateTracker *tracker, uint32_t subresourceCount, uint32_t state, uint32_t flags, void *user)
+{
+   ASSERT(subresourceCount > 0);
+
+   uint32_t id;
+   if (!tracker->freeIds.empty()) {
+      id = tracker->freeIds.back();
+      tracker->freeIds.pop_back();
+   } else {
+      id = (uint32_t)tracker->resources.size();
+      tracker->resources.emplace_back();
+   }
+
+   StateResource *resource = &tracker->resources[id];
+   resource->subresourceCount = subresourceCount;
+   resource->flags = flags;
+   resource->states.assign(subresourceCount, state);
+   resource->user = user;
+   return id;
+}
+
+void StateTrackerRemove(StateTracker *tracker, uint32_t id)
+{
+   ASSERT(id < tracker->resources.size() && tracker->resources[id].subresourceCount);
+   StateResource *resource = &tracker->resources[id];
+   resource->subresourceCount = 0;
+   resource->states.clear();
+   resource->user = nullptr;
+   tracker->freeIds.push_back(id);
+}
+
+void StateListBegin(StateList *list, StateTracker *tracker)
+{
+   list->tracker = tracker;
+   list->used = 0;
+   list->queued.clear();
+   list->flushed.clear();
+   list->stats = StateTrackerStats();
+}
+
+// A list touches a handful of resources, so a scan will do.
+static StateListResource *findResource(const StateList *list, uint32_t id)
+{
+   for (uint32_t i = 0; i < list->used; ++i) {
+      if (list->resources[i].resource == id) {
+         return const_cast<StateListResource *>(&list->resources[i]);
+      }
+   }
+   return nullptr;
+}
+
+static StateListResource *useResource(StateList *list, uint32_t id)
+{
+   StateListResource *entry = findResource(list, id);
+   if (entry) {
+      return entry;
+   }
+
+   ASSERT(id < list->tracker->resources.size());
+   uint32_t count = list->tracker->resources[id].subresourceCount;
+   ASSERT(count > 0);
+
+   // Entries are reused from one recording to the next, vectors and all.
+   if (list->used == list->resources.size()) {
+      list->resources.emplace_back();
+   }
+   entry = &list->resources[list->used++];
+   entry->resource = id;
+   entry->first.assign(count, STATE_INVALID);
+   entry->current.assign(count, STATE_INVALID);
+   entry->splitFrom.assign(count, STATE_INVALID);
+   entry->splitAll = false;
+   return entry;
+}
+
+// The last queued barrier touching the resource, if it's for the same
+// subresources and has the given flags. Anything else queued for the
+// resource in between would have to be reordered around.
+static StateBarrier *lastQueued(StateList *list, uint32_t id, uint32_t key, uint32_t flags)
+{
+   for (size_t i = list->queued.size(); i-- > 0; ) {
+      StateBarrier *barrier = &list->queued[i];
+      if (barrier->resource == id) {
+         return barrier->subresource == key && barrier->flags == flags ? barrier : nullptr;
+      }
+   }
+   return nullptr;
+}
+
+static void queue(StateList *list, uint32_t id, uint32_t key, uint32_t before, uint32_t after, uint32_t flags)
+{
+   if (flags == 0) {
+      StateBarrier *last = lastQueued(list, id, key, 0);
+      if (last) {
+         ++list->stats.merged;
+         if (last->before == after) {
+            list->queued.erase(list->queued.begin() + (last - list->queued.data()));
+         } else {
+            last->after = after;
+         }
+         return;
+      }
+   } else if (flags == STATE_END_ONLY) {
+      // Nothing was recorded between the halves, so there was nothing to
+      // overlap: make it an ordinary transition.
+      StateBarrier *begin = lastQueued(list, id, key, STATE_BEGIN_ONLY);
+      if (begin) {
+         begin->flags = 0;
+         return;
+      }
+   }
+
+   StateBarrier barrier;
+   barrier.resource = id;
+   barrier.subresource = key;
+   barrier.before = before;
+   barrier.after = after;
+   barrier.flags = flags;
+   list->queued.push_back(barrier);
+}
+
+static void endSplit(StateList *list, StateListResource *entry, uint32_t subresource)
+{
+   if (entry->splitAll) {
+      queue(list, entry->resource, STATE_ALL_SUBRESOURCES, entry->splitFrom[0], entry->current[0], STATE_END_ONLY);
+      entry->splitFrom.assign(entry->splitFrom.size(), STATE_INVALID);
+      entry->splitAll = false;
+   } else if (entry->splitFrom[subresource] != STATE_INVALID) {
+      queue(list, entry->resource, subresource, entry->splitFrom[subresource], entry->current[subresource], STATE_END_ONLY);
+      entry->splitFrom[subresource] = STATE_INVALID;
+   }
+}
+
+// Moves subresources [first, end) of entry, all in the same state, to state.
+// key is what the barrier covers: first, or every subresource.
+static void transition(StateList *list, StateListResource *entry, uint32_t key, uint32_t first, uint32_t end,
+   uint32_t state, bool split)
+{
+   uint32_t current = entry->current[first];
+   if (current == STATE_INVALID) {
+      // First use: the list needs it in state from the start, which is up to
+      // StateTrackerResolve.
+      for (uint32_t i = first; i < end; ++i) {
+         entry->first[i] = state;
+         entry->current[i] = state;
+      }
+      return;
+   }
+   if (satisfies(current, state)) {
+      ++list->stats.redundant;
+      return;
+   }
+
+   queue(list, entry->resource, key, current, state, split ? STATE_BEGIN_ONLY : 0);
+   for (uint32_t i = first; i < end; ++i) {
+      if (split) {
+         entry->splitFrom[i] = current;
+      }
+      entry->current[i] = state;
+   }
+   if (split && key == STATE_ALL_SUBRESOURCES) {
+      entry->splitAll = true;
+   }
+}
+
+static bool uniform(const StateListResource *entry)
+{
+   for (size_t i = 1; i < entry->current.size(); ++i) {
+      if (entry->current[i] != entry->current[0] || entry->splitFrom[i] != entry->splitFrom[0]) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static void request(StateList *list, uint32_t id, uint32_t subresource, uint32_t state, bool split)
+{
+   ++list->stats.requests;
+   StateListResource *entry = useResource(list, id);
+   uint32_t count = (uint32_t)entry->current.size();
+   ASSERT(subresource == STATE_ALL_SUBRESOURCES || subresource < count);
+
+   if (subresource != STATE_ALL_SUBRESOURCES) {
+      endSplit(list, entry, subresource);
+      transition(list, entry, count == 1 ? STATE_ALL_SUBRESOURCES : subresource, subresource, subresource + 1,
+         state, split);
+      return;
+   }
+
+   for (uint32_t i = 0; i < count; ++i) {
+      endSplit(list, entry, i);
+   }
+   if (uniform(entry)) {
+      transition(list, entry, STATE_ALL_SUBRESOURCES, 0, count, state, split);
+   } else {
+      for (uint32_t i = 0; i < count; ++i) {
+         transition(list, entry, i, i, i + 1, state, split);
+      }
+   }
+}
+
+void StateListTransition(StateList *list, uint32_t id, uint32_t subresource, uint32_t state)
+{
+   request(list, id, subresource, state, false);
+}
+
+void StateListBeginSplit(StateList *list, uint32_t id, uint32_t subresource, uint32_t state)
+{
+   request(list, id, subresource, state, true);
+}
+
+void StateListAlias(StateList *list, uint32_t before, uint32_t id)
+{
+   ASSERT(id < list->tracker->resources.size() && list->tracker->resources[id].subresourceCount);
+
+   // Queued behind anything else for id, and nothing queued after it merges
+   // across it.
+   StateBarrier barrier;
+   barrier.resource = id;
+   barrier.subresource = STATE_ALL_SUBRESOURCES;
+   barrier.before = before;
+   barrier.after = id;
+   barrier.flags = STATE_ALIASING;
+   list->queued.push_back(barrier);
+}
+
+uint32_t StateListFlush(StateList *list, const StateBarrier **barriers)
+{
+   list->flushed.swap(list->queued);
+   list->queued.clear();
+
+   for (size_t i = 0; i < list->flushed.size(); ++i) {
+      uint32_t flags = list->flushed[i].flags;
+      // A split transition counts once, when it begins.
+      if (flags != STATE_END_ONLY) {
+         ++list->stats.barriers;
+      }
+      if (flags == STATE_BEGIN_ONLY) {
+         ++list->stats.splitBarriers;
+      } else if (flags == STATE_ALIASING) {
+         ++list->stats.aliasing;
+      }
+   }
+   if (!list->flushed.empty()) {
+      ++list->stats.batches;
+   }
+
+   *barriers = list->flushed.data();
+   return (uint32_t)list->flushed.size();
+}
+
+void StateListEnd(StateList *list)
+{
+   for (uint32_t i = 0; i < list->used; ++i) {
+      StateListResource *entry = &list->resources[i];
+      for (uint32_t j = 0; j < entry->splitFrom.size(); ++j) {
+         endSplit(list, entry, j);
+      }
+   }
+}
+
+uint32_t StateListState(const StateList *list, uint32_t id, uint32_t subresource)
+{
+   const StateListResource *entry = findResource(list, id);
+   return entry ? entry->current[subresource == STATE_ALL_SUBRESOURCES ? 0 : subresource] : STATE_INVALID;
+}
+
+void StateTrackerResolve(StateTracker *tracker, StateList *list, std::vector<StateBarrier> *fixups)
+{
+   ASSERT(list->queued.empty());
+   size_t start = fixups->size();
+
+   for (uint32_t i = 0; i < list->used; ++i) {
+      const StateListResource *entry = &list->resources[i];
+      StateResource *resource = &tracker->resources[entry->resource];
+      ASSERT(resource->subresourceCount == entry->first.size());
+
+      size_t resourceStart = fixups->size();
+      for (uint32_t j = 0; j < resource->subresourceCount; ++j) {
+         uint32_t needed = entry->first[j];
+         if (needed == STATE_INVALID) {
+            continue;
+         }
+
+         uint32_t global = resource->states[j];
+         if (global == needed) {
+            // Nothing to do.
+         } else if ((resource->flags & STATE_DECAYS) && global == STATE_COMMON) {
+            ++list->stats.promotions;
+         } else {
+            StateBarrier barrier;
+            barrier.resource = entry->resource;
+            barrier.subresource = resource->subresourceCount == 1 ? STATE_ALL_SUBRESOURCES : j;
+            barrier.before = global;
+            barrier.after = needed;
+            barrier.flags = 0;
+            fixups->push_back(barrier);
+         }
+         resource->states[j] = entry->current[j];
+      }
+
+      // The same transition for every subresource is one barrier.
+      size_t added = fixups->size() - resourceStart;
+      if (added > 1 && added == resource->subresourceCount) {
+         bool same = true;
+         for (size_t j = resourceStart + 1; j < fixups->size() && same; ++j) {
+            same = (*fixups)[j].before == (*fixups)[resourceStart].before && (*fixups)[j].after == (*fixups)[resourceStart].after;
+         }
+         if (same) {
+            fixups->resize(resourceStart + 1);
+            (*fixups)[resourceStart].subresource = STATE_ALL_SUBRESOURCES;
+         }
+      }
+   }
+
+   size_t added = fixups->size() - start;
+   list->stats.fixups += added;
+   list->stats.barriers += added;
+   if (added) {
+      ++list->stats.batches;
+   }
+   addStats(&tracker->stats, &list->stats);
+   list->stats = StateTrackerStats();
+}
+
+void StateTrackerEndSubmit(StateTracker *tracker)
+{
+   for (size_t i = 0; i < tracker->resources.size(); ++i) {
+      StateResource *resource = &tracker->resources[i];
+      if (resource->flags & STATE_DECAYS) {
+         resource->states.assign(resource->subresourceCount, STATE_COMMON);
+      }
+   }
+}
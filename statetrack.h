@@ -0,0 +1,168 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Resource state tracking that knows nothing about the API: states are
+// D3D12_RESOURCE_STATES bit patterns and resources are small integer ids, so
+// the D3D12 and null backends run the same code.
+//
+// Command lists are recorded in parallel and submitted later, so while one is
+// recorded nobody knows what state a resource will be in when it starts. Each
+// StateList remembers, per subresource, the state it first needed a resource
+// in and the state it leaves it in; transitions after the first use are known
+// and get queued. At submit, StateTrackerResolve walks the lists in order
+// against the global state and hands back whatever transitions have to run in
+// front of each one.
+//
+// Queued transitions go out together at the next StateListFlush, for one
+// ResourceBarrier call. Two queued for the same subresource fold into one,
+// and one that undoes another cancels it. A split transition is begun when
+// asked and ended at the resource's next use, leaving the GPU the work in
+// between to overlap it with.
+
+#define STATE_INVALID           UINT32_MAX
+#define STATE_ALL_SUBRESOURCES  UINT32_MAX  // D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES
+
+// The D3D12_RESOURCE_STATES the backends use; statetrack's D3D12 glue checks
+// they match.
+#define STATE_COMMON                      0x0
+#define STATE_PRESENT                     0x0
+#define STATE_RENDER_TARGET               0x4
+#define STATE_UNORDERED_ACCESS            0x8
+#define STATE_NON_PIXEL_SHADER_RESOURCE   0x40
+#define STATE_COPY_DEST                   0x400
+#define STATE_COPY_SOURCE                 0x800
+
+// Read-only states, which may be combined and need no transition between a
+// combination and any part of it.
+#define STATE_READ_MASK   (0x1 | 0x2 | 0x20 | 0x40 | 0x80 | 0x200 | 0x800 | 0x2000)
+
+// Resource flags.
+#define STATE_DECAYS      0x1   // buffers: back in COMMON after every submission, promoted out of it on first use
+
+// Barrier flags, as D3D12_RESOURCE_BARRIER_FLAGS.
+#define STATE_BEGIN_ONLY  0x1
+#define STATE_END_ONLY    0x2
+#define STATE_ALIASING    0x4   // not a transition: resource takes over memory from before, a resource id or STATE_INVALID
+
+struct StateBarrier {
+   uint32_t resource;
+   uint32_t subresource;      // or STATE_ALL_SUBRESOURCES
+   uint32_t before;
+   uint32_t after;
+   uint32_t flags;
+};
+
+struct StateTrackerStats {
+   uint64_t requests;         // transitions asked for
+   uint64_t redundant;        // ...of a subresource already in that state
+   uint64_t merged;           // ...folded into, or cancelling, one still queued
+   uint64_t promotions;       // first uses left to implicit promotion
+   uint64_t barriers;         // transitions issued, fixups included
+   uint64_t splitBarriers;    // ...of which begun early and ended later
+   uint64_t aliasing;         // ...of which handing memory from one placed resource to another
+   uint64_t fixups;           // ...of which issued at submit ahead of a list
+   uint64_t batches;          // ResourceBarrier calls
+};
+
+struct StateResource {
+   uint32_t subresourceCount; // 0 if the id is free
+   uint32_t flags;
+   std::vector<uint32_t> states;   // per subresource, as of the last resolved list
+   void *user;                // e.g. the ID3D12Resource
+};
+
+// Resources may only be added or removed while no list is being recorded.
+struct StateTracker {
+   std::vector<StateResource> resources;   // by id
+   std::vector<uint32_t> freeIds;
+   StateTrackerStats stats;
+};
+
+// A resource as one list uses it.
+struct StateListResource {
+   uint32_t resource;
+   std::vector<uint32_t> first;     // per subresource, STATE_INVALID until used
+   std::vector<uint32_t> current;   // ...and the state the list has left it in
+   std::vector<uint32_t> splitFrom; // ...and if a split transition to current is open, where it began
+   bool splitAll;                   // the open split covers every subresource, in one barrier
+};
+
+// One per command list, and only used by the thread recording it.
+struct StateList {
+   StateTracker *tracker;
+   std::vector<StateListResource> resources;   // the first used of them
+   uint32_t used;
+   std::vector<StateBarrier> queued;
+   std::vector<StateBarrier> flushed;          // the last flush's
+   StateTrackerStats stats;                    // added to the tracker's on resolve
+};
+
+void StateTrackerInit(StateTracker *tracker);
+
+// Returns the new resource's id.
+uint32_t StateTrackerAdd(StateTracker *tracker, uint32_t subresourceCount, uint32_t state, uint32_t flags, void *user);
+void StateTrackerRemove(StateTracker *tracker, uint32_t id);
+
+// Forgets everything list recorded before.
+void StateListBegin(StateList *list, StateTracker *tracker);
+
+// Makes the subresource, or every subresource, be in state from here on.
+// Also ends a split transition it's part of, so it doubles as "about to use".
+void StateListTransition(StateList *list, uint32_t id, uint32_t subresource, uint32_t state);
+
+// Like StateListTransition, but only begins the transition. The next
+// StateListTransition of the subresource ends it, as does StateListEnd.
+void StateListBeginSplit(StateList *list, uint32_t id, uint32_t subresource, uint32_t state);
+
+// Queues an aliasing barrier: id is about to use memory before, another
+// placed resource, used last, or STATE_INVALID for any that might have. The
+// next use of id has to overwrite all of it. Leaves the tracked state alone.
+void StateListAlias(StateList *list, uint32_t before, uint32_t id);
+
+// Returns the transitions queued since the last flush, merged and in order,
+// for one ResourceBarrier call, and counts the call if there is one. The
+// array stays valid until the next flush. Due before any command that uses a
+// resource the queued transitions touch.
+uint32_t StateListFlush(StateList *list, const StateBarrier **barriers);
+
+// Ends the split transitions still open. Flush after it.
+void StateListEnd(StateList *list);
+
+// The state the list currently leaves a subresource in, STATE_INVALID if it
+// hasn't used it.
+uint32_t StateListState(const StateList *list, uint32_t id, uint32_t subresource);
+
+// Lists must be resolved in the order they execute in. Appends the
+// transitions that have to run before list to fixups, and moves the global
+// state on to where list leaves it.
+void StateTrackerResolve(StateTracker *tracker, StateList *list, std::vector<StateBarrier> *fixups);
+
+// After the submission's last list: decaying resources go back to COMMON.
+void StateTrackerEndSubmit(StateTracker *tracker);
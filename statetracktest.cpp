@@ -0,0 +1,343 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks the resource state tracker (statetrack.h):
+//
+//    statetracktest
+//
+// Covers queued transitions merging, cancelling and being dropped as
+// redundant, per-subresource tracking, split barriers, aliasing barriers,
+// and the fixups StateTrackerResolve puts ahead of each list at submit,
+// with buffers left to promotion and decay. Prints nothing and returns 0 if
+// everything holds.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "common.h"
+#include "statetrack.h"
+
+#define STATE_SHADER_READ  (STATE_NON_PIXEL_SHADER_RESOURCE | STATE_COPY_SOURCE)
+
+static uint32_t s_failures;
+
+#define CHECK(x) \
+   do { \
+      if (!(x)) { \
+         fprintf(stderr, "%s(%d): %s\n", __FILE__, __LINE__, #x); \
+         ++s_failures; \
+      } \
+   } while (0)
+
+static bool sameBarriers(const StateBarrier *barriers, uint32_t count, const StateBarrier *expected, uint32_t expectedCount)
+{
+   if (count != expectedCount) {
+      return false;
+   }
+   for (uint32_t i = 0; i < count; ++i) {
+      const StateBarrier *a = &barriers[i], *b = &expected[i];
+      if (a->resource != b->resource || a->subresource != b->subresource || a->before != b->before ||
+         a->after != b->after || a->flags != b->flags) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Flushes list and compares what comes out.
+static bool flushes(StateList *list, const StateBarrier *expected, uint32_t expectedCount)
+{
+   const StateBarrier *barriers;
+   uint32_t count = StateListFlush(list, &barriers);
+   return sameBarriers(barriers, count, expected, expectedCount);
+}
+
+static void testMergeAndCancel()
+{
+   StateTracker tracker;
+   StateTrackerInit(&tracker);
+   uint32_t target = StateTrackerAdd(&tracker, 1, STATE_RENDER_TARGET, 0, nullptr);
+   uint32_t other = StateTrackerAdd(&tracker, 1, STATE_RENDER_TARGET, 0, nullptr);
+
+   StateList list;
+   StateListBegin(&list, &tracker);
+
+   // The first use is left to resolve, so nothing is queued for it.
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   StateListTransition(&list, other, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   CHECK(flushes(&list, nullptr, 0));
+
+   // Two in a row fold into one.
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   StateListTransition(&list, other, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   const StateBarrier merged[] = {
+      { target, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET, STATE_COPY_SOURCE, 0 },
+      { other, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET, STATE_COPY_SOURCE, 0 },
+   };
+   CHECK(flushes(&list, merged, ARRAY_COUNT(merged)));
+   CHECK(StateListState(&list, target, 0) == STATE_COPY_SOURCE);
+
+   // There and back again cancels out, but only while still queued.
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   CHECK(flushes(&list, nullptr, 0));
+
+   // Already in a state that covers the request: dropped.
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_SHADER_READ);
+   const StateBarrier read[] = {
+      { target, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE, STATE_SHADER_READ, 0 },
+   };
+   CHECK(flushes(&list, read, ARRAY_COUNT(read)));
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_SHADER_READ);
+   CHECK(flushes(&list, nullptr, 0));
+   CHECK(StateListState(&list, target, 0) == STATE_SHADER_READ);
+
+   // Anything queued for the resource in between stops a merge.
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   StateListAlias(&list, STATE_INVALID, target);
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   const StateBarrier aliased[] = {
+      { target, STATE_ALL_SUBRESOURCES, STATE_SHADER_READ, STATE_RENDER_TARGET, 0 },
+      { target, STATE_ALL_SUBRESOURCES, STATE_INVALID, target, STATE_ALIASING },
+      { target, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET, STATE_COPY_DEST, 0 },
+   };
+   CHECK(flushes(&list, aliased, ARRAY_COUNT(aliased)));
+
+   // Both were first used in the state they were already in.
+   std::vector<StateBarrier> fixups;
+   StateTrackerResolve(&tracker, &list, &fixups);
+   CHECK(fixups.empty());
+   CHECK(tracker.stats.requests == 13);
+   CHECK(tracker.stats.merged == 2);
+   CHECK(tracker.stats.redundant == 3);
+   CHECK(tracker.stats.aliasing == 1);
+   CHECK(tracker.stats.barriers == 6);
+   CHECK(tracker.stats.batches == 3);
+}
+
+static void testSubresources()
+{
+   StateTracker tracker;
+   StateTrackerInit(&tracker);
+   uint32_t texture = StateTrackerAdd(&tracker, 3, STATE_COPY_DEST, 0, nullptr);
+
+   StateList list;
+   StateListBegin(&list, &tracker);
+
+   // One mip is used first, then the rest: the others' first use is left to
+   // resolve, so only the used one moves.
+   StateListTransition(&list, texture, 1, STATE_COPY_SOURCE);
+   StateListTransition(&list, texture, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   const StateBarrier one[] = {
+      { texture, 1, STATE_COPY_SOURCE, STATE_NON_PIXEL_SHADER_RESOURCE, 0 },
+   };
+   CHECK(flushes(&list, one, ARRAY_COUNT(one)));
+
+   // All in the same state now, so one barrier covers them.
+   StateListTransition(&list, texture, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   const StateBarrier all[] = {
+      { texture, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE, STATE_RENDER_TARGET, 0 },
+   };
+   CHECK(flushes(&list, all, ARRAY_COUNT(all)));
+
+   StateListTransition(&list, texture, 2, STATE_COPY_SOURCE);
+   StateListTransition(&list, texture, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   // Mip 1's barrier comes between mip 2's two, so they don't merge.
+   const StateBarrier apart[] = {
+      { texture, 2, STATE_RENDER_TARGET, STATE_COPY_SOURCE, 0 },
+      { texture, 0, STATE_RENDER_TARGET, STATE_COPY_DEST, 0 },
+      { texture, 1, STATE_RENDER_TARGET, STATE_COPY_DEST, 0 },
+      { texture, 2, STATE_COPY_SOURCE, STATE_COPY_DEST, 0 },
+   };
+   CHECK(flushes(&list, apart, ARRAY_COUNT(apart)));
+
+   // Resolving: mip 1 needs COPY_SOURCE, the others NON_PIXEL_SHADER_RESOURCE.
+   std::vector<StateBarrier> fixups;
+   StateTrackerResolve(&tracker, &list, &fixups);
+   const StateBarrier needed[] = {
+      { texture, 0, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, 0 },
+      { texture, 1, STATE_COPY_DEST, STATE_COPY_SOURCE, 0 },
+      { texture, 2, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, 0 },
+   };
+   CHECK(sameBarriers(fixups.data(), (uint32_t)fixups.size(), needed, ARRAY_COUNT(needed)));
+
+   // The same fixup for every subresource is one barrier.
+   StateListBegin(&list, &tracker);
+   StateListTransition(&list, texture, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   fixups.clear();
+   StateTrackerResolve(&tracker, &list, &fixups);
+   const StateBarrier together[] = {
+      { texture, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST, STATE_RENDER_TARGET, 0 },
+   };
+   CHECK(sameBarriers(fixups.data(), (uint32_t)fixups.size(), together, ARRAY_COUNT(together)));
+}
+
+static void testSplit()
+{
+   StateTracker tracker;
+   StateTrackerInit(&tracker);
+   uint32_t store = StateTrackerAdd(&tracker, 1, STATE_COPY_DEST, 0, nullptr);
+   uint32_t target = StateTrackerAdd(&tracker, 1, STATE_RENDER_TARGET, 0, nullptr);
+
+   StateList list;
+   StateListBegin(&list, &tracker);
+   StateListTransition(&list, store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+
+   // Begun, then ended at the next use after other work was recorded.
+   StateListBeginSplit(&list, store, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   const StateBarrier begin[] = {
+      { store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, STATE_BEGIN_ONLY },
+   };
+   CHECK(flushes(&list, begin, ARRAY_COUNT(begin)));
+   CHECK(StateListState(&list, store, 0) == STATE_NON_PIXEL_SHADER_RESOURCE);
+
+   StateListTransition(&list, target, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   StateListTransition(&list, store, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   const StateBarrier end[] = {
+      { store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, STATE_END_ONLY },
+   };
+   CHECK(flushes(&list, end, ARRAY_COUNT(end)));
+
+   // With nothing flushed between the halves there's nothing to overlap, so
+   // it becomes a plain barrier.
+   StateListBeginSplit(&list, store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   StateListTransition(&list, store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   const StateBarrier plain[] = {
+      { store, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE, STATE_COPY_DEST, 0 },
+   };
+   CHECK(flushes(&list, plain, ARRAY_COUNT(plain)));
+
+   // Moving on to another state ends the split first.
+   StateListBeginSplit(&list, store, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   CHECK(flushes(&list, begin, ARRAY_COUNT(begin)));
+   StateListTransition(&list, store, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   const StateBarrier onward[] = {
+      { store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, STATE_END_ONLY },
+      { store, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE, STATE_COPY_SOURCE, 0 },
+   };
+   CHECK(flushes(&list, onward, ARRAY_COUNT(onward)));
+
+   // One still open when the list ends is ended by StateListEnd.
+   StateListBeginSplit(&list, store, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   const StateBarrier open[] = {
+      { store, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE, STATE_COPY_DEST, STATE_BEGIN_ONLY },
+   };
+   CHECK(flushes(&list, open, ARRAY_COUNT(open)));
+   StateListEnd(&list);
+   const StateBarrier closed[] = {
+      { store, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE, STATE_COPY_DEST, STATE_END_ONLY },
+   };
+   CHECK(flushes(&list, closed, ARRAY_COUNT(closed)));
+
+   std::vector<StateBarrier> fixups;
+   StateTrackerResolve(&tracker, &list, &fixups);
+   CHECK(fixups.empty());
+   CHECK(tracker.stats.splitBarriers == 3);
+   CHECK(tracker.stats.barriers == 5);
+   CHECK(tracker.resources[store].states[0] == STATE_COPY_DEST);
+}
+
+static void testSubmit()
+{
+   StateTracker tracker;
+   StateTrackerInit(&tracker);
+   uint32_t backBuffer = StateTrackerAdd(&tracker, 1, STATE_PRESENT, 0, nullptr);
+   uint32_t texture = StateTrackerAdd(&tracker, 1, STATE_RENDER_TARGET, 0, nullptr);
+   uint32_t buffer = StateTrackerAdd(&tracker, 1, STATE_COMMON, STATE_DECAYS, nullptr);
+
+   // Recorded in any order, resolved in submission order.
+   StateList lists[3];
+   StateListBegin(&lists[2], &tracker);
+   StateListTransition(&lists[2], texture, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   StateListTransition(&lists[2], backBuffer, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET);
+   StateListTransition(&lists[2], buffer, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   StateListTransition(&lists[2], backBuffer, STATE_ALL_SUBRESOURCES, STATE_PRESENT);
+   StateListBegin(&lists[0], &tracker);
+   StateListTransition(&lists[0], texture, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   StateListTransition(&lists[0], texture, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   StateListBegin(&lists[1], &tracker);
+   StateListTransition(&lists[1], texture, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   StateListTransition(&lists[1], buffer, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST);
+   for (uint32_t i = 0; i < 3; ++i) {
+      const StateBarrier *barriers;
+      StateListFlush(&lists[i], &barriers);
+   }
+
+   std::vector<StateBarrier> fixups;
+   StateTrackerResolve(&tracker, &lists[0], &fixups);
+   const StateBarrier first[] = {
+      { texture, STATE_ALL_SUBRESOURCES, STATE_RENDER_TARGET, STATE_NON_PIXEL_SHADER_RESOURCE, 0 },
+   };
+   CHECK(sameBarriers(fixups.data(), (uint32_t)fixups.size(), first, ARRAY_COUNT(first)));
+
+   // Picks up where the first left the texture; the buffer is promoted.
+   fixups.clear();
+   StateTrackerResolve(&tracker, &lists[1], &fixups);
+   CHECK(fixups.empty());
+   CHECK(tracker.stats.promotions == 1);
+
+   // The buffer hasn't decayed within the submission, so it needs a barrier.
+   fixups.clear();
+   StateTrackerResolve(&tracker, &lists[2], &fixups);
+   const StateBarrier third[] = {
+      { texture, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, 0 },
+      { backBuffer, STATE_ALL_SUBRESOURCES, STATE_PRESENT, STATE_RENDER_TARGET, 0 },
+      { buffer, STATE_ALL_SUBRESOURCES, STATE_COPY_DEST, STATE_NON_PIXEL_SHADER_RESOURCE, 0 },
+   };
+   CHECK(sameBarriers(fixups.data(), (uint32_t)fixups.size(), third, ARRAY_COUNT(third)));
+   CHECK(tracker.stats.fixups == 4);
+   CHECK(tracker.stats.batches == 4);   // two flushes and two fixup lists
+
+   // Left where the last list left them, except the buffer, which decays.
+   StateTrackerEndSubmit(&tracker);
+   CHECK(tracker.resources[backBuffer].states[0] == STATE_PRESENT);
+   CHECK(tracker.resources[texture].states[0] == STATE_NON_PIXEL_SHADER_RESOURCE);
+   CHECK(tracker.resources[buffer].states[0] == STATE_COMMON);
+
+   StateListBegin(&lists[0], &tracker);
+   StateListTransition(&lists[0], buffer, STATE_ALL_SUBRESOURCES, STATE_COPY_SOURCE);
+   StateListTransition(&lists[0], texture, STATE_ALL_SUBRESOURCES, STATE_NON_PIXEL_SHADER_RESOURCE);
+   fixups.clear();
+   StateTrackerResolve(&tracker, &lists[0], &fixups);
+   CHECK(fixups.empty());
+   CHECK(tracker.stats.promotions == 2);
+
+   // A removed id is handed out again.
+   StateTrackerRemove(&tracker, texture);
+   CHECK(StateTrackerAdd(&tracker, 2, STATE_COMMON, 0, nullptr) == texture);
+   CHECK(tracker.resources[texture].states.size() == 2);
+}
+
+int main()
+{
+   testMergeAndCancel();
+   testSubresources();
+   testSplit();
+   testSubmit();
+   return s_failures > 0 ? 1 : 0;
+}
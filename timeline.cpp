@@ -0,0 +1,151 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "common.h"
+#include "profiler.h"
+#include "timeline.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void runRetired(Timeline *timeline)
+{
+   std::vector<TimelineCallback> &callbacks = timeline->callbacks;
+
+   size_t count = 0;
+   while (count < callbacks.size() && callbacks[count].value <= timeline->completed) {
+      ++count;
+   }
+   if (count == 0) {
+      return;
+   }
+
+   // Take them out before running any, so a callback can register more or
+   // poll again without seeing itself.
+   std::vector<TimelineCallback> retired(callbacks.begin(), callbacks.begin() + count);
+   callbacks.erase(callbacks.begin(), callbacks.begin() + count);
+   timeline->stats.callbacks += count;
+   for (const TimelineCallback &callback : retired) {
+      callback.fn(callback.user, callback.value);
+   }
+}
+
+static void readFence(Timeline *timeline)
+{
+   Clock::time_point start = Clock::now();
+   uint64_t completed = timeline->fence->CompletedValue();
+   timeline->stats.pollSeconds += secondsSince(start);
+   ++timeline->stats.polls;
+
+   ASSERT(completed >= timeline->completed);
+   timeline->completed = completed;
+}
+
+void TimelineInit(Timeline *timeline, TimelineFence *fence)
+{
+   timeline->fence = fence;
+   timeline->completed = fence->CompletedValue();
+   timeline->callbacks.clear();
+   memset(&timeline->stats, 0, sizeof(timeline->stats));
+}
+
+uint64_t TimelinePoll(Timeline *timeline)
+{
+   readFence(timeline);
+   runRetired(timeline);
+   return timeline->completed;
+}
+
+bool TimelineIsComplete(Timeline *timeline, uint64_t value)
+{
+   if (value > timeline->completed) {
+      TimelinePoll(timeline);
+   }
+   return value <= timeline->completed;
+}
+
+void TimelineWait(Timeline *timeline, uint64_t value)
+{
+   ++timeline->stats.waits;
+
+   if (value <= timeline->completed) {
+      ++timeline->stats.cachedWaits;
+   } else {
+      readFence(timeline);
+      if (value <= timeline->completed) {
+         ++timeline->stats.polledWaits;
+      } else {
+         PROFILE_ZONE("fence wait");
+         Clock::time_point start = Clock::now();
+         timeline->fence->Block(value);
+         timeline->stats.blockedSeconds += secondsSince(start);
+         ++timeline->stats.blockedWaits;
+         readFence(timeline);
+         ASSERT(value <= timeline->completed);
+      }
+   }
+
+   runRetired(timeline);
+}
+
+void TimelineWaitAll(Timeline *const *timelines, const uint64_t *values, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      if (values[i] > timelines[i]->completed) {
+         readFence(timelines[i]);
+      }
+   }
+   for (uint32_t i = 0; i < count; ++i) {
+      TimelineWait(timelines[i], values[i]);
+   }
+}
+
+void TimelineOnComplete(Timeline *timeline, uint64_t value, TimelineCallbackFn *fn, void *user)
+{
+   if (value <= timeline->completed) {
+      ++timeline->stats.callbacks;
+      fn(user, value);
+      return;
+   }
+
+   // Usually registered in order, so this is nearly always an append.
+   TimelineCallback callback = { value, fn, user };
+   std::vector<TimelineCallback> &callbacks = timeline->callbacks;
+   if (callbacks.empty() || callbacks.back().value <= value) {
+      callbacks.push_back(callback);
+   } else {
+      callbacks.insert(std::upper_bound(callbacks.begin(), callbacks.end(), value,
+         [](uint64_t v, const TimelineCallback &c) { return v < c.value; }), callback);
+   }
+}
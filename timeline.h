@@ -0,0 +1,101 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// The GPU side of a timeline: a monotonically increasing counter the GPU
+// advances. Implemented over ID3D12Fence by the D3D12 backend, and by plain
+// counters in the null backend and tests.
+class TimelineFence {
+public:
+   virtual ~TimelineFence() {}
+
+   virtual uint64_t CompletedValue() = 0;
+
+   // Returns once CompletedValue() >= value. Only called when it isn't yet.
+   virtual void Block(uint64_t value) = 0;
+};
+
+typedef void TimelineCallbackFn(void *user, uint64_t value);
+
+struct TimelineCallback {
+   uint64_t value;
+   TimelineCallbackFn *fn;
+   void *user;
+};
+
+struct TimelineStats {
+   uint64_t waits;
+   uint64_t cachedWaits;   // satisfied by the last value read, without touching the fence
+   uint64_t polledWaits;   // ...by reading the fence once
+   uint64_t blockedWaits;  // ...by blocking
+   uint64_t polls;         // fence reads
+   uint64_t callbacks;     // run
+   double pollSeconds;
+   double blockedSeconds;
+};
+
+// Tracks how far a fence has got and runs callbacks as values retire. Waits
+// check the last value seen, then the fence, and only block if both are
+// behind, so waiting on work that's already finished costs next to nothing.
+//
+// Not thread-safe; a timeline belongs to whichever thread submits to its queue.
+struct Timeline {
+   TimelineFence *fence;
+   uint64_t completed;                       // last value read from the fence
+   std::vector<TimelineCallback> callbacks;  // sorted by value
+   TimelineStats stats;
+};
+
+void TimelineInit(Timeline *timeline, TimelineFence *fence);
+
+// Reads the fence, runs every callback that has retired and returns the
+// completed value.
+uint64_t TimelinePoll(Timeline *timeline);
+
+// True if value has completed. Only reads the fence if the last value seen
+// is behind.
+bool TimelineIsComplete(Timeline *timeline, uint64_t value);
+
+// Returns once value has completed, having run the callbacks up to it.
+void TimelineWait(Timeline *timeline, uint64_t value);
+
+// Waits for values[i] on timelines[i], e.g. one per queue. Polls all of them
+// first so it only blocks on the ones that are actually behind.
+void TimelineWaitAll(Timeline *const *timelines, const uint64_t *values, uint32_t count);
+
+// Calls fn(user, value) once value has completed: from a later poll or wait,
+// or right away if it already has. Callbacks run in value order, and may
+// register more.
+void TimelineOnComplete(Timeline *timeline, uint64_t value, TimelineCallbackFn *fn, void *user);
+
+// Callbacks not run yet.
+static inline uint32_t TimelinePending(const Timeline *timeline)
+{
+   return (uint32_t)timeline->callbacks.size();
+}
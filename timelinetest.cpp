@@ -0,0 +1,292 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Checks the timeline (timeline.h) against a fake fence that counts how
+// often it's read and blocked on:
+//
+//    timelinetest
+//
+// Covers waits satisfied from the cached value, by one read and by
+// blocking; callbacks registered out of order and from inside other
+// callbacks; and waiting on several timelines at once. Prints nothing and
+// returns 0 if everything holds.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "common.h"
+#include "timeline.h"
+
+static uint32_t s_failures;
+
+#define CHECK(x) \
+   do { \
+      if (!(x)) { \
+         fprintf(stderr, "%s(%d): %s\n", __FILE__, __LINE__, #x); \
+         ++s_failures; \
+      } \
+   } while (0)
+
+// The test plays the GPU by setting value; blocking jumps straight to the
+// value waited for.
+class FakeFence : public TimelineFence {
+public:
+   uint64_t value;
+   uint32_t reads;
+   uint32_t blocks;
+   uint64_t lastBlock;
+
+   FakeFence() : value(0), reads(0), blocks(0), lastBlock(0) {}
+
+   uint64_t CompletedValue() override
+   {
+      ++reads;
+      return value;
+   }
+
+   void Block(uint64_t target) override
+   {
+      CHECK(target > value);
+      ++blocks;
+      lastBlock = target;
+      value = target;
+   }
+};
+
+struct Call {
+   uint32_t id;
+   uint64_t value;
+};
+
+struct Recorder {
+   Timeline *timeline;
+   std::vector<Call> calls;
+};
+
+struct Callback {
+   Recorder *recorder;
+   uint32_t id;
+};
+
+static void record(void *user, uint64_t value)
+{
+   Callback *callback = (Callback *)user;
+   Call call = { callback->id, value };
+   callback->recorder->calls.push_back(call);
+}
+
+static bool calledInOrder(const Recorder *recorder, const uint32_t *ids, uint32_t count)
+{
+   if (recorder->calls.size() != count) {
+      return false;
+   }
+   for (uint32_t i = 0; i < count; ++i) {
+      if (recorder->calls[i].id != ids[i]) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static void testWaits()
+{
+   FakeFence fence;
+   fence.value = 2;
+   Timeline timeline;
+   TimelineInit(&timeline, &fence);
+   CHECK(timeline.completed == 2);
+
+   // Behind the last value read: no read at all.
+   uint32_t reads = fence.reads;
+   TimelineWait(&timeline, 1);
+   TimelineWait(&timeline, 2);
+   CHECK(fence.reads == reads);
+   CHECK(timeline.stats.cachedWaits == 2);
+   CHECK(TimelineIsComplete(&timeline, 2) && fence.reads == reads);
+
+   // The GPU has got there but the timeline hasn't looked: one read.
+   fence.value = 5;
+   TimelineWait(&timeline, 4);
+   CHECK(fence.reads == reads + 1);
+   CHECK(timeline.stats.polledWaits == 1 && timeline.completed == 5);
+   CHECK(fence.blocks == 0);
+
+   // Not there yet: a read, then a block on exactly that value.
+   TimelineWait(&timeline, 9);
+   CHECK(fence.blocks == 1 && fence.lastBlock == 9);
+   CHECK(timeline.stats.blockedWaits == 1 && timeline.completed == 9);
+   CHECK(timeline.stats.waits == 4);
+
+   CHECK(!TimelineIsComplete(&timeline, 10));
+   fence.value = 10;
+   CHECK(TimelineIsComplete(&timeline, 10));
+   CHECK(fence.blocks == 1);
+   CHECK(TimelinePoll(&timeline) == 10);
+}
+
+static void testCallbackOrder()
+{
+   FakeFence fence;
+   fence.value = 1;
+   Timeline timeline;
+   TimelineInit(&timeline, &fence);
+   Recorder recorder;
+   recorder.timeline = &timeline;
+
+   // Registered out of order; equal values run in the order they came.
+   static const uint64_t values[] = { 5, 3, 4, 3, 7, 2 };
+   Callback callbacks[ARRAY_COUNT(values)];
+   for (uint32_t i = 0; i < ARRAY_COUNT(values); ++i) {
+      callbacks[i].recorder = &recorder;
+      callbacks[i].id = i;
+      TimelineOnComplete(&timeline, values[i], record, &callbacks[i]);
+   }
+   CHECK(recorder.calls.empty());
+   CHECK(TimelinePending(&timeline) == ARRAY_COUNT(values));
+
+   // Already complete: runs right away.
+   Callback now = { &recorder, 100 };
+   TimelineOnComplete(&timeline, 1, record, &now);
+   CHECK(recorder.calls.size() == 1 && recorder.calls[0].id == 100 && recorder.calls[0].value == 1);
+   recorder.calls.clear();
+
+   fence.value = 4;
+   TimelinePoll(&timeline);
+   static const uint32_t first[] = { 5, 1, 3, 2 };
+   CHECK(calledInOrder(&recorder, first, ARRAY_COUNT(first)));
+   CHECK(TimelinePending(&timeline) == 2);
+
+   // A wait runs them too, up to what it waited for.
+   recorder.calls.clear();
+   TimelineWait(&timeline, 7);
+   static const uint32_t second[] = { 0, 4 };
+   CHECK(calledInOrder(&recorder, second, ARRAY_COUNT(second)));
+   CHECK(recorder.calls[0].value == 5 && recorder.calls[1].value == 7);
+   CHECK(TimelinePending(&timeline) == 0);
+   CHECK(timeline.stats.callbacks == ARRAY_COUNT(values) + 1);
+}
+
+// Registers callbacks of its own when it runs: one for a value that's done,
+// which must run at once, one further on, and one for its own value, which
+// must not run it again. Then polls, which must not see itself either.
+struct Chain {
+   Recorder *recorder;
+   Callback done, later, same;
+   uint32_t runs;
+};
+
+static void chain(void *user, uint64_t value)
+{
+   Chain *c = (Chain *)user;
+   ++c->runs;
+   Call call = { 0, value };
+   c->recorder->calls.push_back(call);
+
+   Timeline *timeline = c->recorder->timeline;
+   TimelineOnComplete(timeline, value - 1, record, &c->done);
+   TimelineOnComplete(timeline, value + 2, record, &c->later);
+   TimelineOnComplete(timeline, value, record, &c->same);
+   TimelinePoll(timeline);
+}
+
+static void testNestedCallbacks()
+{
+   FakeFence fence;
+   Timeline timeline;
+   TimelineInit(&timeline, &fence);
+   Recorder recorder;
+   recorder.timeline = &timeline;
+
+   Chain c;
+   c.recorder = &recorder;
+   c.done.recorder = c.later.recorder = c.same.recorder = &recorder;
+   c.done.id = 1;
+   c.later.id = 2;
+   c.same.id = 3;
+   c.runs = 0;
+   TimelineOnComplete(&timeline, 3, chain, &c);
+
+   fence.value = 3;
+   TimelinePoll(&timeline);
+   CHECK(c.runs == 1);
+   static const uint32_t first[] = { 0, 1, 3 };
+   CHECK(calledInOrder(&recorder, first, ARRAY_COUNT(first)));
+   CHECK(TimelinePending(&timeline) == 1);
+
+   recorder.calls.clear();
+   TimelineWait(&timeline, 5);
+   static const uint32_t second[] = { 2 };
+   CHECK(calledInOrder(&recorder, second, ARRAY_COUNT(second)));
+   CHECK(recorder.calls[0].value == 5);
+   CHECK(c.runs == 1 && TimelinePending(&timeline) == 0);
+}
+
+static void testWaitAll()
+{
+   FakeFence fences[3];
+   Timeline timelines[3];
+   for (uint32_t i = 0; i < 3; ++i) {
+      TimelineInit(&timelines[i], &fences[i]);
+   }
+   Recorder recorder;
+   recorder.timeline = nullptr;
+   Callback callbacks[3];
+   for (uint32_t i = 0; i < 3; ++i) {
+      callbacks[i].recorder = &recorder;
+      callbacks[i].id = i;
+      TimelineOnComplete(&timelines[i], 4, record, &callbacks[i]);
+   }
+
+   // The first is already known to be done, the second has got there
+   // without anyone looking, and only the third needs blocking on.
+   fences[0].value = 6;
+   TimelinePoll(&timelines[0]);
+   fences[1].value = 4;
+   fences[2].value = 1;
+   uint32_t reads0 = fences[0].reads;
+
+   Timeline *waits[] = { &timelines[0], &timelines[1], &timelines[2] };
+   uint64_t values[] = { 5, 4, 4 };
+   TimelineWaitAll(waits, values, 3);
+   CHECK(fences[0].reads == reads0);
+   CHECK(fences[0].blocks == 0 && fences[1].blocks == 0);
+   CHECK(fences[2].blocks == 1 && fences[2].lastBlock == 4);
+   CHECK(timelines[0].stats.cachedWaits == 1);
+   CHECK(timelines[1].stats.cachedWaits == 1);      // read by the first pass
+   CHECK(timelines[2].stats.blockedWaits == 1);
+   CHECK(recorder.calls.size() == 3);
+   for (uint32_t i = 0; i < 3; ++i) {
+      CHECK(timelines[i].completed >= values[i] && TimelinePending(&timelines[i]) == 0);
+   }
+}
+
+int main()
+{
+   testWaits();
+   testCallbackOrder();
+   testNestedCallbacks();
+   testWaitAll();
+   return s_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <string.h>
+
+#include <chrono>
+
+#include "common.h"
+#include "transfer.h"
+
+int64_t TransferNow()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Accounts for every request whose batch has completed and hands back its
+// staging memory.
+static void retire(TransferQueue *queue, uint64_t completedValue)
+{
+   int64_t now = TransferNow();
+
+   size_t retired = 0;
+   while (retired < queue->inFlight.size() && queue->inFlight[retired].fenceValue <= completedValue) {
+      const TransferInFlight *request = &queue->inFlight[retired];
+      double latency = (now - request->queuedTime) * 1e-9;
+      queue->stats.latencySeconds += latency;
+      if (latency > queue->stats.maxLatencySeconds) {
+         queue->stats.maxLatencySeconds = latency;
+      }
+      queue->stats.bytes += request->size;
+      ++queue->stats.requests;
+      ++retired;
+   }
+   queue->inFlight.erase(queue->inFlight.begin(), queue->inFlight.begin() + retired);
+
+   if (queue->busy && completedValue + 1 >= queue->nextFenceValue) {
+      queue->stats.busySeconds += (now - queue->busySince) * 1e-9;
+      queue->busy = false;
+   }
+
+   RingBeginFrame(&queue->staging, completedValue);
+}
+
+// Stages chunks of queued requests, oldest first, until budget bytes have
+// been staged or staging memory runs out, and submits them as one batch.
+// Returns the bytes staged.
+static uint64_t submitBatch(TransferQueue *queue, uint64_t budget)
+{
+   // Each batch in flight holds one of the ring's retirement slots.
+   if (queue->staging.retireCount == TRANSFER_MAX_BATCHES) {
+      ++queue->stats.stalls;
+      return 0;
+   }
+
+   uint64_t fenceValue = queue->nextFenceValue;
+   uint64_t staged = 0;
+   size_t finished = 0;
+   queue->copies.clear();
+
+   while (finished < queue->requests.size() && staged < budget) {
+      TransferRequest *request = &queue->requests[finished];
+      uint64_t size = request->size - request->staged;
+      if (size > queue->chunkSize) {
+         size = queue->chunkSize;
+      }
+      if (size > budget - staged) {
+         size = budget - staged;
+      }
+
+      uint64_t offset = RingAlloc(&queue->staging, size, TRANSFER_ALIGNMENT);
+      if (offset == RING_INVALID) {
+         ++queue->stats.stalls;
+         break;
+      }
+
+      memcpy(queue->stagingBase + offset, request->src + request->staged, (size_t)size);
+      TransferCopy copy = { request->dst, request->dstOffset + request->staged, offset, size };
+      queue->copies.push_back(copy);
+      request->staged += size;
+      staged += size;
+
+      if (request->staged == request->size) {
+         TransferInFlight inFlight = { request->id, fenceValue, request->size, request->queuedTime };
+         queue->inFlight.push_back(inFlight);
+         if (request->done) {
+            request->done(request->user);
+         }
+         ++finished;
+      }
+   }
+   queue->requests.erase(queue->requests.begin(), queue->requests.begin() + finished);
+
+   if (queue->copies.empty()) {
+      return 0;
+   }
+
+   queue->submit(queue->user, queue->copies.data(), (uint32_t)queue->copies.size(), fenceValue);
+   RingEndFrame(&queue->staging, fenceValue);
+   ++queue->nextFenceValue;
+   ++queue->stats.batches;
+   queue->stats.chunks += queue->copies.size();
+   if (!queue->busy) {
+      queue->busy = true;
+      queue->busySince = TransferNow();
+   }
+   return staged;
+}
+
+void TransferInit(TransferQueue *queue, Timeline *timeline, uint8_t *stagingBase, uint64_t stagingSize,
+   uint64_t chunkSize, TransferSubmitFn *submit, void *user)
+{
+   // Any chunk has to fit in an empty ring, wherever its head is.
+   ASSERT(chunkSize > 0 && chunkSize <= stagingSize / 2);
+
+   RingInit(&queue->staging, stagingSize);
+   queue->stagingBase = stagingBase;
+   queue->timeline = timeline;
+   queue->chunkSize = chunkSize;
+   queue->submit = submit;
+   queue->user = user;
+   queue->nextFenceValue = TimelinePoll(timeline) + 1;
+   queue->nextId = 1;
+   queue->requests.clear();
+   queue->inFlight.clear();
+   queue->copies.clear();
+   queue->busy = false;
+   queue->busySince = 0;
+   memset(&queue->stats, 0, sizeof(queue->stats));
+}
+
+void TransferShutdown(TransferQueue *queue)
+{
+   if (!queue->requests.empty()) {
+      TransferFlush(queue, queue->requests.back().id);
+   }
+   TimelineWait(queue->timeline, queue->nextFenceValue - 1);
+   retire(queue, queue->timeline->completed);
+   ASSERT(queue->inFlight.empty());
+}
+
+TransferId TransferEnqueue(TransferQueue *queue, void *dst, uint64_t dstOffset, const void *src,
+   uint64_t size, TransferDoneFn *done, void *user)
+{
+   ASSERT(size > 0);
+
+   TransferRequest request;
+   request.id = queue->nextId++;
+   request.dst = dst;
+   request.dstOffset = dstOffset;
+   request.src = (const uint8_t *)src;
+   request.size = size;
+   request.staged = 0;
+   request.done = done;
+   request.user = user;
+   request.queuedTime = TransferNow();
+   queue->requests.push_back(request);
+   return request.id;
+}
+
+void TransferPump(TransferQueue *queue, uint64_t budget)
+{
+   retire(queue, TimelinePoll(queue->timeline));
+   if (!queue->requests.empty() && budget > 0) {
+      submitBatch(queue, budget);
+   }
+}
+
+uint64_t TransferFenceValue(const TransferQueue *queue, TransferId id)
+{
+   ASSERT(id > 0 && id < queue->nextId);
+
+   if (!queue->requests.empty() && id >= queue->requests.front().id) {
+      return TRANSFER_PENDING;
+   }
+   for (size_t i = 0; i < queue->inFlight.size(); ++i) {
+      if (queue->inFlight[i].id == id) {
+         return queue->inFlight[i].fenceValue;
+      }
+   }
+   return 0;
+}
+
+uint64_t TransferFlush(TransferQueue *queue, TransferId id)
+{
+   uint64_t fenceValue = TransferFenceValue(queue, id);
+   if (fenceValue != TRANSFER_PENDING) {
+      return fenceValue;
+   }
+
+   ++queue->stats.flushes;
+   retire(queue, TimelinePoll(queue->timeline));
+   while (!queue->requests.empty() && queue->requests.front().id <= id) {
+      uint64_t budget = 0;
+      for (size_t i = 0; i < queue->requests.size() && queue->requests[i].id <= id; ++i) {
+         budget += queue->requests[i].size - queue->requests[i].staged;
+      }
+      if (submitBatch(queue, budget) == 0) {
+         // Staging memory is full; the oldest batch in flight has to finish.
+         ASSERT(queue->staging.retireCount > 0);
+         TimelineWait(queue->timeline, queue->staging.retirements[queue->staging.retireFirst].fenceValue);
+         retire(queue, queue->timeline->completed);
+      }
+   }
+   return TransferFenceValue(queue, id);
+}
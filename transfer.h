@@ -0,0 +1,164 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "ring.h"
+#include "timeline.h"
+
+#define TRANSFER_MAX_BATCHES  RING_MAX_FRAMES   // submitted and not yet complete
+#define TRANSFER_ALIGNMENT    512               // of each chunk in staging memory
+#define TRANSFER_PENDING      UINT64_MAX
+
+// Identifies a request for as long as the queue lives. Ids are handed out in
+// order, starting at 1.
+typedef uint64_t TransferId;
+
+// One chunk of a request: size bytes from stagingOffset in staging memory to
+// dstOffset in dst.
+struct TransferCopy {
+   void *dst;
+   uint64_t dstOffset;
+   uint64_t stagingOffset;
+   uint64_t size;
+};
+
+// Records copies into a command list, submits it to the copy queue and has
+// the queue signal fenceValue once it's done.
+typedef void TransferSubmitFn(void *user, const TransferCopy *copies, uint32_t count, uint64_t fenceValue);
+
+// The request's source has been copied into staging memory and can go.
+typedef void TransferDoneFn(void *user);
+
+struct TransferRequest {
+   TransferId id;
+   void *dst;
+   uint64_t dstOffset;
+   const uint8_t *src;
+   uint64_t size;
+   uint64_t staged;           // bytes copied into staging memory so far
+   TransferDoneFn *done;
+   void *user;
+   int64_t queuedTime;        // ns, from TransferNow
+};
+
+// A request whose last chunk has been submitted.
+struct TransferInFlight {
+   TransferId id;
+   uint64_t fenceValue;       // of the batch with its last chunk
+   uint64_t size;
+   int64_t queuedTime;
+};
+
+struct TransferStats {
+   uint64_t requests;         // complete on the GPU
+   uint64_t bytes;            // ...and their total size
+   uint64_t batches;          // submitted
+   uint64_t chunks;
+   uint64_t stalls;           // pumps cut short by full staging memory
+   uint64_t flushes;          // requests a frame needed before they were submitted
+   double busySeconds;        // with at least one batch on the GPU
+   double latencySeconds;     // total over requests, from queued to seen complete
+   double maxLatencySeconds;
+};
+
+// Streams data into GPU memory through a dedicated copy queue. Requests are
+// staged in order, a chunk at a time, through a ring of staging memory. Each
+// pump submits at most a budget's worth of chunks as one batch, which
+// signals the next value of the copy queue's fence, so large uploads spread
+// over several frames and never hold up the one being recorded.
+//
+// Frames only wait for what they use: TransferFenceValue says which copy
+// fence value a request completes with, for a GPU-side wait before the
+// frame's work on the direct queue.
+//
+// The queue knows nothing about the GPU; copies are handed to a submit
+// callback, and staging memory and the fence are whatever the caller passes
+// in, so the scheduling runs without one. Not thread-safe; a queue belongs
+// to the thread that submits frames.
+struct TransferQueue {
+   RingAllocator staging;
+   uint8_t *stagingBase;
+   Timeline *timeline;        // the copy queue's
+   uint64_t chunkSize;
+   TransferSubmitFn *submit;
+   void *user;
+
+   uint64_t nextFenceValue;   // signaled by the next batch
+   TransferId nextId;
+   std::vector<TransferRequest> requests;    // not all submitted yet, oldest first
+   std::vector<TransferInFlight> inFlight;   // oldest first
+   std::vector<TransferCopy> copies;         // the batch being built
+
+   bool busy;                 // a batch is on the GPU...
+   int64_t busySince;         // ...since this time
+   TransferStats stats;
+};
+
+// stagingBase points to stagingSize bytes the copy queue can read, e.g. a
+// mapped upload buffer; chunkSize is at most half of stagingSize. Fence values
+// carry on from the timeline's completed value.
+void TransferInit(TransferQueue *queue, Timeline *timeline, uint8_t *stagingBase, uint64_t stagingSize,
+   uint64_t chunkSize, TransferSubmitFn *submit, void *user);
+
+// Submits everything queued and waits for it to complete.
+void TransferShutdown(TransferQueue *queue);
+
+// Queues a copy of size bytes from src to dstOffset in dst. src must stay
+// valid until done(user) is called, which happens once it has all been
+// staged; done may be null.
+TransferId TransferEnqueue(TransferQueue *queue, void *dst, uint64_t dstOffset, const void *src,
+   uint64_t size, TransferDoneFn *done, void *user);
+
+// Retires completed batches, then stages and submits up to budget bytes of
+// queued requests as one batch. Call once a frame. Never blocks: a pump that
+// finds staging memory full leaves the rest for later.
+void TransferPump(TransferQueue *queue, uint64_t budget);
+
+// The copy fence value request id completes with: 0 if it already has, or
+// TRANSFER_PENDING if it isn't all submitted yet.
+uint64_t TransferFenceValue(const TransferQueue *queue, TransferId id);
+
+// Like TransferFenceValue, but first submits whatever is left of id and the
+// requests queued before it, regardless of budget, waiting for staging memory
+// if it has to. Never returns TRANSFER_PENDING.
+uint64_t TransferFlush(TransferQueue *queue, TransferId id);
+
+// Nanoseconds on the clock request times are measured with.
+int64_t TransferNow();
+
+// Bytes per second while the copy queue was busy.
+static inline double TransferBytesPerSecond(const TransferStats *stats)
+{
+   return stats->busySeconds > 0.0 ? stats->bytes / stats->busySeconds : 0.0;
+}
+
+// Mean seconds from queued to complete.
+static inline double TransferMeanLatency(const TransferStats *stats)
+{
+   return stats->requests ? stats->latencySeconds / stats->requests : 0.0;
+}
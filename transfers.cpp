@@ -0,0 +1,151 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include <stdio.h>
+
+#include "transfers.h"
+#include "upload.h"
+
+#define TRANSFER_CHUNK_SIZE   (1ull << 20)
+#define TRANSFER_FRAME_BUDGET (4ull << 20)    // per frame; larger uploads take several
+
+static void submitCopies(void *user, const TransferCopy *copies, uint32_t count, uint64_t fenceValue)
+{
+   Dx12Transfers *transfers = (Dx12Transfers *)user;
+
+   // The queue keeps no more batches in flight than there are allocators, so
+   // this one's last user has finished.
+   ID3D12CommandAllocator *allocator = transfers->allocators[fenceValue % TRANSFER_MAX_BATCHES].Get();
+   ID3D12GraphicsCommandList *commandList = transfers->commandList.Get();
+   DX_VERIFY(allocator->Reset());
+   DX_VERIFY(commandList->Reset(allocator, nullptr));
+
+   ID3D12Resource *staging = transfers->staging.Get();
+   for (uint32_t i = 0; i < count; ++i) {
+      commandList->CopyBufferRegion((ID3D12Resource *)copies[i].dst, copies[i].dstOffset,
+         staging, copies[i].stagingOffset, copies[i].size);
+   }
+   DX_VERIFY(commandList->Close());
+
+   ID3D12CommandList *lists[] = { commandList };
+   transfers->commandQueue->ExecuteCommandLists(1, lists);
+   DX_VERIFY(transfers->commandQueue->Signal(transfers->fence.fence.Get(), fenceValue));
+}
+
+bool CreateTransfers(Dx12Transfers *transfers, ID3D12Device *device, UINT64 stagingSize)
+{
+   D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+   queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+   queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+
+   ComPtr<ID3D12CommandQueue> commandQueue;
+   ComPtr<ID3D12Fence> fence;
+   ComPtr<ID3D12Resource> staging;
+   void *mapped;
+   if (FAILED(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue))) ||
+      FAILED(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence))) ||
+      !CreateUploadBuffer(device, stagingSize, &staging, &mapped)) {
+      return false;
+   }
+
+   for (size_t i = 0; i < ARRAY_COUNT(transfers->allocators); ++i) {
+      if (FAILED(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&transfers->allocators[i])))) {
+         return false;
+      }
+   }
+
+   ComPtr<ID3D12GraphicsCommandList> commandList;
+   if (FAILED(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, transfers->allocators[0].Get(), nullptr,
+      IID_PPV_ARGS(&commandList)))) {
+      return false;
+   }
+   commandList->Close();
+
+   transfers->fence.event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+   transfers->fence.fence = std::move(fence);
+   TimelineInit(&transfers->timeline, &transfers->fence);
+   TransferInit(&transfers->queue, &transfers->timeline, (uint8_t *)mapped, stagingSize, TRANSFER_CHUNK_SIZE,
+      submitCopies, transfers);
+   transfers->commandQueue = std::move(commandQueue);
+   transfers->staging = std::move(staging);
+   transfers->commandList = std::move(commandList);
+   transfers->frameWait = 0;
+   transfers->queueWait = 0;
+   return true;
+}
+
+void DestroyTransfers(Dx12Transfers *transfers)
+{
+   if (transfers->commandQueue) {
+      TransferShutdown(&transfers->queue);
+
+#ifndef NDEBUG
+      const TransferStats *stats = &transfers->queue.stats;
+      char msg[256];
+      sprintf_s(msg, "transfers: %llu requests, %.1f MB in %llu batches, %.1f MB/s, latency %.3f ms mean, %.3f ms max, %llu stalls, %llu flushes\n",
+         stats->requests, stats->bytes / 1048576.0, stats->batches, TransferBytesPerSecond(stats) / 1048576.0,
+         TransferMeanLatency(stats) * 1000.0, stats->maxLatencySeconds * 1000.0, stats->stalls, stats->flushes);
+      OutputDebugStringA(msg);
+#endif
+   }
+
+   transfers->commandList = nullptr;
+   for (size_t i = 0; i < ARRAY_COUNT(transfers->allocators); ++i) {
+      transfers->allocators[i] = nullptr;
+   }
+   transfers->staging = nullptr;
+   CloseHandle(transfers->fence.event);
+   transfers->fence.event = NULL;
+   transfers->fence.fence = nullptr;
+   transfers->commandQueue = nullptr;
+}
+
+TransferId UploadBuffer(Dx12Transfers *transfers, ID3D12Resource *buffer, UINT64 offset,
+   const void *src, UINT64 size, TransferDoneFn *done, void *user)
+{
+   return TransferEnqueue(&transfers->queue, buffer, offset, src, size, done, user);
+}
+
+void TransfersBeginFrame(Dx12Transfers *transfers)
+{
+   TransferPump(&transfers->queue, TRANSFER_FRAME_BUDGET);
+}
+
+void UseTransfer(Dx12Transfers *transfers, TransferId id)
+{
+   uint64_t fenceValue = TransferFlush(&transfers->queue, id);
+   if (fenceValue > transfers->frameWait) {
+      transfers->frameWait = fenceValue;
+   }
+}
+
+void TransfersBeforeSubmit(Dx12Transfers *transfers, ID3D12CommandQueue *commandQueue)
+{
+   // Fence values only grow, so a wait already queued covers anything older.
+   if (transfers->frameWait > transfers->queueWait) {
+      DX_VERIFY(commandQueue->Wait(transfers->fence.fence.Get(), transfers->frameWait));
+      transfers->queueWait = transfers->frameWait;
+   }
+   transfers->frameWait = 0;
+}
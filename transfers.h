@@ -0,0 +1,52 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "dx12demo.h"
+
+// Creates the copy queue, its fence and stagingSize bytes of staging memory.
+bool CreateTransfers(Dx12Transfers *transfers, ID3D12Device *device, UINT64 stagingSize);
+
+// Finishes every queued upload first.
+void DestroyTransfers(Dx12Transfers *transfers);
+
+// Queues a copy of size bytes from src into buffer at offset. The buffer
+// must be in D3D12_RESOURCE_STATE_COMMON: copy queues promote it to
+// COPY_DEST and it decays back once the copy is done, ready to be promoted
+// to whatever read state the direct queue uses it in. src must stay valid
+// until done(user) is called; see TransferEnqueue.
+TransferId UploadBuffer(Dx12Transfers *transfers, ID3D12Resource *buffer, UINT64 offset,
+   const void *src, UINT64 size, TransferDoneFn *done, void *user);
+
+// Submits the next batch of queued uploads. Called at the start of each frame.
+void TransfersBeginFrame(Dx12Transfers *transfers);
+
+// The frame being recorded reads what id writes. Submits id first if it
+// hasn't been yet.
+void UseTransfer(Dx12Transfers *transfers, TransferId id);
+
+// Makes commandQueue wait for everything the frame has used before running
+// what's submitted to it next.
+void TransfersBeforeSubmit(Dx12Transfers *transfers, ID3D12CommandQueue *commandQueue);
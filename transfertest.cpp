@@ -0,0 +1,385 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// Checks the transfer queue's scheduling (transfer.h) against a fake copy
+// fence and a submit callback that records each batch and does its copies
+// on the spot:
+//
+//    transfertest
+//
+// Covers splitting requests into chunks, keeping each pump within its
+// budget, pumps stalling on full staging memory and flushes waiting it out,
+// the fence values requests report, and the bytes and latency counted once
+// they complete. Prints nothing and returns 0 if everything holds.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+#include "transfer.h"
+
+#define STAGING_SIZE    (64u << 10)
+#define CHUNK_SIZE      (8u << 10)
+
+static uint32_t s_failures;
+
+#define CHECK(x) \
+   do { \
+      if (!(x)) { \
+         fprintf(stderr, "%s(%d): %s\n", __FILE__, __LINE__, #x); \
+         ++s_failures; \
+      } \
+   } while (0)
+
+// The test plays the copy queue by setting value; blocking jumps straight to
+// the value waited for.
+class FakeFence : public TimelineFence {
+public:
+   uint64_t value;
+   uint32_t blocks;
+   uint64_t lastBlock;
+
+   FakeFence() : value(0), blocks(0), lastBlock(0) {}
+
+   uint64_t CompletedValue() override { return value; }
+
+   void Block(uint64_t target) override
+   {
+      CHECK(target > value);
+      ++blocks;
+      lastBlock = target;
+      value = target;
+   }
+};
+
+struct Batch {
+   uint64_t fenceValue;
+   uint64_t bytes;
+   uint32_t firstCopy;
+   uint32_t copyCount;
+};
+
+struct Recorder {
+   const uint8_t *staging;
+   std::vector<TransferCopy> copies;
+   std::vector<Batch> batches;
+};
+
+// Copies straight out of staging memory, so anything overwritten before its
+// batch retires would show up in the destination.
+static void submit(void *user, const TransferCopy *copies, uint32_t count, uint64_t fenceValue)
+{
+   Recorder *recorder = (Recorder *)user;
+   Batch batch = { fenceValue, 0, (uint32_t)recorder->copies.size(), count };
+   for (uint32_t i = 0; i < count; ++i) {
+      const TransferCopy *copy = &copies[i];
+      memcpy((uint8_t *)copy->dst + copy->dstOffset, recorder->staging + copy->stagingOffset, (size_t)copy->size);
+      recorder->copies.push_back(*copy);
+      batch.bytes += copy->size;
+   }
+   recorder->batches.push_back(batch);
+}
+
+static void countDone(void *user)
+{
+   ++*(uint32_t *)user;
+}
+
+static uint32_t lcg(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return *state >> 8;
+}
+
+static std::vector<uint8_t> randomBytes(size_t size, uint32_t seed)
+{
+   std::vector<uint8_t> bytes(size);
+   for (size_t i = 0; i < size; ++i) {
+      bytes[i] = (uint8_t)lcg(&seed);
+   }
+   return bytes;
+}
+
+struct Fixture {
+   FakeFence fence;
+   Timeline timeline;
+   std::vector<uint8_t> staging;
+   Recorder recorder;
+   TransferQueue queue;
+
+   Fixture(uint64_t completed)
+   {
+      fence.value = completed;
+      TimelineInit(&timeline, &fence);
+      staging.resize(STAGING_SIZE);
+      recorder.staging = staging.data();
+      TransferInit(&queue, &timeline, staging.data(), STAGING_SIZE, CHUNK_SIZE, submit, &recorder);
+   }
+};
+
+static uint64_t copiedBytes(const Recorder *recorder)
+{
+   uint64_t bytes = 0;
+   for (size_t i = 0; i < recorder->batches.size(); ++i) {
+      bytes += recorder->batches[i].bytes;
+   }
+   return bytes;
+}
+
+// A request bigger than a chunk goes over as chunkSize pieces and one for
+// the rest, in order, each at an aligned place in staging memory.
+static void testChunking()
+{
+   Fixture f(10);
+   std::vector<uint8_t> src = randomBytes(20000, 1);
+   std::vector<uint8_t> dst(100 + src.size());
+   uint32_t done = 0;
+
+   TransferId id = TransferEnqueue(&f.queue, dst.data(), 100, src.data(), src.size(), countDone, &done);
+   CHECK(id == 1);
+   CHECK(TransferFenceValue(&f.queue, id) == TRANSFER_PENDING);
+   CHECK(done == 0);
+
+   TransferPump(&f.queue, STAGING_SIZE);
+   CHECK(f.recorder.batches.size() == 1);
+   CHECK(f.recorder.batches[0].fenceValue == 11);
+   CHECK(f.recorder.copies.size() == 3);
+   if (f.recorder.copies.size() == 3) {
+      const uint64_t sizes[3] = { CHUNK_SIZE, CHUNK_SIZE, 20000 - 2 * CHUNK_SIZE };
+      uint64_t dstOffset = 100;
+      for (int i = 0; i < 3; ++i) {
+         const TransferCopy *copy = &f.recorder.copies[i];
+         CHECK(copy->dst == dst.data());
+         CHECK(copy->dstOffset == dstOffset);
+         CHECK(copy->size == sizes[i]);
+         CHECK(copy->stagingOffset % TRANSFER_ALIGNMENT == 0);
+         CHECK(copy->stagingOffset + copy->size <= STAGING_SIZE);
+         dstOffset += copy->size;
+      }
+   }
+   CHECK(memcmp(dst.data() + 100, src.data(), src.size()) == 0);
+   CHECK(done == 1);
+   CHECK(f.queue.stats.batches == 1);
+   CHECK(f.queue.stats.chunks == 3);
+
+   CHECK(TransferFenceValue(&f.queue, id) == 11);
+   f.fence.value = 11;
+   TransferPump(&f.queue, STAGING_SIZE);
+   CHECK(TransferFenceValue(&f.queue, id) == 0);
+   CHECK(f.recorder.batches.size() == 1);
+
+   TransferShutdown(&f.queue);
+   CHECK(f.fence.blocks == 0);
+}
+
+// However much is queued, a pump never stages more than its budget, and
+// requests complete with the batch holding their last chunk.
+static void testBudget()
+{
+   Fixture f(0);
+   const uint64_t sizes[5] = { 3000, 12000, 500, 9000, 7000 };
+   const uint64_t budget = 10000;
+   std::vector<uint8_t> src[5];
+   std::vector<uint8_t> dst(40000);
+   uint32_t done[5] = {};
+   TransferId ids[5];
+   uint64_t dstOffset = 0;
+   for (int i = 0; i < 5; ++i) {
+      src[i] = randomBytes((size_t)sizes[i], 2 + i);
+      ids[i] = TransferEnqueue(&f.queue, dst.data(), dstOffset, src[i].data(), sizes[i], countDone, &done[i]);
+      CHECK(ids[i] == (TransferId)i + 1);
+      dstOffset += sizes[i];
+   }
+
+   // The fence keeps up, so only the budget limits each pump.
+   for (uint32_t pump = 0; pump < 10 && !f.queue.requests.empty(); ++pump) {
+      size_t before = f.recorder.batches.size();
+      TransferPump(&f.queue, budget);
+      CHECK(f.recorder.batches.size() == before + 1);
+      if (f.recorder.batches.size() == before + 1) {
+         const Batch *batch = &f.recorder.batches.back();
+         CHECK(batch->fenceValue == pump + 1);
+         CHECK(batch->bytes <= budget);
+         CHECK(batch->bytes == budget || f.queue.requests.empty());
+         for (uint32_t i = 0; i < batch->copyCount; ++i) {
+            CHECK(f.recorder.copies[batch->firstCopy + i].size <= CHUNK_SIZE);
+         }
+      }
+      for (int i = 0; i < 5; ++i) {
+         uint64_t fenceValue = TransferFenceValue(&f.queue, ids[i]);
+         CHECK((fenceValue == TRANSFER_PENDING) == (done[i] == 0));
+         CHECK(fenceValue == TRANSFER_PENDING || fenceValue == 0 || fenceValue == pump + 1);
+      }
+      f.fence.value = pump + 1;
+   }
+   CHECK(f.recorder.batches.size() == (dstOffset + budget - 1) / budget);
+   CHECK(copiedBytes(&f.recorder) == dstOffset);
+   for (int i = 0; i < 5; ++i) {
+      CHECK(done[i] == 1);
+   }
+
+   dstOffset = 0;
+   for (int i = 0; i < 5; ++i) {
+      CHECK(memcmp(dst.data() + dstOffset, src[i].data(), src[i].size()) == 0);
+      dstOffset += sizes[i];
+   }
+
+   TransferShutdown(&f.queue);
+   CHECK(f.fence.blocks == 0);
+   CHECK(f.queue.stats.stalls == 0);
+   CHECK(f.queue.stats.flushes == 0);
+}
+
+// With the fence stuck, pumps fill staging memory and then stall without
+// submitting anything; a flush has to wait for the oldest batch, and nothing
+// staged is overwritten before its batch completes.
+static void testStagingFull()
+{
+   Fixture f(5);
+   std::vector<uint8_t> src = randomBytes(3 * STAGING_SIZE / 2, 9);
+   std::vector<uint8_t> dst(src.size());
+   const uint64_t half = STAGING_SIZE / 2;
+
+   TransferId first = TransferEnqueue(&f.queue, dst.data(), 0, src.data(), half, nullptr, nullptr);
+   TransferId second = TransferEnqueue(&f.queue, dst.data(), half, src.data() + half, half, nullptr, nullptr);
+   TransferId third = TransferEnqueue(&f.queue, dst.data(), 2 * half, src.data() + 2 * half, half, nullptr,
+      nullptr);
+
+   TransferPump(&f.queue, half);
+   TransferPump(&f.queue, half);
+   CHECK(f.recorder.batches.size() == 2);
+   CHECK(TransferFenceValue(&f.queue, first) == 6);
+   CHECK(TransferFenceValue(&f.queue, second) == 7);
+   CHECK(f.queue.stats.stalls == 0);
+
+   TransferPump(&f.queue, half);
+   CHECK(f.recorder.batches.size() == 2);
+   CHECK(f.queue.stats.stalls == 1);
+   CHECK(TransferFenceValue(&f.queue, third) == TRANSFER_PENDING);
+   CHECK(f.fence.blocks == 0);
+
+   uint64_t fenceValue = TransferFlush(&f.queue, third);
+   CHECK(fenceValue == 8);
+   CHECK(f.recorder.batches.size() == 3);
+   CHECK(f.fence.blocks == 1);
+   CHECK(f.fence.lastBlock == 6);
+   CHECK(f.queue.stats.flushes == 1);
+   CHECK(TransferFenceValue(&f.queue, first) == 0);
+   CHECK(TransferFenceValue(&f.queue, second) == 7);
+   CHECK(memcmp(dst.data(), src.data(), src.size()) == 0);
+
+   // Already submitted: nothing to flush, and nothing to count.
+   CHECK(TransferFlush(&f.queue, second) == 7);
+   CHECK(TransferFlush(&f.queue, first) == 0);
+   CHECK(f.queue.stats.flushes == 1);
+   CHECK(f.fence.blocks == 1);
+
+   TransferShutdown(&f.queue);
+   CHECK(f.fence.blocks == 2);
+   CHECK(f.fence.lastBlock == 8);
+   CHECK(f.queue.stats.requests == 3);
+}
+
+// Each batch in flight holds a retirement slot in the staging ring, so a pump
+// stalls once TRANSFER_MAX_BATCHES are out, however little memory they use.
+static void testBatchLimit()
+{
+   Fixture f(0);
+   std::vector<uint8_t> src = randomBytes(1024, 10);
+   std::vector<uint8_t> dst(src.size() * (TRANSFER_MAX_BATCHES + 1));
+   TransferId last = 0;
+   for (uint32_t i = 0; i <= TRANSFER_MAX_BATCHES; ++i) {
+      last = TransferEnqueue(&f.queue, dst.data(), i * src.size(), src.data(), src.size(), nullptr, nullptr);
+   }
+
+   for (uint32_t i = 0; i < TRANSFER_MAX_BATCHES; ++i) {
+      TransferPump(&f.queue, src.size());
+   }
+   CHECK(f.recorder.batches.size() == TRANSFER_MAX_BATCHES);
+   CHECK(f.queue.stats.stalls == 0);
+
+   TransferPump(&f.queue, src.size());
+   CHECK(f.recorder.batches.size() == TRANSFER_MAX_BATCHES);
+   CHECK(f.queue.stats.stalls == 1);
+   CHECK(TransferFenceValue(&f.queue, last) == TRANSFER_PENDING);
+
+   // Once the first batch completes, its slot is free again.
+   f.fence.value = 1;
+   TransferPump(&f.queue, src.size());
+   CHECK(f.recorder.batches.size() == TRANSFER_MAX_BATCHES + 1);
+   CHECK(TransferFenceValue(&f.queue, last) == TRANSFER_MAX_BATCHES + 1);
+   CHECK(TransferFenceValue(&f.queue, 1) == 0);
+
+   TransferShutdown(&f.queue);
+   CHECK(f.fence.blocks == 1);
+}
+
+// Requests are counted once they're seen complete, not when submitted, and
+// their latency runs from being queued to then.
+static void testStats()
+{
+   Fixture f(0);
+   std::vector<uint8_t> src = randomBytes(20000, 11);
+   std::vector<uint8_t> dst(src.size());
+
+   TransferEnqueue(&f.queue, dst.data(), 0, src.data(), 5000, nullptr, nullptr);
+   TransferEnqueue(&f.queue, dst.data(), 5000, src.data() + 5000, 15000, nullptr, nullptr);
+   TransferPump(&f.queue, STAGING_SIZE);
+   CHECK(f.queue.stats.batches == 1);
+   CHECK(f.queue.stats.chunks == 3);
+   CHECK(f.queue.stats.requests == 0);
+   CHECK(f.queue.stats.bytes == 0);
+   CHECK(f.queue.stats.latencySeconds == 0.0);
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(5));
+   f.fence.value = 1;
+   TransferPump(&f.queue, STAGING_SIZE);
+   CHECK(f.queue.stats.requests == 2);
+   CHECK(f.queue.stats.bytes == 20000);
+   CHECK(f.queue.stats.maxLatencySeconds >= 0.005);
+   CHECK(f.queue.stats.latencySeconds >= 2 * 0.005);
+   CHECK(f.queue.stats.latencySeconds <= 2 * f.queue.stats.maxLatencySeconds);
+   CHECK(TransferMeanLatency(&f.queue.stats) >= 0.005);
+   CHECK(f.queue.stats.busySeconds >= 0.005);
+   CHECK(TransferBytesPerSecond(&f.queue.stats) > 0.0);
+   CHECK(TransferBytesPerSecond(&f.queue.stats) <= 20000 / 0.005);
+
+   TransferShutdown(&f.queue);
+   CHECK(f.queue.stats.requests == 2);
+}
+
+int main()
+{
+   testChunking();
+   testBudget();
+   testStagingFull();
+   testBatchLimit();
+   testStats();
+   return s_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "common.h"
+#include "jobs.h"
+#include "transform.h"
+
+#define TRANSFORM_JOB_SIZE 4096 // matrices per job
+
+void TransformBatchToClip(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const TransformBatch *batch, uint32_t first, uint32_t count)
+{
+   ASSERT(first + count <= batch->count);
+   ASSERT(((uintptr_t)clipFromLocal & 15) == 0);
+
+   Vm4 c0 = vm4Load(&clipFromWorld->m[0]);
+   Vm4 c1 = vm4Load(&clipFromWorld->m[1]);
+   Vm4 c2 = vm4Load(&clipFromWorld->m[2]);
+   Vm4 c3 = vm4Load(&clipFromWorld->m[3]);
+
+   for (uint32_t i = first; i < first + count; ++i) {
+      float scale = batch->scale ? batch->scale[i] : 1.0f;
+      float sn = 0.0f, cs = scale;
+      if (batch->rotY) {
+         sn = sinf(batch->rotY[i]) * scale;
+         cs = cosf(batch->rotY[i]) * scale;
+      }
+
+      // worldFromLocal only has non-zero terms in the xz plane of the first and
+      // third columns, so the product collapses to a few multiply-adds.
+      Vm4 vcs = vm4Splat(cs);
+      Vm4 vsn = vm4Splat(sn);
+      Vm4 r0 = vm4Add(vm4Mul(c0, vcs), vm4Mul(c2, vsn));
+      Vm4 r1 = vm4Mul(c1, vm4Splat(scale));
+      Vm4 r2 = vm4Sub(vm4Mul(c2, vcs), vm4Mul(c0, vsn));
+      Vm4 r3 = c3;
+      if (batch->posX) {
+         r3 = vm4Add(r3, vm4Mul(c0, vm4Splat(batch->posX[i])));
+      }
+      if (batch->posY) {
+         r3 = vm4Add(r3, vm4Mul(c1, vm4Splat(batch->posY[i])));
+      }
+      if (batch->posZ) {
+         r3 = vm4Add(r3, vm4Mul(c2, vm4Splat(batch->posZ[i])));
+      }
+
+      Mat4 *out = &clipFromLocal[i - first];
+      vm4Stream(&out->m[0], r0);
+      vm4Stream(&out->m[1], r1);
+      vm4Stream(&out->m[2], r2);
+      vm4Stream(&out->m[3], r3);
+   }
+
+   vm4StreamFence();
+}
+
+void TransformMatricesToClip(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const Mat4 *worldFromLocal, uint32_t count)
+{
+   ASSERT(((uintptr_t)clipFromLocal & 15) == 0);
+
+   for (uint32_t i = 0; i < count; ++i) {
+      const Mat4 *world = &worldFromLocal[i];
+      Mat4 *out = &clipFromLocal[i];
+      vm4Stream(&out->m[0], mat4MulVm4(clipFromWorld, vm4Load(&world->m[0])));
+      vm4Stream(&out->m[1], mat4MulVm4(clipFromWorld, vm4Load(&world->m[1])));
+      vm4Stream(&out->m[2], mat4MulVm4(clipFromWorld, vm4Load(&world->m[2])));
+      vm4Stream(&out->m[3], mat4MulVm4(clipFromWorld, vm4Load(&world->m[3])));
+   }
+
+   vm4StreamFence();
+}
+
+void TransformIndexedToClip(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const Mat4 *worldFromLocal, const uint32_t *indices, uint32_t count)
+{
+   ASSERT(((uintptr_t)clipFromLocal & 15) == 0);
+
+   for (uint32_t i = 0; i < count; ++i) {
+      const Mat4 *world = &worldFromLocal[indices[i]];
+      Mat4 *out = &clipFromLocal[i];
+      vm4Stream(&out->m[0], mat4MulVm4(clipFromWorld, vm4Load(&world->m[0])));
+      vm4Stream(&out->m[1], mat4MulVm4(clipFromWorld, vm4Load(&world->m[1])));
+      vm4Stream(&out->m[2], mat4MulVm4(clipFromWorld, vm4Load(&world->m[2])));
+      vm4Stream(&out->m[3], mat4MulVm4(clipFromWorld, vm4Load(&world->m[3])));
+   }
+
+   vm4StreamFence();
+}
+
+struct TransformJob {
+   Mat4 *clipFromLocal;
+   const Mat4 *clipFromWorld;
+   const TransformBatch *batch;
+};
+
+static void transformJob(void *data, uint32_t index)
+{
+   const TransformJob *job = (const TransformJob *)data;
+   uint32_t first = index * TRANSFORM_JOB_SIZE;
+   uint32_t count = job->batch->count - first < TRANSFORM_JOB_SIZE ? job->batch->count - first : TRANSFORM_JOB_SIZE;
+   TransformBatchToClip(job->clipFromLocal + first, job->clipFromWorld, job->batch, first, count);
+}
+
+void TransformBatchToClipParallel(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const TransformBatch *batch)
+{
+   uint32_t jobCount = (batch->count + TRANSFORM_JOB_SIZE - 1) / TRANSFORM_JOB_SIZE;
+   if (jobCount <= 1 || JobThreadCount() == 1) {
+      TransformBatchToClip(clipFromLocal, clipFromWorld, batch, 0, batch->count);
+      return;
+   }
+
+   // Jobs split the output at whole matrices, so if it starts on a cache line
+   // as uploads do, no two jobs write the same line. Output that's only
+   // 16-byte aligned has one line straddling each boundary between jobs.
+   TransformJob job = { clipFromLocal, clipFromWorld, batch };
+   JobParallelFor(transformJob, &job, jobCount);
+}
@@ -0,0 +1,62 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "vecmath.h"
+
+// Structure-of-arrays description of a batch of objects. Each object is
+// uniformly scaled, rotated about Y and then translated. Any of the arrays may
+// be null, in which case every object gets the identity for that component.
+struct TransformBatch {
+   const float *rotY;   // in radians
+   const float *posX;
+   const float *posY;
+   const float *posZ;
+   const float *scale;
+   uint32_t count;
+};
+
+// clipFromLocal[i] = clipFromWorld * worldFromLocal(batch, first + i) for
+// i in [0, count). The output is written with streaming stores and is meant
+// to point straight into a mapped upload buffer; it must be 16-byte aligned.
+void TransformBatchToClip(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const TransformBatch *batch, uint32_t first, uint32_t count);
+
+// Same as above, but for objects that already have a world matrix.
+void TransformMatricesToClip(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const Mat4 *worldFromLocal, uint32_t count);
+
+// Same again, for the objects worldFromLocal[indices[i]].
+void TransformIndexedToClip(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const Mat4 *worldFromLocal, const uint32_t *indices, uint32_t count);
+
+// Whole-batch version of TransformBatchToClip. Large batches are split into
+// jobs and spread across the job system's threads, the calling one included.
+// Jobs only keep to cache lines of their own if the output is 64-byte aligned.
+void TransformBatchToClipParallel(Mat4 *clipFromLocal, const Mat4 *clipFromWorld,
+   const TransformBatch *batch);
@@ -0,0 +1,165 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+// Times TransformBatchToClipParallel (transform.h) for batches of 1K, 100K
+// and 1M objects:
+//
+//    transformbench [--workers N] [--max N] [--rounds N]
+//
+// Each batch is transformed on the calling thread alone, then spread across
+// the job system, into output aligned to a cache line as uploads are, and
+// again 16 bytes off, where neighbouring jobs share the line at each
+// boundary. The parallel results are checked against the single-threaded
+// ones.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "common.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "transform.h"
+
+#define PI  3.14159265f
+
+static const uint32_t s_counts[] = { 1000, 100000, 1000000 };
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "usage: %s [--workers N] [--max N] [--rounds N]\n", program);
+}
+
+// Small, fast and the same everywhere, unlike rand().
+static float random01(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static double millisecondsSince(int64_t start)
+{
+   return (ProfilerNow() - start) * 1e-6;
+}
+
+// Million matrices per second for count matrices, rounds times in ms.
+static double rate(uint32_t count, uint32_t rounds, double ms)
+{
+   return (double)count * rounds / ms * 1e-3;
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t workers = 0, maxCount = 1000000, rounds = 0;
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc) {
+         usage(argv[0]);
+         return 2;
+      }
+      uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+      if (strcmp(argv[i], "--workers") == 0) {
+         workers = value;
+      } else if (strcmp(argv[i], "--max") == 0) {
+         maxCount = value;
+      } else if (strcmp(argv[i], "--rounds") == 0 && value > 0) {
+         rounds = value;
+      } else {
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   Mat4 clipFromWorld;
+   Vec3 eye = { 0.0f, 20.0f, -60.0f }, target = { 0.0f, 0.0f, 0.0f }, up = { 0.0f, 1.0f, 0.0f };
+   Mat4 proj, view;
+   mat4PerspectiveFov(&proj, PI / 4.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+   mat4LookAt(&view, eye, target, up);
+   mat4Mul(&clipFromWorld, &proj, &view);
+
+   JobSystemInit(workers);
+   printf("%u threads, million matrices per second; speedup over one thread in brackets\n", JobThreadCount());
+   printf("%10s %10s %20s %20s\n", "objects", "1 thread", "aligned", "16 bytes off");
+
+   uint32_t seed = 1;
+   for (uint32_t c = 0; c < ARRAY_COUNT(s_counts) && s_counts[c] <= maxCount; ++c) {
+      uint32_t count = s_counts[c];
+      std::vector<float> rotY(count), posX(count), posY(count), posZ(count), scale(count);
+      for (uint32_t i = 0; i < count; ++i) {
+         rotY[i] = random01(&seed) * 2.0f * PI;
+         posX[i] = (random01(&seed) - 0.5f) * 100.0f;
+         posY[i] = random01(&seed) * 10.0f;
+         posZ[i] = (random01(&seed) - 0.5f) * 100.0f;
+         scale[i] = 0.5f + random01(&seed);
+      }
+      TransformBatch batch = { rotY.data(), posX.data(), posY.data(), posZ.data(), scale.data(), count };
+
+      // Room to start the output on a cache line, or 16 bytes past one.
+      std::vector<uint8_t> memory(count * sizeof(Mat4) + 128), checkMemory(count * sizeof(Mat4) + 64);
+      uintptr_t base = ((uintptr_t)memory.data() + 63) & ~(uintptr_t)63;
+      Mat4 *aligned = (Mat4 *)base;
+      Mat4 *offset = (Mat4 *)(base + 16);
+      Mat4 *check = (Mat4 *)(((uintptr_t)checkMemory.data() + 63) & ~(uintptr_t)63);
+
+      // About 30M matrices a column unless told otherwise.
+      uint32_t n = rounds ? rounds : (30000000 / count < 1000 ? 30000000 / count : 1000);
+
+      int64_t start = ProfilerNow();
+      for (uint32_t round = 0; round < n; ++round) {
+         TransformBatchToClip(check, &clipFromWorld, &batch, 0, count);
+      }
+      double singleMs = millisecondsSince(start);
+
+      start = ProfilerNow();
+      for (uint32_t round = 0; round < n; ++round) {
+         TransformBatchToClipParallel(aligned, &clipFromWorld, &batch);
+      }
+      double alignedMs = millisecondsSince(start);
+      if (memcmp(aligned, check, count * sizeof(Mat4)) != 0) {
+         fprintf(stderr, "%u objects: parallel results don't match the single-threaded ones\n", count);
+         JobSystemShutdown();
+         return 1;
+      }
+
+      start = ProfilerNow();
+      for (uint32_t round = 0; round < n; ++round) {
+         TransformBatchToClipParallel(offset, &clipFromWorld, &batch);
+      }
+      double offsetMs = millisecondsSince(start);
+      if (memcmp(offset, check, count * sizeof(Mat4)) != 0) {
+         fprintf(stderr, "%u objects: parallel results don't match the single-threaded ones\n", count);
+         JobSystemShutdown();
+         return 1;
+      }
+
+      char alignedCell[32], offsetCell[32];
+      snprintf(alignedCell, sizeof(alignedCell), "%.1f (%.2fx)", rate(count, n, alignedMs), singleMs / alignedMs);
+      snprintf(offsetCell, sizeof(offsetCell), "%.1f (%.2fx)", rate(count, n, offsetMs), singleMs / offsetMs);
+      printf("%10u %10.1f %20s %20s\n", count, rate(count, n, singleMs), alignedCell, offsetCell);
+   }
+
+   JobSystemShutdown();
+   return 0;
+}
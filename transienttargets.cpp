@@ -0,0 +1,109 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "transienttargets.h"
+#include "deferred.h"
+#include "descriptors.h"
+
+// Typeless, so the resources can take the sRGB views the back buffers do and
+// still be copied to and from them.
+static D3D12_RESOURCE_DESC targetDesc(const RenderTargetDesc *desc)
+{
+   D3D12_RESOURCE_DESC resourceDesc = {};
+   resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+   resourceDesc.Width = desc->width;
+   resourceDesc.Height = desc->height;
+   resourceDesc.DepthOrArraySize = 1;
+   resourceDesc.MipLevels = 1;
+   resourceDesc.Format = DXGI_FORMAT_B8G8R8A8_TYPELESS;
+   resourceDesc.SampleDesc.Count = 1;
+   resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+   resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+   return resourceDesc;
+}
+
+void GetTransientTargetAllocation(Dx12Device *device, const RenderTargetDesc *desc, UINT64 *size, UINT64 *alignment)
+{
+   D3D12_RESOURCE_DESC resourceDesc = targetDesc(desc);
+   D3D12_RESOURCE_ALLOCATION_INFO info = device->device->GetResourceAllocationInfo(0, 1, &resourceDesc);
+   *size = info.SizeInBytes;
+   *alignment = info.Alignment;
+}
+
+bool SetTransientTargets(Dx12TransientTargets *targets, Dx12Device *device, const RenderTargetPlacement *placements,
+   uint32_t count, UINT64 heapSize)
+{
+   ASSERT(count <= RENDER_MAX_TARGETS);
+   DestroyTransientTargets(targets, device);
+   if (count == 0) {
+      return true;
+   }
+
+   // Render targets only, which heap tier 1 hardware needs kept apart from
+   // buffers and other textures anyway.
+   D3D12_HEAP_DESC heapDesc = {};
+   heapDesc.SizeInBytes = heapSize;
+   heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+   heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+   heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+   if (FAILED(device->device->CreateHeap(&heapDesc, IID_PPV_ARGS(&targets->heap)))) {
+      return false;
+   }
+
+   D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
+   rtvDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+   rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+   rtvDesc.Texture2D.MipSlice = 0;
+   rtvDesc.Texture2D.PlaneSlice = 0;
+
+   for (uint32_t i = 0; i < count; ++i) {
+      const RenderTargetPlacement *placement = &placements[i];
+      D3D12_RESOURCE_DESC resourceDesc = targetDesc(&placement->desc);
+      if (FAILED(device->device->CreatePlacedResource(targets->heap.Get(), placement->offset, &resourceDesc,
+            (D3D12_RESOURCE_STATES)placement->state, nullptr, IID_PPV_ARGS(&targets->targets[i])))) {
+         DestroyTransientTargets(targets, device);
+         return false;
+      }
+
+      // RTVs are read when a pass is recorded, so frames in flight don't
+      // care that the old targets' are overwritten.
+      targets->rtvs[i] = DescriptorCpuHandle(&device->rtvHeap, MAX_BACK_BUFFERS + i);
+      device->device->CreateRenderTargetView(targets->targets[i].Get(), &rtvDesc, targets->rtvs[i]);
+      targets->states[i] = StateTrackerAdd(&device->states, 1, placement->state, 0, targets->targets[i].Get());
+      targets->count = i + 1;
+   }
+   return true;
+}
+
+void DestroyTransientTargets(Dx12TransientTargets *targets, Dx12Device *device)
+{
+   for (uint32_t i = 0; i < targets->count; ++i) {
+      StateTrackerRemove(&device->states, targets->states[i]);
+      DeferRelease(device, targets->targets[i].Get());
+      targets->targets[i] = nullptr;
+   }
+   targets->count = 0;
+   DeferRelease(device, targets->heap.Get());
+   targets->heap = nullptr;
+}
@@ -0,0 +1,40 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "dx12demo.h"
+#include "render.h"
+
+// Render targets for passes whose output the frame only needs for a while;
+// see framegraph.h for how their placements are worked out. Their RTVs come
+// after the back buffers' in Dx12Device::rtvHeap.
+
+void GetTransientTargetAllocation(Dx12Device *device, const RenderTargetDesc *desc, UINT64 *size, UINT64 *alignment);
+
+// Replaces the targets and their heap. The old ones go to the deferred-release
+// queue, so frames in flight can keep using them. On failure there are none.
+bool SetTransientTargets(Dx12TransientTargets *targets, Dx12Device *device, const RenderTargetPlacement *placements,
+   uint32_t count, UINT64 heapSize);
+void DestroyTransientTargets(Dx12TransientTargets *targets, Dx12Device *device);
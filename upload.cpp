@@ -0,0 +1,123 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+
+#include "upload.h"
+
+bool CreateUploadBuffer(ID3D12Device *device, UINT64 size, ID3D12Resource **buffer, void **mapped)
+{
+   D3D12_HEAP_PROPERTIES heapProps = {};
+   heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+   heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+   heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+   D3D12_RESOURCE_DESC desc = {};
+   desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+   desc.Alignment = 0;
+   desc.Width = size;
+   desc.Height = 1;
+   desc.DepthOrArraySize = 1;
+   desc.MipLevels = 1;
+   desc.Format = DXGI_FORMAT_UNKNOWN;
+   desc.SampleDesc.Count = 1;
+   desc.SampleDesc.Quality = 0;
+   desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+   desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+   if (FAILED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &desc,
+      D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(buffer)))) {
+      return false;
+   }
+
+   // Upload heaps can stay mapped for their whole lifetime; the empty read
+   // range tells the driver we never read back through this pointer.
+   D3D12_RANGE readRange = { 0, 0 };
+   if (FAILED((*buffer)->Map(0, &readRange, mapped))) {
+      (*buffer)->Release();
+      *buffer = nullptr;
+      return false;
+   }
+
+   return true;
+}
+
+bool CreateUploadRing(Dx12UploadRing *upload, ID3D12Device *device, UINT64 size)
+{
+   ASSERT(upload && device);
+
+   ComPtr<ID3D12Resource> buffer;
+   void *mapped;
+   if (!CreateUploadBuffer(device, size, &buffer, &mapped)) {
+      return false;
+   }
+
+   RingInit(&upload->ring, size);
+   upload->cpuBase = (uint8_t *)mapped;
+   upload->gpuBase = buffer->GetGPUVirtualAddress();
+   upload->buffer = std::move(buffer);
+   upload->view = DESCRIPTOR_INVALID;
+   return true;
+}
+
+void DestroyUploadRing(Dx12UploadRing *upload)
+{
+#ifndef NDEBUG
+   if (upload->buffer) {
+      char msg[256];
+      sprintf_s(msg, "upload ring: %llu of %llu bytes high water, %llu per frame, %llu failed allocations\n",
+         upload->ring.highWater, upload->ring.size, upload->ring.frameHighWater, upload->ring.failedAllocs);
+      OutputDebugStringA(msg);
+   }
+#endif
+
+   upload->buffer = nullptr;
+   upload->cpuBase = nullptr;
+   upload->gpuBase = 0;
+}
+
+void UploadRingBeginFrame(Dx12UploadRing *upload, UINT64 completedValue)
+{
+   RingBeginFrame(&upload->ring, completedValue);
+}
+
+bool UploadRingAlloc(Dx12UploadRing *upload, UINT64 size, UINT64 alignment, Dx12UploadAlloc *alloc)
+{
+   uint64_t offset = RingAlloc(&upload->ring, size, alignment);
+   if (offset == RING_INVALID) {
+      return false;
+   }
+
+   alloc->cpu = upload->cpuBase + offset;
+   alloc->gpu = upload->gpuBase + offset;
+   alloc->resource = upload->buffer.Get();
+   alloc->offset = offset;
+   return true;
+}
+
+void UploadRingEndFrame(Dx12UploadRing *upload, UINT64 fenceValue)
+{
+   RingEndFrame(&upload->ring, fenceValue);
+}
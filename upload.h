@@ -0,0 +1,47 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "dx12demo.h"
+
+#define UPLOAD_ALIGNMENT   D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+
+struct Dx12UploadAlloc {
+   void *cpu;
+   D3D12_GPU_VIRTUAL_ADDRESS gpu;
+   ID3D12Resource *resource;  // for use as a CopyBufferRegion source
+   UINT64 offset;             // ...at this offset
+};
+
+bool CreateUploadBuffer(ID3D12Device *device, UINT64 size, ID3D12Resource **buffer, void **mapped);
+
+bool CreateUploadRing(Dx12UploadRing *upload, ID3D12Device *device, UINT64 size);
+void DestroyUploadRing(Dx12UploadRing *upload);
+
+// completedValue is the fence's current completed value; anything older is reclaimed.
+void UploadRingBeginFrame(Dx12UploadRing *upload, UINT64 completedValue);
+bool UploadRingAlloc(Dx12UploadRing *upload, UINT64 size, UINT64 alignment, Dx12UploadAlloc *alloc);
+void UploadRingEndFrame(Dx12UploadRing *upload, UINT64 fenceValue);
@@ -0,0 +1,361 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+// Kernel selection. Define VECMATH_KERNEL to one of the values below to force
+// a particular implementation, otherwise the widest one the compiler targets is
+// picked. All kernels do the multiplies and adds in the same order as the
+// scalar code and never fuse them themselves, so results are bit-identical
+// across kernels as long as the compiler doesn't fuse them either. GCC and
+// Clang may once FMA is enabled (-mfma, -march=native), to the scalar code
+// and to separate multiply and add intrinsics alike, unless built with
+// -ffp-contract=off; MSVC only does with /fp:contract or /fp:fast.
+#define VECMATH_KERNEL_SCALAR 0
+#define VECMATH_KERNEL_SSE    1
+#define VECMATH_KERNEL_AVX    2
+#define VECMATH_KERNEL_NEON   3
+
+#ifndef VECMATH_KERNEL
+#  if defined(__AVX__)
+#    define VECMATH_KERNEL VECMATH_KERNEL_AVX
+#  elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define VECMATH_KERNEL VECMATH_KERNEL_SSE
+#  elif defined(__ARM_NEON) || defined(_M_ARM64) || defined(_M_ARM)
+#    define VECMATH_KERNEL VECMATH_KERNEL_NEON
+#  else
+#    define VECMATH_KERNEL VECMATH_KERNEL_SCALAR
+#  endif
+#endif
+
+#if VECMATH_KERNEL == VECMATH_KERNEL_AVX
+#  include <immintrin.h>
+#elif VECMATH_KERNEL == VECMATH_KERNEL_SSE
+#  include <xmmintrin.h>
+#elif VECMATH_KERNEL == VECMATH_KERNEL_NEON
+#  include <arm_neon.h>
+#endif
+
+typedef struct Vec3 {
+   float x, y, z;
+} Vec3;
+
+typedef struct alignas(16) Vec4 {
+   float x, y, z, w;
+} Vec4;
+
+// Column-major: m[i] is column i, so clipFromLocal * v is m[0]*v.x + ... + m[3]*v.w.
+typedef struct alignas(16) Mat4 {
+   Vec4 m[4];
+} Mat4;
+
+//
+// Four-wide register wrapper. Everything below that wants SIMD goes through
+// these so each kernel only has to supply this handful of operations.
+//
+
+#if VECMATH_KERNEL == VECMATH_KERNEL_SSE || VECMATH_KERNEL == VECMATH_KERNEL_AVX
+
+typedef __m128 Vm4;
+
+static inline Vm4 vm4Load(const Vec4 *p) { return _mm_load_ps(&p->x); }
+static inline void vm4Store(Vec4 *p, Vm4 v) { _mm_store_ps(&p->x, v); }
+static inline void vm4Stream(Vec4 *p, Vm4 v) { _mm_stream_ps(&p->x, v); }
+static inline Vm4 vm4Splat(float f) { return _mm_set1_ps(f); }
+static inline Vm4 vm4Add(Vm4 a, Vm4 b) { return _mm_add_ps(a, b); }
+static inline Vm4 vm4Sub(Vm4 a, Vm4 b) { return _mm_sub_ps(a, b); }
+static inline Vm4 vm4Mul(Vm4 a, Vm4 b) { return _mm_mul_ps(a, b); }
+static inline Vm4 vm4SplatX(Vm4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)); }
+static inline Vm4 vm4SplatY(Vm4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)); }
+static inline Vm4 vm4SplatZ(Vm4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)); }
+static inline Vm4 vm4SplatW(Vm4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+static inline void vm4StreamFence() { _mm_sfence(); }
+
+#elif VECMATH_KERNEL == VECMATH_KERNEL_NEON
+
+typedef float32x4_t Vm4;
+
+static inline Vm4 vm4Load(const Vec4 *p) { return vld1q_f32(&p->x); }
+static inline void vm4Store(Vec4 *p, Vm4 v) { vst1q_f32(&p->x, v); }
+static inline void vm4Stream(Vec4 *p, Vm4 v) { vst1q_f32(&p->x, v); }
+static inline Vm4 vm4Splat(float f) { return vdupq_n_f32(f); }
+static inline Vm4 vm4Add(Vm4 a, Vm4 b) { return vaddq_f32(a, b); }
+static inline Vm4 vm4Sub(Vm4 a, Vm4 b) { return vsubq_f32(a, b); }
+static inline Vm4 vm4Mul(Vm4 a, Vm4 b) { return vmulq_f32(a, b); }
+static inline Vm4 vm4SplatX(Vm4 v) { return vdupq_lane_f32(vget_low_f32(v), 0); }
+static inline Vm4 vm4SplatY(Vm4 v) { return vdupq_lane_f32(vget_low_f32(v), 1); }
+static inline Vm4 vm4SplatZ(Vm4 v) { return vdupq_lane_f32(vget_high_f32(v), 0); }
+static inline Vm4 vm4SplatW(Vm4 v) { return vdupq_lane_f32(vget_high_f32(v), 1); }
+static inline void vm4StreamFence() {}
+
+#else
+
+typedef Vec4 Vm4;
+
+static inline Vm4 vm4Load(const Vec4 *p) { return *p; }
+static inline void vm4Store(Vec4 *p, Vm4 v) { *p = v; }
+static inline void vm4Stream(Vec4 *p, Vm4 v) { *p = v; }
+static inline Vm4 vm4Splat(float f) { Vm4 r = { f, f, f, f }; return r; }
+static inline Vm4 vm4Add(Vm4 a, Vm4 b) { Vm4 r = { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; return r; }
+static inline Vm4 vm4Sub(Vm4 a, Vm4 b) { Vm4 r = { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; return r; }
+static inline Vm4 vm4Mul(Vm4 a, Vm4 b) { Vm4 r = { a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w }; return r; }
+static inline Vm4 vm4SplatX(Vm4 v) { return vm4Splat(v.x); }
+static inline Vm4 vm4SplatY(Vm4 v) { return vm4Splat(v.y); }
+static inline Vm4 vm4SplatZ(Vm4 v) { return vm4Splat(v.z); }
+static inline Vm4 vm4SplatW(Vm4 v) { return vm4Splat(v.w); }
+static inline void vm4StreamFence() {}
+
+#endif
+
+//
+// Vec3. Only used for camera setup, so these stay scalar.
+//
+
+static inline Vec3 vec3Add(Vec3 a, Vec3 b)
+{
+   Vec3 r;
+
+   r.x = a.x + b.x;
+   r.y = a.y + b.y;
+   r.z = a.z + b.z;
+
+   return r;
+}
+
+static inline Vec3 vec3Sub(Vec3 a, Vec3 b)
+{
+   Vec3 r;
+
+   r.x = a.x - b.x;
+   r.y = a.y - b.y;
+   r.z = a.z - b.z;
+
+   return r;
+}
+
+static inline Vec3 vec3Scale(Vec3 a, float b)
+{
+   Vec3 r;
+
+   r.x = a.x * b;
+   r.y = a.y * b;
+   r.z = a.z * b;
+
+   return r;
+}
+
+static inline float vec3Dot(Vec3 a, Vec3 b)
+{
+   return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline Vec3 vec3Normalize(Vec3 v)
+{
+   float lensq = vec3Dot(v, v);
+   return vec3Scale(v, 1.0f / sqrtf(lensq));
+}
+
+static inline Vec3 vec3Cross(Vec3 a, Vec3 b)
+{
+   Vec3 r;
+
+   r.x = a.y * b.z - a.z * b.y;
+   r.y = a.z * b.x - a.x * b.z;
+   r.z = a.x * b.y - a.y * b.x;
+
+   return r;
+}
+
+//
+// Mat4
+//
+
+// m * v, accumulated column by column.
+static inline Vm4 mat4MulVm4(const Mat4 *m, Vm4 v)
+{
+   Vm4 r = vm4Mul(vm4Load(&m->m[0]), vm4SplatX(v));
+   r = vm4Add(r, vm4Mul(vm4Load(&m->m[1]), vm4SplatY(v)));
+   r = vm4Add(r, vm4Mul(vm4Load(&m->m[2]), vm4SplatZ(v)));
+   r = vm4Add(r, vm4Mul(vm4Load(&m->m[3]), vm4SplatW(v)));
+   return r;
+}
+
+// A single vector comes from and goes back to memory, so the SSE kernel gains
+// nothing from doing it in a register: compilers vectorize the scalar code
+// into the same four multiplies and adds, and mathbench timed the intrinsics
+// no faster, at times slower. Batches go through mat4MulVm4 instead.
+static inline Vec4 mat4MulVec4(const Mat4 *m, Vec4 v)
+{
+#if VECMATH_KERNEL == VECMATH_KERNEL_SSE
+   Vec4 r;
+   r.x = m->m[0].x * v.x + m->m[1].x * v.y + m->m[2].x * v.z + m->m[3].x * v.w;
+   r.y = m->m[0].y * v.x + m->m[1].y * v.y + m->m[2].y * v.z + m->m[3].y * v.w;
+   r.z = m->m[0].z * v.x + m->m[1].z * v.y + m->m[2].z * v.z + m->m[3].z * v.w;
+   r.w = m->m[0].w * v.x + m->m[1].w * v.y + m->m[2].w * v.z + m->m[3].w * v.w;
+   return r;
+#else
+   Vec4 r;
+   vm4Store(&r, mat4MulVm4(m, vm4Load(&v)));
+   return r;
+#endif
+}
+
+// r = a * b. r may alias a or b.
+static inline void mat4Mul(Mat4 *r, const Mat4 *a, const Mat4 *b)
+{
+#if VECMATH_KERNEL == VECMATH_KERNEL_AVX
+   // Two columns of the result per iteration: a's columns are broadcast to both
+   // lanes and each lane picks its own column's coefficient out of b.
+   __m256 a0 = _mm256_broadcast_ps((const __m128 *)&a->m[0]);
+   __m256 a1 = _mm256_broadcast_ps((const __m128 *)&a->m[1]);
+   __m256 a2 = _mm256_broadcast_ps((const __m128 *)&a->m[2]);
+   __m256 a3 = _mm256_broadcast_ps((const __m128 *)&a->m[3]);
+   __m256 b01 = _mm256_loadu_ps(&b->m[0].x);
+   __m256 b23 = _mm256_loadu_ps(&b->m[2].x);
+
+   __m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+   r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_permute_ps(b01, 0x55)));
+   r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_permute_ps(b01, 0xaa)));
+   r01 = _mm256_add_ps(r01, _mm256_mul_ps(a3, _mm256_permute_ps(b01, 0xff)));
+
+   __m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+   r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_permute_ps(b23, 0x55)));
+   r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_permute_ps(b23, 0xaa)));
+   r23 = _mm256_add_ps(r23, _mm256_mul_ps(a3, _mm256_permute_ps(b23, 0xff)));
+
+   _mm256_storeu_ps(&r->m[0].x, r01);
+   _mm256_storeu_ps(&r->m[2].x, r23);
+#else
+   Vm4 c0 = mat4MulVm4(a, vm4Load(&b->m[0]));
+   Vm4 c1 = mat4MulVm4(a, vm4Load(&b->m[1]));
+   Vm4 c2 = mat4MulVm4(a, vm4Load(&b->m[2]));
+   Vm4 c3 = mat4MulVm4(a, vm4Load(&b->m[3]));
+
+   vm4Store(&r->m[0], c0);
+   vm4Store(&r->m[1], c1);
+   vm4Store(&r->m[2], c2);
+   vm4Store(&r->m[3], c3);
+#endif
+}
+
+static inline void mat4Identity(Mat4 *m)
+{
+   memset(m, 0, sizeof(*m));
+   m->m[0].x = 1.0f;
+   m->m[1].y = 1.0f;
+   m->m[2].z = 1.0f;
+   m->m[3].w = 1.0f;
+}
+
+static inline void mat4RotY(Mat4 *m, float angle)
+{
+   float c = cosf(angle);
+   float s = sinf(angle);
+
+   m->m[0].x = c;
+   m->m[0].y = 0.0f;
+   m->m[0].z = s;
+   m->m[0].w = 0.0f;
+
+   m->m[1].x = 0.0f;
+   m->m[1].y = 1.0f;
+   m->m[1].z = 0.0f;
+   m->m[1].w = 0.0f;
+
+   m->m[2].x = -s;
+   m->m[2].y = 0.0f;
+   m->m[2].z = c;
+   m->m[2].w = 0.0f;
+
+   m->m[3].x = 0.0f;
+   m->m[3].y = 0.0f;
+   m->m[3].z = 0.0f;
+   m->m[3].w = 1.0f;
+}
+
+static inline void mat4PerspectiveFov(Mat4 *r, float fovY, float aspect, float nearDist, float farDist)
+{
+   float y = tanf(fovY * 0.5f);
+   float x = aspect * y;
+   float c, d;
+
+   if (nearDist < farDist) {
+      c = nearDist / (nearDist - farDist);
+      d = -farDist * nearDist / (nearDist - farDist);
+   } else {
+      c = 0.0f;
+      d = nearDist;
+   }
+
+   r->m[0].x = 1.0f / x;
+   r->m[0].y = 0.0f;
+   r->m[0].z = 0.0f;
+   r->m[0].w = 0.0f;
+
+   r->m[1].x = 0.0f;
+   r->m[1].y = -1.0f / y;
+   r->m[1].z = 0.0f;
+   r->m[1].w = 0.0f;
+
+   r->m[2].x = 0.0f;
+   r->m[2].y = 0.0f;
+   r->m[2].z = c;
+   r->m[2].w = 1.0f;
+
+   r->m[3].x = 0.0f;
+   r->m[3].y = 0.0f;
+   r->m[3].z = d;
+   r->m[3].w = 0.0f;
+}
+
+static inline void mat4LookAt(Mat4 *r, Vec3 eye, Vec3 target, Vec3 up)
+{
+   Vec3 mf = vec3Normalize(vec3Sub(target, eye));
+   Vec3 mr = vec3Normalize(vec3Cross(up, mf));
+   Vec3 mu = vec3Cross(mr, mf);
+
+   r->m[0].x = mr.x;
+   r->m[0].y = mr.y;
+   r->m[0].z = mr.z;
+   r->m[0].w = 0.0f;
+
+   r->m[1].x = mu.x;
+   r->m[1].y = mu.y;
+   r->m[1].z = mu.z;
+   r->m[1].w = 0.0f;
+
+   r->m[2].x = mf.x;
+   r->m[2].y = mf.y;
+   r->m[2].z = mf.z;
+   r->m[2].w = 0.0f;
+
+   r->m[3].x = -eye.x * mr.x - eye.y * mu.x - eye.z * mf.x;
+   r->m[3].y = -eye.x * mr.y - eye.y * mu.y - eye.z * mf.y;
+   r->m[3].z = -eye.x * mr.z - eye.y * mu.z - eye.z * mf.z;
+   r->m[3].w = 1.0f;
+}
@@ -25,261 +25,304 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <shellapi.h>
+#include <stdio.h>
 
-#include "dx12demo.h"
-
-void DrawFrame(const Dx12Device *device, float dt);
-bool CreateResources(const Dx12Device *device);
-void DestroyResources(const Dx12Device *device);
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
-Dx12 s_dx12;
-Dx12Device s_device;
-
-static bool createDescriptorHeap(Dx12DescriptorHeap *heap, ID3D12Device *device,
-   D3D12_DESCRIPTOR_HEAP_TYPE type, UINT descriptorCount)
+#include "bench.h"
+#include "dx12demo.h"
+#include "frame.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "render.h"
+#include "sim.h"
+#include "spsc.h"
+
+#define TITLE_UPDATE_INTERVAL 0.5 // seconds
+#define SIM_TICK_RATE         60.0  // Hz
+#define SIM_MAX_STEPS         8     // per wakeup; more than that and the simulation drops time
+#define PACKET_QUEUE_SIZE     64
+#define TRACE_PATH            "dx12demo.trace.json"
+#define RESIZE_SETTLE_TIME    0.1   // seconds a drag has to pause for before the swap chain follows it
+#define BENCH_JSON_PATH       "dx12demo.bench.json"
+#define BENCH_CSV_PATH        "dx12demo.bench.csv"
+
+typedef std::chrono::steady_clock Clock;
+
+static RenderBackend *s_backend;
+
+// Shared by the window, simulation and render threads.
+static SpscQueue<FramePacket, PACKET_QUEUE_SIZE> s_packets;
+static std::atomic<bool> s_quit;
+static std::atomic<bool> s_resizePending;
+static std::atomic<bool> s_sizing;                  // inside the drag-resize modal loop
+static std::atomic<Clock::rep> s_lastSizeTime;      // of the last WM_SIZE, in Clock ticks
+static std::atomic<uint32_t> s_requestedFramesInFlight;
+static Clock::time_point s_startTime;
+
+// Set from the command line. In a benchmark run the render thread measures
+// every frame after the warm-up and closes the window once it has enough.
+static BenchConfig s_bench;
+static BenchRun s_benchRun;
+
+// Shows the instance count, frames in flight, average CPU time spent in
+// DrawFrame and how much of it was blocked on the GPU, the upload ring's
+// high-water mark and how much of the GPU heaps is in use.
+static void updateTitle(HWND hwnd, double cpuTime, uint32_t frameCount)
 {
-   ASSERT(heap);
-   ASSERT(device);
-
-   D3D12_DESCRIPTOR_HEAP_DESC heapDesc;
-   heapDesc.NumDescriptors = descriptorCount;
-   heapDesc.Type = type;
-   heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-   heapDesc.NodeMask = 0;
-   if (FAILED(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&heap->heap)))) {
-      return false;
-   }
-
-   heap->type = type;
-   heap->descriptorCount = descriptorCount;
-   heap->cpuStart = heap->heap->GetCPUDescriptorHandleForHeapStart();
-   heap->gpuStart = heap->heap->GetGPUDescriptorHandleForHeapStart();
-   heap->increment = device->GetDescriptorHandleIncrementSize(type);
-   return true;
+   static double lastBlockedSeconds;
+
+   RenderStats stats;
+   s_backend->GetStats(&stats);
+
+   wchar_t title[320];
+   swprintf_s(title, L"DX12 - %u cubes - %u frames in flight - %.3f ms CPU/frame (%.3f ms GPU wait) - upload peak %.1f/%.1f MB"
+      L" - heaps %.1f/%.1f MB, %.0f%% fragmented",
+      GetInstanceCount(), stats.framesInFlight, cpuTime * 1000.0 / frameCount,
+      (stats.gpuBlockedSeconds - lastBlockedSeconds) * 1000.0 / frameCount,
+      stats.uploadHighWater / 1048576.0, stats.uploadSize / 1048576.0,
+      stats.memory.used / 1048576.0, stats.memory.reserved / 1048576.0, HeapFragmentation(&stats.memory) * 100.0);
+   SetWindowText(hwnd, title);
+   lastBlockedSeconds = stats.gpuBlockedSeconds;
 }
 
-static bool createSwapChain(Dx12Device *device, HWND hwnd)
+static double secondsBetween(Clock::time_point from, Clock::time_point to)
 {
-   ASSERT(device && device->dx12 && device->device);
-   const Dx12 *dx12 = device->dx12;
-
-   RECT rect;
-   GetClientRect(hwnd, &rect);
-   device->surfaceWidth = rect.right - rect.left;
-   device->surfaceHeight = rect.bottom - rect.top;
-
-   DXGI_SWAP_CHAIN_DESC swapChainDesc = { 0 };
-   swapChainDesc.BufferCount = (UINT)ARRAY_COUNT(device->frames);
-   swapChainDesc.BufferDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
-   swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-   swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-   swapChainDesc.OutputWindow = hwnd;
-   swapChainDesc.SampleDesc.Count = 1;
-   swapChainDesc.Windowed = TRUE;
-
-   ComPtr<IDXGISwapChain> swapChain;
-   if (FAILED(dx12->factory->CreateSwapChain(device->commandQueue.Get(), &swapChainDesc, &swapChain))) {
-      return false;
-   }
-
-   if (FAILED(dx12->factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER))) {
-      return false;
-   }
-
-   if (!createDescriptorHeap(&device->rtvHeap, device->device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_RTV, swapChainDesc.BufferCount)) {
-      return false;
-   }
-
-   // create render target views
-   {
-      D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = device->rtvHeap.cpuStart;
-      D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
-      rtvDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
-      rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-      rtvDesc.Texture2D.MipSlice = 0;
-      rtvDesc.Texture2D.PlaneSlice = 0;
-
-      for (std::size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
-         if (FAILED(device->device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&device->frames[i].commandAllocator)))) {
-            return false;
-         }
-
-         if (FAILED(swapChain->GetBuffer((UINT)i, IID_PPV_ARGS(&device->frames[i].renderTarget)))) {
-            return false;
-         }
-
-         device->device->CreateRenderTargetView(device->frames[i].renderTarget.Get(), &rtvDesc, rtvHandle);
-         device->frames[i].rtv = rtvHandle;
-         rtvHandle.ptr += device->rtvHeap.increment;
-      }
-   }
-
-   if (!swapChain.As(&device->swapChain)) {
-      return false;
-   }
-
-   return CreateResources(device);
+   return std::chrono::duration<double>(to - from).count();
 }
 
-static void destroySwapChain(Dx12Device *device)
+// Steps the simulation at a fixed rate and publishes a packet per tick. Runs
+// ahead of the render thread; if the queue backs up, ticks are dropped rather
+// than blocking.
+static void simThreadMain()
 {
-   ASSERT(device && device->device);
+   ProfilerSetThreadName("simulation");
 
-   DestroyResources(device);
-   for (std::size_t i = 0; i < ARRAY_COUNT(device->frames); ++i) {
-      device->frames[i].commandAllocator = nullptr;
-      device->frames[i].renderTarget = nullptr;
-      device->frames[i].rtv.ptr = 0;
-   }
+   FixedTimestep timestep;
+   FixedTimestepInit(&timestep, 1.0 / SIM_TICK_RATE, SIM_MAX_STEPS);
 
-   device->rtvHeap.heap = nullptr;
-   device->swapChain = nullptr;
-}
+   SimState state;
+   SimInit(&state);
 
-static bool initD3d(Dx12 *dx12)
-{
-   UINT dxgiFactoryFlags = 0;
+   FramePacket packet;
+   SimPublish(&state, &packet);
+   s_packets.push(packet);
 
-#ifndef NDEBUG
-   ComPtr<ID3D12Debug> debugController;
-   if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController)))) {
-      debugController->EnableDebugLayer();
-      dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
-   }
-#endif
+   Clock::time_point lastTime = s_startTime;
+   while (!s_quit.load(std::memory_order_acquire)) {
+      Clock::time_point curTime = Clock::now();
+      uint32_t steps = FixedTimestepAdvance(&timestep, secondsBetween(lastTime, curTime));
+      lastTime = curTime;
 
-   ComPtr<IDXGIFactory4> factory;
-   if (FAILED(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)))) {
-      return false;
-   }
-
-   ComPtr<IDXGIAdapter1> adapter;
-   dx12->adapters.reserve(8);
-   dx12->adapterDescs.reserve(8);
-   while (SUCCEEDED(factory->EnumAdapters1((UINT)dx12->adapters.size(), &adapter))) {
-      dx12->adapterDescs.resize(dx12->adapterDescs.size() + 1);
-      adapter->GetDesc1(&dx12->adapterDescs.back());
-
-      dx12->adapters.emplace_back(std::move(adapter));
-   }
-
-   dx12->factory = std::move(factory);
-   return true;
-}
+      for (uint32_t i = 0; i < steps; ++i) {
+         PROFILE_ZONE("SimStep");
+         SimStep(&state, timestep.step);
+         SimPublish(&state, &packet);
+         s_packets.push(packet);
+      }
 
-static void uninitD3d(Dx12 *dx12)
-{
-   if (dx12) {
-      dx12->adapters.clear();
-      dx12->adapterDescs.clear();
-      dx12->factory = nullptr;
+      std::this_thread::sleep_for(std::chrono::duration<double>(timestep.step - timestep.accumulator));
    }
 }
 
-static bool createDevice(const Dx12 *dx12, Dx12Device *device)
+// Owns the swap chain and everything on the GPU: applies resize and frames in
+// flight requests from the window thread, then draws the newest simulation
+// state, interpolated one tick behind so there's always a packet either side.
+static void renderThreadMain(HWND hwnd)
 {
-   // look for a hardware adapter
-   std::size_t deviceIdx = dx12->adapterDescs.size();
-   for (std::size_t i = 0; i < deviceIdx; ++i) {
-      if ((dx12->adapterDescs[i].Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == 0) {
-         deviceIdx = i;
+   ProfilerSetThreadName("render");
+
+   FramePacket prev, cur;
+   bool havePacket = false;
+   double titleTime = 0.0, cpuTime = 0.0;
+   uint32_t titleFrames = 0;
+   Clock::time_point lastTime = Clock::now();
+   bool benchmarking = BenchEnabled(&s_bench);
+   bool firstFrame = true;
+
+   while (!s_quit.load(std::memory_order_acquire)) {
+      uint32_t framesInFlight = s_requestedFramesInFlight.exchange(0);
+      if (framesInFlight) {
+         s_backend->SetFramesInFlight(framesInFlight);
+      }
+      // While the user drags the window border, DXGI stretches the old
+      // buffers to fit and the resize waits until the size stops changing,
+      // so a drag costs one or two resizes instead of one per frame.
+      bool settled = !s_sizing.load() ||
+         secondsBetween(Clock::time_point(Clock::duration(s_lastSizeTime.load())), Clock::now()) >= RESIZE_SETTLE_TIME;
+      if (settled && s_resizePending.exchange(false)) {
+         RECT rect;
+         GetClientRect(hwnd, &rect);
+         s_backend->Resize(rect.right - rect.left, rect.bottom - rect.top);
       }
-   }
-
-   if (deviceIdx == dx12->adapters.size()) {
-      return false;
-   }
-
-   ComPtr<ID3D12Device> d3dDevice;
-   if (FAILED(D3D12CreateDevice(dx12->adapters[deviceIdx].Get(), D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&d3dDevice)))) {
-      return false;
-   }
 
-   D3D12_COMMAND_QUEUE_DESC queueDesc = {};
-   queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-   queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+      FramePacket next;
+      while (s_packets.pop(&next)) {
+         prev = havePacket ? cur : next;
+         cur = next;
+         havePacket = true;
+      }
 
-   ComPtr<ID3D12CommandQueue> commandQueue;
-   if (FAILED(d3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)))) {
-      return false;
-   }
+      if (!havePacket) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         continue;
+      }
 
-   ComPtr<ID3D12Fence> fence;
-   if (FAILED(d3dDevice->CreateFence(ARRAY_COUNT(device->frames) - 1, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)))) {
-      return false;
-   }
+      Clock::time_point curTime = Clock::now();
+      double renderTime = secondsBetween(s_startTime, curTime) - 1.0 / SIM_TICK_RATE;
+      FramePacket packet;
+      InterpolatePackets(&prev, &cur, InterpolationAlpha(&prev, &cur, renderTime), &packet);
 
-   device->fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-   device->commandQueue = std::move(commandQueue);
-   device->fence = std::move(fence);
-   device->device = std::move(d3dDevice);
-   device->deviceIdx = (uint32_t) deviceIdx;
-   device->dx12 = dx12;
-   return true;
-}
+      FrameStats frameStats;
+      if (!DrawFrame(s_backend, &packet, &frameStats)) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         continue;
+      }
 
-static void destroyDevice(Dx12Device *device)
-{
-   if (device) {
-      destroySwapChain(device);
-      CloseHandle(device->fenceEvent);
-      device->fenceEvent = NULL;
-      device->fence = nullptr;
-      device->commandQueue = nullptr;
-      device->device = nullptr;
+      // The first frame has no previous one to be measured from.
+      if (benchmarking && !firstFrame &&
+         !BenchRunAddFrame(&s_benchRun, secondsBetween(lastTime, curTime), &frameStats)) {
+         benchmarking = false;
+         PostMessage(hwnd, WM_CLOSE, 0, 0);
+      }
+      firstFrame = false;
+
+      Clock::time_point endTime = Clock::now();
+      cpuTime += secondsBetween(curTime, endTime);
+      titleTime += secondsBetween(lastTime, curTime);
+      lastTime = curTime;
+      ++titleFrames;
+      if (titleTime >= TITLE_UPDATE_INTERVAL) {
+         updateTitle(hwnd, cpuTime, titleFrames);
+         titleTime = 0.0;
+         cpuTime = 0.0;
+         titleFrames = 0;
+      }
    }
 }
 
+// Only pumps messages and forwards requests to the render thread, so nothing
+// here can hold up a frame.
 static LRESULT CALLBACK wndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
-   static LARGE_INTEGER s_lastTime, s_freq;
-
    switch (msg) {
-   case WM_CREATE:
-      QueryPerformanceFrequency(&s_freq);
-      QueryPerformanceCounter(&s_lastTime);
-      return 0;
    case WM_CLOSE:
       PostQuitMessage(0);
       return 0;
    case WM_PAINT:
    {
       PAINTSTRUCT ps;
-      LARGE_INTEGER curTime;
-
-      QueryPerformanceCounter(&curTime);
-      double dt = (curTime.QuadPart - s_lastTime.QuadPart) / (double)s_freq.QuadPart;
-      s_lastTime = curTime;
-
       BeginPaint(hwnd, &ps);
-      DrawFrame(&s_device, (float)dt);
       EndPaint(hwnd, &ps);
       return 0;
    }
-   case WM_SIZE:
-      if (wParam != SIZE_MINIMIZED) {
-         destroySwapChain(&s_device);
-         createSwapChain(&s_device, hwnd);
+   case WM_KEYDOWN:
+      switch (wParam) {
+      case VK_UP:
+      case VK_ADD:
+      case VK_OEM_PLUS:
+         SetInstanceCount(GetInstanceCount() * 2);
+         return 0;
+      case VK_DOWN:
+      case VK_SUBTRACT:
+      case VK_OEM_MINUS:
+         SetInstanceCount(GetInstanceCount() / 2);
+         return 0;
+      case 'P':
+         // Starts a capture, or ends the running one and writes it out.
+         if (ProfilerCapturing()) {
+            ProfilerEndCapture(TRACE_PATH);
+         } else {
+            ProfilerBeginCapture();
+         }
+         return 0;
+      case 'C':
+         // None, then CPU, then GPU.
+         SetCulling(GetCulling() == FRAME_CULL_NONE ? FRAME_CULL_CPU :
+            GetCulling() == FRAME_CULL_CPU ? FRAME_CULL_GPU : FRAME_CULL_NONE);
+         return 0;
+      case '1':
+      case '2':
+      case '3':
+      case '4':
+         s_requestedFramesInFlight.store((uint32_t)(wParam - '0'));
+         return 0;
       }
+      return DefWindowProc(hwnd, msg, wParam, lParam);
+   case WM_ENTERSIZEMOVE:
+      s_sizing.store(true);
+      return 0;
+   case WM_EXITSIZEMOVE:
+      s_sizing.store(false);
+      return 0;
+   case WM_SIZE:
+      s_lastSizeTime.store(Clock::now().time_since_epoch().count());
+      s_resizePending.store(true);
       return 0;
    default:
       return DefWindowProc(hwnd, msg, wParam, lParam);
    }
 }
 
-int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPWSTR /*lpCmdLine*/, int nShowCmd)
+// Fills in s_bench. lpCmdLine would do, but CommandLineToArgvW only splits
+// it properly with the program name in front, so this starts from scratch.
+static bool parseCommandLine()
 {
-   if (!initD3d(&s_dx12)) {
-      //FIXME: better error message.
-      MessageBox(NULL, L"Could not initialize Direct3D.", L"Error", MB_ICONERROR | MB_OK);
-      return -1;
+   BenchConfigInit(&s_bench);
+
+   int argc;
+   LPWSTR *wideArgv = CommandLineToArgvW(GetCommandLineW(), &argc);
+   if (!wideArgv) {
+      return false;
    }
-   if (!createDevice(&s_dx12, &s_device)) {
-      MessageBox(NULL, L"Could not find suitable Direct3D 12 device.", L"Error", MB_ICONERROR | MB_OK);
-      uninitD3d(&s_dx12);
-      return -1;
+
+   std::vector<std::string> argv(argc);
+   for (int i = 0; i < argc; ++i) {
+      int size = WideCharToMultiByte(CP_UTF8, 0, wideArgv[i], -1, NULL, 0, NULL, NULL);
+      if (size > 0) {
+         argv[i].resize(size);
+         WideCharToMultiByte(CP_UTF8, 0, wideArgv[i], -1, &argv[i][0], size, NULL, NULL);
+         argv[i].resize(size - 1);
+      }
+   }
+   LocalFree(wideArgv);
+
+   // Paths stay in argv, so it has to outlive the run.
+   static std::vector<std::string> s_args;
+   s_args.swap(argv);
+   for (int i = 1; i < argc; i += 2) {
+      if (i + 1 >= argc || ParseBenchOption(&s_bench, s_args[i].c_str(), s_args[i + 1].c_str()) <= 0) {
+         return false;
+      }
    }
 
+   if (BenchEnabled(&s_bench) && !s_bench.reportPath) {
+      s_bench.reportPath = s_bench.format == BENCH_FORMAT_CSV ? BENCH_CSV_PATH : BENCH_JSON_PATH;
+   }
+   return true;
+}
+
+int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPWSTR /*lpCmdLine*/, int nShowCmd)
+{
+   if (!parseCommandLine()) {
+      std::string usage = std::string("usage: dx12demo [options]\n") + BENCH_USAGE +
+         "\nWith --frames or --seconds, draws the warm-up and measured frames, writes the report and exits.";
+      MessageBoxA(NULL, usage.c_str(), "dx12demo", MB_ICONERROR | MB_OK);
+      return 2;
+   }
+
+   ProfilerSetThreadName("main");
+   JobSystemInit(0);
+   SetInstanceCount(s_bench.instances);
+   SetSpinningPercent(s_bench.spinningPercent);
+   SetCulling(s_bench.culling);
+   SetPostPasses(s_bench.postPasses);
+
    WNDCLASSEX wcex;
    wcex.cbSize = sizeof(wcex);
    wcex.style = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
@@ -296,31 +339,74 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPWSTR /*l
 
    ATOM atom = RegisterClassEx(&wcex);
    if (!atom) {
-      destroyDevice(&s_device);
-      uninitD3d(&s_dx12);
+      JobSystemShutdown();
       return -1;
    }
 
-   HWND hwnd = CreateWindowEx(0, MAKEINTATOM(atom), L"DX12", WS_OVERLAPPEDWINDOW,
-      CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, NULL, NULL, hInstance, NULL);
+   // Sized so the client area, and so the back buffers, match --size.
+   RECT windowRect = { 0, 0, (LONG)s_bench.width, (LONG)s_bench.height };
+   AdjustWindowRect(&windowRect, WS_OVERLAPPEDWINDOW, FALSE);
+   HWND hwnd = CreateWindowEx(0, MAKEINTATOM(atom), L"DX12", WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT,
+      windowRect.right - windowRect.left, windowRect.bottom - windowRect.top, NULL, NULL, hInstance, NULL);
    if (!hwnd) {
-      destroyDevice(&s_device);
-      uninitD3d(&s_dx12);
+      JobSystemShutdown();
+      return -1;
+   }
+
+   s_backend = CreateDx12Backend(hwnd, s_bench.bindless);
+   if (!s_backend) {
+      //FIXME: better error message.
+      MessageBox(NULL, L"Could not find suitable Direct3D 12 device.", L"Error", MB_ICONERROR | MB_OK);
+      DestroyWindow(hwnd);
+      JobSystemShutdown();
       return -1;
    }
 
+   s_backend->SetFramesInFlight(s_bench.framesInFlight);
+   s_backend->SetVsync(s_bench.vsync);
+   BenchRunInit(&s_benchRun, &s_bench);
+
    ShowWindow(hwnd, nShowCmd);
 
+   s_startTime = Clock::now();
+   std::thread simThread(simThreadMain);
+   std::thread renderThread(renderThreadMain, hwnd);
+
    MSG msg = { 0 };
-   while (msg.message != WM_QUIT) {
-      while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-         TranslateMessage(&msg);
-         DispatchMessage(&msg);
-      }
-      RedrawWindow(hwnd, NULL, NULL, RDW_INTERNALPAINT);
+   while (GetMessage(&msg, NULL, 0, 0) > 0) {
+      TranslateMessage(&msg);
+      DispatchMessage(&msg);
    }
 
-   destroyDevice(&s_device);
-   uninitD3d(&s_dx12);
-   return (int)msg.wParam;
-}
\ No newline at end of file
+   // DXGI and SetWindowText send messages to this thread from the render
+   // thread, so keep pumping until it has finished.
+   s_quit.store(true, std::memory_order_release);
+   HANDLE renderHandle = renderThread.native_handle();
+   while (MsgWaitForMultipleObjects(1, &renderHandle, FALSE, INFINITE, QS_ALLINPUT) == WAIT_OBJECT_0 + 1) {
+      MSG pending;
+      while (PeekMessage(&pending, NULL, 0, 0, PM_REMOVE)) {
+         DispatchMessage(&pending);
+      }
+   }
+   renderThread.join();
+   simThread.join();
+
+   delete s_backend;
+   s_backend = nullptr;
+   JobSystemShutdown();
+   if (ProfilerCapturing()) {
+      ProfilerEndCapture(TRACE_PATH);
+   }
+   ProfilerShutdown();
+
+   // A run cut short by closing the window still reports what it measured.
+   int result = (int)msg.wParam;
+   if (BenchEnabled(&s_bench)) {
+      BenchSummary summary;
+      BenchSummarize(&s_benchRun, &summary);
+      if (!WriteBenchReport(&s_bench, "d3d12", &summary)) {
+         result = 1;
+      }
+   }
+   return result;
+}